@@ -0,0 +1,25 @@
+/* Andre Byrne
+ * 100045589 */
+
+#include "vash.h"
+#include "bench/bench.h"
+
+int make_file(const char * path, long bytes) {
+
+  char block[1 << 16];
+  FILE * file = fopen(path, "w");
+  long index;
+
+  if (NULL == file) {
+    return 1;
+  }
+
+  for (index = 0; index < (long)sizeof(block); index++) {
+    block[index] = (char)('a' + index % 26);
+  }
+  for (index = 0; index < bytes; index += (long)sizeof(block)) {
+    (void)fwrite(block, sizeof(block), 1, file);
+  }
+
+  return (0 == fclose(file))? 0 : 1;
+}
@@ -0,0 +1,15 @@
+/* Andre Byrne
+ * 100045589 */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+/* what the benchmarks share, linked into each of them, @see makefile */
+
+/* writes a file of the given size, in blocks of the alphabet
+ * @param path the file to write, truncated if it is there
+ * @param bytes its size, rounded up to a whole block
+ * @return 0 on success, 1 otherwise */
+int make_file(const char * path, long bytes);
+
+#endif
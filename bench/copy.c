@@ -0,0 +1,86 @@
+/* Andre Byrne
+ * 100045589 */
+
+/* Benchmarks the in-shell copy of a pure redirection line against cat run
+ * as a process, @see isPureCopy in command.c:
+ *
+ *   make bench/copy && ./bench/copy [MEGABYTES]
+ *
+ * cat -u is cat all the same, but with an option it is never copied in
+ * the shell, so it is forked and exec'd as any other command would be.
+ * Each line is run over a file that is already in the page cache, to an
+ * output that does not exist yet, and the best time is kept: once over a
+ * large file for the rate, and many times over a small one for what the
+ * fork and exec cost on their own. */
+
+#include "vash.h"
+#include "bench/bench.h"
+
+#define COPY_RUNS 5
+#define SMALL_RUNS 200
+#define SMALL_BYTES (64L * 1024L)
+
+/* runs the line the given number of times, each to a new out, and returns
+ * the best time in microseconds */
+static long best_us(Vash * vash, const char * line, const char * out, int runs);
+
+int main(int argc, char ** argv) {
+
+  static const char * const formats[] = { "cat < %s > %s", "< %s > %s", "cat -u < %s > %s", NULL };
+
+  long megabytes = (1 < argc)? strtol(argv[1], NULL, 10) : 256;
+  const char * in = "/tmp/vash-bench-copy.in", * out = "/tmp/vash-bench-copy.out";
+  char line[MAX_INPUT_LENGTH];
+  Vash * vash;
+  long took;
+  int index;
+
+  if (0 >= megabytes || 0 != make_file(in, megabytes << 20)) {
+    fprintf(stderr, "usage: %s [MEGABYTES]\n", argv[0]);
+    return 2;
+  }
+
+  vash = init_vash();
+
+  printf("%ld MB, best of %d\n", megabytes, COPY_RUNS);
+  for (index = 0; NULL != formats[index]; index++) {
+    sprintf(line, formats[index], in, out);
+    took = best_us(vash, line, out, COPY_RUNS);
+    printf("%-60s %6.2f GB/s\n", line, (double)(megabytes << 20) / 1e3 / (double)((0 == took)? 1 : took));
+  }
+
+  (void)make_file(in, SMALL_BYTES);
+
+  printf("%ld KB, best of %d\n", SMALL_BYTES >> 10, SMALL_RUNS);
+  for (index = 0; NULL != formats[index]; index++) {
+    sprintf(line, formats[index], in, out);
+    printf("%-60s %6ld us\n", line, best_us(vash, line, out, SMALL_RUNS));
+  }
+
+  release_vash(vash);
+  (void)unlink(in);
+  (void)unlink(out);
+
+  return 0;
+}
+
+static long best_us(Vash * vash, const char * line, const char * out, int runs) {
+
+  long best = 0, started, took;
+  int run;
+
+  for (run = 0; run < runs; run++) {
+    /* truncating the last copy is not part of the next */
+    (void)unlink(out);
+
+    started = now_us();
+    (void)vash_eval(vash, line, NULL);
+    took = now_us() - started;
+
+    if (0 == run || took < best) {
+      best = took;
+    }
+  }
+
+  return best;
+}
@@ -0,0 +1,64 @@
+/* Andre Byrne
+ * 100045589 */
+
+/* Benchmarks a loop compiled once and run by the Program VM against the
+ * same work unrolled into a line per iteration, each read, split and
+ * decoded again, @see program.h:
+ *
+ *   make bench/loop && ./bench/loop [ITERATIONS]
+ *
+ * The body is an assignment, which runs in the shell, so that what is
+ * timed is the shell and not fork and exec. A second, shorter run has
+ * the body fork true, to show what the VM saves on a real command. */
+
+#include "vash.h"
+
+#define FORKED_ITERATIONS 1000
+
+/* runs ITERATIONS of the body as one compiled loop, and then as one line
+ * per iteration, and prints both */
+static void compare(Vash * vash, long iterations, const char * body);
+
+int main(int argc, char ** argv) {
+
+  long iterations = (1 < argc)? strtol(argv[1], NULL, 10) : 100000;
+  Vash * vash;
+
+  if (0 >= iterations) {
+    fprintf(stderr, "usage: %s [ITERATIONS]\n", argv[0]);
+    return 2;
+  }
+
+  vash = init_vash();
+
+  compare(vash, iterations, "x=$i");
+  compare(vash, (iterations < FORKED_ITERATIONS)? iterations : FORKED_ITERATIONS, "true $i");
+
+  release_vash(vash);
+
+  return 0;
+}
+
+static void compare(Vash * vash, long iterations, const char * body) {
+
+  char line[MAX_INPUT_LENGTH], value[3 * sizeof(long) + 2];
+  long started, compiled, unrolled, index;
+
+  sprintf(line, "for i in $(seq %ld); do %s; done", iterations, body);
+  started = now_us();
+  (void)vash_eval(vash, line, NULL);
+  compiled = now_us() - started;
+
+  printf("%-44s %9ld us %9.0f ns/iteration\n", line, compiled, 1e3 * (double)compiled / (double)iterations);
+
+  started = now_us();
+  for (index = 1; index <= iterations; index++) {
+    sprintf(value, "%ld", index);
+    vash->variables->set(vash->variables, "i", value);
+    (void)vash_eval(vash, body, NULL);
+  }
+  unrolled = now_us() - started;
+
+  sprintf(line, "%s, %ld lines", body, iterations);
+  printf("%-44s %9ld us %9.0f ns/iteration\n", line, unrolled, 1e3 * (double)unrolled / (double)iterations);
+}
@@ -0,0 +1,62 @@
+/* Andre Byrne
+ * 100045589 */
+
+/* Benchmarks a bulk three stage pipeline at several VASH_PIPE_SIZE values,
+ * @see pipe_size_of in command.c:
+ *
+ *   make bench/pipes && ./bench/pipes [MEGABYTES]
+ *
+ * Each stage is cat, so that what is timed is the pipes and the context
+ * switches between the stages rather than any work done in them. The
+ * input is in the page cache and the output is /dev/null, and the best
+ * of a few runs is kept. An empty VASH_PIPE_SIZE leaves the pipes as the
+ * kernel makes them. */
+
+#include "vash.h"
+#include "bench/bench.h"
+
+#define PIPE_RUNS 3
+
+int main(int argc, char ** argv) {
+
+  static const char * const sizes[] = { "", "4k", "16k", "64k", "256k", "1m", NULL };
+
+  long megabytes = (1 < argc)? strtol(argv[1], NULL, 10) : 256;
+  const char * in = "/tmp/vash-bench-pipes.in";
+  char line[MAX_INPUT_LENGTH];
+  Vash * vash;
+  long best, started, took;
+  int index, run;
+
+  if (0 >= megabytes || 0 != make_file(in, megabytes << 20)) {
+    fprintf(stderr, "usage: %s [MEGABYTES]\n", argv[0]);
+    return 2;
+  }
+
+  vash = init_vash();
+
+  printf("%ld MB through cat < in | cat | cat > /dev/null, best of %d\n", megabytes, PIPE_RUNS);
+  for (index = 0; NULL != sizes[index]; index++) {
+    sprintf(line, "VASH_PIPE_SIZE=%s", sizes[index]);
+    (void)vash_eval(vash, line, NULL);
+
+    sprintf(line, "cat < %s | cat | cat > /dev/null", in);
+    for (best = 0, run = 0; run < PIPE_RUNS; run++) {
+      started = now_us();
+      (void)vash_eval(vash, line, NULL);
+      took = now_us() - started;
+
+      if (0 == run || took < best) {
+        best = took;
+      }
+    }
+
+    printf("VASH_PIPE_SIZE=%-8s %6.2f GB/s\n", ('\0' == sizes[index][0])? "(kernel)" : sizes[index],
+        (double)(megabytes << 20) / 1e3 / (double)((0 == best)? 1 : best));
+  }
+
+  release_vash(vash);
+  (void)unlink(in);
+
+  return 0;
+}
@@ -0,0 +1,80 @@
+/* Andre Byrne
+ * 100045589 */
+
+/* Benchmarks reading a file that is not in the page cache, when the shell
+ * opens it for a < and asks the kernel to read it in ahead of the command,
+ * against the command opening it itself, @see open_read_ahead in
+ * command.c:
+ *
+ *   make bench/readahead && ./bench/readahead [MEGABYTES]
+ *
+ * Before every run the file is synced and dropped from the page cache with
+ * POSIX_FADV_DONTNEED, so each run reads it from the disk. The command is
+ * cat -u to /dev/null, which is never copied in the shell. A file system
+ * that keeps its files in memory, as tmpfs does, cannot drop them, and
+ * shows no difference. */
+
+#define _GNU_SOURCE /* fdatasync */
+
+#include "vash.h"
+#include "bench/bench.h"
+
+#define COLD_RUNS 3
+
+/* drops every page of the given file from the page cache */
+static void evict(const char * path);
+
+int main(int argc, char ** argv) {
+
+  static const char * const formats[] = { "cat -u < %s > /dev/null", "cat -u %s > /dev/null", NULL };
+
+  long megabytes = (1 < argc)? strtol(argv[1], NULL, 10) : 256;
+  const char * in = "/tmp/vash-bench-readahead.in";
+  char line[MAX_INPUT_LENGTH];
+  Vash * vash;
+  long best, started, took;
+  int index, run;
+
+  if (0 >= megabytes || 0 != make_file(in, megabytes << 20)) {
+    fprintf(stderr, "usage: %s [MEGABYTES]\n", argv[0]);
+    return 2;
+  }
+
+  vash = init_vash();
+
+  printf("%ld MB from the disk, best of %d\n", megabytes, COLD_RUNS);
+  for (index = 0; NULL != formats[index]; index++) {
+    sprintf(line, formats[index], in);
+
+    for (best = 0, run = 0; run < COLD_RUNS; run++) {
+      evict(in);
+
+      started = now_us();
+      (void)vash_eval(vash, line, NULL);
+      took = now_us() - started;
+
+      if (0 == run || took < best) {
+        best = took;
+      }
+    }
+
+    printf("%-60s %8ld us %6.2f GB/s\n", line, best,
+        (double)(megabytes << 20) / 1e3 / (double)((0 == best)? 1 : best));
+  }
+
+  release_vash(vash);
+  (void)unlink(in);
+
+  return 0;
+}
+
+static void evict(const char * path) {
+
+  int file = open(path, O_RDONLY);
+
+  if (-1 != file) {
+    (void)fdatasync(file);
+    (void)posix_fadvise(file, 0, 0, POSIX_FADV_DONTNEED);
+    (void)close(file);
+  }
+}
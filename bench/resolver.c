@@ -0,0 +1,249 @@
+/* Andre Byrne
+ * 100045589 */
+
+/* Benchmarks the shared command table of the Resolver against looking in
+ * every PATH directory, from 1 to 64 threads at once, @see resolver.h:
+ *
+ *   make bench/resolver && ./bench/resolver [MILLISECONDS]
+ *
+ * and with --stress, runs as many threads as it is given for as long as it
+ * is given, resolving, forgetting and expiring names while the PATH keeps
+ * changing under them, and checks every path that comes back:
+ *
+ *   make stress
+ *   ./bench/resolver --stress [THREADS] [MILLISECONDS]
+ *
+ * The PATH is two directories made for the run: the first half of the
+ * names are in both, so the first must win, and the rest only in the
+ * second. */
+
+#define _GNU_SOURCE /* mkdtemp */
+
+#include <pthread.h>
+
+#include "vash.h"
+
+#define NAMES 512
+#define MAX_THREADS 64
+
+/* struct Worker
+ * one thread, with a Resolver of its own on the table they all share: the
+ * copy has the same table, and a checked flag of its own, as each process
+ * forked from the shell would */
+typedef struct Worker {
+
+  pthread_t thread;
+  Resolver resolver;
+  BOOL walk; /* look in the directories, and not in the table */
+  BOOL stress; /* also forget and expire names as it goes */
+  unsigned int seed;
+  long resolves;
+  long wrong;
+
+} Worker;
+
+static char names[NAMES][16];
+static char * expected[NAMES];
+static char directories[2][32];
+static List * PATH;
+static int running;
+
+/* makes the directories and the executables in them */
+static void make_path(void);
+
+/* removes them again */
+static void remove_path(void);
+
+/* resolves names until running is cleared */
+static void * work(void * worker_);
+
+/* runs count workers on the given resolver for the given time
+ * @return the resolves per second of all of them together */
+static double run(Resolver * resolver, Worker * workers, int count, long milliseconds,
+    BOOL walk, BOOL stress);
+
+int main(int argc, char ** argv) {
+
+  BOOL stress = (BOOL)(1 < argc && 0 == strcmp(argv[1], "--stress"));
+  int first = (stress)? 2 : 1;
+  long threads = (first < argc && stress)? strtol(argv[first++], NULL, 10) : MAX_THREADS;
+  long milliseconds = (first < argc)? strtol(argv[first], NULL, 10) : (stress)? 2000 : 200;
+  Worker workers[MAX_THREADS];
+  Resolver * resolver;
+  long wrong = 0, resolves = 0;
+  int count, index;
+
+  if (0 >= threads || MAX_THREADS < threads || 0 >= milliseconds) {
+    fprintf(stderr, "usage: %s [MILLISECONDS]\n"
+        "       %s --stress [THREADS] [MILLISECONDS]\n", argv[0], argv[0]);
+    return 2;
+  }
+
+  make_path();
+  resolver = init_resolver(PATH);
+
+  if (stress) {
+    (void)run(resolver, workers, (int)threads, milliseconds, false, true);
+
+    for (index = 0; index < threads; index++) {
+      resolves += workers[index].resolves;
+      wrong += workers[index].wrong;
+    }
+    printf("%ld threads, %ld resolves, %ld wrong\n", threads, resolves, wrong);
+
+  } else {
+    printf("%-8s %16s %16s\n", "threads", "table/s", "PATH/s");
+    for (count = 1; count <= MAX_THREADS; count *= 2) {
+      double table = run(resolver, workers, count, milliseconds, false, false);
+      double walked = run(resolver, workers, count, milliseconds, true, false);
+
+      printf("%-8d %16.0f %16.0f\n", count, table, walked);
+    }
+  }
+
+  release_resolver(resolver);
+  remove_path();
+
+  return (0 == wrong)? 0 : 1;
+}
+
+static double run(Resolver * resolver, Worker * workers, int count, long milliseconds,
+    BOOL walk, BOOL stress) {
+
+  char churn[sizeof(directories[0]) + sizeof("/churn")];
+  long started, resolves = 0;
+  int index;
+
+  __atomic_store_n(&running, 1, __ATOMIC_RELEASE);
+  started = now_us();
+
+  for (index = 0; index < count; index++) {
+    workers[index].resolver = *resolver;
+    workers[index].walk = walk;
+    workers[index].stress = stress;
+    workers[index].seed = (unsigned int)index + 1;
+    workers[index].resolves = 0;
+    workers[index].wrong = 0;
+
+    if (0 != pthread_create(&workers[index].thread, NULL, work, &workers[index])) {
+      perror("pthread_create");
+      exit(1);
+    }
+  }
+
+  /* under stress the first directory keeps changing, which clears the
+   * table every time a worker next looks */
+  sprintf(churn, "%s/churn", directories[0]);
+  while (now_us() - started < milliseconds * 1000) {
+    if (stress) {
+      int fd = open(churn, O_CREAT | O_WRONLY, 0600);
+
+      if (-1 != fd) (void)close(fd);
+      (void)unlink(churn);
+    }
+    usleep(1000);
+  }
+
+  __atomic_store_n(&running, 0, __ATOMIC_RELEASE);
+
+  for (index = 0; index < count; index++) {
+    (void)pthread_join(workers[index].thread, NULL);
+    resolves += workers[index].resolves;
+  }
+
+  return 1e6 * (double)resolves / (double)(now_us() - started);
+}
+
+static void * work(void * worker_) {
+
+  Worker * worker = (Worker *)worker_;
+
+  while (__atomic_load_n(&running, __ATOMIC_ACQUIRE)) {
+    int name = (int)(rand_r(&worker->seed) % NAMES);
+    char * path = NULL;
+    const Node * node;
+
+    if (worker->walk) {
+      for (node = PATH->head; NULL != node && NULL == path; node = node->next) {
+        path = resolve_path(node->string, names[name]);
+      }
+    } else {
+      path = worker->resolver.resolve(&worker->resolver, names[name]);
+    }
+
+    if (NULL == path || 0 != strcmp(path, expected[name])) {
+      worker->wrong++;
+    }
+    free(path);
+    worker->resolves++;
+
+    /* each line of a shell expires the table once, and a command that
+     * failed to run is forgotten */
+    if (worker->stress && 0 == worker->resolves % 64) {
+      worker->resolver.expire(&worker->resolver);
+    }
+    if (worker->stress && 0 == worker->resolves % 97) {
+      worker->resolver.forget(&worker->resolver, names[rand_r(&worker->seed) % NAMES]);
+    }
+  }
+
+  return NULL;
+}
+
+static void make_path(void) {
+
+  int directory, name;
+
+  PATH = init_list();
+
+  for (directory = 0; directory < 2; directory++) {
+    strcpy(directories[directory], "/tmp/vash-resolver.XXXXXX");
+    if (NULL == mkdtemp(directories[directory])) {
+      perror("mkdtemp");
+      exit(1);
+    }
+    (void)PATH->append(PATH, directories[directory]);
+  }
+
+  for (name = 0; name < NAMES; name++) {
+    sprintf(names[name], "command%d", name);
+
+    for (directory = (name < NAMES / 2)? 0 : 1; directory < 2; directory++) {
+      char path[sizeof(directories[0]) + sizeof(names[0]) + 1];
+      int fd;
+
+      sprintf(path, "%s/%s", directories[directory], names[name]);
+      if (-1 == (fd = open(path, O_CREAT | O_WRONLY, 0700))) {
+        perror(path);
+        exit(1);
+      }
+      (void)close(fd);
+
+      if (NULL == expected[name]) {
+        expected[name] = string_with_size(strlen(path) + 1, "make_path");
+        strcpy(expected[name], path);
+      }
+    }
+  }
+}
+
+static void remove_path(void) {
+
+  int directory, name;
+
+  for (name = 0; name < NAMES; name++) {
+    for (directory = 0; directory < 2; directory++) {
+      char path[sizeof(directories[0]) + sizeof(names[0]) + 1];
+
+      sprintf(path, "%s/%s", directories[directory], names[name]);
+      (void)unlink(path);
+    }
+    free(expected[name]);
+  }
+
+  for (directory = 0; directory < 2; directory++) {
+    (void)rmdir(directories[directory]);
+  }
+
+  release_list(PATH);
+}
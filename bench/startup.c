@@ -0,0 +1,132 @@
+/* Andre Byrne
+ * 100045589 */
+
+/* Benchmarks what a new shell costs before it runs its first command, as
+ * lab02 -c does it: init_vash, then one line, @see vash_eval:
+ *
+ *   make bench/startup && ./bench/startup [RUNS]
+ *
+ * Each run is a new process, forked from this one before it has made any
+ * shell, so that nothing is warm but the page cache. It times the shell
+ * from init_vash to the end of its first line, and reads how much its RSS
+ * grew on the way, from /proc/self/status. The line is run once naming
+ * its executable, which never needs the PATH, once by name, and once as
+ * an assignment, which runs nothing at all. */
+
+#include "vash.h"
+
+/* runs the line in a new shell, in a child, and reads back what it took
+ * @param took set to the microseconds from init_vash to the end of the line
+ * @param grew set to the kilobytes the RSS grew by
+ * @return 0 on success, 1 otherwise */
+static int start_once(const char * line, long * took, long * grew);
+
+/* makes the shell and runs the line, in the child, then writes what it
+ * took and how much the RSS grew to the given pipe */
+static void start_child(const char * line, int out);
+
+/* the VmRSS of this process, in kilobytes, or 0 if it cannot be read */
+static long resident_kb(void);
+
+int main(int argc, char ** argv) {
+
+  static const char * const lines[] = { "/bin/true", "true", "x=1", NULL };
+
+  long runs = (1 < argc)? strtol(argv[1], NULL, 10) : 200;
+  long took, grew, best, total, most;
+  int index, run;
+
+  if (0 >= runs) {
+    fprintf(stderr, "usage: %s [RUNS]\n", argv[0]);
+    return 2;
+  }
+
+  printf("%ld new shells each, from init_vash to the end of the first line\n", runs);
+  for (index = 0; NULL != lines[index]; index++) {
+    for (best = 0, total = 0, most = 0, run = 0; run < runs; run++) {
+      if (0 != start_once(lines[index], &took, &grew)) {
+        return 1;
+      }
+
+      if (0 == run || took < best) best = took;
+      if (grew > most) most = grew;
+      total += took;
+    }
+
+    printf("%-12s best %6ld us, mean %6ld us, RSS +%ld KB\n", lines[index], best, total / runs, most);
+  }
+
+  return 0;
+}
+
+static int start_once(const char * line, long * took, long * grew) {
+
+  long results[2];
+  int ends[2], status;
+  pid_t pid;
+
+  if (-1 == pipe(ends)) {
+    perror("pipe");
+    return 1;
+  }
+
+  fflush(stdout);
+
+  switch ((pid = fork())) {
+    case -1 :
+      perror("fork");
+      return 1;
+    case 0 :
+      close(ends[0]);
+      start_child(line, ends[1]);
+      _exit(0);
+    default :
+      break;
+  }
+
+  close(ends[1]);
+  status = (sizeof(results) == read(ends[0], results, sizeof(results)))? 0 : 1;
+  close(ends[0]);
+  (void)waitpid(pid, NULL, 0);
+
+  *took = results[0];
+  *grew = results[1];
+
+  return status;
+}
+
+static void start_child(const char * line, int out) {
+
+  long results[2];
+  long before = resident_kb(), started = now_us();
+  Vash * vash = init_vash();
+
+  (void)vash_eval(vash, line, NULL);
+  results[0] = now_us() - started;
+  results[1] = resident_kb() - before;
+
+  if (sizeof(results) != write(out, results, sizeof(results))) {
+    perror("write");
+  }
+}
+
+static long resident_kb(void) {
+
+  char line[256];
+  long kb = 0;
+  FILE * file = fopen("/proc/self/status", "r");
+
+  if (NULL == file) {
+    return 0;
+  }
+
+  while (NULL != fgets(line, sizeof(line), file)) {
+    if (0 == strncmp(line, "VmRSS:", 6)) {
+      kb = strtol(&line[6], NULL, 10);
+    }
+  }
+
+  (void)fclose(file);
+
+  return kb;
+}
@@ -0,0 +1,502 @@
+/* Andre Byrne
+ * 100045589 */
+
+#define _GNU_SOURCE /* st_mtim, environ */
+
+#include <dirent.h>
+#include <utime.h>
+
+#include "cache.h"
+#include "context.h"
+#include "command.h"
+#include "relay.h"
+
+/* instance methods documented in cache.h */
+static int run(Cache * self_, Context * context, List * argv);
+
+/* struct Entry
+ * what eviction needs to know about an entry on disk */
+typedef struct Entry {
+
+  char name[32]; /* the hash that names the entry's files */
+  time_t used; /* when the entry was last stored or replayed */
+  off_t size; /* the bytes taken up by all of the entry's files */
+
+} Entry;
+
+/* Private instance scope methods */
+
+/* Builds the text that identifies a command: every input that could change
+ * what the command prints. Fields are length prefixed, so no argument can
+ * be mistaken for another.
+ * @alloc YES the caller becomes responsible for the return value
+ * @crash YES failed to malloc
+ * */
+static char * makeKey(const Context * context, const Command * command);
+
+/* replays the entry with the given name, onto the given stdout and stderr,
+ * if it exists and was made for exactly the given key.
+ * @return true on a hit, with its exit status set */
+static BOOL replay(Cache * self, const char * name, const char * key, const int * stdio, int * exit_status);
+
+/* runs the command with its stdout and stderr captured, stores both and
+ * the exit status under the given name, then replays them.
+ * @return the exit status of the command */
+static int store(Cache * self, const char * name, const char * key, Command * command);
+
+/* deletes least recently used entries until the store fits its capacity */
+static void evict(Cache * self);
+
+/* Private class scope methods */
+
+/* returns true if the command may be stored: commands that write to files
+ * or run in the background have effects beyond their output, and a file
+ * such as the /dev/fd/N of a <(...) is a pipe that is different every run */
+static BOOL isCacheable(const Command * command);
+
+/* returns the path of the named entry's file with the given extension
+ * @alloc YES the caller becomes responsible for the return value */
+static char * entry_path(const Cache * self, const char * name, const char * extension);
+
+/* appends a length prefixed field to the key. @see makeKey */
+static char * append_field(char * key, size_t * capacity, const char * label, const char * value);
+
+/* appends the stat signature of the given file to the key. @see makeKey */
+static char * append_stat(char * key, size_t * capacity, const char * label, const char * path);
+
+/* orders entries from least to most recently used, for qsort */
+static int compare_entries(const void * left, const void * right);
+
+Cache * init_cache(const char * directory, long capacity) {
+
+  Cache * self = (Cache *) failSafeMalloc(sizeof(Cache), "init_cache");
+  const char * size = getenv("VASH_CACHE_SIZE");
+
+  if (NULL == directory) {
+    const char * base;
+
+    if (NULL != (base = getenv("VASH_CACHE_DIR"))) {
+      self->directory = string_with_size(strlen(base) + 1, "init_cache");
+      strcpy(self->directory, base);
+    } else if (NULL != (base = getenv("XDG_CACHE_HOME"))) {
+      self->directory = string_with_size(strlen(base) + strlen("/vash") + 1, "init_cache");
+      sprintf(self->directory, "%s/vash", base);
+    } else {
+      base = (NULL == getenv("HOME"))? "/tmp" : getenv("HOME");
+      self->directory = string_with_size(strlen(base) + strlen("/.cache/vash") + 1, "init_cache");
+      sprintf(self->directory, "%s/.cache/vash", base);
+    }
+
+  } else {
+    self->directory = string_with_size(strlen(directory) + 1, "init_cache");
+    strcpy(self->directory, directory);
+  }
+
+  self->capacity = (0 < capacity)? capacity : CACHE_CAPACITY;
+  if (NULL != size && 0 < atol(size)) {
+    self->capacity = atol(size);
+  }
+
+  self->run = run;
+
+  return self;
+}
+
+void release_cache(Cache * cache) {
+
+  if (NULL != cache) {
+    free(cache->directory);
+    free(cache);
+  }
+}
+
+static int run(Cache * self_, Context * context, List * argv) {
+  Cache * const self = self_;
+
+  Command * command;
+  char * message, * key;
+  char name[32];
+  int exit_status = 1;
+  uint64_t hash = 14695981039346656037ULL; /* FNV-1a */
+  const unsigned char * byte;
+
+  if (argv->isEmpty(argv)) {
+    fprintf(stderr, "%s: cache: usage: cache command [args...]\n", SHELL_NAME);
+    return 1;
+  }
+
+  message = argv->pop(argv);
+  command = init_command(context, message);
+  free(message);
+
+  if (NULL == command) {
+    return 1;
+  }
+
+  command->setArgv(command, argv);
+
+  if (!isCacheable(command)) {
+    exit_status = command->execute(command);
+    release_command(command);
+    return exit_status;
+  }
+
+  key = makeKey(context, command);
+
+  for (byte = (const unsigned char *)key; '\0' != *byte; byte++) {
+    hash = (hash ^ *byte) * 1099511628211ULL;
+  }
+  sprintf(name, "%016" PRIx64, hash);
+
+  if (!replay(self, name, key, context->stdio, &exit_status)) {
+    exit_status = store(self, name, key, command);
+  }
+
+  free(key);
+  release_command(command);
+
+  return exit_status;
+}
+
+static BOOL isCacheable(const Command * command) {
+
+  int index;
+
+  if (command->background) {
+    return false;
+  }
+
+  for (index = 0; index < command->pipe_length; index++) {
+    const Stage * stage = command->stages[index];
+    Node * node;
+
+    if (!stage->out_files->isEmpty(stage->out_files)
+        || (NULL != stage->in_file && names_own_fd(command->cwd, stage->in_file))) {
+      return false;
+    }
+
+    for (node = stage->argv->head; NULL != node; node = node->next) {
+      if (names_own_fd(command->cwd, node->string)) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+static char * makeKey(const Context * context, const Command * command) {
+
+  extern char ** environ;
+
+  size_t capacity = 1024;
+  char * key = string_with_size(capacity, "makeKey");
+  char ** variable;
+  int index;
+
+  key = append_field(key, &capacity, "cwd", context->cwd);
+
+  for (index = 0; index < command->pipe_length; index++) {
+    const Stage * stage = command->stages[index];
+    Node * node;
+
+    key = append_field(key, &capacity, "exe", stage->executablePath);
+    key = append_stat(key, &capacity, "exe", stage->executablePath);
+
+    for (node = stage->argv->head; NULL != node; node = node->next) {
+      key = append_field(key, &capacity, "arg", node->string);
+    }
+
+    if (NULL != stage->in_file) {
+      char * path = absolute_path(context->cwd, stage->in_file);
+
+      key = append_field(key, &capacity, "in", stage->in_file);
+      key = append_stat(key, &capacity, "in", path);
+      free(path);
+    }
+
+    if (NULL != stage->here_document) {
+      key = append_field(key, &capacity, "here", stage->here_document);
+    }
+  }
+
+  for (variable = environ; NULL != variable && NULL != *variable; variable++) {
+    key = append_field(key, &capacity, "env", *variable);
+  }
+
+  return key;
+}
+
+static char * append_field(char * key, size_t * capacity, const char * label, const char * value) {
+
+  char prefix[64];
+
+  sprintf(prefix, "%s %lu ", label, (unsigned long)strlen(value));
+  key = string_append(key, capacity, prefix);
+  key = string_append(key, capacity, value);
+
+  return string_append(key, capacity, "\n");
+}
+
+static char * append_stat(char * key, size_t * capacity, const char * label, const char * path) {
+
+  struct stat status;
+  char signature[160];
+
+  if (-1 == stat(path, &status)) {
+    sprintf(signature, "%s-stat missing\n", label);
+  } else {
+    sprintf(signature, "%s-stat %lu %lu %ld %ld.%09ld\n", label,
+        (unsigned long)status.st_dev, (unsigned long)status.st_ino,
+        (long)status.st_size, (long)status.st_mtim.tv_sec, (long)status.st_mtim.tv_nsec);
+  }
+
+  return string_append(key, capacity, signature);
+}
+
+static char * entry_path(const Cache * self, const char * name, const char * extension) {
+
+  char * path = string_with_size(strlen(self->directory) + strlen(name) + strlen(extension) + 3, "entry_path");
+
+  sprintf(path, "%s/%s.%s", self->directory, name, extension);
+
+  return path;
+}
+
+static BOOL replay(Cache * self, const char * name, const char * key, const int * stdio, int * exit_status) {
+
+  char * key_path = entry_path(self, name, "key");
+  char * stored = NULL;
+  BOOL hit = false;
+  struct stat status;
+  int file = open(key_path, O_RDONLY);
+
+  /* the key file holds the exit status on its first line, then the key */
+  if (-1 != file && -1 != fstat(file, &status)) {
+    size_t length = (size_t)status.st_size;
+    ssize_t got;
+    char * newline;
+
+    stored = string_with_size(length + 1, "replay");
+    got = read(file, stored, length);
+
+    if (got == (ssize_t)length) {
+      stored[length] = '\0';
+      newline = strchr(stored, '\n');
+      hit = (BOOL)(NULL != newline && 0 == strcmp(&newline[1], key));
+    }
+  }
+
+  if (-1 != file) {
+    close(file);
+  }
+
+  if (hit) {
+    const char * extensions[2] = { "out", "err" };
+    const int descriptors[2] = { stdio[STDOUT_FILENO], stdio[STDERR_FILENO] };
+    int index;
+
+    *exit_status = atoi(stored);
+
+    for (index = 0; index < 2; index++) {
+      char * path = entry_path(self, name, extensions[index]);
+      int output = open(path, O_RDONLY);
+
+      if (-1 != output) {
+        (void)relay_copy(output, descriptors[index]);
+        close(output);
+      }
+
+      free(path);
+    }
+
+    /* the key file's mtime is the entry's place in the LRU order */
+    (void)utime(key_path, NULL);
+  }
+
+  free(stored);
+  free(key_path);
+
+  return hit;
+}
+
+static int store(Cache * self, const char * name, const char * key, Command * command) {
+
+  const char * extensions[3] = { "out", "err", "key" };
+  int * stdio = command->context->stdio;
+  char * final[3], * temporary[3];
+  int files[3], saved[2];
+  int index, exit_status;
+  char status_line[32];
+  BOOL stored = true;
+
+  if (0 != make_directories(self->directory)) {
+    fprintf(stderr, "%s: cache: %s: ", SHELL_NAME, self->directory);
+    perror("");
+    return command->execute(command);
+  }
+
+  /* entries are written under names private to this process, and only
+   * renamed into place, key last, once they are complete */
+  for (index = 0; index < 3; index++) {
+    char suffix[32];
+
+    sprintf(suffix, "%s.%d", extensions[index], (int)getpid());
+    final[index] = entry_path(self, name, extensions[index]);
+    temporary[index] = entry_path(self, name, suffix);
+    files[index] = open(temporary[index], O_RDWR | O_CREAT | O_TRUNC, S_IWUSR | S_IRUSR);
+    stored = (BOOL)(stored && -1 != files[index]);
+  }
+
+  if (!stored) {
+    for (index = 0; index < 3; index++) {
+      if (-1 != files[index]) {
+        close(files[index]);
+        unlink(temporary[index]);
+      }
+      free(final[index]);
+      free(temporary[index]);
+    }
+    return command->execute(command);
+  }
+
+  /* the command is given the capture files as its stdout and stderr */
+  fflush(stdout);
+  fflush(stderr);
+  for (index = 0; index < 2; index++) {
+    saved[index] = stdio[STDOUT_FILENO + index];
+    stdio[STDOUT_FILENO + index] = files[index];
+  }
+
+  exit_status = command->execute(command);
+
+  for (index = 0; index < 2; index++) {
+    stdio[STDOUT_FILENO + index] = saved[index];
+  }
+
+  sprintf(status_line, "%d\n", exit_status);
+  stored = (BOOL)(strlen(status_line) == (size_t)write(files[2], status_line, strlen(status_line))
+      && strlen(key) == (size_t)write(files[2], key, strlen(key)));
+
+  for (index = 0; index < 3; index++) {
+    if (index < 2) {
+      (void)lseek(files[index], 0, SEEK_SET);
+      (void)relay_copy(files[index], stdio[STDOUT_FILENO + index]);
+    }
+
+    close(files[index]);
+
+    if (!stored || -1 == rename(temporary[index], final[index])) {
+      unlink(temporary[index]);
+    }
+
+    free(final[index]);
+    free(temporary[index]);
+  }
+
+  evict(self);
+
+  return exit_status;
+}
+
+static void evict(Cache * self) {
+
+  DIR * directory = opendir(self->directory);
+  struct dirent * file;
+  Entry * entries = NULL;
+  int count = 0, capacity = 0, index, extension;
+  off_t total = 0;
+
+  if (NULL == directory) {
+    return;
+  }
+
+  while (NULL != (file = readdir(directory))) {
+    size_t length = strlen(file->d_name);
+    struct stat status;
+    char * path;
+
+    /* an entry is complete once its key file exists */
+    if (4 >= length || length >= sizeof entries->name
+        || 0 != strcmp(&file->d_name[length - 4], ".key")) {
+      continue;
+    }
+
+    if (count == capacity) {
+      capacity = (0 == capacity)? 64 : 2 * capacity;
+      entries = (Entry *) realloc(entries, sizeof(Entry) * capacity);
+      if (NULL == entries) {
+        alertAndCrash("evict", "failed to realloc");
+      }
+    }
+
+    strncpy(entries[count].name, file->d_name, length - 4);
+    entries[count].name[length - 4] = '\0';
+    entries[count].size = 0;
+    entries[count].used = 0;
+
+    for (extension = 0; extension < 3; extension++) {
+      const char * extensions[3] = { "key", "out", "err" };
+
+      path = entry_path(self, entries[count].name, extensions[extension]);
+      if (0 == stat(path, &status)) {
+        entries[count].size += status.st_size;
+        if (0 == extension) entries[count].used = status.st_mtime;
+      }
+      free(path);
+    }
+
+    total += entries[count].size;
+    count++;
+  }
+
+  closedir(directory);
+
+  if (total > (off_t)self->capacity) {
+    qsort(entries, (size_t)count, sizeof(Entry), compare_entries);
+
+    for (index = 0; index < count && total > (off_t)self->capacity; index++) {
+      for (extension = 0; extension < 3; extension++) {
+        const char * extensions[3] = { "key", "out", "err" };
+        char * path = entry_path(self, entries[index].name, extensions[extension]);
+
+        unlink(path);
+        free(path);
+      }
+
+      total -= entries[index].size;
+    }
+  }
+
+  free(entries);
+}
+
+static int compare_entries(const void * left, const void * right) {
+
+  time_t a = ((const Entry *)left)->used, b = ((const Entry *)right)->used;
+
+  return (a < b)? -1 : (a > b)? 1 : 0;
+}
+
+int make_directories(const char * directory) {
+
+  char * path = string_with_size(strlen(directory) + 1, "make_directories");
+  char * slash;
+  int exit_status = 0;
+
+  strcpy(path, directory);
+
+  for (slash = strchr(&path[1], '/'); NULL != slash; slash = strchr(&slash[1], '/')) {
+    *slash = '\0';
+    (void)mkdir(path, S_IRWXU); /* only the last one has to succeed */
+    *slash = '/';
+  }
+
+  if (-1 == mkdir(path, S_IRWXU) && EEXIST != errno) {
+    exit_status = 1;
+  }
+
+  free(path);
+
+  return exit_status;
+}
@@ -0,0 +1,68 @@
+/* Andre Byrne
+ * 100045589 */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "va_utils.h"
+#include "list.h"
+
+/* the most the cache will hold on disk, unless VASH_CACHE_SIZE says otherwise */
+#define CACHE_CAPACITY (64L * 1024L * 1024L)
+
+/* forward declaration: the cache runs commands in a context */
+struct Context;
+
+/* Class Cache
+ * brief: the Cache remembers what a command printed and how it exited, so
+ * that running the very same command again can replay the result instead
+ * of running anything. It is used through the cache builtin:
+ *
+ *   $$ cache find . -name *.c
+ *
+ * An entry is keyed by everything that could change the result: the
+ * resolved executable and its identity on disk (path, device, inode,
+ * size, mtime), every argument, the cwd of the context, the environment,
+ * and the stat signature of every < input file. Entries live in a
+ * directory on disk which is kept under a size cap by evicting the least
+ * recently used entries first.
+ * */
+typedef struct Cache {
+
+  char * directory; /* where the entries are stored */
+  long capacity; /* the most bytes the entries may take up */
+
+  /* Runs the command described by argv in the given context, unless an
+   * entry for exactly that command exists, in which case its output and
+   * exit status are replayed. Commands that write to files or run in the
+   * background are always run, and never stored.
+   * @param self_ the calling object
+   * @param context the context the command is run in
+   * @param argv (retained) the name of the command followed by its arguments
+   * @alloc NO all memory allocated by run is freed by run
+   * @return the exit status of the command, whether run or replayed
+   * */
+  int (*run)(struct Cache * self_, struct Context * context, List * argv);
+
+} Cache;
+
+/* Allocates a cache which stores its entries in the given directory. The
+ * directory is only created when the first entry is stored.
+ * @see release_cache
+ * @param directory (retained) where the entries are kept
+ * @param capacity the most bytes the entries may take up
+ * @alloc YES the caller becomes responsible for the return value
+ * @dtor YES Cache is a Class and instances must be freed with release_cache
+ * @crash YES failed to malloc
+ * */
+Cache * init_cache(const char * directory, long capacity);
+
+/* creates the given directory and any missing parents, as the cache
+ * directory is made the first time something is kept in it
+ * @return 0 on success */
+int make_directories(const char * directory);
+
+/* @dtor THIS is the destructor for Class Cache */
+void release_cache(/*@null@*/ /*@only@*/ Cache * cache);
+
+#endif
@@ -1,82 +1,240 @@
 /* Andre Byrne
  * 100045589 */
 
+#define _GNU_SOURCE /* memfd_create, F_ADD_SEALS, pipe2, F_SETPIPE_SZ, O_NOATIME */
+
+#include <limits.h>
+#include <sys/mman.h>
+
 #include "command.h"
+#include "relay.h"
 
 /* documented in command.h */
 static void setArgv(Command * self_, List * argv);
-static /*@null@*/ char ** const getArgv(Command * self_);
-static int getArgc(Command * self_);
-static int execute(Command * self_); 
+static /*@null@*/ char ** const getArgv(Command * self_, int stage);
+static int getArgc(Command * self_, int stage);
+static int execute(Command * self_);
+
+/* struct Relay
+ * a relay is run by a child of the shell for every stage whose output
+ * must go to more than one place. @see relay.h */
+typedef struct Relay {
+
+  int in_fd; /* the read end of the pipe the stage writes to */
+  int * outs; /* the descriptors that each receive a copy */
+  int count;
+
+  /* a relay that only meters a pipe has one output, and writes down what
+   * went through it here. NULL for any other relay */
+  /*@null@*/ RelayMeter * meter;
+
+} Relay;
+
+/* struct Plumbing
+ * all of the descriptors the shell opens to connect the stages of a
+ * pipeline to each other, to their relays, and to their output files.
+ * */
+typedef struct Plumbing {
+
+  int * in_fds; /* per stage: the descriptor to become stdin, or -1 */
+  int * out_fds; /* per stage: the descriptor to become stdout, or -1 */
+
+  /* per stage: its < file, opened by the shell and already being read
+   * ahead, or -1 if the stage has none or must open it itself */
+  int * in_files;
+
+  Relay * relays;
+  int relay_count;
+
+  int * fds; /* every descriptor opened by the shell for this pipeline */
+  int fd_count;
+
+  int pipe_size; /* the capacity every pipe is given, or 0 for the default */
+  int file_flags; /* added to the flags every file is opened with */
+
+} Plumbing;
 
 /* Private class scope method */
 
 /* ensures that, within the given context and PATH, the given message represents
- * an executable file. Finally, the absolute path to the executable file is 
+ * an executable file. Finally, the absolute path to the executable file is
  * returned if such a file exists.
- * @pre Context is initialized, List is initialized 
- * @post message is known to be an executable or not 
+ * @pre Context is initialized, List is initialized
+ * @post message is known to be an executable or not
  * @param context provides the cwd to check in
- * @param message the string of interest 
+ * @param message the string of interest
  * @param PATH a list of directories in which message may reside
- * @alloc YES the caller is responsible for the return value 
+ * @alloc YES the caller is responsible for the return value
  * @null YES if no executable file could be resolved
- * @return the absolute path of the given executable  
+ * @return the absolute path of the given executable
  * */
 static /*@null@*/ char * validateMessage(const Context * context, const char * message);
 
 /* interprets the status returned by execv and displays relevant message */
 int status_report(Command * command, int *status, pid_t pid);
 
-Command * init_command(const Context * context, const char * message, const List * PATH) {
+/* returns true if the command does nothing but move the bytes of named
+ * files to a single output: a bare redirection (< in > out) or the system
+ * cat, /bin/cat or /usr/bin/cat, with plain file arguments (cat a b > out).
+ * These are run in the shell itself.
+ * */
+static BOOL isPureCopy(const Command * command);
 
-  Command * self = (Command *) failSafeMalloc(sizeof(Command), "init_command");
+/* performs a pure copy in the shell, without forking. @see isPureCopy
+ * @return 0 if every input was copied, 1 otherwise (as cat would)
+ * */
+static int copyInShell(const Command * command);
 
-  char * executablePath = validateMessage(context, message);
+/* Puts the given text in an anonymous memory file, seals it against any
+ * further change and rewinds it, ready to be read as stdin. No file is
+ * created on disk, and no process is needed to feed the text in.
+ * @return the memory file, or -1 if it could not be made
+ * */
+static int open_here_document(const char * text);
+
+/* Allocates a new stage for the given executable.
+ * @param name the name the stage was invoked by
+ * @param executablePath (retained) the resolved executable, which may be NULL
+ * @param branch the branch of the pipeline the stage belongs to
+ * @alloc YES the caller is responsible for the return value
+ * @dtor YES stages must be freed with release_stage
+ * @crash YES failed to malloc
+ * */
+static Stage * init_stage(const char * name, /*@null@*/ const char * executablePath, int branch);
 
-  if (NULL != executablePath) {
+/* @dtor THIS is the destructor for struct Stage */
+static void release_stage(/*@null@*/ /*@only@*/ Stage * stage);
 
-    char * cwd = string_with_size(strlen(context->cwd) + 1, "init_command");
-    strcpy(cwd, context->cwd);
-    self->cwd = cwd;
+/* Opens every pipe, relay input and output file needed to connect the
+ * stages of the given command. Nothing is forked here.
+ * @param meters if not NULL, every pipe between two stages gets a relay
+ *               that meters it into the entry for the stage writing to it
+ * @alloc YES the caller must release the return value with release_plumbing
+ * @null YES if a pipe or output file could not be opened
+ * */
+static /*@null@*/ Plumbing * init_plumbing(const Command * command, /*@null@*/ RelayMeter * meters);
 
-    self->context = context; /* weak reference @see Command */
+/* writes what the meters of a pipeline saw to stderr, a stage to a line,
+ * @see run_pipestat
+ * @param meters one for each stage, for the pipe it writes to
+ * */
+static void report_meters(const Command * command, const RelayMeter * meters);
 
-    self->executablePath = string_with_size(strlen(executablePath) + 1, "init_command");
-    strcpy(self->executablePath, executablePath);
+/* returns the capacity that the pipes of a command run in the given
+ * context are given: $VASH_PIPE_SIZE, in bytes or with a k or m after it,
+ * or 0 to leave them as the kernel makes them */
+static int pipe_size_of(const Context * context);
+
+/* returns true if the named variable of the given context is set to
+ * anything but nothing or 0: how the VASH_NOATIME and VASH_DONTNEED
+ * options are turned on */
+static BOOL option_of(const Context * context, const char * name);
+
+/* returns the flags every file opened for a command run in the given
+ * context is opened with, beyond those it needs: O_NOATIME if
+ * $VASH_NOATIME is set */
+static int file_flags_of(const Context * context);
+
+/* opens the given file as open(2) would, except that O_NOATIME is dropped
+ * for a file the user does not own rather than failing */
+static int open_file(const char * path, int flags);
 
-    free(executablePath); 
+/* opens the < file of a stage, if it has one, and asks the kernel to read
+ * it in sequentially, starting now, while the stage is still to be forked
+ * @return the file, or -1 if the stage is left to open it itself */
+static int open_read_ahead(const Command * command, const Stage * stage, int flags);
 
-    self->argv = NULL;
-    self->in_file = NULL;
-    self->out_file = NULL;
+/* asks the kernel to drop the pages of every output file of the command
+ * from the page cache, once they have been written: for $VASH_DONTNEED.
+ * Dirty pages are not dropped, so each file is synced first */
+static void drop_outputs(const Command * command);
 
-    self->background = false;
-    self->pipe_output = false;
-    self->pipe_length = 1;
+/* returns the stage that reads from the given stage, when it writes to a
+ * single pipe: the next stage, or the first of the only branch */
+static int reader_of(const Command * command, int stage);
 
-    self->setArgv = setArgv;
-    self->getArgv = getArgv;
-    self->getArgc = getArgc;
-    self->execute = execute;
+/* closes every descriptor in the plumbing and frees it
+ * @dtor THIS is the destructor for struct Plumbing */
+static void release_plumbing(/*@null@*/ /*@only@*/ Plumbing * plumbing);
 
+/* closes every descriptor opened for the pipeline except those listed, in
+ * a child of the shell that has already moved the ones it needs */
+static void close_plumbing(const Plumbing * plumbing, const int * keep, int count);
+
+/* in a child of the shell, makes the given descriptors its stdin, stdout
+ * and stderr, where they are not already */
+static void take_stdio(const int * stdio);
+
+Command * init_command(const Context * context, const char * message) {
+
+  Command * self = NULL;
+
+  /* a bare redirection has no executable, @see isPureCopy */
+  BOOL bare = (BOOL)('\0' == message[0]);
+  char * executablePath = (bare)? NULL : validateMessage(context, message);
+
+  if (NULL != executablePath || bare) {
+    self = init_resolved_command(context, message, executablePath);
   } else {
-    free(self);
-    self = NULL;
     fprintf(stderr, "%s: %s\n", message, "command not found");
   }
 
+  free(executablePath);
+
   return self;
 }
 
+Command * init_resolved_command(const Context * context, const char * message, const char * executablePath) {
+
+  Command * self = (Command *) failSafeMalloc(sizeof(Command), "init_resolved_command");
+
+  char * cwd = string_with_size(strlen(context->cwd) + 1, "init_resolved_command");
+  strcpy(cwd, context->cwd);
+  self->cwd = cwd;
+
+  self->context = context; /* weak reference @see Command */
+
+  self->executablePath = NULL;
+  if (NULL != executablePath) {
+    self->executablePath = string_with_size(strlen(executablePath) + 1, "init_resolved_command");
+    strcpy(self->executablePath, executablePath);
+  }
+
+  /* the first stage is the command itself */
+  self->stages = (Stage **) failSafeMalloc(sizeof(Stage *), "init_resolved_command");
+  self->stages[0] = init_stage(message, self->executablePath, 0);
+  self->pipe_length = 1;
+  self->branches = 0;
+
+  self->background = false;
+  self->measured = false;
+  self->pid = 0;
+
+  self->setArgv = setArgv;
+  self->getArgv = getArgv;
+  self->getArgc = getArgc;
+  self->execute = execute;
+
+  return self;
+}
+
+char * resolve_command(const Context * context, const char * message) {
+
+  return validateMessage(context, message);
+}
+
 void release_command(Command * command) {
-  
+
   if (NULL != command) {
-    release_list(command->argv);
+    int index;
+
+    for (index = 0; index < command->pipe_length; index++) {
+      release_stage(command->stages[index]);
+    }
+
+    free(command->stages);
     free((char *)command->cwd);
-    free((char *)command->in_file);
-    free((char *)command->out_file);
-  
+
     if (NULL != command->executablePath) {
       free(command->executablePath);
     }
@@ -85,21 +243,59 @@ void release_command(Command * command) {
   }
 }
 
+static Stage * init_stage(const char * name, const char * executablePath, int branch) {
+
+  Stage * stage = (Stage *) failSafeMalloc(sizeof(Stage), "init_stage");
+
+  stage->name = string_with_size(strlen(name) + 1, "init_stage");
+  strcpy(stage->name, name);
+
+  stage->executablePath = NULL;
+  if (NULL != executablePath) {
+    stage->executablePath = string_with_size(strlen(executablePath) + 1, "init_stage");
+    strcpy(stage->executablePath, executablePath);
+  }
+
+  stage->argv = init_list();
+  stage->in_file = NULL;
+  stage->out_files = init_list();
+  stage->here_document = NULL;
+  stage->branch = branch;
+
+  return stage;
+}
+
+static void release_stage(Stage * stage) {
+
+  if (NULL != stage) {
+    release_list(stage->argv);
+    release_list(stage->out_files);
+    free(stage->in_file);
+    free(stage->here_document);
+    free(stage->executablePath);
+    free(stage->name);
+    free(stage);
+  }
+}
+
 char * validateMessage(const Context * context, const char * message) {
-  
-  const List * PATH = context->PATH;
+
+  Vash * vash = context->parent;
   char * executablePath = NULL;
 
-  /* check the current directory */
-  if (NULL != (executablePath = resolve_path(".", message))) {
+  /* check the context cwd: the shell's own cwd means nothing, @see Vash */
+  if (NULL != (executablePath = resolve_path(context->cwd, message))) {
 
-  /* check the context cwd */
-  } else if (NULL != (executablePath = resolve_path(context->cwd, message))) {
+  } else if (NULL == strchr(message, '/') && NULL == context->PATH) {
+    /* the resolver is made with the PATH of the Vash, so a context with a
+     * PATH of its own, as load gives back, looks in that instead */
+    (void)vash->getPath(vash);
+    executablePath = vash->resolver->resolve(vash->resolver, message);
 
   } else {
-    
+
     /* iterate over PATH */
-    Node * node = PATH->head;
+    Node * node = context->getPath(context)->head;
     while (NULL != node && NULL == executablePath) {
       executablePath = resolve_path(node->string, message);
       node = node->next;
@@ -113,108 +309,117 @@ void setArgv(Command * self_, List * argv) {
   Command * const self = self_;
 
   char * token, * executable_path; /* for pipes */
-  
-  self->argv = init_list();
-  
+  Stage * stage = self->stages[self->pipe_length - 1];
+
   /* pop each tokens from list and examine it */
   while(!argv->isEmpty(argv)) {
     token = argv->pop(argv);
 
-    if (1 == strlen(token)) { /* we may have a special characters */
-      switch (token[0]) {
-        case '<' :
-          if (!argv->isEmpty(argv)) {
-            free(token);
-            token = argv->pop(argv);
-            self->in_file = string_with_size(strlen(token) + 1, "setArgv");
-            strcpy(self->in_file, token);
-          }
-          break;
-        case '>' :
-          if (!argv->isEmpty(argv)) {
-            free(token);
-            token = argv->pop(argv);
-            self->out_file = string_with_size(strlen(token) + 1, "setArgv");
-            strcpy(self->out_file, token);
-          }
-          break;
-        case '&' :
-          self->background = true;
-          break;
-        case '|' :
-          /* pipes are all executed together in a loop */  
-          self->pipe_output = true;
-          (void)self->argv->append(self->argv, token); /* execute will need the | token */
-          if (!argv->isEmpty(argv)) {
-            free(token);
-            token = argv->pop(argv); /* this should be a valid path */
-            executable_path = validateMessage(self->context, token);
-            /* if validateMessage returns NULL then that's OK 
-             * execute will do the first part of the pipe and stop 
-             * when it encounters a bad command */
-            if (NULL == executable_path) {
-              (void)self->argv->append(self->argv, token);
-            } else {
-              self->pipe_length++;
-              (void)self->argv->append(self->argv, executable_path);
-            }
-            free(executable_path);
-          }
-          break;
-        case ';' : /* don't care about these */
-          break;
-        default : /* just some crap I don't know */
-          (void)self->argv->append(self->argv, token);
-          break;
+    if (is_operator(token, "<")) {
+      if (!argv->isEmpty(argv)) {
+        free(token);
+        token = argv->pop(argv);
+        free(stage->in_file);
+        free(stage->here_document);
+        stage->here_document = NULL;
+        stage->in_file = string_with_size(strlen(token) + 1, "setArgv");
+        strcpy(stage->in_file, token);
       }
-    /* its an argument so just append it */
+
+    } else if (is_operator(token, "<<") || is_operator(token, "<<<")) {
+      /* the body follows: a here-document as is, a here-string plus \n */
+      if (!argv->isEmpty(argv)) {
+        BOOL string = is_operator(token, "<<<");
+
+        free(token);
+        token = argv->pop(argv);
+        free(stage->in_file);
+        free(stage->here_document);
+        stage->in_file = NULL;
+        stage->here_document = string_with_size(strlen(token) + 2, "setArgv");
+        strcpy(stage->here_document, token);
+        if (string) {
+          strcat(stage->here_document, "\n");
+        }
+      }
+
+    } else if (is_operator(token, ">")) {
+      /* a stage may send its output to any number of files */
+      if (!argv->isEmpty(argv)) {
+        free(token);
+        token = argv->pop(argv);
+        (void)stage->out_files->append(stage->out_files, token);
+      }
+
+    } else if (is_operator(token, "&")) {
+      self->background = true;
+
+    } else if (is_operator(token, "|") || is_operator(token, "|>")) {
+      /* | continues the current branch, |> starts a new one */
+      int branch = (is_operator(token, "|>"))? ++self->branches : stage->branch;
+
+      if (!argv->isEmpty(argv)) {
+        free(token);
+        token = argv->pop(argv); /* this should be a valid path */
+        executable_path = validateMessage(self->context, token);
+      } else {
+        executable_path = NULL;
+      }
+
+      /* if validateMessage returns NULL then that's OK, execute will
+       * refuse to run a pipeline with an unresolved stage */
+      stage = init_stage(token, executable_path, branch);
+      free(executable_path);
+
+      self->stages = (Stage **) realloc(self->stages, sizeof(Stage *) * (self->pipe_length + 1));
+      if (NULL == self->stages) {
+        alertAndCrash("setArgv", "failed to realloc");
+      }
+      self->stages[self->pipe_length++] = stage;
+
+    } else if (is_operator(token, ";")) {
+      /* don't care about these */
+
     } else {
-      (void)self->argv->append(self->argv, token);
+      /* its an argument so just append it */
+      (void)stage->argv->append(stage->argv, token);
     }
 
     free(token);
   }
 }
 
-char ** const getArgv(Command * self_) {
+char ** const getArgv(Command * self_, int stage) {
   Command * const self = self_;
-  
-  char ** argv = NULL;
-
-  if (NULL != self->argv) {
-    int count = self->argv->count(self->argv);
-    int index = 1;
-    Node * node = self->argv->head;
-
-    /* alloc enough space for count + 1 char pointers + the NULL */ 
-    argv = (char**) failSafeMalloc((sizeof(char*)) * (count + 2), "getArgv");
-
-    /* for each char * starting at 1 allocate enough space for the right string */
-    while (NULL != node) {
-      if (0 == strcmp(node->string, "|")) {
-        /* replace the pipe with a NULL for exec to stop on */
-        argv[index] = NULL;
-      } else {
-        argv[index] = string_with_size(strlen(node->string) + 1, "getArgv"); 
-        strcpy(argv[index], node->string);
-      }
 
-      node = node->next;
-      index++;
-    }
+  const Stage * const link = self->stages[stage];
+  int count = link->argv->count(link->argv);
+  int index = 1;
+  Node * node = link->argv->head;
+
+  /* alloc enough space for the name, count char pointers and the NULL */
+  char ** argv = (char**) failSafeMalloc((sizeof(char*)) * (count + 2), "getArgv");
 
-    argv[0] = string_with_size(strlen(self->executablePath) + 1, "getArgv");
-    strcpy(argv[0], self->executablePath);
-    argv[count + 1] = NULL;
+  while (NULL != node) {
+    argv[index] = string_with_size(strlen(node->string) + 1, "getArgv");
+    strcpy(argv[index], node->string);
+
+    node = node->next;
+    index++;
   }
 
+  argv[0] = string_with_size(strlen(link->executablePath) + 1, "getArgv");
+  strcpy(argv[0], link->executablePath);
+  argv[count + 1] = NULL;
+
   return argv;
 }
 
-static int getArgc(Command * self_) {
+static int getArgc(Command * self_, int stage) {
   const Command * const self = self_;
+  const List * argv = self->stages[stage]->argv;
 
-  return self->argv->count(self->argv) + 1; /* +1 argv also contains the command name */
+  return argv->count(argv) + 1; /* +1 argv also contains the command name */
 }
 
 int redirect_to_file(char * file_name, int file_number, int options) {
@@ -222,13 +427,15 @@ int redirect_to_file(char * file_name, int file_number, int options) {
   int file_handle;
   int exit_status = 0;
 
-  /* actually a null file handle is no problem: it just means we didn't 
+  /* actually a null file handle is no problem: it just means we didn't
    * actually want to redirect */
   if (NULL == file_name) {
     return 0;
   }
 
-  file_handle = open(file_name, O_RDWR | options, S_IWUSR | S_IRUSR);
+  /* read only or write only: a pipe opened through /dev/fd for both would
+   * never see the end of its input */
+  file_handle = open_file(file_name, ((STDIN_FILENO == file_number)? O_RDONLY : O_WRONLY) | options);
 
   if (-1 != file_handle) {
     dup2(file_handle, file_number);
@@ -242,137 +449,837 @@ int redirect_to_file(char * file_name, int file_number, int options) {
   return exit_status;
 }
 
+/* returns true if the given stage is the last in its branch */
+static BOOL is_last_of_branch(const Command * command, int stage) {
+
+  return (BOOL)(stage + 1 == command->pipe_length
+      || command->stages[stage + 1]->branch != command->stages[stage]->branch);
+}
+
+/* opens a pipe and remembers both ends so they can be closed later. Both
+ * are closed on exec: a stage gets only the ends it moves onto its stdin
+ * and stdout, so the reader of every pipe sees end of file as soon as its
+ * writers finish */
+static int open_pipe(Plumbing * plumbing, int ends[2]) {
+
+  if (-1 == pipe2(ends, O_CLOEXEC)) {
+    perror(SHELL_NAME ": pipe");
+    return 1;
+  }
+
+  /* a kernel that will not make the pipe that big leaves it as it was */
+  if (0 < plumbing->pipe_size && -1 == fcntl(ends[1], F_SETPIPE_SZ, plumbing->pipe_size)) {
+    fprintf(stderr, "%s: VASH_PIPE_SIZE: %d: ", SHELL_NAME, plumbing->pipe_size);
+    perror("");
+    plumbing->pipe_size = 0;
+  }
+
+  plumbing->fds[plumbing->fd_count++] = ends[0];
+  plumbing->fds[plumbing->fd_count++] = ends[1];
+
+  return 0;
+}
+
+static int pipe_size_of(const Context * context) {
+
+  const char * value = context->variables->get(context->variables, "VASH_PIPE_SIZE");
+  char * end;
+  long size;
+
+  if (NULL == value || '\0' == value[0]) {
+    return 0;
+  }
+
+  /* no bigger than an int, even in megabytes, and a long holds it */
+  size = strtol(value, &end, 10);
+  if (INT_MAX < size) {
+    size = 0;
+  }
+
+  if ('k' == *end || 'K' == *end) {
+    size *= 1024;
+    end++;
+  } else if ('m' == *end || 'M' == *end) {
+    size *= 1024 * 1024;
+    end++;
+  }
+
+  if ('\0' != *end || 0 >= size || INT_MAX < size) {
+    fprintf(stderr, "%s: VASH_PIPE_SIZE: %s: not a size\n", SHELL_NAME, value);
+    return 0;
+  }
+
+  return (int)size;
+}
+
+static BOOL option_of(const Context * context, const char * name) {
+
+  const char * value = context->variables->get(context->variables, name);
+
+  return (BOOL)(NULL != value && '\0' != value[0] && 0 != strcmp(value, "0"));
+}
+
+static int file_flags_of(const Context * context) {
+
+  return (option_of(context, "VASH_NOATIME"))? O_NOATIME : 0;
+}
+
+static int open_file(const char * path, int flags) {
+
+  int file_handle = open(path, flags, S_IWUSR | S_IRUSR);
+
+  /* only the owner of a file may leave its access time alone */
+  if (-1 == file_handle && EPERM == errno && 0 != (flags & O_NOATIME)) {
+    file_handle = open(path, flags & ~O_NOATIME, S_IWUSR | S_IRUSR);
+  }
+
+  return file_handle;
+}
+
+static int open_read_ahead(const Command * command, const Stage * stage, int flags) {
+
+  struct stat status;
+  char * path;
+  int file;
+
+  if (NULL == stage->in_file) {
+    return -1;
+  }
+
+  /* a file that cannot be opened is the stage's to report, as it was, and
+   * so is a fifo: the shell must not wait for its writer */
+  path = absolute_path(command->cwd, stage->in_file);
+  file = open_file(path, O_RDONLY | O_CLOEXEC | O_NONBLOCK | flags);
+  free(path);
+
+  if (-1 != file && (-1 == fstat(file, &status) || !S_ISREG(status.st_mode))) {
+    close(file);
+    return -1;
+  }
+
+  if (-1 != file) {
+    (void)fcntl(file, F_SETFL, fcntl(file, F_GETFL) & ~O_NONBLOCK);
+    (void)posix_fadvise(file, 0, 0, POSIX_FADV_SEQUENTIAL);
+    (void)posix_fadvise(file, 0, READ_AHEAD_BYTES, POSIX_FADV_WILLNEED);
+  }
+
+  return file;
+}
+
+static void drop_outputs(const Command * command) {
+
+  int index;
+
+  for (index = 0; index < command->pipe_length; index++) {
+    const Node * node = command->stages[index]->out_files->head;
+
+    for (; NULL != node; node = node->next) {
+      char * path = absolute_path(command->cwd, node->string);
+      int file = open_file(path, O_RDONLY | O_CLOEXEC | O_NOATIME);
+
+      free(path);
+
+      /* DONTNEED passes over dirty pages, and a file the command has just
+       * written is nothing but: they must be on disk before they can go */
+      if (-1 != file) {
+        (void)fdatasync(file);
+        (void)posix_fadvise(file, 0, 0, POSIX_FADV_DONTNEED);
+        close(file);
+      }
+    }
+  }
+}
+
+static int reader_of(const Command * command, int stage) {
+
+  int reader = stage + 1;
+
+  if (0 == command->stages[stage]->branch && is_last_of_branch(command, stage)) {
+    while (0 == command->stages[reader]->branch) reader++;
+  }
+
+  return reader;
+}
+
+static Plumbing * init_plumbing(const Command * command, RelayMeter * meters) {
+
+  Plumbing * plumbing = (Plumbing *) failSafeMalloc(sizeof(Plumbing), "init_plumbing");
+  int length = command->pipe_length;
+  int index, capacity = 2 * command->branches;
+  int ends[2];
+  BOOL failed = false;
+
+  /* every stage needs at most a relay pipe, a pipe to the next stage, a
+   * here-document and its output files, and the source needs a pipe per
+   * branch */
+  for (index = 0; index < length; index++) {
+    capacity += 5 + command->stages[index]->out_files->count(command->stages[index]->out_files);
+  }
+
+  plumbing->in_fds = (int *) failSafeMalloc(sizeof(int) * length, "init_plumbing");
+  plumbing->out_fds = (int *) failSafeMalloc(sizeof(int) * length, "init_plumbing");
+  plumbing->in_files = (int *) failSafeMalloc(sizeof(int) * length, "init_plumbing");
+  plumbing->relays = (Relay *) failSafeMalloc(sizeof(Relay) * length, "init_plumbing");
+  plumbing->fds = (int *) failSafeMalloc(sizeof(int) * capacity, "init_plumbing");
+  plumbing->relay_count = 0;
+  plumbing->fd_count = 0;
+  plumbing->pipe_size = pipe_size_of(command->context);
+  plumbing->file_flags = file_flags_of(command->context);
+
+  for (index = 0; index < length; index++) {
+    plumbing->in_fds[index] = -1;
+    plumbing->out_fds[index] = -1;
+    plumbing->in_files[index] = -1;
+  }
+
+  for (index = 0; index < length && !failed; index++) {
+    const Stage * stage = command->stages[index];
+    int files = stage->out_files->count(stage->out_files);
+    BOOL last = is_last_of_branch(command, index);
+    BOOL fan_out = (BOOL)(last && 0 == stage->branch && 0 < command->branches);
+    int pipes = (last)? 0 : 1;
+    int targets, consumer;
+
+    if (fan_out) {
+      pipes = command->branches;
+    }
+
+    targets = files + pipes;
+
+    if (0 == targets || (1 == targets && 1 == files)) {
+      /* stdout, or a single file the stage will open for itself */
+
+    } else if (1 == targets) {
+      /* a plain pipe to the next stage or to the only branch */
+      consumer = reader_of(command, index);
+
+      failed = (BOOL)(0 != open_pipe(plumbing, ends));
+      if (!failed && NULL != meters) {
+        /* two pipes, and a relay metering what goes from one to the other */
+        Relay * relay = &plumbing->relays[plumbing->relay_count++];
+
+        relay->outs = (int *) failSafeMalloc(sizeof(int) * 2, "init_plumbing");
+        relay->count = 0;
+        relay->meter = &meters[index];
+        relay->in_fd = ends[0];
+        plumbing->out_fds[index] = ends[1];
+
+        failed = (BOOL)(0 != open_pipe(plumbing, ends));
+        if (!failed) {
+          relay->outs[relay->count++] = ends[1];
+          plumbing->in_fds[consumer] = ends[0];
+        }
+      } else if (!failed) {
+        plumbing->out_fds[index] = ends[1];
+        plumbing->in_fds[consumer] = ends[0];
+      }
+
+    } else {
+      /* more than one target: the stage writes to a relay */
+      Relay * relay = &plumbing->relays[plumbing->relay_count++];
+      Node * node = stage->out_files->head;
+
+      relay->outs = (int *) failSafeMalloc(sizeof(int) * (targets + 1), "init_plumbing");
+      relay->count = 0;
+      relay->meter = NULL;
+
+      failed = (BOOL)(0 != open_pipe(plumbing, ends));
+      if (!failed) {
+        plumbing->out_fds[index] = ends[1];
+        relay->in_fd = ends[0];
+      }
+
+      for (; NULL != node && !failed; node = node->next) {
+        char * path = absolute_path(command->cwd, node->string);
+        int file = open_file(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | plumbing->file_flags);
+
+        free(path);
+
+        if (-1 == file) {
+          fprintf(stderr, "%s: %s: " , SHELL_NAME, node->string);
+          perror("");
+          failed = true;
+        } else {
+          plumbing->fds[plumbing->fd_count++] = file;
+          relay->outs[relay->count++] = file;
+        }
+      }
+
+      /* then the next stage, or the first stage of every branch */
+      for (consumer = index + 1; 0 < pipes && !failed && consumer < length; consumer++) {
+        if (!fan_out || command->stages[consumer]->branch != command->stages[consumer - 1]->branch) {
+          failed = (BOOL)(0 != open_pipe(plumbing, ends));
+          if (!failed) {
+            relay->outs[relay->count++] = ends[1];
+            plumbing->in_fds[consumer] = ends[0];
+            pipes--;
+          }
+        }
+      }
+    }
+  }
+
+  /* a here-document replaces whatever else the stage would read */
+  for (index = 0; index < length && !failed; index++) {
+    const char * text = command->stages[index]->here_document;
+
+    if (NULL != text) {
+      int document = open_here_document(text);
+
+      if (-1 == document) {
+        failed = true;
+      } else {
+        plumbing->fds[plumbing->fd_count++] = document;
+        plumbing->in_fds[index] = document;
+      }
+    }
+  }
+
+  /* a < file is opened now, so the kernel reads it in during the forks */
+  for (index = 0; index < length && !failed; index++) {
+    int file = open_read_ahead(command, command->stages[index], plumbing->file_flags);
+
+    if (-1 != file) {
+      plumbing->fds[plumbing->fd_count++] = file;
+      plumbing->in_files[index] = file;
+    }
+  }
+
+  if (failed) {
+    release_plumbing(plumbing);
+    plumbing = NULL;
+  }
+
+  return plumbing;
+}
+
+static void close_plumbing(const Plumbing * plumbing, const int * keep, int count) {
+
+  int index, kept;
+
+  for (index = 0; index < plumbing->fd_count; index++) {
+    BOOL needed = false;
+
+    for (kept = 0; kept < count; kept++) {
+      if (keep[kept] == plumbing->fds[index]) needed = true;
+    }
+
+    if (!needed) {
+      close(plumbing->fds[index]);
+    }
+  }
+}
+
+static void take_stdio(const int * stdio) {
+
+  int fd;
+
+  for (fd = STDIN_FILENO; fd <= STDERR_FILENO; fd++) {
+    if (fd != stdio[fd]) {
+      dup2(stdio[fd], fd);
+    }
+  }
+}
+
+static void release_plumbing(Plumbing * plumbing) {
+
+  if (NULL != plumbing) {
+    int index;
+
+    close_plumbing(plumbing, NULL, 0);
+
+    for (index = 0; index < plumbing->relay_count; index++) {
+      free(plumbing->relays[index].outs);
+    }
+
+    free(plumbing->relays);
+    free(plumbing->fds);
+    free(plumbing->in_fds);
+    free(plumbing->out_fds);
+    free(plumbing->in_files);
+    free(plumbing);
+  }
+}
+
 int execute(Command * self_) {
   Command * self = self_;
 
   /* by this point we know executablePath is an executable file */
-  int * status;
-  int in_file = -1, out_file = -1;
-  int leftPipe[2], rightPipe[2], temp[2];
-  int std_in = dup(STDIN_FILENO), std_out = dup(STDOUT_FILENO);
+  int status;
   int exit_status = 0; /* if this is set to 1 before the exec, we bail */
-  char ** argv_start = NULL;
-  char ** argv = NULL;
-  int index = 0;
-  int iteration;
-  int argc = self->getArgc(self);
-  pid_t pid;
-  int options = (self->background)? WNOHANG : 0;
-
-  status = (int *) failSafeMalloc(sizeof(int), "execute");
-
-  /* memory leak: actually this is freed most of the time... but sometimes
-   * mysteriously it is not. I think it is because of the lame ass way
-   * in which I fiddle with the array pointer later on */
-  argv = self->getArgv(self);
-  argv_start = &argv[0];
-
-  /* by default we read from stdin and write to stdout */
-  leftPipe[0] = STDIN_FILENO;
-
-  /* we'll execute at least one, but as many as pipe_length programs */
-  /* if for some reason we fail, we'll break from this loop */
-  for(iteration = 0; iteration < self->pipe_length; iteration++) {
-
-    /* here we sneaky open the pipe when no one is watching */
-    if (iteration < self->pipe_length - 1) {
-      pipe(rightPipe);
+  int index, children = 0;
+  pid_t pid = 0;
+  pid_t * pids;
+  Plumbing * plumbing;
+  /*@null@*/ RelayMeter * meters = NULL;
+  Tracer * tracer = self->context->tracer;
+  long forked, waited;
+
+  /* moving bytes from files to a file does not need a process */
+  if (isPureCopy(self)) {
+    return copyInShell(self);
+  }
+
+  /* a pipeline with a stage that could not be resolved is not run at all */
+  for (index = 0; index < self->pipe_length; index++) {
+    if (NULL == self->stages[index]->executablePath) {
+      if ('\0' == self->stages[index]->name[0]) {
+        fprintf(stderr, "%s: %s\n", SHELL_NAME, "redirection without a command");
+      } else {
+        fprintf(stderr, "%s: %s\n", self->stages[index]->name, "command not found");
+      }
+      return 1;
+    }
+  }
+
+  /* the relays write their meters where the shell can read them after */
+  if (self->measured && !self->background && 1 < self->pipe_length) {
+    void * shared = mmap(NULL, sizeof(RelayMeter) * self->pipe_length, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    if (MAP_FAILED == shared) {
+      perror(SHELL_NAME ": pipestat");
     } else {
-      rightPipe[1] = STDOUT_FILENO;
+      meters = (RelayMeter *)shared;
     }
-     
+  }
+
+  if (NULL == (plumbing = init_plumbing(self, meters))) {
+    if (NULL != meters) (void)munmap(meters, sizeof(RelayMeter) * self->pipe_length);
+    return 1;
+  }
+
+  pids = (pid_t *) failSafeMalloc(sizeof(pid_t) * (self->pipe_length + plumbing->relay_count), "execute");
+
+  /* whether each executable was still in memory is known before it runs.
+   * Only a shell with a prompt counts them */
+  for (index = 0; index < self->pipe_length && NULL != self->context->parent->prefetch; index++) {
+    Prefetch * prefetch = self->context->parent->prefetch;
+    prefetch->used(prefetch, self->stages[index]->executablePath);
+  }
+
+  /* every stage is started before any is waited on, so that no stage can
+   * block forever on a full pipe */
+  for (index = 0; index < self->pipe_length; index++) {
+    Stage * stage = self->stages[index];
+
+    forked = now_us();
     switch ((pid = fork())) {
       case -1 :
         perror("fork");
         exit(1);
       case 0 :
         if (self->background) {
-          setpgid(pid, 0);
+          setpgid(0, 0);
+        }
+
+        /* the child is the first process to be in the context's cwd, and
+         * gets the descriptors its Vash was given before any of its own */
+        if (-1 == chdir(self->cwd)) {
+          fprintf(stderr, "%s: %s: " , SHELL_NAME, self->cwd);
+          perror("");
+          exit(EXIT_FAILURE);
         }
-        dup2(leftPipe[0], STDIN_FILENO);
-        dup2(rightPipe[1], STDOUT_FILENO);
+        take_stdio(self->context->stdio);
 
-        exit_status = redirect_to_file(self->in_file, STDIN_FILENO, 0);
-        exit_status = redirect_to_file(self->out_file, STDOUT_FILENO, O_CREAT | O_TRUNC);
+        if (-1 != plumbing->in_fds[index]) {
+          dup2(plumbing->in_fds[index], STDIN_FILENO);
+        }
 
-        if (1 != exit_status) {
+        if (-1 != plumbing->out_fds[index]) {
+          dup2(plumbing->out_fds[index], STDOUT_FILENO);
+        }
+
+        /* the < file comes after any pipe or here-document, as it did */
+        if (-1 != plumbing->in_files[index]) {
+          dup2(plumbing->in_files[index], STDIN_FILENO);
+        } else {
+          exit_status = redirect_to_file(stage->in_file, STDIN_FILENO, plumbing->file_flags);
+        }
+
+        close_plumbing(plumbing, NULL, 0);
+
+        /* a single output file is opened by the stage itself */
+        if (0 == exit_status && -1 == plumbing->out_fds[index] && NULL != stage->out_files->head) {
+          exit_status = redirect_to_file(stage->out_files->head->string, STDOUT_FILENO,
+              O_CREAT | O_TRUNC | plumbing->file_flags);
+        }
+
+        if (0 == exit_status) {
           if (SIG_ERR == signal(SIGINT, SIG_DFL)) {
             perror("vash");
             exit(EXIT_FAILURE);
           }
 
-          if (-1 == execv(self->executablePath, argv)) {
+          /* from the fork to here is the shell's cost of the stage */
+          tracer->span(tracer, "exec", stage->name, forked);
+
+          if (-1 == execv(stage->executablePath, self->getArgv(self, index))) {
+            BOOL vanished = (BOOL)(ENOENT == errno);
+
             perror("vash");
+
+            /* it was there when it was found: found again, next time */
+            if (vanished && NULL != self->context->parent->resolver) {
+              Resolver * resolver = self->context->parent->resolver;
+              resolver->forget(resolver, stage->name);
+            }
             exit(EXIT_FAILURE);
           }
         }
-          
+
         exit(EXIT_FAILURE);
-      default : 
-        close(rightPipe[1]);
-        if (-1 != in_file) {
-          close(in_file);
-        }
-        
-        if (-1 != out_file) {
-          close(out_file);
-        }
+      default :
+        tracer->span(tracer, "fork", stage->name, forked);
+        tracer->started(tracer, pid, (self->background)? "job" : "stage", stage->name, forked);
+        pids[children++] = pid;
+    }
+  }
 
-        /* if we're in the background we won't waitpid */
-        if (!self->background) {
-          if (-1 == waitpid(pid, status, options)) {
-            fprintf(stderr, "%s: %s", SHELL_NAME, self->executablePath);
-            perror(""); 
-            errno = 0;
-          }
-        } else {
-          free(status);
-          status = NULL;
+  /* relays are children of the shell that never exec */
+  for (index = 0; index < plumbing->relay_count; index++) {
+    const Relay * relay = &plumbing->relays[index];
+
+    forked = now_us();
+    switch ((pids[children] = fork())) {
+      case -1 :
+        perror("fork");
+        exit(1);
+      case 0 :
+        if (self->background) {
+          setpgid(0, 0);
         }
+        take_stdio(self->context->stdio);
+
+        /* a relay outlives any one of its readers */
+        (void)signal(SIGPIPE, SIG_IGN);
+
+        /* the relay keeps its input and its outputs, nothing else */
+        relay->outs[relay->count] = relay->in_fd;
+        close_plumbing(plumbing, relay->outs, relay->count + 1);
+        _exit((NULL != relay->meter)? relay_metered(relay->in_fd, relay->outs[0], relay->meter)
+            : relay_fan_out(relay->in_fd, relay->outs, relay->count));
+      default :
+        tracer->started(tracer, pids[children], "relay", "relay", forked);
+        children++;
+    }
+  }
+
+  /* the shell itself holds no end of any pipe */
+  release_plumbing(plumbing);
+  self->pid = pid;
+
+  /* if we're in the background we won't waitpid */
+  if (!self->background) {
+    waited = now_us();
+    for (index = 0; index < self->pipe_length; index++) {
+      if (-1 == waitpid(pids[index], &status, 0)) {
+        fprintf(stderr, "%s: %s", SHELL_NAME, self->stages[index]->executablePath);
+        perror("");
+        errno = 0;
+      } else {
+        tracer->reaped(tracer, pids[index], status);
+      }
+    }
+
+    /* the relays finish once the stages they feed have read everything */
+    for (; index < children; index++) {
+      int relay_status;
+      if (pids[index] == waitpid(pids[index], &relay_status, 0)) {
+        tracer->reaped(tracer, pids[index], relay_status);
+      }
+    }
+
+    tracer->span(tracer, "wait", self->stages[self->pipe_length - 1]->name, waited);
+
+    exit_status = status_report(self, &status, pid);
+
+    if (option_of(self->context, "VASH_DONTNEED")) {
+      drop_outputs(self);
+    }
+
+    if (NULL != meters) {
+      report_meters(self, meters);
+    }
+  } else {
+    /* every stage and relay is a job, reaped by the Vash that started it */
+    for (index = 0; index < children; index++) {
+      self->context->jobs->add(self->context->jobs, pids[index]);
+    }
+
+    exit_status = status_report(self, NULL, pid);
+  }
+
+  free(pids);
+
+  if (NULL != meters) {
+    (void)munmap(meters, sizeof(RelayMeter) * self->pipe_length);
+  }
+
+  return exit_status;
+}
+
+int run_pipestat(const Context * context, List * argv) {
+
+  Command * command;
+  char * message;
+  int exit_status;
+
+  if (argv->isEmpty(argv)) {
+    fprintf(stderr, "%s: pipestat: usage: pipestat command [args...] | command ...\n", SHELL_NAME);
+    return 1;
+  }
+
+  message = argv->pop(argv);
+  command = init_command(context, message);
+  free(message);
+
+  if (NULL == command) {
+    return 1;
+  }
+
+  command->setArgv(command, argv);
+  command->measured = true;
+  exit_status = command->execute(command);
+  release_command(command);
+
+  return exit_status;
+}
+
+static void report_meters(const Command * command, const RelayMeter * meters) {
+
+  const RelayMeter ** feeding;
+  FILE * out = fdopen(dup(command->context->stdio[STDERR_FILENO]), "w");
+  int index, slowest = -1;
+  double worst = 0.1; /* a stage that held nothing up for long is not slow */
+
+  if (NULL == out) {
+    return;
+  }
+
+  /* the meter on the pipe each stage reads from, if there is one */
+  feeding = (const RelayMeter **) failSafeMalloc(sizeof(RelayMeter *) * command->pipe_length, "report_meters");
+  for (index = 0; index < command->pipe_length; index++) {
+    feeding[index] = NULL;
+  }
+  for (index = 0; index < command->pipe_length; index++) {
+    if (meters[index].metered) {
+      feeding[reader_of(command, index)] = &meters[index];
+    }
+  }
+
+  /* the slowest stage has its input backing up behind it and its output
+   * running dry: the source always has input, and the sink somewhere to
+   * put its output */
+  for (index = 0; index < command->pipe_length; index++) {
+    const RelayMeter * in = feeding[index], * out_meter = &meters[index];
+    double backed = 1, starved = 1, score;
+
+    if (NULL == in && !out_meter->metered) {
+      continue;
+    }
+
+    if (NULL != in && in->finished_us > in->started_us) {
+      backed = (double)in->waited_out_us / (double)(in->finished_us - in->started_us);
+    }
+
+    if (out_meter->metered && out_meter->finished_us > out_meter->started_us) {
+      starved = (double)out_meter->waited_in_us / (double)(out_meter->finished_us - out_meter->started_us);
+    }
+
+    score = (backed < starved)? backed : starved;
+    if (score > worst) {
+      worst = score;
+      slowest = index;
+    }
+  }
+
+  fprintf(out, "%s: pipestat: %-4s %-16s %12s %12s %9s %14s %14s\n", SHELL_NAME,
+      "", "stage", "read", "written", "MB/s", "held writer", "held reader");
+
+  for (index = 0; index < command->pipe_length; index++) {
+    const RelayMeter * in = feeding[index], * out_meter = &meters[index];
+    char read[24] = "-", written[24] = "-", rate[24] = "-", held_writer[24] = "-", held_reader[24] = "-";
+
+    if (NULL != in) {
+      sprintf(read, "%lld", in->bytes);
+      sprintf(held_writer, "%ld ms", in->waited_out_us / 1000);
+    }
+
+    if (out_meter->metered) {
+      long elapsed = out_meter->finished_us - out_meter->started_us;
+
+      sprintf(written, "%lld", out_meter->bytes);
+      sprintf(held_reader, "%ld ms", out_meter->waited_in_us / 1000);
+      if (0 < elapsed) {
+        sprintf(rate, "%.1f", (double)out_meter->bytes / (double)elapsed);
+      }
+    }
+
+    fprintf(out, "%s: pipestat: %-4d %-16.16s %12s %12s %9s %14s %14s%s\n", SHELL_NAME,
+        index + 1, command->stages[index]->name, read, written, rate, held_writer, held_reader,
+        (index == slowest)? "  <- slowest" : "");
+  }
+
+  free(feeding);
+  (void)fclose(out);
+}
+
+static BOOL isPureCopy(const Command * command) {
+
+  /* only the system's own cat: a ./cat script or a cat wrapper earlier in
+   * the PATH does whatever it does, and is run */
+  static const char * const system_cats[] = { "/bin/cat", "/usr/bin/cat", NULL };
+
+  const Stage * stage = command->stages[0];
+  Node * node;
+  int index;
+
+  if (1 != command->pipe_length || command->background
+      || 1 < stage->out_files->count(stage->out_files)) {
+    return false;
+  }
+
+  /* cat /dev/stdin < f reads f: only the forked stage has f as its fd 0 */
+  if ((NULL != stage->in_file && names_own_fd(command->cwd, stage->in_file))
+      || (NULL != stage->out_files->head && names_own_fd(command->cwd, stage->out_files->head->string))) {
+    return false;
+  }
+  for (node = stage->argv->head; NULL != node; node = node->next) {
+    if (names_own_fd(command->cwd, node->string)) {
+      return false;
+    }
+  }
+
+  /* < in > out, or > out on its own */
+  if (NULL == stage->executablePath) {
+    return stage->argv->isEmpty(stage->argv);
+  }
+
+  for (index = 0; NULL != system_cats[index] && 0 != strcmp(stage->executablePath, system_cats[index]); index++);
+  if (NULL == system_cats[index]) {
+    return false;
+  }
+
+  /* cat with no files reads stdin, which may well be the terminal */
+  if (stage->argv->isEmpty(stage->argv)) {
+    return (BOOL)(NULL != stage->in_file || NULL != stage->here_document);
+  }
+
+  /* any option at all, and cat is doing more than copying */
+  for (node = stage->argv->head; NULL != node; node = node->next) {
+    if ('-' == node->string[0]) {
+      return false;
     }
+  }
+
+  return true;
+}
+
+/* opens the given file, relative to the given cwd, for copyInShell,
+ * reporting failure as cat would. A file opened to be read is read
+ * sequentially */
+static int open_for_copy(const char * cwd, const char * file_name, int flags) {
+
+  char * path = absolute_path(cwd, file_name);
+  int file_handle = open_file(path, flags);
+
+  free(path);
+
+  if (-1 == file_handle) {
+    fprintf(stderr, "%s: %s: " , SHELL_NAME, file_name);
+    perror("");
+  } else if (O_RDONLY == (flags & O_ACCMODE)) {
+    (void)posix_fadvise(file_handle, 0, 0, POSIX_FADV_SEQUENTIAL);
+  }
+
+  return file_handle;
+}
 
-    /* set up the next iteration if there is one */
-    /* this is probably the source of that memory leak above */
-    if (1 < self->pipe_length && iteration < self->pipe_length -1) {
-  
-      /* setup the next command */
-      /* walk until the next null */
-      while (NULL != argv_start[index]) {
-        index++;
+static int copyInShell(const Command * command) {
+
+  const Stage * stage = command->stages[0];
+  int out_fd = command->context->stdio[STDOUT_FILENO], in_fd;
+  int exit_status = 0, flags = file_flags_of(command->context);
+  Node * node;
+
+  if (NULL != stage->out_files->head) {
+    out_fd = open_for_copy(command->cwd, stage->out_files->head->string,
+        O_WRONLY | O_CREAT | O_TRUNC | flags);
+    if (-1 == out_fd) return 1;
+  }
+
+  if (stage->argv->isEmpty(stage->argv)) {
+    /* > out on its own only creates the file */
+    if (NULL != stage->here_document) {
+      if (-1 == (in_fd = open_here_document(stage->here_document))) {
+        exit_status = 1;
+      } else {
+        exit_status = relay_copy(in_fd, out_fd);
+        close(in_fd);
+      }
+
+    } else if (NULL != stage->in_file) {
+      if (-1 == (in_fd = open_for_copy(command->cwd, stage->in_file, O_RDONLY | flags))) {
+        exit_status = 1;
+      } else {
+        exit_status = relay_copy(in_fd, out_fd);
+        close(in_fd);
       }
-    
-      /* If index >= argc then index + 1 is out of bounds 
-       * even otherwise, there is still a chance index + 1 is out of bounds */
-      if (index >= argc || NULL == argv_start[index + 1]) {
-        break; /* bail out */
+    }
 
+  } else {
+    /* cat concatenates its arguments and ignores stdin */
+    for (node = stage->argv->head; NULL != node; node = node->next) {
+      if (-1 == (in_fd = open_for_copy(command->cwd, node->string, O_RDONLY | flags))) {
+        exit_status = 1;
       } else {
-        index++; /* we know there is something after the NULL */
-        argv = &argv_start[index];
-        free(self->executablePath);
-        self->executablePath = argv[0]; /* we already validated this path */
+        if (0 != relay_copy(in_fd, out_fd)) exit_status = 1;
+        close(in_fd);
       }
     }
+  }
+
+  if (NULL != stage->out_files->head) {
+    close(out_fd);
 
-    /* if there is another iteration, swap the pipes */
-    if (iteration < self->pipe_length - 1) {
-      memcpy(temp,   leftPipe,  sizeof temp);
-      memcpy(leftPipe,  rightPipe, sizeof leftPipe);
-      memcpy(rightPipe, temp,   sizeof rightPipe);
+    if (option_of(command->context, "VASH_DONTNEED")) {
+      drop_outputs(command);
     }
   }
 
-  /* restore stdin and stdout because I bin messin */
-  dup2(std_in, STDIN_FILENO);
-  dup2(std_out, STDOUT_FILENO);
+  return exit_status;
+}
+
+static int open_here_document(const char * text) {
+
+  size_t length = strlen(text), offset = 0;
+  ssize_t written;
+  int document = memfd_create("vash-here-document", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+
+  if (-1 == document) {
+    perror(SHELL_NAME ": here-document");
+    return -1;
+  }
 
-  exit_status = status_report(self, status, pid);
+  /* the whole text goes in at once: there is no pipe to fill up */
+  while (offset < length) {
+    written = write(document, &text[offset], length - offset);
 
-  free(status);
-  free(*argv_start); /* see here I free what argv_start points to... */
-  free(argv_start);
+    if (-1 == written && EINTR == errno) continue;
+    if (-1 == written) {
+      perror(SHELL_NAME ": here-document");
+      close(document);
+      return -1;
+    }
+
+    offset += (size_t)written;
+  }
 
-  return exit_status; 
+  (void)fcntl(document, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+  (void)lseek(document, 0, SEEK_SET);
+
+  return document;
 }
 
 int status_report(Command * command, int *status, pid_t pid) {
@@ -381,7 +1288,7 @@ int status_report(Command * command, int *status, pid_t pid) {
 
   if (NULL == status) {
     fprintf(stderr, "[] %d\n", (int)pid);
-    return 0; 
+    return 0;
   }
 
   /* still not entirely clear on this stuff... */
@@ -395,4 +1302,3 @@ int status_report(Command * command, int *status, pid_t pid) {
 
   return exit_status;
 }
-
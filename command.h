@@ -8,6 +8,9 @@
 #include "list.h"
 #include "va_utils.h"
 
+/* how much of each < file the shell asks the kernel to start reading as
+ * soon as the line is parsed, while the stage that reads it is forked */
+#define READ_AHEAD_BYTES (8 * 1024 * 1024)
 
 /* Class Command 
  * brief: Command encapsulates the validation and execution of an executable
@@ -20,6 +23,36 @@
 /* forward declaration: Command needs to know about context */
 struct Context;
 
+/* struct Stage
+ * A Stage is one link in the chain of a pipeline: an executable file, the
+ * arguments passed to it, and the redirections that belong to it alone.
+ *
+ *   ls -l > listing | wc -c > count
+ *
+ * is two stages, each with its own output file. A stage may name several
+ * output files, in which case the shell relays its output to all of them.
+ * */
+typedef struct Stage {
+
+  /*@null@*/ char * executablePath; /* NULL if the stage could not be resolved */
+  char * name; /* the name the stage was invoked by, for error messages */
+
+  List * argv; /* the arguments to the executable, not including its name */
+
+  /* redirection handles: these are POSIX filenames */
+  /*@null@*/ char * in_file;
+  List * out_files; /* every > target of this stage, in order */
+
+  /* the text of a << here-document or <<< here-string, which becomes
+   * stdin in place of in_file. NULL if the stage has neither */
+  /*@null@*/ char * here_document;
+
+  /* stages connected by | share a branch. Branch 0 is the source pipeline,
+   * and every |> starts a new branch fed by the last stage of the source */
+  int branch;
+
+} Stage;
+
 typedef struct Command {
 
   char * executablePath; /* the path to a valid executable file */
@@ -33,43 +66,47 @@ typedef struct Command {
    * */
   const struct Context * context;
 
-  /*@null@*/ List * argv; /* a list of arguments to the command, which may be NULL */
-
-  /* redirection handles: these are POSIX filenames */
-  char * in_file;
-  char * out_file;
+  /* the stages of the pipeline, in the order they were given. 
+   * There is always at least one stage. */
+  Stage ** stages;
+  int pipe_length; /* the number of stages */
+  int branches; /* the number of |> branches fed by the source pipeline */
 
   /* execution flags: how should this command be executed */
   BOOL background;
-  BOOL pipe_output;
-  int pipe_length;
+  BOOL measured; /* every pipe between its stages is metered, @see run_pipestat */
+
+  pid_t pid; /* the last stage of the pipeline, once it has been started */
   
-  /* Sets argv to the given list.
+  /* Sets argv to the given list. The list is broken into stages on | and
+   * |> and each stage collects its own < and > redirections.
    * @see getArgv
-   * @post argv is an independant copy of the given list 
+   * @post every stage holds an independant copy of its part of the list 
    * @param self_ the calling object 
    * @param argv (retained) the list to be copied
    * @alloc NO memory allocated by setArgv is the responsibility of self_ 
    * */
   void (*setArgv)(struct Command * self_, List * argv); 
 
-  /* Returns an array containing the command name followed by all of the 
-   * arguments. The array returned is NULL terminated and suitable to 
-   * be passed to functions in the exec family.   
+  /* Returns an array containing the name of the given stage's executable
+   * followed by all of its arguments. The array returned is NULL terminated
+   * and suitable to be passed to functions in the exec family.   
    * @see setArgv
+   * @pre 0 <= stage < pipe_length
    * @param self_ the calling object 
+   * @param stage the index of the stage in the pipeline
    * @alloc YES the caller becomes responsible for freeing the return value 
+   *            and every string in it
    * @null NO argv will contain at minimum the name of the command and NULL
    * @crash YES failed to malloc
    * @return a linear array of strings 
    * */
-  char ** const (*getArgv)(struct Command * self_);
+  char ** const (*getArgv)(struct Command * self_, int stage);
 
-  /* returns the number of elements in argv. Remember that 
-   * argv is a NULL terminated array of strings, so count 
-   * will be one less than the number of elements in the 
-   * array. */
-  int (*getArgc)(struct Command * self_);
+  /* returns the number of elements in the given stage's argv. Remember
+   * that argv is a NULL terminated array of strings, so count will be
+   * one less than the number of elements in the array. */
+  int (*getArgc)(struct Command * self_, int stage);
 
   /* Executes the command represented by the callilng object. A Command 
    * object is guaranteed to execute. After that the child process may
@@ -84,10 +121,12 @@ typedef struct Command {
 } Command;
 
 /* Allocates an initializes a new Command object encapsulating a given message
- * which may exist in the given PATH or the given context. The message is 
+ * which may exist in the PATH of the given context or in its cwd. The message is 
  * checked agains the path and context cwd, and if it does not describe an 
  * executable file then the return value will be NULL. This means that one 
  * of the class invarients of Command is that it represents an executable. 
+ * The one exception is the empty message, which makes a Command with no 
+ * executable that only moves bytes between its redirections: < in > out 
  * @see release_command 
  * @pre context and list are initialized 
  * @alloc YES the caller is responsible for freeing the return value
@@ -95,7 +134,42 @@ typedef struct Command {
  * @crash YES failed to malloc
  * @null YES if the given command does not exist 
  * */
-/*@null@*/ Command * init_command(const struct Context * context, const char * message, const List * PATH);
+/*@null@*/ Command * init_command(const struct Context * context, const char * message);
+
+/* Allocates a Command for an executable that has already been resolved, so
+ * that nothing is looked up. @see init_command @see resolve_command
+ * @param context the context the command will run in
+ * @param message the name the command was invoked by
+ * @param executablePath (retained) the resolved executable, or NULL for a
+ *                       line that only redirects
+ * @alloc YES the caller is responsible for freeing the return value
+ * @dtor YES instances must be freed by release_command
+ * @crash YES failed to malloc
+ * */
+Command * init_resolved_command(const struct Context * context, const char * message, /*@null@*/ const char * executablePath);
+
+/* Resolves the given message to an executable exactly as init_command
+ * would: in the cwd, then in the cwd of the context, then in its PATH.
+ * @alloc YES the caller is responsible for freeing the return value
+ * @null YES if the message does not name an executable file
+ * @return the absolute path of the executable
+ * */
+/*@null@*/ char * resolve_command(const struct Context * context, const char * message);
+
+/* the pipestat builtin: runs a pipeline with a relay metering every pipe
+ * between its stages, and says on stderr, once it has finished, how many
+ * bytes each stage read and wrote, how fast, and how long it held up the
+ * stage writing to it and the stage reading from it:
+ *
+ *   $$ pipestat zcat big.gz | grep -v '^#' | sort | uniq -c
+ *
+ * The stage marked slowest is the one whose input backed up while its
+ * output ran dry. A pipeline run in the background is not metered.
+ * @param context the context the pipeline runs in
+ * @param argv (retained) the pipeline
+ * @return the exit status of the pipeline, or 1 if it could not be run
+ * */
+int run_pipestat(const struct Context * context, List * argv);
 
 /* deallocates and frees all the fields in the given command instance. 
  * @param command the Command instance to be freed
@@ -6,9 +6,16 @@
 
 /* instance methods documented in context.h */
 static int callCommand(Context * self_, const char * message, List * argv);
+static const List * getPath(const Context * self_);
+static int callResolved(Context * self_, const char * message, const char * executablePath, List * argv);
 static void setCWD(Context * self_, const char * dir_path);
 
-Context * init_context(const Vash * parent, const char * cwd) {
+/* Private instance scope methods */
+
+/* sets $! in the given context if the command went to the background */
+static void rememberBackground(Context * self, const Command * command);
+
+Context * init_context(Vash * parent, const char * cwd) {
 
   Context * context;
 
@@ -28,12 +35,18 @@ Context * init_context(const Vash * parent, const char * cwd) {
   context->old_cwd = string_with_size(strlen(cwd) + 1, "init_context");
   strcpy(context->old_cwd, cwd);
 
-  context->PATH = copy_list(parent->getPath(parent));
-  if (NULL == context->PATH) {
-    context->PATH = init_list();
-  }
+  /* the PATH of the Vash is not even parsed until a command needs it */
+  context->parent = parent;
+  context->PATH = NULL;
+
+  context->variables = init_table(parent->variables);
+  context->tracer = parent->tracer;
+  context->jobs = parent->jobs;
+  context->stdio = (int *)parent->stdio;
 
   context->callCommand = callCommand;
+  context->getPath = getPath;
+  context->callResolved = callResolved;
   context->setCWD = setCWD;
 
   return context;
@@ -47,6 +60,7 @@ void release_context(const Context * context) {
       release_list(context->PATH);
     }
 
+    release_table(context->variables);
     free((char *)context->cwd);
     free((char *)context->old_cwd);
   } 
@@ -54,16 +68,23 @@ void release_context(const Context * context) {
   free((char *)context);
 }
 
+static const List * getPath(const Context * self_) {
+  const Context * const self = self_;
+
+  return (NULL != self->PATH)? self->PATH : self->parent->getPath(self->parent);
+}
+
 int callCommand(Context * self_, const char * message, List * argv) {
   Context * const self = self_;
   /* try to instantiate a command */
-  Command * command = init_command(self, message, self->PATH);
+  Command * command = init_command(self, message);
   int exit_status = 1;
 
   /* command may be NULL if message is not an executable file */
   if (NULL != command) {
     command->setArgv(command, argv);
     exit_status = command->execute(command);
+    rememberBackground(self, command);
   }
 
   release_command(command);
@@ -71,6 +92,30 @@ int callCommand(Context * self_, const char * message, List * argv) {
   return exit_status; 
 }
 
+int callResolved(Context * self_, const char * message, const char * executablePath, List * argv) {
+  Context * const self = self_;
+  Command * command = init_resolved_command(self, message, executablePath);
+  int exit_status;
+
+  command->setArgv(command, argv);
+  exit_status = command->execute(command);
+  rememberBackground(self, command);
+
+  release_command(command);
+
+  return exit_status;
+}
+
+void rememberBackground(Context * self, const Command * command) {
+
+  if (command->background && 0 < command->pid) {
+    char pid[3 * sizeof(pid_t) + 2];
+
+    sprintf(pid, "%d", (int)command->pid);
+    self->variables->set(self->variables, "!", pid);
+  }
+}
+
 void setCWD(Context * self_, const char * dir_path) {
   Context * const self = self_;
 
@@ -7,6 +7,7 @@
 #include "list.h"
 #include "vash.h"
 #include "command.h"
+#include "table.h"
 
 /* Class Context 
  * brief: Vash has a the concept of "execution contexts". These are implemented
@@ -26,14 +27,34 @@ typedef struct Context {
   char * cwd; /* The current working directory for this context */
   char * old_cwd; /* The previous current working directory */
 
-  const struct List * PATH; /* The Vash that created this context */
+  struct Vash * parent; /* The Vash that created this context */
+
+  /* a PATH of its own, as loaded from a snapshot, or NULL while it uses
+   * the one of the Vash, @see getPath */
+  /*@null@*/ const struct List * PATH;
+
+  /* the variables of this context, a scope on top of the global variables.
+   * $! is set here, so each context knows its own last background job */
+  Table * variables;
+
+  /* the tracer of the Vash that created this context */
+  struct Tracer * tracer;
+
+  /* the job table of the Vash that created this context, which its
+   * background commands go into */
+  struct Jobs * jobs;
+
+  /* the stdin, stdout and stderr of the Vash that created this context,
+   * which its commands get in place of the process's own. @see Vash */
+  int * stdio;
 
   /* Calls the command matching the given string with the arguments 
    * in the given list, if such a command exists. CallCommand collects
    * the return value from the execution, if it exists, and propagates 
    * it to the controller. 
    * @param self_ the calling object
-   * @param message (retained) the name of or path to an executable file
+   * @param message (retained) the name of or path to an executable file,
+   *                or the empty string for a line that only redirects
    * @param argv (retained) a list of arguments to pass to the executable, the
                             first of which is expected to be the name of 
                             or path to the executable 
@@ -42,6 +63,26 @@ typedef struct Context {
    * */
   int (*callCommand)(struct Context * self_, const char * message, List * argv);
 
+  /* returns the PATH of this context: its own, or else the one of the
+   * Vash, which is only parsed when a command first needs it
+   * @param self_ the calling object
+   * @crash YES failed to malloc
+   * @return a const reference to the PATH
+   * */
+  const List * (*getPath)(const struct Context * self_);
+
+  /* Calls a command that was resolved ahead of time, with resolve_command,
+   * and so skips looking for it. Otherwise the same as callCommand.
+   * @see callCommand
+   * @param self_ the calling object
+   * @param message (retained) the name the command was invoked by
+   * @param executablePath (retained) the resolved executable
+   * @param argv (retained) the arguments, as for callCommand
+   * @alloc NO all memory allocated by callResolved is freed by callResolved
+   * @return the exit status of the executable
+   * */
+  int (*callResolved)(struct Context * self_, const char * message, const char * executablePath, List * argv);
+
   /* Sets the cwd of this context to the given directory path. If dir_path is
    * an empty string, dir_path will be set to the current working directory as
    * returned by getcwd(char *, size_t). This is used to "clean up" the cwd.
@@ -66,7 +107,7 @@ typedef struct Context {
  * @crash YES failed to malloc 
  * @return a new instance of Context 
  * */
-/*@null@*/ Context * init_context(const struct Vash * parent, const char * cwd);
+/*@null@*/ Context * init_context(struct Vash * parent, const char * cwd);
 
 /* Deallocates all memory and frees the given context object. 
  * @param context the context object to be freed 
@@ -0,0 +1,291 @@
+/* Andre Byrne
+ * 100045589 */
+
+#include "dag.h"
+#include "vash.h"
+
+/* instance methods documented in dag.h */
+static void addPhrase(Dag * self_, Vash * vash, const char * phrase);
+static int run(Dag * self_, Vash * vash);
+
+/* Private class scope methods */
+
+/* returns the absolute form of a file named in a phrase run in the given cwd
+ * @alloc YES the caller becomes responsible for the return value */
+static char * absolute_file(const char * cwd, const char * file_name);
+
+/* returns true if the two lists of paths have a path in common */
+static BOOL overlap(const List * left, const List * right);
+
+/* returns true if the later vertex must wait for the earlier one */
+static BOOL depends(const Vertex * earlier, const Vertex * later);
+
+Dag * init_dag(int workers) {
+
+  Dag * self = (Dag *) failSafeMalloc(sizeof(Dag), "init_dag");
+
+  self->vertices = NULL;
+  self->count = 0;
+  self->capacity = 0;
+
+  self->workers = workers;
+  if (1 > self->workers && NULL != getenv("VASH_JOBS")) {
+    self->workers = atoi(getenv("VASH_JOBS"));
+  }
+
+  if (1 > self->workers) {
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    self->workers = (1 > processors)? 1 : (int)processors;
+  }
+
+  self->addPhrase = addPhrase;
+  self->run = run;
+
+  return self;
+}
+
+void release_dag(Dag * dag) {
+
+  if (NULL != dag) {
+    int index;
+
+    for (index = 0; index < dag->count; index++) {
+      free(dag->vertices[index].phrase);
+      release_list(dag->vertices[index].inputs);
+      release_list(dag->vertices[index].outputs);
+    }
+
+    free(dag->vertices);
+    free(dag);
+  }
+}
+
+static void addPhrase(Dag * self_, Vash * vash, const char * phrase) {
+  Dag * const self = self_;
+
+  Vertex * vertex;
+  List * tokens = init_list();
+  char * first, * message;
+  const char * separator;
+
+  /* name:command runs in the named context, and its files are there too */
+  Context * context = vash->contextOf(vash, phrase);
+  const char * cwd = context->cwd;
+
+  if (self->count == self->capacity) {
+    self->capacity = (0 == self->capacity)? 16 : 2 * self->capacity;
+    self->vertices = (Vertex *) realloc(self->vertices, sizeof(Vertex) * self->capacity);
+    if (NULL == self->vertices) {
+      alertAndCrash("addPhrase", "failed to realloc");
+    }
+  }
+
+  vertex = &self->vertices[self->count++];
+  vertex->phrase = string_with_size(strlen(phrase) + 1, "addPhrase");
+  strcpy(vertex->phrase, phrase);
+  vertex->inputs = init_list();
+  vertex->outputs = init_list();
+  vertex->barrier = false;
+
+  /* the files are the ones the phrase will see, variables and all. Nothing
+   * is run to find them: a substitution runs once, when its phrase does */
+  (void)lex_words(tokens, phrase, context, NULL);
+
+  if (tokens->isEmpty(tokens)) {
+    release_list(tokens);
+    return;
+  }
+
+  first = tokens->pop(tokens);
+  separator = context_separator(first);
+  message = (NULL == separator)? first : &first[separator - first + 1];
+
+  /* builtins and assignments change the shell itself */
+  vertex->barrier = (BOOL)('\0' != message[0]
+      && (BUILTIN == vash->decode(message) || is_assignment(message)));
+
+  /* a bare redirection starts with its first < or > */
+  if (is_operator(message, "<") || is_operator(message, ">")) {
+    (void)tokens->add(tokens, message);
+  }
+
+  while (!tokens->isEmpty(tokens)) {
+    char * token = tokens->pop(tokens);
+    BOOL in = is_operator(token, "<");
+    BOOL out = is_operator(token, ">");
+
+    if ((in || out) && !tokens->isEmpty(tokens)) {
+      char * file_name = tokens->pop(tokens);
+      char * path = absolute_file(cwd, file_name);
+      List * files = (in)? vertex->inputs : vertex->outputs;
+
+      (void)files->append(files, path);
+      free(path);
+      free(file_name);
+    }
+
+    free(token);
+  }
+
+  free(first);
+  release_list(tokens);
+}
+
+static int run(Dag * self_, Vash * vash) {
+  Dag * const self = self_;
+
+  int count = self->count;
+  int * waiting_on = (int *) failSafeMalloc(sizeof(int) * (count + 1), "run");
+  int * statuses = (int *) failSafeMalloc(sizeof(int) * (count + 1), "run");
+  pid_t * pids = (pid_t *) failSafeMalloc(sizeof(pid_t) * (count + 1), "run");
+  char * edges = (char *) failSafeMalloc((size_t)count * count + 1, "run");
+  BOOL * started = (BOOL *) failSafeMalloc(sizeof(BOOL) * (count + 1), "run");
+  int running = 0, finished = 0, first_unstarted = 0;
+  int earlier, later, index, exit_status = 0;
+
+  /* edges[earlier * count + later] is set if later must wait for earlier */
+  for (later = 0; later < count; later++) {
+    waiting_on[later] = 0;
+    statuses[later] = 0;
+    pids[later] = 0;
+    started[later] = false;
+
+    for (earlier = 0; earlier < later; earlier++) {
+      BOOL edge = depends(&self->vertices[earlier], &self->vertices[later]);
+
+      edges[earlier * count + later] = (char)edge;
+      if (edge) waiting_on[later]++;
+    }
+  }
+
+  /* the resolver is made on the first lookup, in memory every fork of the
+   * shell shares: made in a worker, it would be the worker's alone */
+  (void)vash->getPath(vash);
+
+  while (finished < count) {
+    int completed = -1;
+
+    /* start the earliest ready phrases, as many as there are workers */
+    for (index = first_unstarted; index < count && running < self->workers; index++) {
+      char * phrase;
+      long forked;
+
+      if (started[index] || 0 < waiting_on[index]) {
+        continue;
+      }
+
+      started[index] = true;
+      phrase = string_with_size(strlen(self->vertices[index].phrase) + 1, "run");
+      strcpy(phrase, self->vertices[index].phrase);
+
+      if (self->vertices[index].barrier) {
+        /* everything before a barrier is done, and nothing after it starts */
+        statuses[index] = vash->interpretPhrase(vash, phrase);
+        free(phrase);
+        completed = index;
+        break;
+      }
+
+      /* a worker must not repeat whatever the shell has buffered */
+      fflush(stdout);
+      fflush(stderr);
+
+      forked = now_us();
+      switch ((pids[index] = fork())) {
+        case -1 :
+          perror("fork");
+          exit(1);
+        case 0 :
+          exit(vash->interpretPhrase(vash, phrase));
+        default :
+          vash->tracer->started(vash->tracer, pids[index], "dag", phrase, forked);
+          running++;
+          free(phrase);
+      }
+    }
+
+    while (first_unstarted < count && started[first_unstarted]) {
+      first_unstarted++;
+    }
+
+    if (-1 == completed) {
+      int status;
+      /* only the workers: jobs from before the block are reaped at the prompt */
+      pid_t pid = wait_for_any(pids, count, &status);
+
+      if (-1 == pid) {
+        perror(SHELL_NAME ": dag");
+        break;
+      }
+
+      vash->tracer->reaped(vash->tracer, pid, status);
+
+      for (index = 0; index < count && -1 == completed; index++) {
+        if (pid == pids[index]) completed = index;
+      }
+
+      pids[completed] = 0; /* not to be waited for again */
+      running--;
+      statuses[completed] = (WIFEXITED(status))? WEXITSTATUS(status) : 1;
+    }
+
+    /* release everything that was waiting on the completed phrase */
+    finished++;
+    for (later = completed + 1; later < count; later++) {
+      if (edges[completed * count + later]) waiting_on[later]--;
+    }
+  }
+
+  if (0 < count) {
+    exit_status = statuses[count - 1];
+  }
+
+  free(waiting_on);
+  free(statuses);
+  free(pids);
+  free(edges);
+  free(started);
+
+  return exit_status;
+}
+
+static BOOL depends(const Vertex * earlier, const Vertex * later) {
+
+  if (earlier->barrier || later->barrier) {
+    return true;
+  }
+
+  /* read after write, write after write, write after read */
+  return (BOOL)(overlap(earlier->outputs, later->inputs)
+      || overlap(earlier->outputs, later->outputs)
+      || overlap(earlier->inputs, later->outputs));
+}
+
+static BOOL overlap(const List * left, const List * right) {
+
+  Node * outer, * inner;
+
+  for (outer = left->head; NULL != outer; outer = outer->next) {
+    for (inner = right->head; NULL != inner; inner = inner->next) {
+      if (0 == strcmp(outer->string, inner->string)) {
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+static char * absolute_file(const char * cwd, const char * file_name) {
+
+  char * path = string_with_size(strlen(cwd) + strlen(file_name) + 2, "absolute_file");
+
+  if ('/' != file_name[0]) {
+    strcat(path, cwd);
+    strcat(path, "/");
+  }
+
+  strcat(path, file_name);
+
+  return path;
+}
@@ -0,0 +1,80 @@
+/* Andre Byrne
+ * 100045589 */
+
+#ifndef DAG_H
+#define DAG_H
+
+#include "va_utils.h"
+#include "list.h"
+
+/* forward declaration: a Dag runs its phrases through Vash */
+struct Vash;
+
+/* struct Vertex
+ * one phrase of a dag block, with the files it reads (<) and writes (>)
+ * resolved against the cwd of the context it names */
+typedef struct Vertex {
+
+  char * phrase; /* the phrase as it will be interpreted */
+  List * inputs; /* absolute paths of its < files */
+  List * outputs; /* absolute paths of its > files */
+
+  /* builtins and assignments change the shell itself (cd, mk, x=1...), so
+   * they run in the shell, after everything before them and before
+   * everything after them */
+  BOOL barrier;
+
+} Vertex;
+
+/* Class Dag
+ * brief: a Dag runs the phrases of a dag block in parallel wherever their
+ * redirections say it is safe to:
+ *
+ *   $$ dag { sort a > x; sort b > y; cat x y > z; wc -l < z }
+ *
+ * A phrase depends on every earlier phrase that writes a file it reads or
+ * writes, or that reads a file it writes. Phrases that do not depend on
+ * each other run at the same time, each in its own child of the shell, on
+ * a pool of at most workers children. Phrases that do depend on each other
+ * keep the order they were written in.
+ * */
+typedef struct Dag {
+
+  Vertex * vertices;
+  int count; /* the number of vertices */
+  int capacity; /* the number of vertices allocated */
+
+  int workers; /* the most phrases that may run at once */
+
+  /* Adds a phrase to the graph, reading its declared inputs and outputs.
+   * @param self_ the calling object
+   * @param vash the shell the phrase will run in, to resolve contexts
+   * @param phrase (retained) the phrase to be added
+   * @crash YES failed to malloc
+   * */
+  void (*addPhrase)(struct Dag * self_, struct Vash * vash, const char * phrase);
+
+  /* Runs every phrase in the graph, each only after everything it depends
+   * on has finished, and waits for all of them.
+   * @param self_ the calling object
+   * @param vash the shell to interpret the phrases
+   * @crash YES failed to fork
+   * @return the exit status of the last phrase in the block
+   * */
+  int (*run)(struct Dag * self_, struct Vash * vash);
+
+} Dag;
+
+/* Allocates an empty graph.
+ * @param workers the size of the worker pool, or 0 for $VASH_JOBS, or
+ *                failing that one per processor
+ * @alloc YES the caller becomes responsible for the return value
+ * @dtor YES Dag is a Class and instances must be freed with release_dag
+ * @crash YES failed to malloc
+ * */
+Dag * init_dag(int workers);
+
+/* @dtor THIS is the destructor for Class Dag */
+void release_dag(/*@null@*/ /*@only@*/ Dag * dag);
+
+#endif
@@ -0,0 +1,354 @@
+/* Andre Byrne
+ * 100045589 */
+
+#include <limits.h>
+
+#include "each.h"
+#include "vash.h"
+
+/* Private class scope methods */
+
+/* appends every line of the given text to items, skipping empty lines */
+static void append_lines(List * items, const char * text);
+
+/* reads everything from the given stream
+ * @alloc YES the caller becomes responsible for the return value
+ * @crash YES failed to malloc
+ * @null YES if the stream could not be read
+ * */
+static /*@null@*/ char * read_stream(FILE * stream);
+
+/* returns the bytes an argument takes up in argv: its characters, its \0
+ * and the pointer to it */
+static long argument_cost(const char * argument);
+
+/* runs one batch: the words of the command, then the items of the batch,
+ * which are moved out of batch
+ * @return the exit status of the batch */
+static int run_batch(Context * context, const char * message, const char * executablePath,
+    const List * words, List * batch);
+
+/* waits for one of the given workers to finish, and forgets it
+ * @return the exit status of the worker, or 1 if there was nothing to wait on */
+static int wait_for_worker(Tracer * tracer, pid_t * workers, int * running);
+
+int run_each(Context * context, Glob * glob, List * argv, BOOL script) {
+
+  List * words = init_list(); /* the command and its arguments */
+  List * items = init_list();
+  List * batch;
+  /*@null@*/ char * source = NULL; /* the < file or << body the items are in */
+  BOOL here = false; /* is source a here-document rather than a file */
+  BOOL listed = false; /* were the items given after -- */
+  long per_batch = 0; /* 0 for as many as fit */
+  long parallel = 1;
+  long space, fixed;
+  char * message, * executablePath, * token;
+  const Node * node;
+  pid_t * workers;
+  int running = 0, exit_status = 0, status;
+
+  /* the options come first */
+  while (!argv->isEmpty(argv) && '-' == argv->head->string[0]
+      && (0 == strcmp(argv->head->string, "-n") || 0 == strcmp(argv->head->string, "-P"))) {
+    BOOL batch_size = (BOOL)('n' == argv->head->string[1]);
+    char * value, * end;
+    long number;
+
+    free(argv->pop(argv));
+    if (argv->isEmpty(argv)) {
+      break;
+    }
+
+    value = argv->pop(argv);
+    number = strtol(value, &end, 10);
+
+    if (batch_size && 0 == strcmp(value, "auto")) {
+      per_batch = 0;
+    } else if ('\0' == value[0] || '\0' != *end || 1 > number) {
+      fprintf(stderr, "%s: each: %s: not a positive number\n", SHELL_NAME, value);
+      per_batch = -1;
+    } else if (!batch_size && EACH_MAX_PARALLEL < number) {
+      fprintf(stderr, "%s: each: -P %s: at most %d at once\n", SHELL_NAME, value, EACH_MAX_PARALLEL);
+      per_batch = -1;
+    } else if (batch_size) {
+      per_batch = number;
+    } else {
+      parallel = number;
+    }
+
+    free(value);
+  }
+
+  /* then the command, up to -- or the end, less any < of its own */
+  while (!argv->isEmpty(argv) && !listed) {
+    token = argv->pop(argv);
+
+    if (0 == strcmp(token, "--")) {
+      listed = true;
+    } else if ((is_operator(token, "<") || is_operator(token, "<<") || is_operator(token, "<<<"))
+        && !argv->isEmpty(argv)) {
+      here = (BOOL)(!is_operator(token, "<"));
+      free(source);
+      source = argv->pop(argv);
+    } else {
+      (void)words->append(words, token);
+    }
+
+    free(token);
+  }
+
+  if (words->isEmpty(words) || 0 > per_batch) {
+    if (0 <= per_batch) {
+      fprintf(stderr, "%s: each: usage: each [-n auto|N] [-P N] command [args...] [-- items...]\n", SHELL_NAME);
+    }
+    free(source);
+    release_list(words);
+    release_list(items);
+    return 1;
+  }
+
+  /* the items: a pattern that matches nothing is an item as it is */
+  if (listed) {
+    while (!argv->isEmpty(argv)) {
+      struct stat info;
+      long unlimited = LONG_MAX;
+      char * path;
+
+      token = argv->pop(argv);
+      path = absolute_path(context->cwd, token);
+      if (0 == stat(path, &info) || 0 == glob->expand(glob, context->cwd, token, items, &unlimited)) {
+        (void)items->append(items, token);
+      }
+      free(path);
+      free(token);
+    }
+
+  } else if (here) {
+    append_lines(items, source);
+
+  } else if (NULL == source && STDIN_FILENO == context->stdio[STDIN_FILENO] && script) {
+    /* reading it would swallow the rest of the script */
+    fprintf(stderr, "%s: each: no items: stdin is the script, give them after -- or with <\n", SHELL_NAME);
+    exit_status = 1;
+
+  } else {
+    FILE * stream;
+    char * text;
+
+    /* stdin is the one the shell was given, not always the process's */
+    if (NULL != source) {
+      char * path = absolute_path(context->cwd, source);
+      stream = fopen(path, "r");
+      free(path);
+    } else if (STDIN_FILENO == context->stdio[STDIN_FILENO]) {
+      stream = stdin;
+    } else {
+      stream = fdopen(dup(context->stdio[STDIN_FILENO]), "r");
+    }
+
+    text = (NULL == stream)? NULL : read_stream(stream);
+
+    if (NULL == text) {
+      fprintf(stderr, "%s: each: %s: ", SHELL_NAME, (NULL == source)? "stdin" : source);
+      perror("");
+      exit_status = 1;
+    } else {
+      append_lines(items, text);
+    }
+
+    if (NULL != stream && stdin != stream) {
+      (void)fclose(stream);
+    }
+    free(text);
+  }
+
+  free(source);
+
+  message = words->pop(words);
+  executablePath = resolve_command(context, message);
+
+  if (NULL == executablePath) {
+    fprintf(stderr, "%s: %s\n", message, "command not found");
+    free(message);
+    release_list(words);
+    release_list(items);
+    return 1;
+  }
+
+  /* every batch has argv[0], the arguments and the NULL at the end */
+  fixed = argument_cost(executablePath) + (long)sizeof(char *);
+  for (node = words->head; NULL != node; node = node->next) {
+    fixed += argument_cost(node->string);
+  }
+  space = argument_space() - fixed;
+
+  workers = (pid_t *) failSafeMalloc(sizeof(pid_t) * parallel, "run_each");
+
+  while (!items->isEmpty(items)) {
+    long used = 0, count = 0;
+
+    batch = init_list();
+
+    /* as many items as fit, and always at least one */
+    while (!items->isEmpty(items) && (0 == per_batch || count < per_batch)
+        && (0 == count || used + argument_cost(items->head->string) <= space)) {
+      used += argument_cost(items->head->string);
+      token = items->pop(items);
+      (void)batch->append(batch, token);
+      free(token);
+      count++;
+    }
+
+    if (used > space) {
+      fprintf(stderr, "%s: each: %s: argument too long\n", SHELL_NAME, batch->head->string);
+      exit_status = 1;
+      release_list(batch);
+      continue;
+    }
+
+    if (1 == parallel) {
+      status = run_batch(context, message, executablePath, words, batch);
+
+    } else {
+      long forked;
+
+      /* a full pool waits for a worker before starting another */
+      if (running == parallel) {
+        status = wait_for_worker(context->tracer, workers, &running);
+        if (0 != status) exit_status = 1;
+      }
+
+      /* a worker must not repeat whatever the shell has buffered */
+      fflush(stdout);
+      fflush(stderr);
+
+      forked = now_us();
+
+      switch ((workers[running] = fork())) {
+        case -1 :
+          perror("fork");
+          exit(1);
+        case 0 :
+          exit(run_batch(context, message, executablePath, words, batch));
+        default :
+          context->tracer->started(context->tracer, workers[running], "each", message, forked);
+          running++;
+      }
+      status = 0;
+    }
+
+    if (0 != status) exit_status = 1;
+    release_list(batch);
+  }
+
+  while (0 < running) {
+    if (0 != wait_for_worker(context->tracer, workers, &running)) exit_status = 1;
+  }
+
+  free(workers);
+  free(executablePath);
+  free(message);
+  release_list(words);
+  release_list(items);
+
+  return exit_status;
+}
+
+static int run_batch(Context * context, const char * message, const char * executablePath,
+    const List * words, List * batch) {
+
+  List * argv = copy_list(words);
+  int exit_status;
+
+  if (NULL == argv) {
+    argv = init_list();
+  }
+
+  while (!batch->isEmpty(batch)) {
+    char * item = batch->pop(batch);
+    (void)argv->append(argv, item);
+    free(item);
+  }
+
+  exit_status = context->callResolved(context, message, executablePath, argv);
+  release_list(argv);
+
+  return exit_status;
+}
+
+static int wait_for_worker(Tracer * tracer, pid_t * workers, int * running) {
+
+  int status, index;
+  pid_t pid;
+
+  /* only the workers: jobs from before each are reaped at the prompt */
+  if (-1 != (pid = wait_for_any(workers, *running, &status))) {
+    tracer->reaped(tracer, pid, status);
+
+    for (index = 0; index < *running; index++) {
+      if (pid == workers[index]) {
+        workers[index] = workers[--*running];
+        return (WIFEXITED(status))? WEXITSTATUS(status) : 1;
+      }
+    }
+  }
+
+  perror(SHELL_NAME ": each");
+  *running = 0;
+
+  return 1;
+}
+
+static void append_lines(List * items, const char * text) {
+
+  const char * line = text;
+
+  while ('\0' != *line) {
+    size_t length = strcspn(line, "\n");
+
+    if (0 < length) {
+      char * item = string_with_size(length + 1, "append_lines");
+      strncat(item, line, length);
+      (void)items->append(items, item);
+      free(item);
+    }
+
+    line += length;
+    if ('\n' == *line) line++;
+  }
+}
+
+static char * read_stream(FILE * stream) {
+
+  size_t capacity = BUFSIZ, length = 0, got;
+  char * text = string_with_size(capacity + 1, "read_stream");
+
+  while (0 < (got = fread(&text[length], 1, capacity - length, stream))) {
+    length += got;
+
+    if (length == capacity) {
+      capacity *= 2;
+      text = (char *) realloc(text, capacity + 1);
+      if (NULL == text) {
+        alertAndCrash("read_stream", "failed to realloc");
+      }
+    }
+  }
+
+  if (ferror(stream)) {
+    free(text);
+    return NULL;
+  }
+
+  /* the shell reads its own input from stdin after this */
+  clearerr(stream);
+  text[length] = '\0';
+
+  return text;
+}
+
+static long argument_cost(const char * argument) {
+
+  return (long)(strlen(argument) + 1 + sizeof(char *));
+}
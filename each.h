@@ -0,0 +1,50 @@
+/* Andre Byrne
+ * 100045589 */
+
+#ifndef EACH_H
+#define EACH_H
+
+#include "va_utils.h"
+#include "list.h"
+#include "glob.h"
+
+/* -P runs at most this many batches at once */
+#define EACH_MAX_PARALLEL 256
+
+/* forward declaration: each runs its batches in a context */
+struct Context;
+
+/* Each
+ * brief: each runs a command over a list of items, passing the command as
+ * many items at a time as will fit in one argv, like xargs but without the
+ * extra process and pipe:
+ *
+ *   $$ each -n auto rm -f -- '*.o'
+ *   $$ each -n 100 -P 4 gzip < files.txt
+ *
+ * The items are the words after --, or else the lines of the < file, the
+ * here-document or here-string, or else the lines of stdin. Stdin is only
+ * read when it is not the script the shell itself is reading, so in a
+ * piped script the items must come after -- or from a < file. A word after --
+ * that names no file is a pattern, matched without the ARG_MAX limit that
+ * applies when the shell itself expands a word, so a quoted pattern may
+ * match any number of files. @see glob.h
+ *
+ * -n auto packs each batch up to ARG_MAX, and -n N passes at most N items
+ * per batch. -P N runs up to N batches at once, each in its own child of
+ * the shell, and N is at most EACH_MAX_PARALLEL.
+ * */
+
+/* Runs the command given in argv over its items in batches.
+ * @param context the context the command is run in
+ * @param glob expands the patterns after --
+ * @param argv (retained) the options, the command and its arguments, then
+ *             the items or where to read them from
+ * @param script is stdin the script the shell is reading, rather than
+ *               input each may take its items from
+ * @crash YES failed to malloc; failed to fork
+ * @return 0 if every batch succeeded, 1 otherwise
+ * */
+int run_each(struct Context * context, Glob * glob, List * argv, BOOL script);
+
+#endif
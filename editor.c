@@ -0,0 +1,565 @@
+/* Andre Byrne
+ * 100045589 */
+
+#include <limits.h>
+
+#include "editor.h"
+#include "vash.h"
+
+/* the keys the editor knows, as the terminal sends them */
+#define KEY_CTRL(letter) ((letter) & 0x1f)
+#define KEY_BACKSPACE 127
+#define KEY_ESCAPE 27
+
+/* more completions than this are counted rather than listed */
+#define EDITOR_MAX_LISTED 100
+
+/* instance methods documented in editor.h */
+static char * read_line(Editor * self_, const char * prompt);
+
+/* Private instance methods */
+
+/* puts the terminal in raw mode, remembering how it was
+ * @return false if the terminal could not be changed */
+static BOOL enter_raw(Editor * self);
+
+/* puts the terminal back the way enter_raw found it */
+static void leave_raw(Editor * self);
+
+/* draws the prompt and the line again, with the cursor in its place */
+static void redraw(const Editor * self, const char * prompt);
+
+/* replaces the line with the given text, with the cursor at its end */
+static void replace_line(Editor * self, const char * text);
+
+/* puts the given text in the line at the cursor, and the cursor after it
+ * @return false if the line would be too long */
+static BOOL insert(Editor * self, const char * text, size_t length);
+
+/* takes the given number of characters out of the line at position */
+static void erase(Editor * self, size_t position, size_t count);
+
+/* completes the word before the cursor */
+static void complete(Editor * self, const char * prompt);
+
+/* shows the line before or after the one shown, from the history
+ * @param older true for Up, false for Down */
+static void browse(Editor * self, BOOL older);
+
+/* searches back through the history as the user types, Ctrl-R
+ * @return true if the line that was found is to be run at once */
+static BOOL search(Editor * self, const char * prompt);
+
+/* reads the rest of an escape sequence and returns the key it stands for:
+ * A B C D for the arrows, H and F for Home and End, ~ for Delete, or 0 */
+static char read_escape(void);
+
+/* Private class scope methods */
+
+/* orders completions alphabetically, for qsort */
+static int compare_words(const void * left, const void * right);
+
+/* writes text to the terminal */
+static void put(const char * text);
+
+/* writes a line to the terminal, on one row: a line from the history
+ * that was typed on several has each of its newlines shown as a ; in
+ * reverse video, which takes the one column the newline does in the line */
+static void put_line(const char * text);
+
+Editor * init_editor(Vash * vash, size_t capacity) {
+
+  Editor * self = (Editor *) failSafeMalloc(sizeof(Editor), "init_editor");
+
+  self->vash = vash;
+  self->capacity = capacity;
+  self->line = string_with_size(capacity, "init_editor");
+  self->length = 0;
+  self->cursor = 0;
+  self->browsing = -1;
+  self->typed = NULL;
+
+  self->read = read_line;
+
+  return self;
+}
+
+void release_editor(Editor * editor) {
+
+  if (NULL != editor) {
+    free(editor->line);
+    free(editor->typed);
+    free(editor);
+  }
+}
+
+static char * read_line(Editor * self_, const char * prompt) {
+  Editor * const self = self_;
+
+  char * line;
+  BOOL done = false, ended = false;
+
+  self->line[0] = '\0';
+  self->length = 0;
+  self->cursor = 0;
+  self->browsing = -1;
+  free(self->typed);
+  self->typed = NULL;
+
+  if (!enter_raw(self)) {
+    return NULL;
+  }
+
+  redraw(self, prompt);
+
+  while (!done) {
+    char key;
+
+    if (1 != read(STDIN_FILENO, &key, 1)) {
+      ended = true;
+      break;
+    }
+
+    switch (key) {
+      case '\r' :
+      case '\n' :
+        done = true;
+        break;
+      case KEY_CTRL('d') :
+        if (0 == self->length) {
+          ended = true;
+          done = true;
+        } else {
+          erase(self, self->cursor, 1);
+        }
+        break;
+      case KEY_CTRL('c') :
+        /* the line is thrown away, and the user starts again */
+        put("^C\r\n");
+        self->line[0] = '\0';
+        self->length = 0;
+        self->cursor = 0;
+        break;
+      case KEY_BACKSPACE :
+      case KEY_CTRL('h') :
+        if (0 < self->cursor) {
+          erase(self, self->cursor - 1, 1);
+          self->cursor--;
+        }
+        break;
+      case KEY_CTRL('a') :
+        self->cursor = 0;
+        break;
+      case KEY_CTRL('e') :
+        self->cursor = self->length;
+        break;
+      case KEY_CTRL('u') :
+        erase(self, 0, self->cursor);
+        self->cursor = 0;
+        break;
+      case KEY_CTRL('k') :
+        erase(self, self->cursor, self->length - self->cursor);
+        break;
+      case KEY_CTRL('l') :
+        put("\x1b[H\x1b[2J");
+        break;
+      case KEY_CTRL('p') :
+        browse(self, true);
+        break;
+      case KEY_CTRL('n') :
+        browse(self, false);
+        break;
+      case KEY_CTRL('r') :
+        done = search(self, prompt);
+        break;
+      case '\t' :
+        complete(self, prompt);
+        break;
+      case KEY_ESCAPE :
+        switch (read_escape()) {
+          case 'A' : browse(self, true); break;
+          case 'B' : browse(self, false); break;
+          case 'C' : if (self->cursor < self->length) self->cursor++; break;
+          case 'D' : if (0 < self->cursor) self->cursor--; break;
+          case 'H' : self->cursor = 0; break;
+          case 'F' : self->cursor = self->length; break;
+          case '~' : erase(self, self->cursor, 1); break;
+          default : break;
+        }
+        break;
+      default :
+        if (' ' <= (unsigned char)key && !insert(self, &key, 1)) {
+          put("\a");
+        }
+        break;
+    }
+
+    if (!done) {
+      redraw(self, prompt);
+    }
+  }
+
+  put("\r\n");
+  leave_raw(self);
+
+  if (ended && 0 == self->length) {
+    return NULL;
+  }
+
+  line = string_with_size(self->length + 1, "read_line");
+  strcpy(line, self->line);
+
+  return line;
+}
+
+static BOOL enter_raw(Editor * self) {
+
+  struct termios raw;
+
+  if (-1 == tcgetattr(STDIN_FILENO, &self->cooked)) {
+    return false;
+  }
+
+  /* keys one at a time, unechoed, and ^C as a key rather than a signal */
+  raw = self->cooked;
+  raw.c_iflag &= ~(ICRNL | IXON | BRKINT | INPCK | ISTRIP);
+  raw.c_lflag &= ~(ECHO | ICANON | ISIG | IEXTEN);
+  raw.c_cc[VMIN] = 1;
+  raw.c_cc[VTIME] = 0;
+
+  return (BOOL)(-1 != tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw));
+}
+
+static void leave_raw(Editor * self) {
+
+  (void)tcsetattr(STDIN_FILENO, TCSAFLUSH, &self->cooked);
+}
+
+static void redraw(const Editor * self, const char * prompt) {
+
+  char back[3 * sizeof(size_t) + 8];
+
+  put("\r");
+  put(prompt);
+  put_line(self->line);
+  put("\x1b[K");
+
+  if (self->cursor < self->length) {
+    sprintf(back, "\x1b[%luD", (unsigned long)(self->length - self->cursor));
+    put(back);
+  }
+}
+
+static void replace_line(Editor * self, const char * text) {
+
+  self->line[0] = '\0';
+  self->length = 0;
+  self->cursor = 0;
+  (void)insert(self, text, strlen(text));
+}
+
+static BOOL insert(Editor * self, const char * text, size_t length) {
+
+  if (self->length + length >= self->capacity) {
+    return false;
+  }
+
+  memmove(&self->line[self->cursor + length], &self->line[self->cursor], self->length - self->cursor + 1);
+  memcpy(&self->line[self->cursor], text, length);
+  self->length += length;
+  self->cursor += length;
+
+  return true;
+}
+
+static void erase(Editor * self, size_t position, size_t count) {
+
+  if (position + count > self->length) {
+    count = self->length - position;
+  }
+
+  memmove(&self->line[position], &self->line[position + count], self->length - position - count + 1);
+  self->length -= count;
+}
+
+static void complete(Editor * self, const char * prompt) {
+
+  List * matches = init_list();
+  char ** words;
+  char * before;
+  size_t start = self->cursor, typed, common;
+  int count, unique, index;
+
+  while (0 < start && NULL == strchr(" \t;&|<>(", self->line[start - 1])) {
+    start--;
+  }
+  typed = self->cursor - start;
+
+  /* the shell only needs the line up to the cursor */
+  before = string_with_size(self->cursor + 1, "complete");
+  strncat(before, self->line, self->cursor);
+  self->vash->completeWord(self->vash, before, start, matches);
+  free(before);
+
+  unique = matches->count(matches);
+  words = (char **) failSafeMalloc(sizeof(char *) * (unique + 1), "complete");
+  for (index = 0; index < unique; index++) {
+    words[index] = matches->pop(matches);
+  }
+  release_list(matches);
+
+  /* the builtins and contexts come before the commands: sort them in, and
+   * a command in two directories of the PATH is listed once */
+  qsort(words, (size_t)unique, sizeof(char *), compare_words);
+  for (count = 0, index = 0; index < unique; index++) {
+    if (0 < count && 0 == strcmp(words[count - 1], words[index])) {
+      free(words[index]);
+    } else {
+      words[count++] = words[index];
+    }
+  }
+
+  if (0 == count) {
+    put("\a");
+    free(words);
+    return;
+  }
+
+  /* as much as every match has in common */
+  common = strlen(words[0]);
+  for (index = 1; index < count; index++) {
+    size_t same = 0;
+    while (same < common && words[0][same] == words[index][same]) same++;
+    common = same;
+  }
+
+  if (common > typed) {
+    if (!insert(self, &words[0][typed], common - typed)) {
+      put("\a");
+    }
+  }
+
+  if (1 == count) {
+    char last = words[0][strlen(words[0]) - 1];
+
+    /* a finished word is followed by a space, a directory or context is not */
+    if ('/' != last && ':' != last) {
+      (void)insert(self, " ", 1);
+    }
+
+  } else if (common <= typed) {
+    put("\r\n");
+
+    if (EDITOR_MAX_LISTED < count) {
+      char message[3 * sizeof(int) + 32];
+      sprintf(message, "%d possibilities\r\n", count);
+      put(message);
+    } else {
+      size_t width = 0;
+
+      for (index = 0; index < count; index++) {
+        if (0 < width && 80 < width + strlen(words[index]) + 2) {
+          put("\r\n");
+          width = 0;
+        }
+        put(words[index]);
+        put("  ");
+        width += strlen(words[index]) + 2;
+      }
+      put("\r\n");
+    }
+
+    redraw(self, prompt);
+  }
+
+  for (index = 0; index < count; index++) {
+    free(words[index]);
+  }
+  free(words);
+}
+
+static void browse(Editor * self, BOOL older) {
+
+  History * history = self->vash->getHistory(self->vash);
+  long entry;
+  char * line;
+
+  if (older) {
+    entry = history->search(history, "", (-1 == self->browsing)? LONG_MAX : self->browsing);
+    if (-1 == entry) {
+      put("\a");
+      return;
+    }
+
+    /* what was being typed comes back after the newest entry */
+    if (-1 == self->browsing) {
+      self->typed = string_with_size(self->length + 1, "browse");
+      strcpy(self->typed, self->line);
+    }
+
+  } else {
+    if (-1 == self->browsing) {
+      return;
+    }
+
+    entry = (self->browsing + 1 < history->count)? self->browsing + 1 : -1;
+  }
+
+  self->browsing = entry;
+
+  if (-1 == entry) {
+    replace_line(self, (NULL == self->typed)? "" : self->typed);
+    free(self->typed);
+    self->typed = NULL;
+  } else {
+    line = history->line(history, entry);
+    replace_line(self, line);
+    free(line);
+  }
+}
+
+static BOOL search(Editor * self, const char * prompt) {
+
+  History * history = self->vash->getHistory(self->vash);
+  char * query = string_with_size(self->capacity, "search");
+  char * found = NULL;
+  size_t length = 0;
+  long entry = -1;
+  BOOL run = false, searching = true;
+
+  while (searching) {
+    char key;
+
+    put("\r(reverse-i-search)`");
+    put(query);
+    put("': ");
+    put_line((NULL == found)? "" : found);
+    put("\x1b[K");
+
+    if (1 != read(STDIN_FILENO, &key, 1)) {
+      break;
+    }
+
+    switch (key) {
+      case KEY_CTRL('r') :
+        /* the match before this one */
+        if (-1 != entry && 0 < length) {
+          long older = history->search(history, query, entry);
+          if (-1 == older) {
+            put("\a");
+          } else {
+            entry = older;
+          }
+        }
+        break;
+      case KEY_BACKSPACE :
+      case KEY_CTRL('h') :
+        if (0 < length) {
+          query[--length] = '\0';
+          entry = (0 == length)? -1 : history->search(history, query, LONG_MAX);
+        }
+        break;
+      case KEY_CTRL('g') :
+      case KEY_CTRL('c') :
+        /* the line is left as it was */
+        free(found);
+        found = NULL;
+        searching = false;
+        break;
+      case '\r' :
+      case '\n' :
+        run = (BOOL)(NULL != found);
+        searching = false;
+        break;
+      default :
+        if (' ' <= (unsigned char)key && length + 1 < self->capacity) {
+          query[length++] = key;
+          query[length] = '\0';
+          entry = history->search(history, query, LONG_MAX);
+        } else {
+          /* any other key leaves the match to be edited */
+          if (KEY_ESCAPE == key) (void)read_escape();
+          searching = false;
+        }
+        break;
+    }
+
+    if (searching) {
+      free(found);
+      found = (-1 == entry)? NULL : history->line(history, entry);
+    }
+  }
+
+  if (NULL != found) {
+    replace_line(self, found);
+    free(found);
+  }
+
+  free(query);
+
+  put("\r\x1b[K");
+  redraw(self, prompt);
+
+  return run;
+}
+
+static char read_escape(void) {
+
+  char sequence[3];
+
+  if (1 != read(STDIN_FILENO, &sequence[0], 1) || 1 != read(STDIN_FILENO, &sequence[1], 1)) {
+    return 0;
+  }
+
+  if ('[' != sequence[0] && 'O' != sequence[0]) {
+    return 0;
+  }
+
+  /* Delete, Home and End may come as ESC [ 3 ~, ESC [ 1 ~ and ESC [ 4 ~ */
+  if ('0' <= sequence[1] && '9' >= sequence[1]) {
+    if (1 != read(STDIN_FILENO, &sequence[2], 1) || '~' != sequence[2]) {
+      return 0;
+    }
+    switch (sequence[1]) {
+      case '3' : return '~';
+      case '1' : case '7' : return 'H';
+      case '4' : case '8' : return 'F';
+      default : return 0;
+    }
+  }
+
+  return sequence[1];
+}
+
+static int compare_words(const void * left, const void * right) {
+
+  return strcmp(*(char * const *)left, *(char * const *)right);
+}
+
+static void put(const char * text) {
+
+  size_t length = strlen(text);
+
+  if ((ssize_t)length != write(STDOUT_FILENO, text, length)) {
+    /* a terminal that will not take the line cannot be helped */
+  }
+}
+
+static void put_line(const char * text) {
+
+  size_t length;
+
+  while ('\0' != *text) {
+    length = strcspn(text, "\n");
+
+    if ((ssize_t)length != write(STDOUT_FILENO, text, length)) {
+      return; /* as put */
+    }
+
+    text = &text[length];
+    if ('\n' == *text) {
+      put("\x1b[7m;\x1b[27m");
+      text++;
+    }
+  }
+}
@@ -0,0 +1,70 @@
+/* Andre Byrne
+ * 100045589 */
+
+#ifndef EDITOR_H
+#define EDITOR_H
+
+#include <termios.h>
+
+#include "va_utils.h"
+#include "list.h"
+
+/* forward declaration: the editor asks its Vash what a word completes to */
+struct Vash;
+
+/* Class Editor
+ * brief: when the shell reads from a terminal, the Editor reads each line
+ * a key at a time, with the terminal in raw mode, so that the line can be
+ * edited as it is typed:
+ *
+ *   Tab        completes the word before the cursor: a command, builtin or
+ *              context: where a command goes, a path anywhere else. As
+ *              far as it can, and then it lists what the word could be
+ *   Up, Down   go back and forward through the history
+ *   Ctrl-R     searches back through the history for what is typed next;
+ *              Ctrl-R again finds the match before, Enter runs the match
+ *              and any other key edits it
+ *   Left, Right, Home, End, Ctrl-A, Ctrl-E  move the cursor
+ *   Backspace, Delete, Ctrl-U, Ctrl-K  delete before or after the cursor
+ *   Ctrl-C     throws the line away
+ *   Ctrl-D     on an empty line ends the session
+ *
+ * The terminal is put back the way it was before the line is returned, so
+ * that whatever runs the line sees the terminal it expects.
+ * */
+typedef struct Editor {
+
+  struct Vash * vash;
+  struct termios cooked; /* the terminal as it was before the line */
+
+  char * line; /* the line being edited, \0 terminated */
+  size_t length, cursor, capacity;
+
+  long browsing; /* the history entry shown by Up and Down, or -1 */
+  /*@null@*/ char * typed; /* the line as it was before Up was pressed */
+
+  /* reads a line from the terminal
+   * @param self_ the calling object
+   * @param prompt the prompt, which is drawn again whenever the line is
+   * @alloc YES the caller becomes responsible for the return value
+   * @null YES at the end of the input
+   * @crash YES failed to malloc
+   * @return the line, without a newline
+   * */
+  /*@null@*/ char * (*read)(struct Editor * self_, const char * prompt);
+
+} Editor;
+
+/* Makes an editor for the given shell's terminal.
+ * @param vash (retained) completes words, and has the history
+ * @param capacity the longest line that can be typed, with its \0
+ * @alloc YES the caller becomes responsible for the return value
+ * @dtor YES Editor is a Class and instances must be freed with release_editor
+ * @crash YES failed to malloc
+ * */
+Editor * init_editor(struct Vash * vash, size_t capacity);
+
+/* @dtor THIS is the destructor for Class Editor */
+void release_editor(/*@null@*/ /*@only@*/ Editor * editor);
+
+#endif
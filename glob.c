@@ -0,0 +1,681 @@
+/* Andre Byrne
+ * 100045589 */
+
+#define _GNU_SOURCE /* getdents64, st_mtim */
+
+#include <dirent.h>
+
+#include "glob.h"
+
+extern char ** environ;
+
+/* struct Listing
+ * the entries of one directory, kept with what the directory looked like
+ * when it was read, so that a change to it can be noticed */
+struct Listing {
+
+  char * path; /* the absolute path of the directory */
+
+  dev_t device;
+  ino_t inode;
+  struct timespec modified;
+
+  char * arena; /* every name, one after another, each with its \0 */
+  size_t * names; /* where each name starts in the arena */
+  unsigned char * types; /* the d_type of each name */
+  int count;
+
+  /*@null@*/ struct Listing * next;
+
+};
+
+/* struct Matches
+ * the paths a pattern has matched so far */
+typedef struct Matches {
+
+  char ** paths;
+  int count;
+  int capacity;
+
+  long budget; /* the bytes of argv still free */
+  BOOL overflow; /* set once the budget ran out */
+
+} Matches;
+
+/* instance methods documented in glob.h */
+static int expand(Glob * self_, const char * cwd, const char * pattern, List * matches, long * budget);
+static void forget(Glob * self_);
+
+/* Private class scope methods */
+
+/* returns true if the component has a *, ? or [ that is not escaped */
+static BOOL has_magic(const char * component);
+
+/* returns the component with its escapes removed
+ * @alloc YES the caller becomes responsible for the return value */
+static char * unescape(const char * component);
+
+/* returns true if the whole of name matches the pattern */
+static BOOL match(const char * pattern, const char * name);
+
+/* matches a single character against the next element of the pattern: a
+ * plain or escaped character, a ? or a [...]. If it matches, the pattern
+ * is moved past the element. */
+static BOOL match_one(const char ** pattern, char character);
+
+/* returns prefix followed by name and then suffix
+ * @alloc YES the caller becomes responsible for the return value */
+static char * join(const char * prefix, const char * name, const char * suffix);
+
+/* returns the absolute path of a path relative to cwd
+ * @alloc YES the caller becomes responsible for the return value */
+static char * absolute(const char * cwd, const char * path);
+
+/* reads every entry of the directory at path with getdents64
+ * @null YES if the directory could not be opened */
+static /*@null@*/ struct Listing * read_listing(const char * path, const struct stat * info);
+
+/* @dtor THIS is the destructor for struct Listing */
+static void release_listing(/*@null@*/ /*@only@*/ struct Listing * listing);
+
+/* appends the path to the matches, unless it would go over the budget */
+static void add_match(Matches * matches, const char * path);
+
+/* sorts strings in place with a multikey quicksort, comparing a single
+ * character of each string at a time, starting from depth */
+static void sort_paths(char ** paths, int count, size_t depth);
+
+/* Private instance scope methods */
+
+/* returns the entries of the directory at prefix, relative to cwd, read
+ * now if they were never read or the directory has changed since
+ * @null YES if the directory could not be read */
+static /*@null@*/ const struct Listing * list_directory(Glob * self, const char * cwd, const char * prefix);
+
+/* returns true if the given entry of the listing is a directory. Symbolic
+ * links are followed only if follow is set */
+static BOOL is_directory(const struct Listing * listing, int entry, BOOL follow);
+
+/* matches components[index] onwards below prefix, which ends with a / or
+ * is empty. verified is set if prefix is known to exist */
+static void walk(Glob * self, const char * cwd, char ** components, int index, int count,
+    const char * prefix, BOOL verified, Matches * matches);
+
+/* matches a ** component: no directories at all, or any below prefix */
+static void walk_tree(Glob * self, const char * cwd, char ** components, int index, int count,
+    const char * prefix, BOOL verified, Matches * matches);
+
+Glob * init_glob(void) {
+
+  Glob * self = (Glob *) failSafeMalloc(sizeof(Glob), "init_glob");
+
+  self->listings = NULL;
+
+  self->expand = expand;
+  self->forget = forget;
+
+  return self;
+}
+
+void release_glob(Glob * glob) {
+
+  if (NULL != glob) {
+    glob->forget(glob);
+    free(glob);
+  }
+}
+
+long argument_space(void) {
+
+  long space = sysconf(_SC_ARG_MAX);
+  char ** variable;
+
+  if (0 >= space) {
+    space = 4096; /* _POSIX_ARG_MAX */
+  }
+
+  /* the environment goes on the same stack as the arguments */
+  for (variable = environ; NULL != *variable; variable++) {
+    space -= (long)(strlen(*variable) + 1 + sizeof(char *));
+  }
+
+  return space - 2048;
+}
+
+static int expand(Glob * self_, const char * cwd, const char * pattern, List * matches, long * budget) {
+  Glob * const self = self_;
+
+  char * copy = string_with_size(strlen(pattern) + 1, "expand");
+  char ** components = (char **) failSafeMalloc(sizeof(char *) * (strlen(pattern) + 1), "expand");
+  char * cursor = copy, * slash;
+  int count = 0, index;
+  Matches found;
+
+  strcpy(copy, pattern);
+
+  found.paths = NULL;
+  found.count = 0;
+  found.capacity = 0;
+  found.budget = *budget;
+  found.overflow = false;
+
+  /* a/b/c is three components; /a has an empty one first */
+  while (NULL != (slash = strchr(cursor, '/'))) {
+    *slash = '\0';
+    components[count++] = cursor;
+    cursor = &slash[1];
+  }
+  components[count++] = cursor;
+
+  if ('/' == pattern[0]) {
+    walk(self, cwd, components, 1, count, "/", true, &found);
+  } else {
+    walk(self, cwd, components, 0, count, "", true, &found);
+  }
+
+  /* all of the matches or none of them */
+  if (!found.overflow) {
+    sort_paths(found.paths, found.count, 0);
+    for (index = 0; index < found.count; index++) {
+      (void)matches->append(matches, found.paths[index]);
+    }
+    *budget = found.budget;
+  }
+
+  for (index = 0; index < found.count; index++) {
+    free(found.paths[index]);
+  }
+
+  free(found.paths);
+  free(components);
+  free(copy);
+
+  return (found.overflow)? -1 : found.count;
+}
+
+static void forget(Glob * self_) {
+  Glob * const self = self_;
+
+  while (NULL != self->listings) {
+    struct Listing * next = self->listings->next;
+
+    release_listing(self->listings);
+    self->listings = next;
+  }
+}
+
+static void walk(Glob * self, const char * cwd, char ** components, int index, int count,
+    const char * prefix, BOOL verified, Matches * matches) {
+
+  const struct Listing * listing;
+  const char * component;
+  int entry;
+
+  if (matches->overflow) {
+    return;
+  }
+
+  if (index == count) {
+    char * path = absolute(cwd, prefix);
+    struct stat info;
+
+    /* plain components were never looked for, so look now */
+    if ('\0' != prefix[0] && (verified || 0 == lstat(path, &info))) {
+      add_match(matches, prefix);
+    }
+
+    free(path);
+    return;
+  }
+
+  component = components[index];
+
+  /* a//b is a/b, and a/ is a directory */
+  if ('\0' == component[0]) {
+    walk(self, cwd, components, index + 1, count, prefix, verified, matches);
+    return;
+  }
+
+  if (0 == strcmp(component, "**")) {
+    walk_tree(self, cwd, components, index, count, prefix, verified, matches);
+    return;
+  }
+
+  if (!has_magic(component)) {
+    char * plain = unescape(component);
+    char * path = join(prefix, plain, (index + 1 < count)? "/" : "");
+
+    walk(self, cwd, components, index + 1, count, path, false, matches);
+
+    free(path);
+    free(plain);
+    return;
+  }
+
+  if (NULL == (listing = list_directory(self, cwd, prefix))) {
+    return;
+  }
+
+  for (entry = 0; entry < listing->count && !matches->overflow; entry++) {
+    const char * name = &listing->arena[listing->names[entry]];
+
+    /* hidden files must be asked for */
+    if ('.' == name[0] && '.' != component[0]) {
+      continue;
+    }
+
+    if (!match(component, name)) {
+      continue;
+    }
+
+    if (index + 1 == count) {
+      char * path = join(prefix, name, "");
+      add_match(matches, path);
+      free(path);
+
+    } else if (is_directory(listing, entry, true)) {
+      char * path = join(prefix, name, "/");
+      walk(self, cwd, components, index + 1, count, path, true, matches);
+      free(path);
+    }
+  }
+}
+
+static void walk_tree(Glob * self, const char * cwd, char ** components, int index, int count,
+    const char * prefix, BOOL verified, Matches * matches) {
+
+  const struct Listing * listing;
+  BOOL last = (BOOL)(index + 1 == count);
+  int entry;
+
+  /* ** at the end matches everything below, otherwise it may be nothing */
+  if (!last) {
+    walk(self, cwd, components, index + 1, count, prefix, verified, matches);
+  }
+
+  if (NULL == (listing = list_directory(self, cwd, prefix))) {
+    return;
+  }
+
+  for (entry = 0; entry < listing->count && !matches->overflow; entry++) {
+    const char * name = &listing->arena[listing->names[entry]];
+
+    if ('.' == name[0]) {
+      continue;
+    }
+
+    if (last) {
+      char * path = join(prefix, name, "");
+      add_match(matches, path);
+      free(path);
+    }
+
+    /* links are not followed down, so a tree never loops */
+    if (is_directory(listing, entry, false)) {
+      char * path = join(prefix, name, "/");
+      walk_tree(self, cwd, components, index, count, path, true, matches);
+      free(path);
+    }
+  }
+}
+
+static const struct Listing * list_directory(Glob * self, const char * cwd, const char * prefix) {
+
+  char * path = absolute(cwd, prefix);
+  struct Listing * listing, * previous = NULL;
+  struct stat info;
+  size_t length = strlen(path);
+
+  /* the listing is kept under the name of the directory, without its / */
+  if (1 < length && '/' == path[length - 1]) {
+    path[length - 1] = '\0';
+  }
+
+  if (-1 == stat(path, &info) || !S_ISDIR(info.st_mode)) {
+    free(path);
+    return NULL;
+  }
+
+  for (listing = self->listings; NULL != listing; previous = listing, listing = listing->next) {
+    if (0 == strcmp(listing->path, path)) {
+      break;
+    }
+  }
+
+  /* a listing is good for as long as its directory is unchanged */
+  if (NULL != listing && listing->device == info.st_dev && listing->inode == info.st_ino
+      && listing->modified.tv_sec == info.st_mtim.tv_sec
+      && listing->modified.tv_nsec == info.st_mtim.tv_nsec) {
+    free(path);
+    return listing;
+  }
+
+  if (NULL != listing) {
+    if (NULL == previous) {
+      self->listings = listing->next;
+    } else {
+      previous->next = listing->next;
+    }
+    release_listing(listing);
+  }
+
+  if (NULL != (listing = read_listing(path, &info))) {
+    listing->next = self->listings;
+    self->listings = listing;
+  }
+
+  free(path);
+
+  return listing;
+}
+
+static struct Listing * read_listing(const char * path, const struct stat * info) {
+
+  struct Listing * listing;
+  char * buffer;
+  size_t used = 0, arena_size = GLOB_BUFFER;
+  int capacity = 256;
+  ssize_t length;
+  int fd = open(path, O_RDONLY | O_DIRECTORY);
+
+  if (-1 == fd) {
+    return NULL;
+  }
+
+  listing = (struct Listing *) failSafeMalloc(sizeof(struct Listing), "read_listing");
+  listing->path = string_with_size(strlen(path) + 1, "read_listing");
+  strcpy(listing->path, path);
+  listing->device = info->st_dev;
+  listing->inode = info->st_ino;
+  listing->modified = info->st_mtim;
+  listing->arena = (char *) failSafeMalloc(arena_size, "read_listing");
+  listing->names = (size_t *) failSafeMalloc(sizeof(size_t) * capacity, "read_listing");
+  listing->types = (unsigned char *) failSafeMalloc(capacity, "read_listing");
+  listing->count = 0;
+  listing->next = NULL;
+
+  buffer = (char *) failSafeMalloc(GLOB_BUFFER, "read_listing");
+
+  /* each call fills the buffer with as many entries as fit */
+  while (0 < (length = getdents64(fd, buffer, GLOB_BUFFER))) {
+    ssize_t offset = 0;
+
+    while (offset < length) {
+      struct dirent64 * entry = (struct dirent64 *) &buffer[offset];
+      size_t size = strlen(entry->d_name) + 1;
+
+      offset += entry->d_reclen;
+
+      if (0 == strcmp(entry->d_name, ".") || 0 == strcmp(entry->d_name, "..")) {
+        continue;
+      }
+
+      if (used + size > arena_size) {
+        arena_size = 2 * (used + size);
+        listing->arena = (char *) realloc(listing->arena, arena_size);
+      }
+
+      if (listing->count == capacity) {
+        capacity *= 2;
+        listing->names = (size_t *) realloc(listing->names, sizeof(size_t) * capacity);
+        listing->types = (unsigned char *) realloc(listing->types, capacity);
+      }
+
+      if (NULL == listing->arena || NULL == listing->names || NULL == listing->types) {
+        alertAndCrash("read_listing", "failed to realloc");
+      }
+
+      memcpy(&listing->arena[used], entry->d_name, size);
+      listing->names[listing->count] = used;
+      listing->types[listing->count] = entry->d_type;
+      listing->count++;
+      used += size;
+    }
+  }
+
+  free(buffer);
+  close(fd);
+
+  return listing;
+}
+
+static void release_listing(struct Listing * listing) {
+
+  if (NULL != listing) {
+    free(listing->path);
+    free(listing->arena);
+    free(listing->names);
+    free(listing->types);
+    free(listing);
+  }
+}
+
+static BOOL is_directory(const struct Listing * listing, int entry, BOOL follow) {
+
+  unsigned char type = listing->types[entry];
+  struct stat info;
+  char * path;
+  int result;
+
+  if (DT_DIR == type) {
+    return true;
+  }
+
+  /* only some file systems say what their entries are */
+  if (DT_UNKNOWN != type && (DT_LNK != type || !follow)) {
+    return false;
+  }
+
+  path = join(listing->path, "/", &listing->arena[listing->names[entry]]);
+  result = (follow)? stat(path, &info) : lstat(path, &info);
+  free(path);
+
+  return (BOOL)(0 == result && S_ISDIR(info.st_mode));
+}
+
+static void add_match(Matches * matches, const char * path) {
+
+  long cost = (long)(strlen(path) + 1 + sizeof(char *));
+
+  if (cost > matches->budget) {
+    matches->overflow = true;
+    return;
+  }
+
+  matches->budget -= cost;
+
+  if (matches->count == matches->capacity) {
+    matches->capacity = (0 == matches->capacity)? 64 : 2 * matches->capacity;
+    matches->paths = (char **) realloc(matches->paths, sizeof(char *) * matches->capacity);
+    if (NULL == matches->paths) {
+      alertAndCrash("add_match", "failed to realloc");
+    }
+  }
+
+  matches->paths[matches->count] = string_with_size(strlen(path) + 1, "add_match");
+  strcpy(matches->paths[matches->count], path);
+  matches->count++;
+}
+
+static void sort_paths(char ** paths, int count, size_t depth) {
+
+  while (1 < count) {
+    int less = 0, greater = count - 1, index = 1;
+    int pivot;
+    char * swap;
+
+    /* the middle string is a better guess than the first at the median */
+    swap = paths[0];
+    paths[0] = paths[count / 2];
+    paths[count / 2] = swap;
+    pivot = (unsigned char)paths[0][depth];
+
+    /* less than the pivot to the front, greater to the back */
+    while (index <= greater) {
+      int character = (unsigned char)paths[index][depth];
+
+      if (character < pivot) {
+        swap = paths[less];
+        paths[less++] = paths[index];
+        paths[index++] = swap;
+      } else if (character > pivot) {
+        swap = paths[greater];
+        paths[greater--] = paths[index];
+        paths[index] = swap;
+      } else {
+        index++;
+      }
+    }
+
+    sort_paths(paths, less, depth);
+
+    /* those equal to the pivot only differ further along, if at all */
+    if (0 != pivot) {
+      sort_paths(&paths[less], greater - less + 1, depth + 1);
+    }
+
+    paths = &paths[greater + 1];
+    count = count - greater - 1;
+  }
+}
+
+static BOOL has_magic(const char * component) {
+
+  for (; '\0' != *component; component++) {
+    if ('\\' == *component && '\0' != component[1]) {
+      component++;
+    } else if ('*' == *component || '?' == *component || '[' == *component) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static char * unescape(const char * component) {
+
+  char * plain = string_with_size(strlen(component) + 1, "unescape");
+  char * cursor = plain;
+
+  for (; '\0' != *component; component++) {
+    if ('\\' == *component && '\0' != component[1]) {
+      component++;
+    }
+    *cursor++ = *component;
+  }
+
+  *cursor = '\0';
+
+  return plain;
+}
+
+static BOOL match(const char * pattern, const char * name) {
+
+  /* where to go back to if what follows the last * stops matching */
+  const char * star_pattern = NULL, * star_name = NULL;
+
+  while ('\0' != *name) {
+    if ('*' == *pattern) {
+      star_pattern = ++pattern;
+      star_name = name;
+    } else if (match_one(&pattern, *name)) {
+      name++;
+    } else if (NULL != star_pattern) {
+      pattern = star_pattern;
+      name = ++star_name;
+    } else {
+      return false;
+    }
+  }
+
+  while ('*' == *pattern) {
+    pattern++;
+  }
+
+  return (BOOL)('\0' == *pattern);
+}
+
+static BOOL match_one(const char ** pattern, char character) {
+
+  const char * element = *pattern;
+
+  if ('\0' == element[0]) {
+    return false;
+  }
+
+  if ('?' == element[0]) {
+    *pattern = &element[1];
+    return true;
+  }
+
+  if ('\\' == element[0] && '\0' != element[1]) {
+    if (element[1] == character) {
+      *pattern = &element[2];
+      return true;
+    }
+    return false;
+  }
+
+  if ('[' == element[0]) {
+    const char * cursor = &element[1], * first;
+    BOOL negate = false, found = false;
+
+    if ('!' == *cursor || '^' == *cursor) {
+      negate = true;
+      cursor++;
+    }
+
+    /* a ] straight after the [ is just a ] */
+    for (first = cursor; '\0' != *cursor && (']' != *cursor || cursor == first); cursor++) {
+      unsigned char low = (unsigned char)*cursor, high;
+
+      if ('\\' == low && '\0' != cursor[1]) {
+        low = (unsigned char)*++cursor;
+      }
+
+      high = low;
+      if ('-' == cursor[1] && ']' != cursor[2] && '\0' != cursor[2]) {
+        high = (unsigned char)cursor[2];
+        cursor += 2;
+      }
+
+      if (low <= (unsigned char)character && (unsigned char)character <= high) {
+        found = true;
+      }
+    }
+
+    if (']' == *cursor) {
+      *pattern = &cursor[1];
+      return (BOOL)(found != negate);
+    }
+
+    /* with no ] to close it, [ is just a [ */
+  }
+
+  if (element[0] == character) {
+    *pattern = &element[1];
+    return true;
+  }
+
+  return false;
+}
+
+static char * join(const char * prefix, const char * name, const char * suffix) {
+
+  char * path = string_with_size(strlen(prefix) + strlen(name) + strlen(suffix) + 1, "join");
+
+  strcat(path, prefix);
+  strcat(path, name);
+  strcat(path, suffix);
+
+  return path;
+}
+
+static char * absolute(const char * cwd, const char * path) {
+
+  if ('/' == path[0]) {
+    return join(path, "", "");
+  }
+
+  return join(cwd, ('\0' == path[0])? "" : "/", path);
+}
@@ -0,0 +1,75 @@
+/* Andre Byrne
+ * 100045589 */
+
+#ifndef GLOB_H
+#define GLOB_H
+
+#include "va_utils.h"
+#include "list.h"
+
+/* how much of a directory is read with each call to getdents64 */
+#define GLOB_BUFFER (64 * 1024)
+
+/* struct Listing
+ * the names in a directory, as read by getdents64. @see glob.c */
+struct Listing;
+
+/* Class Glob
+ * brief: a Glob expands the patterns in the words of a phrase into the
+ * names of the files they match, relative to the cwd of its context:
+ *
+ *   $$ wc -l *.c
+ *   $$ ls src/[a-m]?.h
+ *   $$ grep -l TODO **
+ *
+ * * matches any run of characters, ? any single character, and [...] any
+ * character in the brackets ([!...] any character not in them). A
+ * component that is ** on its own matches any number of directories,
+ * including none. Names that start with a . are only matched by a pattern
+ * that starts with a . too. A pattern that matches nothing is left as it
+ * is, and every expansion is sorted.
+ *
+ * Directories are read once for as long as the Glob remembers them, which
+ * is until forget is called, and only read again if they change. The
+ * shell calls forget before every line it runs.
+ * */
+typedef struct Glob {
+
+  /*@null@*/ struct Listing * listings; /* every directory remembered */
+
+  /* Appends every path matching the given pattern to matches, sorted.
+   * @param self_ the calling object
+   * @param cwd the directory that relative patterns are relative to
+   * @param pattern the pattern, in which \ makes the next character plain
+   * @param matches the list to append the paths to
+   * @param budget the number of bytes that argv may still take up, which
+   *               is reduced by the size of every match
+   * @crash YES failed to malloc
+   * @return the number of paths appended, or -1 if the matches would not
+   *         fit in the budget, in which case none are appended
+   * */
+  int (*expand)(struct Glob * self_, const char * cwd, const char * pattern, List * matches, long * budget);
+
+  /* forgets every directory that was read, so that they are read again
+   * @param self_ the calling object */
+  void (*forget)(struct Glob * self_);
+
+} Glob;
+
+/* returns the number of bytes that the arguments of a command may take up:
+ * ARG_MAX, less the environment every command inherits and some room for
+ * the loader to work with. Every argument costs its length, plus one for
+ * its \0, plus the size of the pointer to it. */
+long argument_space(void);
+
+/* Allocates a Glob that remembers no directories yet.
+ * @alloc YES the caller becomes responsible for the return value
+ * @dtor YES Glob is a Class and instances must be freed with release_glob
+ * @crash YES failed to malloc
+ * */
+Glob * init_glob(void);
+
+/* @dtor THIS is the destructor for Class Glob */
+void release_glob(/*@null@*/ /*@only@*/ Glob * glob);
+
+#endif
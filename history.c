@@ -0,0 +1,575 @@
+/* Andre Byrne
+ * 100045589 */
+
+#define _GNU_SOURCE /* memmem */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "history.h"
+
+/* struct TrieNode
+ * a character of the first HISTORY_TRIE_DEPTH of some line */
+struct TrieNode {
+
+  long latest; /* the newest entry whose line passes through this node */
+  long child; /* the first child, or 0 */
+  long sibling; /* the next child of the same parent, or 0 */
+  char character;
+
+};
+
+/* struct Postings
+ * the entries with a trigram that hashes to this list, oldest first, each
+ * entry once */
+struct Postings {
+
+  long * entries;
+  long count, capacity;
+
+};
+
+/* instance methods documented in history.h */
+static void add(History * self_, const char * context, int status, const char * line);
+static long complete(History * self_, const char * prefix);
+static long search(History * self_, const char * text, long before);
+static char * line(History * self_, long entry);
+static int run(History * self_, List * argv, int out);
+
+/* Private instance methods */
+
+/* maps and indexes whatever has been appended to the log since the last
+ * call, by this session or any other */
+static void refresh(History * self);
+
+/* indexes the entry that starts at the given byte of the map */
+static void index_entry(History * self, size_t start);
+
+/* makes the empty lists of the trigram index
+ * @crash YES failed to malloc */
+static void make_buckets(History * self);
+
+/* finds the line of an entry in the map
+ * @param length set to the length of the line
+ * @return the start of the line, which is not \0 terminated */
+static const char * find_line(const History * self, long entry, size_t * length);
+
+/* prints an entry of the log as history does: its number, then its
+ * status, context and line, with each of the lines of the line on one of
+ * its own */
+static void print_entry(const History * self, long entry, FILE * stream);
+
+/* returns the newest entry before the given one whose line contains the
+ * given text, or starts with it if anchored, or -1 */
+static long find(History * self, const char * text, long before, BOOL anchored);
+
+/* returns the child of the given node for the given character, making it
+ * if make is set, or 0 if there is none */
+static long trie_child(History * self, long node, char character, BOOL make);
+
+/* Private class scope methods */
+
+/* returns the list of the trigram at the given text */
+static unsigned int trigram_bucket(const char * text);
+
+/* returns the path of the log, from $VASH_HISTORY or $HOME
+ * @alloc YES the caller becomes responsible for the return value
+ * @null YES if neither is set */
+static /*@null@*/ char * history_path(void);
+
+History * init_history(void) {
+
+  History * self = (History *) failSafeMalloc(sizeof(History), "init_history");
+  char * path = history_path();
+
+  self->fd = -1;
+  self->map = NULL;
+  self->mapped = 0;
+  self->indexed = 0;
+
+  self->capacity = 1024;
+  self->count = 0;
+  self->entries = (size_t *) failSafeMalloc(sizeof(size_t) * self->capacity, "init_history");
+
+  self->node_capacity = 1024;
+  self->node_count = 1;
+  self->nodes = (struct TrieNode *) failSafeMalloc(sizeof(struct TrieNode) * self->node_capacity, "init_history");
+  self->nodes[0].latest = -1;
+  self->nodes[0].child = 0;
+  self->nodes[0].sibling = 0;
+  self->nodes[0].character = '\0';
+
+  /* a megabyte and more of lists: made by the first entry indexed */
+  self->buckets = NULL;
+
+  self->add = add;
+  self->complete = complete;
+  self->search = search;
+  self->line = line;
+  self->run = run;
+
+  if (NULL != path) {
+    self->fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0600);
+
+    if (-1 == self->fd) {
+      fprintf(stderr, "%s: history: %s: ", SHELL_NAME, path);
+      perror("");
+    } else {
+      /* no child needs the log */
+      (void)fcntl(self->fd, F_SETFD, FD_CLOEXEC);
+    }
+
+    free(path);
+  }
+
+  /* the log is read on the first search, not when the shell starts */
+
+  return self;
+}
+
+void release_history(History * history) {
+
+  long index;
+
+  if (NULL != history) {
+    if (NULL != history->map) {
+      (void)munmap(history->map, history->mapped);
+    }
+
+    if (-1 != history->fd) {
+      (void)close(history->fd);
+    }
+
+    for (index = 0; NULL != history->buckets && index < HISTORY_BUCKETS; index++) {
+      free(history->buckets[index].entries);
+    }
+
+    free(history->buckets);
+    free(history->nodes);
+    free(history->entries);
+    free(history);
+  }
+}
+
+static void add(History * self_, const char * context, int status, const char * line) {
+  History * const self = self_;
+
+  char * record, * newline;
+  size_t length;
+
+  if (-1 == self->fd) {
+    return;
+  }
+
+  record = string_with_size(strlen(context) + strlen(line) + 3 * sizeof(int) + 5, "add");
+  sprintf(record, "%d\t%s\t%s\n", status, context, line);
+  length = strlen(record);
+
+  /* an entry is one line of the log, whatever lines it was typed on */
+  for (newline = strchr(record, '\n'); NULL != newline && &newline[1] != &record[length];
+      newline = strchr(newline, '\n')) {
+    *newline = HISTORY_NEWLINE;
+  }
+
+  /* the whole entry in one write, so that it is never split by another
+   * session's */
+  if ((ssize_t)length != write(self->fd, record, length)) {
+    perror(SHELL_NAME ": history");
+  }
+
+  free(record);
+}
+
+static long complete(History * self_, const char * prefix) {
+  History * const self = self_;
+
+  size_t length = strlen(prefix), depth;
+  long node = 0;
+
+  refresh(self);
+
+  for (depth = 0; depth < length && depth < HISTORY_TRIE_DEPTH; depth++) {
+    node = trie_child(self, node, prefix[depth], false);
+    if (0 == node) {
+      return -1;
+    }
+  }
+
+  if (length <= HISTORY_TRIE_DEPTH) {
+    return self->nodes[node].latest;
+  }
+
+  return find(self, prefix, self->count, true);
+}
+
+static long search(History * self_, const char * text, long before) {
+  History * const self = self_;
+
+  refresh(self);
+
+  return find(self, text, before, false);
+}
+
+static char * line(History * self_, long entry) {
+  History * const self = self_;
+
+  size_t length;
+  const char * start = find_line(self, entry, &length);
+  char * copy = string_with_size(length + 1, "line");
+  char * newline;
+
+  strncat(copy, start, length);
+  for (newline = strchr(copy, HISTORY_NEWLINE); NULL != newline; newline = strchr(newline, HISTORY_NEWLINE)) {
+    *newline = '\n';
+  }
+
+  return copy;
+}
+
+static int run(History * self_, List * argv, int out) {
+  History * const self = self_;
+
+  long first = 0, entry, * found = NULL;
+  long count = 0, index;
+  char * end;
+  FILE * stream;
+
+  refresh(self);
+
+  if (2 == argv->count(argv) && 0 == strcmp(argv->head->string, "-g")) {
+    /* the matches come newest first, and are printed oldest first */
+    found = (long *) failSafeMalloc(sizeof(long) * (self->count + 1), "run");
+    for (entry = self->count; -1 != (entry = find(self, argv->head->next->string, entry, false));) {
+      found[count++] = entry;
+    }
+
+  } else if (1 == argv->count(argv)) {
+    long last = strtol(argv->head->string, &end, 10);
+
+    if ('\0' == argv->head->string[0] || '\0' != *end || 0 > last) {
+      fprintf(stderr, "%s: history: usage: history [N] | history -g TEXT\n", SHELL_NAME);
+      return 1;
+    }
+    first = (last < self->count)? self->count - last : 0;
+
+  } else if (!argv->isEmpty(argv)) {
+    fprintf(stderr, "%s: history: usage: history [N] | history -g TEXT\n", SHELL_NAME);
+    return 1;
+  }
+
+  /* buffered, on a descriptor of its own that fclose leaves out alone */
+  if (NULL == (stream = fdopen(dup(out), "w"))) {
+    perror(SHELL_NAME ": history");
+    free(found);
+    return 1;
+  }
+
+  if (NULL == found) {
+    for (entry = first; entry < self->count; entry++) {
+      print_entry(self, entry, stream);
+    }
+  } else {
+    for (index = count - 1; 0 <= index; index--) {
+      print_entry(self, found[index], stream);
+    }
+    free(found);
+  }
+
+  (void)fclose(stream);
+
+  return 0;
+}
+
+static void print_entry(const History * self, long entry, FILE * stream) {
+
+  const char * record = &self->map[self->entries[entry]];
+  size_t length = strcspn(record, "\n");
+  const char * newline;
+
+  /* the lines of an entry after its first line up under it */
+  fprintf(stream, "%6ld  ", entry + 1);
+  while (NULL != (newline = memchr(record, HISTORY_NEWLINE, length))) {
+    fprintf(stream, "%.*s\n        ", (int)(newline - record), record);
+    length -= (size_t)(&newline[1] - record);
+    record = &newline[1];
+  }
+  fprintf(stream, "%.*s\n", (int)length, record);
+}
+
+static void refresh(History * self) {
+
+  struct stat info;
+  size_t size, start;
+
+  if (-1 == self->fd || -1 == fstat(self->fd, &info) || (size_t)info.st_size <= self->mapped) {
+    return;
+  }
+
+  size = (size_t)info.st_size;
+
+  if (NULL != self->map) {
+    (void)munmap(self->map, self->mapped);
+  }
+
+  self->map = (char *) mmap(NULL, size, PROT_READ, MAP_SHARED, self->fd, 0);
+  if (MAP_FAILED == (void *)self->map) {
+    perror(SHELL_NAME ": history");
+    self->map = NULL;
+    self->mapped = 0;
+    self->indexed = 0;
+    self->count = 0;
+    return;
+  }
+  self->mapped = size;
+
+  /* only whole entries: one still being written is read next time */
+  for (start = self->indexed; start < size; ) {
+    const char * newline = memchr(&self->map[start], '\n', size - start);
+
+    if (NULL == newline) {
+      break;
+    }
+
+    index_entry(self, start);
+    start = (size_t)(newline - self->map) + 1;
+    self->indexed = start;
+  }
+}
+
+static void index_entry(History * self, size_t start) {
+
+  long entry = self->count, node = 0;
+  size_t length, index;
+  const char * text;
+
+  if (self->count == self->capacity) {
+    self->capacity *= 2;
+    self->entries = (size_t *) realloc(self->entries, sizeof(size_t) * self->capacity);
+    if (NULL == self->entries) {
+      alertAndCrash("index_entry", "failed to realloc");
+    }
+  }
+  self->entries[self->count++] = start;
+
+  if (NULL == self->buckets) {
+    make_buckets(self);
+  }
+
+  text = find_line(self, entry, &length);
+
+  self->nodes[0].latest = entry;
+  for (index = 0; index < length && index < HISTORY_TRIE_DEPTH; index++) {
+    node = trie_child(self, node, text[index], true);
+    self->nodes[node].latest = entry;
+  }
+
+  for (index = 0; index + 3 <= length; index++) {
+    struct Postings * postings = &self->buckets[trigram_bucket(&text[index])];
+
+    /* a line with a trigram twice is listed once */
+    if (0 < postings->count && entry == postings->entries[postings->count - 1]) {
+      continue;
+    }
+
+    if (postings->count == postings->capacity) {
+      postings->capacity = (0 == postings->capacity)? 4 : 2 * postings->capacity;
+      postings->entries = (long *) realloc(postings->entries, sizeof(long) * postings->capacity);
+      if (NULL == postings->entries) {
+        alertAndCrash("index_entry", "failed to realloc");
+      }
+    }
+    postings->entries[postings->count++] = entry;
+  }
+}
+
+static void make_buckets(History * self) {
+
+  long index;
+
+  self->buckets = (struct Postings *) failSafeMalloc(sizeof(struct Postings) * HISTORY_BUCKETS, "make_buckets");
+  for (index = 0; index < HISTORY_BUCKETS; index++) {
+    self->buckets[index].entries = NULL;
+    self->buckets[index].count = 0;
+    self->buckets[index].capacity = 0;
+  }
+}
+
+static const char * find_line(const History * self, long entry, size_t * length) {
+
+  const char * record = &self->map[self->entries[entry]];
+  const char * end = strchr(record, '\n');
+  const char * field = record;
+  int tabs;
+
+  /* the line is the third field: status, context, line */
+  for (tabs = 0; tabs < 2; tabs++) {
+    const char * tab = memchr(field, '\t', (size_t)(end - field));
+    field = (NULL == tab)? end : &tab[1];
+  }
+
+  *length = (size_t)(end - field);
+
+  return field;
+}
+
+static long find(History * self, const char * text, long before, BOOL anchored) {
+
+  size_t text_length = strlen(text), length;
+  long lists = 0, index, agreed = 0, target;
+  const struct Postings ** postings;
+  long * positions; /* how far back each list has been read */
+
+  if (before > self->count) {
+    before = self->count;
+  }
+
+  /* a text too short for a trigram is looked for in every entry */
+  if (3 > text_length) {
+    for (target = before - 1; 0 <= target; target--) {
+      const char * found = find_line(self, target, &length);
+
+      if (anchored) {
+        if (length >= text_length && 0 == memcmp(found, text, text_length)) return target;
+      } else if (NULL != memmem(found, length, text, text_length)) {
+        return target;
+      }
+    }
+    return -1;
+  }
+
+  /* nothing has been indexed */
+  if (NULL == self->buckets) {
+    return -1;
+  }
+
+  postings = (const struct Postings **) failSafeMalloc(sizeof(struct Postings *) * text_length, "find");
+  positions = (long *) failSafeMalloc(sizeof(long) * text_length, "find");
+
+  /* the shortest lists first, as they skip the furthest */
+  for (index = 0; index + 3 <= (long)text_length; index++) {
+    const struct Postings * list = &self->buckets[trigram_bucket(&text[index])];
+    long place = lists++;
+
+    while (0 < place && postings[place - 1]->count > list->count) {
+      postings[place] = postings[place - 1];
+      place--;
+    }
+    postings[place] = list;
+  }
+
+  for (index = 0; index < lists; index++) {
+    positions[index] = postings[index]->count;
+  }
+
+  /* every match is in every list: the lists are read newest first, each
+   * skipping back to the newest entry that all of the others have had,
+   * until they agree on one. Only entries in every list are read. */
+  target = before - 1;
+  index = 0;
+  while (0 <= target) {
+    const struct Postings * list = postings[index];
+    long low = 0, high = positions[index];
+
+    while (low < high) {
+      long middle = low + (high - low) / 2;
+      if (list->entries[middle] <= target) low = middle + 1; else high = middle;
+    }
+    positions[index] = low;
+
+    if (0 == low) {
+      target = -1;
+      break;
+    }
+
+    if (list->entries[low - 1] < target) {
+      target = list->entries[low - 1];
+      agreed = 0;
+    }
+
+    if (++agreed == lists) {
+      const char * found = find_line(self, target, &length);
+
+      /* the trigrams of another text may hash to the same lists */
+      if (anchored) {
+        if (length >= text_length && 0 == memcmp(found, text, text_length)) break;
+      } else if (NULL != memmem(found, length, text, text_length)) {
+        break;
+      }
+
+      target--;
+      agreed = 0;
+    }
+
+    index = (index + 1) % lists;
+  }
+
+  free(positions);
+  free(postings);
+
+  return target;
+}
+
+static long trie_child(History * self, long node, char character, BOOL make) {
+
+  long child;
+
+  for (child = self->nodes[node].child; 0 != child; child = self->nodes[child].sibling) {
+    if (character == self->nodes[child].character) {
+      return child;
+    }
+  }
+
+  if (!make) {
+    return 0;
+  }
+
+  if (self->node_count == self->node_capacity) {
+    self->node_capacity *= 2;
+    self->nodes = (struct TrieNode *) realloc(self->nodes, sizeof(struct TrieNode) * self->node_capacity);
+    if (NULL == self->nodes) {
+      alertAndCrash("trie_child", "failed to realloc");
+    }
+  }
+
+  child = self->node_count++;
+  self->nodes[child].character = character;
+  self->nodes[child].latest = -1;
+  self->nodes[child].child = 0;
+  self->nodes[child].sibling = self->nodes[node].child;
+  self->nodes[node].child = child;
+
+  return child;
+}
+
+static unsigned int trigram_bucket(const char * text) {
+
+  unsigned long trigram = ((unsigned long)(unsigned char)text[0] << 16)
+      | ((unsigned long)(unsigned char)text[1] << 8) | (unsigned char)text[2];
+
+  /* Fibonacci hashing spreads the trigrams of ASCII text over the lists */
+  return (unsigned int)(((trigram * 2654435761UL) & 0xffffffffUL) >> 16) & (HISTORY_BUCKETS - 1);
+}
+
+static char * history_path(void) {
+
+  const char * path = getenv("VASH_HISTORY");
+  const char * home = getenv("HOME");
+  char * copy;
+
+  if (NULL != path) {
+    copy = string_with_size(strlen(path) + 1, "history_path");
+    strcpy(copy, path);
+    return copy;
+  }
+
+  if (NULL == home) {
+    return NULL;
+  }
+
+  copy = string_with_size(strlen(home) + sizeof("/.vash_history"), "history_path");
+  strcpy(copy, home);
+  strcat(copy, "/.vash_history");
+
+  return copy;
+}
@@ -0,0 +1,128 @@
+/* Andre Byrne
+ * 100045589 */
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "va_utils.h"
+#include "list.h"
+
+/* how many characters of each line the prefix trie holds. A longer prefix
+ * is found through the trigram index instead */
+#define HISTORY_TRIE_DEPTH 8
+
+/* the number of lists in the trigram index: a power of 2 */
+#define HISTORY_BUCKETS 65536
+
+/* what stands for a newline inside an entry of the log, so that a line
+ * that took several, as a program does, is still one line of it */
+#define HISTORY_NEWLINE '\x1e'
+
+/* struct TrieNode
+ * one character of the prefix trie. The children of a node are a list,
+ * linked through sibling. @see history.c */
+struct TrieNode;
+
+/* struct Postings
+ * the entries that contain one trigram, or one of the trigrams that hash
+ * alike, oldest first. @see history.c */
+struct Postings;
+
+/* Class History
+ * brief: History remembers every line run at the prompt, in a log that
+ * every session shares:
+ *
+ *   $$ history 5
+ *   $$ history -g make
+ *   $$ !mak
+ *   $$ !!
+ *
+ * The log is ~/.vash_history, or $VASH_HISTORY. An entry is one line of
+ * it: the exit status of the line, the context it ran in and the line
+ * itself, with a tab between them. A line that took several to finish,
+ * as a for loop or a here-document does, is kept whole, with a
+ * HISTORY_NEWLINE for each newline in it, and comes back as it was typed.
+ * Entries are only ever appended, each
+ * with a single write to a file opened O_APPEND, so no session takes a
+ * lock and no entry lands inside another. The log is read through mmap
+ * and mapped again when it has grown, whoever appended to it.
+ *
+ * The log is indexed the first time it is searched: the first
+ * HISTORY_TRIE_DEPTH characters of each line in a prefix trie that knows
+ * the newest entry under each node, and every trigram in a hashed list
+ * of the entries that contain it. A search steps back through the lists
+ * of all of its trigrams at once, so it only reads the lines that have
+ * every one of them.
+ * */
+typedef struct History {
+
+  int fd; /* -1 if there is no log */
+  /*@null@*/ char * map; /* the log, as far as it has been read */
+  size_t mapped; /* the bytes of the log that are mapped */
+  size_t indexed; /* the bytes of the log that are indexed */
+
+  size_t * entries; /* where each entry starts in the log */
+  long count, capacity;
+
+  struct TrieNode * nodes; /* nodes[0] is the root */
+  long node_count, node_capacity;
+
+  /*@null@*/ struct Postings * buckets; /* NULL until an entry is indexed */
+
+  /* appends a line that has been run to the log
+   * @param self_ the calling object
+   * @param context the name of the context the line ran in
+   * @param status its exit status
+   * @param line the line, without its newline, and with the lines read to
+   *             finish it after a newline each
+   * @crash YES failed to malloc
+   * */
+  void (*add)(struct History * self_, const char * context, int status, const char * line);
+
+  /* finds the newest entry that starts with the given prefix: !prefix
+   * @param self_ the calling object
+   * @param prefix the text the line starts with; "" for the newest entry
+   * @return the entry, or -1 if there is none
+   * */
+  long (*complete)(struct History * self_, const char * prefix);
+
+  /* finds the newest entry before the given one that contains the given
+   * text, for searching back through the history one match at a time
+   * @param self_ the calling object
+   * @param text the text to look for
+   * @param before only entries older than this one are looked at; pass
+   *               LONG_MAX, or the count, for every entry
+   * @return the entry, or -1 if there is none
+   * */
+  long (*search)(struct History * self_, const char * text, long before);
+
+  /* returns the line of an entry, with its newlines as they were added
+   * @param self_ the calling object
+   * @param entry an entry returned by complete or search
+   * @alloc YES the caller becomes responsible for the return value
+   * @crash YES failed to malloc
+   * */
+  char * (*line)(struct History * self_, long entry);
+
+  /* the history builtin: history [N], history -g TEXT
+   * @param self_ the calling object
+   * @param argv (retained) the arguments to history
+   * @param out the descriptor the entries are written to
+   * @return 0 on success, 1 on a bad argument
+   * */
+  int (*run)(struct History * self_, List * argv, int out);
+
+} History;
+
+/* Opens the history log, creating it if it is not there.
+ * A log that cannot be opened leaves the history empty, after saying why.
+ * @alloc YES the caller becomes responsible for the return value
+ * @dtor YES History is a Class and instances must be freed with release_history
+ * @crash YES failed to malloc
+ * */
+History * init_history(void);
+
+/* @dtor THIS is the destructor for Class History */
+void release_history(/*@null@*/ /*@only@*/ History * history);
+
+#endif
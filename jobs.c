@@ -0,0 +1,140 @@
+/* Andre Byrne
+ * 100045589 */
+
+#define _GNU_SOURCE /* syscall, SYS_pidfd_open */
+
+#include <poll.h>
+#include <sys/syscall.h>
+
+#include "jobs.h"
+#include "vash.h"
+
+/* instance methods documented in jobs.h */
+static void add(Jobs * self_, pid_t pid);
+static void reap(Jobs * self_, Tracer * tracer);
+
+Jobs * init_jobs(void) {
+
+  Jobs * self = (Jobs *) failSafeMalloc(sizeof(Jobs), "init_jobs");
+
+  self->pids = NULL;
+  self->count = 0;
+  self->capacity = 0;
+
+  self->add = add;
+  self->reap = reap;
+
+  return self;
+}
+
+void release_jobs(Jobs * jobs) {
+
+  if (NULL != jobs) {
+    free(jobs->pids);
+    free(jobs);
+  }
+}
+
+static void add(Jobs * self_, pid_t pid) {
+  Jobs * const self = self_;
+
+  if (self->count == self->capacity) {
+    self->capacity = (0 == self->capacity)? 8 : 2 * self->capacity;
+    self->pids = (pid_t *) realloc(self->pids, sizeof(pid_t) * self->capacity);
+    if (NULL == self->pids) {
+      alertAndCrash("add", "failed to realloc");
+    }
+  }
+
+  self->pids[self->count++] = pid;
+}
+
+static void reap(Jobs * self_, Tracer * tracer) {
+  Jobs * const self = self_;
+
+  int index = 0, status;
+
+  while (index < self->count) {
+    pid_t pid = self->pids[index];
+    pid_t reaped = waitpid(pid, &status, WNOHANG | WUNTRACED);
+
+    if (0 == reaped) {
+      index++;
+      continue;
+    }
+
+    if (pid == reaped) {
+      if (NULL != tracer) tracer->reaped(tracer, pid, status);
+      the_worst_signal_handler_EVAR(status, pid);
+
+      /* a stopped job is still a job: it is killed, and reaped next time */
+      if (WIFSTOPPED(status)) {
+        index++;
+        continue;
+      }
+    }
+
+    /* reaped, or not a child at all any more */
+    self->pids[index] = self->pids[--self->count];
+  }
+}
+
+pid_t wait_for_any(const pid_t * pids, int count, int * status) {
+
+  struct pollfd * watched = (struct pollfd *) failSafeMalloc(sizeof(struct pollfd) * (count + 1), "wait_for_any");
+  pid_t * owners = (pid_t *) failSafeMalloc(sizeof(pid_t) * (count + 1), "wait_for_any");
+  pid_t found = -1, blocking = -1;
+  int index, watching = 0;
+  BOOL done = false;
+
+  /* a pidfd is readable once its child has finished, so poll can wait on
+   * just these children */
+  for (index = 0; index < count && -1 == blocking; index++) {
+    int fd;
+
+    if (0 >= pids[index]) {
+      continue;
+    }
+
+    if (-1 == (fd = (int)syscall(SYS_pidfd_open, pids[index], 0))) {
+      blocking = pids[index];
+    } else {
+      watched[watching].fd = fd;
+      watched[watching].events = POLLIN;
+      owners[watching++] = pids[index];
+    }
+  }
+
+  /* without pidfds the children are waited for one at a time, in order */
+  if (-1 != blocking) {
+    found = waitpid(blocking, status, 0);
+    done = true;
+  }
+
+  while (!done && 0 < watching) {
+    if (-1 == poll(watched, (nfds_t)watching, -1)) {
+      if (EINTR == errno) continue;
+      break;
+    }
+
+    /* -1 here means the child was reaped by someone else */
+    for (index = 0; index < watching && !done; index++) {
+      if (0 != watched[index].revents && 0 != (found = waitpid(owners[index], status, WNOHANG))) {
+        done = true;
+      }
+    }
+  }
+
+  if (!done) {
+    found = -1;
+  }
+
+  for (index = 0; index < watching; index++) {
+    close(watched[index].fd);
+  }
+
+  free(watched);
+  free(owners);
+
+  return found;
+}
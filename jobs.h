@@ -0,0 +1,58 @@
+/* Andre Byrne
+ * 100045589 */
+
+#ifndef JOBS_H
+#define JOBS_H
+
+#include "va_utils.h"
+#include "trace.h"
+
+/* Class Jobs
+ * brief: Jobs is the job table of one Vash: every child it started in the
+ * background and has not yet reaped. A Vash only ever waits for children
+ * it knows it started, by pid, and never with waitpid(-1), so that several
+ * shells, or a shell and the program it is built into, can start children
+ * in one process without reaping each other's.
+ * */
+typedef struct Jobs {
+
+  pid_t * pids;
+  int count, capacity;
+
+  /* adds a child started in the background to the table
+   * @param self_ the calling object
+   * @param pid the child
+   * @crash YES failed to realloc
+   * */
+  void (*add)(struct Jobs * self_, pid_t pid);
+
+  /* reaps every job that has finished, or stopped, without waiting for
+   * the others, and says on stderr how each one ended
+   * @see the_worst_signal_handler_EVAR
+   * @param self_ the calling object
+   * @param tracer is told about every job reaped, if there is one
+   * */
+  void (*reap)(struct Jobs * self_, /*@null@*/ Tracer * tracer);
+
+} Jobs;
+
+/* Makes an empty job table.
+ * @alloc YES the caller becomes responsible for the return value
+ * @dtor YES Jobs is a Class and instances must be freed with release_jobs
+ * @crash YES failed to malloc
+ * */
+Jobs * init_jobs(void);
+
+/* Jobs still running are left to run. @dtor THIS is the destructor for Class Jobs */
+void release_jobs(/*@null@*/ /*@only@*/ Jobs * jobs);
+
+/* waits for whichever of the given children finishes first, without
+ * reaping any other child of the process. A pid of 0 or less is skipped.
+ * @param pids the children to wait for
+ * @param count how many there are
+ * @param status set to the status of the child, as waitpid sets it
+ * @return the child that finished, or -1 if none could be waited for
+ * */
+pid_t wait_for_any(const pid_t * pids, int count, int * status);
+
+#endif
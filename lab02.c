@@ -8,14 +8,59 @@
  *   for those that may return NULL, make a safe version */
 
 #include "vash.h"
+#include "server.h"
 
-int main () {
+int main (int argc, char ** argv) {
 
-  Vash * vash = init_vash();
-  int result;
+  Vash * vash;
+  /*@null@*/ const char * record = NULL, * replay = NULL, * serve = NULL, * line = NULL;
+  BOOL realtime = false;
+  int result = 1, index;
+
+  for (index = 1; index < argc; index++) {
+    if (0 == strcmp(argv[index], "--connect") && 2 == argc - index) {
+      return run_client(argv[index + 1]);
+    } else if (0 == strcmp(argv[index], "--serve") && index + 1 < argc) {
+      serve = argv[++index];
+    } else if (0 == strcmp(argv[index], "-c") && index + 1 < argc) {
+      line = argv[++index];
+    } else if (0 == strcmp(argv[index], "--record") && index + 1 < argc) {
+      record = argv[++index];
+    } else if (0 == strcmp(argv[index], "--replay") && index + 1 < argc) {
+      replay = argv[++index];
+    } else if (0 == strcmp(argv[index], "--speed") && index + 1 < argc
+        && (0 == strcmp(argv[index + 1], "max") || 0 == strcmp(argv[index + 1], "1x"))) {
+      realtime = (BOOL)(0 == strcmp(argv[++index], "1x"));
+    } else {
+      fprintf(stderr, "usage: %s [--record FILE] [--replay FILE [--speed max|1x]]\n"
+          "       %s -c LINE\n"
+          "       %s --serve SOCKET | --connect SOCKET\n", argv[0], argv[0], argv[0]);
+      return 2;
+    }
+  }
+
+  vash = init_vash();
 
   if (NULL != vash) {
-    result = vash->start(vash);
+    if (NULL != record && NULL == (vash->recorder = init_recorder(record))) {
+      release_vash(vash);
+      return 1;
+    }
+
+    if (NULL != serve) {
+      Server * server = init_server(vash, serve);
+
+      if (NULL != server) {
+        result = server->run(server);
+      }
+
+      release_server(server);
+    } else if (NULL != line) {
+      /* a single line, with no prompt, as vash_eval runs it */
+      result = vash_eval(vash, line, NULL);
+    } else {
+      result = (NULL == replay)? vash->start(vash) : vash->replay(vash, replay, realtime);
+    }
     /* input = vash->prompt(vash);
     command_list = commandFactory->makeCommands(commandFactory, vash, input);
     vash->execute(command_list); */
@@ -0,0 +1,419 @@
+/* Andre Byrne
+ * 100045589 */
+
+#include "lexer.h"
+#include "context.h"
+#include "vash.h"
+
+/* struct Lexer
+ * the word being built by the lexer, which grows as needed, and where the
+ * words go once they are done */
+typedef struct Lexer {
+
+  char * text;
+  size_t length;
+  size_t capacity;
+
+  /* the word again, as a pattern: quoted *, ? and [ are escaped with a \,
+   * and so is any \ */
+  char * pattern;
+  size_t pattern_length;
+  BOOL magic; /* does the word have an unquoted *, ? or [ in it */
+
+  /* a word has begun once it has a character in it, or a pair of quotes,
+   * since "" is an empty word where nothing at all is none */
+  BOOL started;
+
+  /* how many characters at the start of the word were written as they
+   * are, and whether a quote or an expansion has come since: only such
+   * a word can be an operator */
+  size_t plain;
+  BOOL interrupted;
+
+  List * tokens;
+  /*@null@*/ struct Vash * vash; /* runs substitutions */
+  /*@null@*/ Glob * glob;
+  const Context * context; /* patterns are matched from its cwd */
+  long budget; /* the bytes of argv left for the matches of patterns */
+  BOOL failed; /* a pattern matched more than argv can hold */
+
+} Lexer;
+
+/* Private class scope methods */
+
+/* adds a character to the word, quoted or not */
+static void put(Lexer * lexer, char character, BOOL quoted);
+
+/* adds the value of a variable or a substitution to the word. Blanks in
+ * an unquoted value end the word and start another. */
+static void put_value(Lexer * lexer, const char * value, BOOL quoted);
+
+/* returns true if the word so far is name= and every word before it was an
+ * assignment too, in which case a value added to it is not split */
+static BOOL assigning(Lexer * lexer);
+
+/* appends the word to the list, if it was started, and starts a new one.
+ * An unquoted pattern is replaced by the paths it matches, and an operator
+ * written as it is is marked. */
+static void end_word(Lexer * lexer);
+
+/* returns true if the given text, all written as it is, is an operator */
+static BOOL is_operator_text(const char * text, size_t plain);
+
+/* Finds the variable referred to at the given $ and its value.
+ * @param dollar the $ that starts the reference
+ * @param scope where the value is looked up
+ * @param value set to the value, or NULL if the variable is not set
+ * @return the number of characters in the reference, or 0 if the $ does
+ *         not start one and is just a $
+ * */
+static size_t reference(const char * dollar, const Table * scope, const char ** value);
+
+int lex_words(List * tokens, const char * text, const Context * context, Vash * vash) {
+
+  Lexer lexer;
+  char quote = '\0'; /* the quote we are inside of, if any */
+  const char * cursor = text;
+  const Table * scope = context->variables;
+  char * command, * output;
+  size_t length;
+
+  lexer.capacity = strlen(text) + 1;
+  lexer.text = string_with_size(lexer.capacity, "lex_words");
+  lexer.pattern = string_with_size(2 * lexer.capacity, "lex_words");
+  lexer.length = 0;
+  lexer.pattern_length = 0;
+  lexer.magic = false;
+  lexer.started = false;
+  lexer.plain = 0;
+  lexer.interrupted = false;
+  lexer.tokens = tokens;
+  lexer.vash = vash;
+  lexer.glob = (NULL == vash)? NULL : vash->glob;
+  lexer.context = context;
+  lexer.budget = (NULL == vash)? 0 : argument_space();
+  lexer.failed = false;
+
+  while ('\0' != *cursor) {
+    char character = *cursor;
+
+    if ('\0' == quote && (' ' == character || '\t' == character || '\n' == character)) {
+      end_word(&lexer);
+      cursor++;
+
+    } else if ('\0' == quote && ('\'' == character || '"' == character)) {
+      quote = character;
+      lexer.started = true;
+      lexer.interrupted = true;
+      cursor++;
+
+    } else if (character == quote) {
+      quote = '\0';
+      cursor++;
+
+    } else if (('$' == character || '`' == character || ('\0' == quote && !lexer.started))
+        && '\'' != quote && 0 < (length = substitution_length(cursor))) {
+      BOOL backtick = (BOOL)('`' == character);
+
+      lexer.interrupted = true;
+
+      /* without a shell to run it in, a substitution is just text */
+      if (NULL == vash) {
+        for (; 0 < length; length--) {
+          put(&lexer, *cursor++, (BOOL)('\0' != quote));
+        }
+        continue;
+      }
+
+      command = string_with_size(length, "lex_words");
+      strncat(command, &cursor[2 - backtick], length - 3 + backtick);
+      cursor += length;
+
+      /* <(command) and >(command) are a word of their own: a path to a pipe */
+      if ('<' == character || '>' == character) {
+        output = vash->substitute(vash, command, (BOOL)('>' == character));
+        put_value(&lexer, output, true);
+      } else {
+        output = vash->capture(vash, command);
+        put_value(&lexer, output, (BOOL)('\0' != quote));
+      }
+
+      free(output);
+      free(command);
+
+    } else if ('$' == character && '\'' != quote) {
+      const char * value;
+
+      length = reference(cursor, scope, &value);
+
+      if (0 == length) {
+        put(&lexer, '$', (BOOL)('\0' != quote));
+        cursor++;
+        continue;
+      }
+
+      lexer.interrupted = true;
+      cursor += length;
+      put_value(&lexer, value, (BOOL)('\0' != quote));
+
+    } else {
+      if ('\0' == quote && !lexer.interrupted) {
+        lexer.plain++;
+      }
+      put(&lexer, character, (BOOL)('\0' != quote));
+      cursor++;
+    }
+  }
+
+  /* an unterminated quote is closed by the end of the text */
+  end_word(&lexer);
+
+  free(lexer.text);
+  free(lexer.pattern);
+
+  if (lexer.failed) {
+    fprintf(stderr, "%s: argument list too long\n", SHELL_NAME);
+  }
+
+  return (lexer.failed)? 1 : 0;
+}
+
+size_t substitution_length(const char * text) {
+
+  size_t index;
+  int depth = 1;
+  char quote = '\0';
+
+  if ('`' == text[0]) {
+    const char * close = strchr(&text[1], '`');
+    return (NULL == close)? 0 : (size_t)(close - text) + 1;
+  }
+
+  if (NULL == strchr("$<>", text[0]) || '\0' == text[0] || '(' != text[1]) {
+    return 0;
+  }
+
+  /* parentheses nest, except inside quotes */
+  for (index = 2; '\0' != text[index]; index++) {
+    char character = text[index];
+
+    if ('\0' != quote) {
+      if (character == quote) quote = '\0';
+    } else if ('\'' == character || '"' == character) {
+      quote = character;
+    } else if ('(' == character) {
+      depth++;
+    } else if (')' == character && 0 == --depth) {
+      return index + 1;
+    }
+  }
+
+  return 0;
+}
+
+size_t variable_name_length(const char * text) {
+
+  size_t length = 0;
+
+  if ('_' == text[0] || ('a' <= text[0] && text[0] <= 'z') || ('A' <= text[0] && text[0] <= 'Z')) {
+    length = 1 + strspn(&text[1], "_abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789");
+  }
+
+  return length;
+}
+
+BOOL is_operator(const char * token, const char * operator) {
+
+  return (BOOL)(OPERATOR_MARK == token[0] && 0 == strcmp(&token[1], operator));
+}
+
+char * literal_word(const char * word) {
+
+  BOOL marked = is_operator_text(word, strlen(word));
+  char * literal = string_with_size(strlen(word) + 2, "literal_word");
+
+  if (marked) {
+    literal[0] = OPERATOR_MARK;
+    literal[1] = '\0';
+  }
+  strcat(literal, word);
+
+  return literal;
+}
+
+BOOL is_assignment(const char * word) {
+
+  size_t length = variable_name_length(word);
+
+  return (BOOL)(0 < length && '=' == word[length]);
+}
+
+const char * context_separator(const char * word) {
+
+  size_t length = strcspn(word, ":=");
+
+  return (':' == word[length])? &word[length] : NULL;
+}
+
+BOOL assign_variable(Table * scope, const char * word) {
+
+  size_t length = variable_name_length(word);
+  char * name;
+
+  if (0 == length || '=' != word[length]) {
+    return false;
+  }
+
+  name = string_with_size(length + 1, "assign_variable");
+  strncat(name, word, length);
+  scope->set(scope, name, &word[length + 1]);
+  free(name);
+
+  return true;
+}
+
+static void put(Lexer * lexer, char character, BOOL quoted) {
+
+  BOOL magic = (BOOL)('*' == character || '?' == character || '[' == character);
+
+  if (lexer->length + 1 >= lexer->capacity) {
+    lexer->capacity *= 2;
+    lexer->text = (char *) realloc(lexer->text, lexer->capacity);
+    lexer->pattern = (char *) realloc(lexer->pattern, 2 * lexer->capacity);
+    if (NULL == lexer->text || NULL == lexer->pattern) {
+      alertAndCrash("put", "failed to realloc");
+    }
+  }
+
+  if ('\\' == character || (quoted && magic)) {
+    lexer->pattern[lexer->pattern_length++] = '\\';
+  } else if (magic) {
+    lexer->magic = true;
+  }
+
+  lexer->text[lexer->length++] = character;
+  lexer->pattern[lexer->pattern_length++] = character;
+  lexer->started = true;
+}
+
+static void put_value(Lexer * lexer, const char * value, BOOL quoted) {
+
+  if (!quoted && assigning(lexer)) {
+    quoted = true;
+  }
+
+  for (; NULL != value && '\0' != *value; value++) {
+    if (!quoted && (' ' == *value || '\t' == *value || '\n' == *value)) {
+      end_word(lexer);
+    } else {
+      put(lexer, *value, quoted);
+    }
+  }
+}
+
+static BOOL assigning(Lexer * lexer) {
+
+  const Node * node;
+
+  lexer->text[lexer->length] = '\0';
+  if (!is_assignment(lexer->text)) {
+    return false;
+  }
+
+  for (node = lexer->tokens->head; NULL != node; node = node->next) {
+    if (!is_assignment(node->string)) return false;
+  }
+
+  return true;
+}
+
+static void end_word(Lexer * lexer) {
+
+  if (lexer->started && !lexer->failed) {
+    int matched = 0;
+
+    lexer->text[lexer->length] = '\0';
+    lexer->pattern[lexer->pattern_length] = '\0';
+
+    if (lexer->magic && NULL != lexer->glob) {
+      matched = lexer->glob->expand(lexer->glob, lexer->context->cwd, lexer->pattern, lexer->tokens, &lexer->budget);
+    }
+
+    /* a pattern that matches nothing is left as it is */
+    if (0 == matched && is_operator_text(lexer->text, lexer->plain)) {
+      char * marked = string_with_size(lexer->length + 2, "end_word");
+
+      marked[0] = OPERATOR_MARK;
+      strcpy(&marked[1], lexer->text);
+      (void)lexer->tokens->append(lexer->tokens, marked);
+      free(marked);
+    } else if (0 == matched) {
+      (void)lexer->tokens->append(lexer->tokens, lexer->text);
+    } else if (-1 == matched) {
+      lexer->failed = true;
+    }
+  }
+
+  lexer->length = 0;
+  lexer->pattern_length = 0;
+  lexer->magic = false;
+  lexer->started = false;
+  lexer->plain = 0;
+  lexer->interrupted = false;
+}
+
+static BOOL is_operator_text(const char * text, size_t plain) {
+
+  static const char * const operators[] = { "<", ">", "|", "|>", "&", ";", NULL };
+  size_t length = strlen(text);
+  int index;
+
+  /* <<EOF and <<<word carry their delimiter or word, which may be quoted */
+  if (0 == strncmp(text, "<<", 2)) {
+    return (BOOL)(2 <= plain && ('<' != text[2] || 3 <= plain));
+  }
+
+  if (plain < length) {
+    return false;
+  }
+
+  for (index = 0; NULL != operators[index]; index++) {
+    if (0 == strcmp(text, operators[index])) return true;
+  }
+
+  return false;
+}
+
+static size_t reference(const char * dollar, const Table * scope, const char ** value) {
+
+  BOOL braced = (BOOL)('{' == dollar[1]);
+  const char * name = &dollar[1 + braced];
+  size_t length = variable_name_length(name);
+  char buffer[MAX_NAME_LENGTH];
+
+  /* $? $! and $$ are named by a single character */
+  if (0 == length && NULL != strchr("?!$", name[0]) && '\0' != name[0]) {
+    length = 1;
+  }
+
+  if (0 == length || (braced && '}' != name[length])) {
+    *value = NULL;
+    return 0;
+  }
+
+  /* most names fit on the stack */
+  if (length < MAX_NAME_LENGTH) {
+    strncpy(buffer, name, length);
+    buffer[length] = '\0';
+    *value = scope->get(scope, buffer);
+    if (NULL == *value) *value = getenv(buffer);
+  } else {
+    char * long_name = string_with_size(length + 1, "reference");
+    strncat(long_name, name, length);
+    *value = scope->get(scope, long_name);
+    if (NULL == *value) *value = getenv(long_name);
+    free(long_name);
+  }
+
+  return 1 + braced + length + braced;
+}
@@ -0,0 +1,113 @@
+/* Andre Byrne
+ * 100045589 */
+
+#ifndef LEXER_H
+#define LEXER_H
+
+#include "va_utils.h"
+#include "list.h"
+#include "table.h"
+
+/* variable names shorter than this are looked up without a malloc */
+#define MAX_NAME_LENGTH 64
+
+/* the byte the lexer puts before an operator it found unquoted and as it
+ * was written: < > | |> & ; and the << and <<< of here-documents. A '>'
+ * quoted, or a > that a variable or substitution expanded to, is a word
+ * like any other, and only a marked > redirects. @see is_operator */
+#define OPERATOR_MARK '\x1f'
+#define OPERATOR_MARK_STRING "\x1f"
+
+/* Lexer
+ * brief: the lexer splits a phrase into words, and expands the variables
+ * in it as it goes, in a single pass over the phrase:
+ *
+ *   $$ dir=/tmp
+ *   $$ ls -l $dir "${dir}/my file" '$dir'
+ *
+ * gives ls the words -l, /tmp, /tmp/my file and $dir. $name and ${name}
+ * are the value of a shell variable, $? is the exit status of the last
+ * phrase, $! is the last command sent to the background and $$ is the
+ * shell itself. A name the shell has no variable for is looked up in the
+ * environment it was started with, so $HOME is the HOME it was given.
+ * Inside '...' nothing is expanded, and inside "..." blanks do not split
+ * words. An unquoted value with blanks in it becomes several
+ * words, and an unquoted word that expands to nothing is no word at all.
+ *
+ * $(command) and `command` are replaced by what the command prints, less
+ * its trailing newlines, and split like the value of a variable. The
+ * command is run like a line of its own, with its stdout captured in
+ * memory, and as a subshell would: what it does to variables, contexts or
+ * the cwd stays in it. A command, or a builtin such as history that only
+ * reads the shell, runs without a fork of its own. @see capture
+ *
+ * <(command) and >(command) start the command alongside the phrase, and
+ * become a path, /dev/fd/N, to a pipe from its stdout or to its stdin:
+ *
+ *   $$ diff <(sort a) <(sort b)
+ *
+ * The pipes are closed, and the commands waited for, once the phrase is
+ * done.
+ *
+ * Unquoted patterns are expanded last. @see glob.h
+ *
+ * An operator is only ever what was typed: echo '>' x and y='|'; echo $y
+ * print their words rather than redirect or pipe. @see OPERATOR_MARK
+ * */
+
+/* forward declarations: words are lexed for a context of a shell */
+struct Context;
+struct Vash;
+
+/* Appends the words of the given text to the given list, expanded.
+ * @param tokens the list to append the words to
+ * @param text the text to be split into words
+ * @param context the context the words are for: its variables, and the
+ *                scopes under them, are expanded, and its cwd is where
+ *                patterns are matched from
+ * @param vash the shell that runs substitutions and expands patterns, or
+ *             NULL to leave both as they are written
+ * @crash YES failed to malloc
+ * @return 0, or 1 if the matches of the patterns would not fit in an argv,
+ *         in which case the words are incomplete and the reason is printed
+ * */
+int lex_words(List * tokens, const char * text, const struct Context * context, /*@null@*/ struct Vash * vash);
+
+/* returns the length of the $(...), <(...), >(...) or `...` at the start
+ * of the given text, including the $( and ), or 0 if the text does not
+ * start with one or it is never closed. Parentheses inside them nest. */
+size_t substitution_length(const char * text);
+
+/* returns the length of the variable name at the start of the given text,
+ * which is 0 if the text does not start with a name */
+size_t variable_name_length(const char * text);
+
+/* returns true if the given token is the given operator, as the lexer
+ * marked it: is_operator(token, "<") */
+BOOL is_operator(const char * token, const char * operator);
+
+/* returns a copy of the given word, which has no quotes, $ or patterns in
+ * it, as lex_words would give it: marked if it is an operator
+ * @alloc YES the caller becomes responsible for the return value
+ * @crash YES failed to malloc
+ * */
+char * literal_word(const char * word);
+
+/* returns true if the given word has the form name=value */
+BOOL is_assignment(const char * word);
+
+/* returns the : that ends the context name of the given first word, as in
+ * ctx:command or ctx:name=value, or NULL if it names no context. A : that
+ * comes after an = is part of a value: x=a:b and PATH=/bin:/usr/bin are
+ * assignments in the default context */
+const char * context_separator(const char * word);
+
+/* Sets a variable from a word of the form name=value.
+ * @param scope the scope to set the variable in
+ * @param word the assignment
+ * @crash YES failed to malloc
+ * @return true if the word was an assignment, false if it was left alone
+ * */
+BOOL assign_variable(Table * scope, const char * word);
+
+#endif
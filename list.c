@@ -99,14 +99,14 @@ void appendTokensAndDelimiters(List * list, /*@unused@*/ char * string, const ch
 }
 
 void appendTokens(List * list, /*@unused@*/ char * string, const char * separator) {
-  char * token;
+  char * token, * rest;
 
   /* null holder is string during the first iteration and NULL subsequently
-   * see strtok(3) */
+   * see strtok_r(3): the place reached is kept in rest, not in strtok */
   char * null_holder = string;
 
   /* ISSUE: see list.h */
-  while (NULL != (token = strtok(null_holder, separator))) {
+  while (NULL != (token = strtok_r(null_holder, separator, &rest))) {
     null_holder = NULL;
     (void)list->append(list, token); /* list is changed in place */
   }
@@ -114,14 +114,14 @@ void appendTokens(List * list, /*@unused@*/ char * string, const char * separato
 }
 
 void addTokens(List * list, /*@unused@*/ char * string, const char * separator) {
-  char * str;
+  char * str, * rest;
 
   /* null holder is string during the first iteration and NULL subsequently
-   * see strtok(3) */
+   * see strtok_r(3) */
   char * null_holder = string;
 
   /* ISSUE: see list.h */
-  while (NULL != (str = strtok(null_holder, separator))) {
+  while (NULL != (str = strtok_r(null_holder, separator, &rest))) {
     null_holder = NULL;
     (void)list->add(list, str); /* list is changed in place */
   }
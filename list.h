@@ -130,8 +130,7 @@ void release_list(/*@null@*/ /*@only@*/ const List * list);
  * token separator to the given list. All strings appended in this way are
  * copies, independant of the given string. 
  * 
- * @see append, strtok
- * @post further calls to strtok(NULL, separator) will yield NULL
+ * @see append, strtok_r
  * @param list the list to which tokens will be appended
  * @param string the string to be tokenized
  * @param separator a list of separators around which to tokenize 
@@ -141,8 +140,7 @@ void appendTokens(List * list, char * string, const char * separator);
 
 /* Much like appendTokens above, addTokens adds all of the tokens described
  * by a given separator in the given string to the given list. 
- * @see appendTokens, strtok
- * @post further calls to strtok(NULL, separator) will yield NULL 
+ * @see appendTokens, strtok_r
  * @param list the list to which tokens will be added
  * @param string the string to be tokenized
  * @param separator a list of separators around which to tokenize 
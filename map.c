@@ -0,0 +1,597 @@
+/* Andre Byrne
+ * 100045589 */
+
+#define _GNU_SOURCE /* pipe2, _SC_NPROCESSORS_ONLN, sigtimedwait */
+
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+
+#include "map.h"
+#include "vash.h"
+
+/* struct Worker
+ * one process running the command, and the bytes on their way to and from
+ * it. Sent bytes are pending[sent .. length]; the bytes it has written and
+ * that have not been passed on yet are output[start .. length] */
+typedef struct Worker {
+
+  pid_t pid;
+  int in, out; /* the shell's ends of its stdin and stdout, or -1 once closed */
+
+  char * pending;
+  size_t pending_length, pending_sent, pending_capacity;
+
+  char * output;
+  size_t output_start, output_length, output_capacity;
+
+  long outstanding; /* lines sent that it has not answered yet */
+
+} Worker;
+
+/* struct Block
+ * lines sent to one worker together, in the order they were read */
+typedef struct Block {
+
+  int worker;
+  long lines; /* how many of them are still to be passed on */
+
+} Block;
+
+/* Private class scope methods */
+
+/* forks a worker running the given command, on two new pipes
+ * @crash YES failed to fork */
+static void start_worker(Context * context, Worker * worker, const char * executablePath, char ** argv);
+
+/* appends length bytes to a buffer, growing it as needed
+ * @crash YES failed to realloc */
+static void append_bytes(char ** buffer, size_t * length, size_t * capacity, const char * bytes, size_t count);
+
+/* sends the complete records in input[0 .. length] to the workers, in
+ * blocks, and records each block. A record left incomplete at the end
+ * stays for the next call.
+ * @return the number of bytes sent */
+static size_t dispatch(Worker * workers, int count, Block ** blocks, int * block_count, int * block_capacity,
+    const char * input, size_t length, char separator);
+
+/* writes every answer that is due: the lines of each block in turn, as far
+ * as its worker has written them
+ * @param head the first block not yet passed on in full
+ * */
+static void collect(Worker * workers, Block * blocks, int block_count, int * head, int out, char separator);
+
+/* writes all of count bytes to a blocking descriptor
+ * @return false if they could not be written */
+static BOOL write_all(int fd, const char * bytes, size_t count);
+
+/* blocks SIGPIPE in the calling thread alone, so that a worker that dies is
+ * seen as a write that fails with EPIPE. The disposition of the process is
+ * left alone: another thread running a Vash of its own is not affected.
+ * @param was set to the signal mask of the thread before */
+static void block_sigpipe(sigset_t * was);
+
+/* takes any SIGPIPE the writes of the thread raised while it was blocked,
+ * then gives the thread back the given mask
+ * @param was the mask block_sigpipe saved, or NULL in a worker, which only
+ *            unblocks SIGPIPE before it runs the command */
+static void restore_sigpipe(const sigset_t * was);
+
+int run_map(Context * context, List * argv) {
+
+  List * words = init_list(); /* the command and its arguments */
+  /*@null@*/ char * source = NULL; /* the < file or << body the lines are in */
+  BOOL here = false, finished = false, mismatch = false;
+  char separator = '\n';
+  long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+  char * message, * executablePath, * token, ** worker_argv, * input = NULL;
+  size_t input_length = 0, input_capacity = 0;
+  Worker * workers;
+  Block * blocks = NULL;
+  struct pollfd * watched;
+  const Node * node;
+  int index, count, head = 0, block_count = 0, block_capacity = 0, in_fd, exit_status = 0;
+  sigset_t was;
+
+  /* the options come first */
+  while (!argv->isEmpty(argv) && (0 == strcmp(argv->head->string, "-j") || 0 == strcmp(argv->head->string, "-0"))) {
+    BOOL zero = (BOOL)('0' == argv->head->string[1]);
+    char * value, * end;
+
+    free(argv->pop(argv));
+    if (zero) {
+      separator = '\0';
+      continue;
+    }
+
+    if (argv->isEmpty(argv)) {
+      jobs = 0;
+      break;
+    }
+
+    value = argv->pop(argv);
+    jobs = strtol(value, &end, 10);
+
+    if ('\0' == value[0] || '\0' != *end || 1 > jobs || 1024 < jobs) {
+      fprintf(stderr, "%s: map: %s: not a number of workers\n", SHELL_NAME, value);
+      jobs = -1;
+    }
+
+    free(value);
+  }
+
+  /* then the command, less any < of its own */
+  while (!argv->isEmpty(argv)) {
+    token = argv->pop(argv);
+
+    if ((is_operator(token, "<") || is_operator(token, "<<") || is_operator(token, "<<<"))
+        && !argv->isEmpty(argv)) {
+      here = (BOOL)(!is_operator(token, "<"));
+      free(source);
+      source = argv->pop(argv);
+    } else {
+      (void)words->append(words, token);
+    }
+
+    free(token);
+  }
+
+  if (words->isEmpty(words) || 1 > jobs) {
+    if (0 == jobs || words->isEmpty(words)) {
+      fprintf(stderr, "%s: map: usage: map [-j N] [-0] command [args...]\n", SHELL_NAME);
+    }
+    free(source);
+    release_list(words);
+    return 1;
+  }
+
+  /* stdin is the one the shell was given, not always the process's */
+  in_fd = context->stdio[STDIN_FILENO];
+  if (here) {
+    append_bytes(&input, &input_length, &input_capacity, source, strlen(source));
+    in_fd = -1;
+  } else if (NULL != source) {
+    char * path = absolute_path(context->cwd, source);
+
+    in_fd = open(path, O_RDONLY | O_CLOEXEC);
+    free(path);
+
+    if (-1 == in_fd) {
+      fprintf(stderr, "%s: map: %s: ", SHELL_NAME, source);
+      perror("");
+      free(source);
+      release_list(words);
+      return 1;
+    }
+  }
+
+  message = words->pop(words);
+  executablePath = resolve_command(context, message);
+
+  if (NULL == executablePath) {
+    fprintf(stderr, "%s: %s\n", message, "command not found");
+    if (NULL != source && !here) (void)close(in_fd);
+    free(source);
+    free(message);
+    free(input);
+    release_list(words);
+    return 1;
+  }
+
+  worker_argv = (char **) failSafeMalloc(sizeof(char *) * (words->count(words) + 2), "run_map");
+  worker_argv[0] = message;
+  for (node = words->head, index = 1; NULL != node; node = node->next, index++) {
+    worker_argv[index] = node->string;
+  }
+  worker_argv[index] = NULL;
+
+  /* a worker that dies is seen as a write that fails, not as a signal */
+  block_sigpipe(&was);
+
+  count = (int)jobs;
+  workers = (Worker *) failSafeMalloc(sizeof(Worker) * count, "run_map");
+  watched = (struct pollfd *) failSafeMalloc(sizeof(struct pollfd) * (2 * count + 1), "run_map");
+
+  for (index = 0; index < count; index++) {
+    start_worker(context, &workers[index], executablePath, worker_argv);
+  }
+
+  for (;;) {
+    size_t waiting = 0;
+    int watching = 0, reading = -1;
+
+    for (index = 0; index < count; index++) {
+      waiting += workers[index].pending_length - workers[index].pending_sent;
+    }
+
+    /* the input is read only as fast as the workers take it */
+    if (-1 != in_fd && waiting < MAP_BUFFER) {
+      reading = watching;
+      watched[watching].fd = in_fd;
+      watched[watching++].events = POLLIN;
+    }
+
+    for (index = 0; index < count; index++) {
+      Worker * worker = &workers[index];
+
+      /* once the input has all been sent, the workers are told so */
+      if (finished && -1 != worker->in && worker->pending_sent == worker->pending_length) {
+        (void)close(worker->in);
+        worker->in = -1;
+      }
+
+      if (-1 != worker->in) {
+        watched[watching].fd = worker->in;
+        watched[watching++].events = POLLOUT;
+      }
+
+      if (-1 != worker->out) {
+        watched[watching].fd = worker->out;
+        watched[watching++].events = POLLIN;
+      }
+    }
+
+    if (0 == watching) {
+      break;
+    }
+
+    /* a block is only sent once its lines are all there */
+    if (-1 == in_fd && !finished) {
+      if (0 < input_length && separator != input[input_length - 1]) {
+        append_bytes(&input, &input_length, &input_capacity, &separator, 1);
+      }
+      (void)dispatch(workers, count, &blocks, &block_count, &block_capacity, input, input_length, separator);
+      input_length = 0;
+      finished = true;
+      continue;
+    }
+
+    if (-1 == poll(watched, (nfds_t)watching, -1)) {
+      if (EINTR == errno) continue;
+      perror(SHELL_NAME ": map");
+      exit_status = 1;
+      break;
+    }
+
+    for (index = 0; index < watching; index++) {
+      int fd = watched[index].fd, worker;
+
+      if (0 == watched[index].revents) {
+        continue;
+      }
+
+      if (index == reading) {
+        char chunk[BUFSIZ * 8];
+        ssize_t got = read(fd, chunk, sizeof(chunk));
+
+        if (0 < got) {
+          size_t sent;
+
+          append_bytes(&input, &input_length, &input_capacity, chunk, (size_t)got);
+          sent = dispatch(workers, count, &blocks, &block_count, &block_capacity, input, input_length, separator);
+          memmove(input, input + sent, input_length - sent);
+          input_length -= sent;
+        } else if (-1 == got && EINTR == errno) {
+          continue;
+        } else {
+          if (-1 == got) {
+            perror(SHELL_NAME ": map");
+            exit_status = 1;
+          }
+          if (NULL != source && !here) (void)close(in_fd);
+          in_fd = -1;
+        }
+        continue;
+      }
+
+      for (worker = 0; worker < count; worker++) {
+        Worker * const current = &workers[worker];
+
+        if (fd == current->in) {
+          ssize_t put = write(fd, current->pending + current->pending_sent,
+              current->pending_length - current->pending_sent);
+
+          if (0 < put) {
+            current->pending_sent += (size_t)put;
+            if (current->pending_sent == current->pending_length) {
+              current->pending_sent = current->pending_length = 0;
+            }
+          } else if (-1 == put && EAGAIN != errno && EINTR != errno) {
+            /* it will answer no more: what it was sent is lost */
+            (void)close(current->in);
+            current->in = -1;
+            current->pending_sent = current->pending_length = 0;
+          }
+          break;
+        }
+
+        if (fd == current->out) {
+          char chunk[BUFSIZ * 8];
+          ssize_t got = read(fd, chunk, sizeof(chunk));
+
+          if (0 < got) {
+            append_bytes(&current->output, &current->output_length, &current->output_capacity, chunk, (size_t)got);
+          } else if (0 == got || EINTR != errno) {
+            (void)close(current->out);
+            current->out = -1;
+          }
+          break;
+        }
+      }
+    }
+
+    collect(workers, blocks, block_count, &head, context->stdio[STDOUT_FILENO], separator);
+  }
+
+  collect(workers, blocks, block_count, &head, context->stdio[STDOUT_FILENO], separator);
+
+  /* whatever was not answered line for line still comes out, in order */
+  mismatch = (BOOL)(head < block_count);
+  for (index = 0; index < count; index++) {
+    Worker * worker = &workers[index];
+
+    if (worker->output_start < worker->output_length) {
+      mismatch = true;
+      (void)write_all(context->stdio[STDOUT_FILENO], worker->output + worker->output_start,
+          worker->output_length - worker->output_start);
+    }
+  }
+
+  if (mismatch) {
+    fprintf(stderr, "%s: map: %s did not write one line for each line it read\n", SHELL_NAME, message);
+    exit_status = 1;
+  }
+
+  for (index = 0; index < count; index++) {
+    Worker * worker = &workers[index];
+    int status;
+
+    if (-1 != worker->in) (void)close(worker->in);
+    if (-1 != worker->out) (void)close(worker->out);
+
+    if (worker->pid == waitpid(worker->pid, &status, 0)) {
+      context->tracer->reaped(context->tracer, worker->pid, status);
+      if (!WIFEXITED(status) || 0 != WEXITSTATUS(status)) exit_status = 1;
+    }
+
+    free(worker->pending);
+    free(worker->output);
+  }
+
+  restore_sigpipe(&was);
+
+  free(workers);
+  free(watched);
+  free(blocks);
+  free(input);
+  free(worker_argv);
+  free(executablePath);
+  free(message);
+  free(source);
+  release_list(words);
+
+  return exit_status;
+}
+
+static void start_worker(Context * context, Worker * worker, const char * executablePath, char ** argv) {
+
+  int to[2], from[2];
+  long forked;
+
+  worker->pending = worker->output = NULL;
+  worker->pending_length = worker->pending_sent = worker->pending_capacity = 0;
+  worker->output_start = worker->output_length = worker->output_capacity = 0;
+  worker->outstanding = 0;
+
+  if (-1 == pipe2(to, O_CLOEXEC) || -1 == pipe2(from, O_CLOEXEC)) {
+    alertAndCrash("start_worker", "failed to pipe");
+  }
+
+  /* a worker must not repeat whatever the shell has buffered */
+  fflush(stdout);
+  fflush(stderr);
+
+  forked = now_us();
+  switch ((worker->pid = fork())) {
+    case -1 :
+      perror("fork");
+      exit(1);
+    case 0 :
+      if (-1 == chdir(context->cwd)) {
+        fprintf(stderr, "%s: %s: ", SHELL_NAME, context->cwd);
+        perror("");
+        _exit(EXIT_FAILURE);
+      }
+
+      if (STDERR_FILENO != context->stdio[STDERR_FILENO]) {
+        dup2(context->stdio[STDERR_FILENO], STDERR_FILENO);
+      }
+      dup2(to[0], STDIN_FILENO);
+      dup2(from[1], STDOUT_FILENO);
+
+      (void)signal(SIGPIPE, SIG_DFL);
+      (void)signal(SIGINT, SIG_DFL);
+      restore_sigpipe(NULL);
+
+      execv(executablePath, argv);
+      perror(SHELL_NAME);
+      _exit(EXIT_FAILURE);
+    default :
+      context->tracer->started(context->tracer, worker->pid, "map", argv[0], forked);
+  }
+
+  (void)close(to[0]);
+  (void)close(from[1]);
+
+  worker->in = to[1];
+  worker->out = from[0];
+
+  /* the shell waits on poll, never on a worker that is not reading */
+  (void)fcntl(worker->in, F_SETFL, fcntl(worker->in, F_GETFL) | O_NONBLOCK);
+}
+
+static size_t dispatch(Worker * workers, int count, Block ** blocks, int * block_count, int * block_capacity,
+    const char * input, size_t length, char separator) {
+
+  size_t sent = 0;
+
+  while (sent < length) {
+    const char * end = input + sent;
+    long lines = 0;
+    int worker, chosen = 0;
+    Block * block;
+
+    /* up to MAP_BLOCK_LINES complete records */
+    while (lines < MAP_BLOCK_LINES) {
+      const char * found = (const char *)memchr(end, separator, (size_t)(input + length - end));
+
+      if (NULL == found) break;
+      end = found + 1;
+      lines++;
+    }
+
+    if (0 == lines) {
+      break;
+    }
+
+    /* the worker with the least to do */
+    for (worker = 1; worker < count; worker++) {
+      if (workers[worker].outstanding < workers[chosen].outstanding) {
+        chosen = worker;
+      }
+    }
+
+    append_bytes(&workers[chosen].pending, &workers[chosen].pending_length, &workers[chosen].pending_capacity,
+        input + sent, (size_t)(end - (input + sent)));
+    workers[chosen].outstanding += lines;
+
+    if (*block_count == *block_capacity) {
+      *block_capacity = (0 == *block_capacity)? 64 : 2 * *block_capacity;
+      *blocks = (Block *) realloc(*blocks, sizeof(Block) * *block_capacity);
+      if (NULL == *blocks) {
+        alertAndCrash("dispatch", "failed to realloc");
+      }
+    }
+
+    block = &(*blocks)[(*block_count)++];
+    block->worker = chosen;
+    block->lines = lines;
+
+    sent = (size_t)(end - input);
+  }
+
+  return sent;
+}
+
+static void collect(Worker * workers, Block * blocks, int block_count, int * head, int out, char separator) {
+
+  while (*head < block_count) {
+    Block * block = &blocks[*head];
+    Worker * worker = &workers[block->worker];
+    const char * start = worker->output + worker->output_start, * end = start;
+    long lines = 0;
+
+    /* as many of the block's lines as the worker has written */
+    while (lines < block->lines) {
+      const char * found = (const char *)memchr(end, separator,
+          (size_t)(worker->output + worker->output_length - end));
+
+      if (NULL == found) break;
+      end = found + 1;
+      lines++;
+    }
+
+    if (0 < lines) {
+      (void)write_all(out, start, (size_t)(end - start));
+      worker->output_start += (size_t)(end - start);
+      worker->outstanding -= lines;
+      block->lines -= lines;
+    }
+
+    /* what has been passed on is dropped, once it is most of the buffer */
+    if (worker->output_start == worker->output_length) {
+      worker->output_start = worker->output_length = 0;
+    } else if (worker->output_start > worker->output_length / 2) {
+      memmove(worker->output, worker->output + worker->output_start, worker->output_length - worker->output_start);
+      worker->output_length -= worker->output_start;
+      worker->output_start = 0;
+    }
+
+    if (0 < block->lines) {
+      break;
+    }
+
+    (*head)++;
+  }
+}
+
+static void append_bytes(char ** buffer, size_t * length, size_t * capacity, const char * bytes, size_t count) {
+
+  if (*length + count > *capacity) {
+    while (*length + count > *capacity) {
+      *capacity = (0 == *capacity)? BUFSIZ : 2 * *capacity;
+    }
+
+    *buffer = (char *) realloc(*buffer, *capacity);
+    if (NULL == *buffer) {
+      alertAndCrash("append_bytes", "failed to realloc");
+    }
+  }
+
+  memcpy(*buffer + *length, bytes, count);
+  *length += count;
+}
+
+static BOOL write_all(int fd, const char * bytes, size_t count) {
+
+  while (0 < count) {
+    ssize_t put = write(fd, bytes, count);
+
+    if (-1 == put) {
+      if (EINTR == errno) continue;
+      return false;
+    }
+
+    bytes += put;
+    count -= (size_t)put;
+  }
+
+  return true;
+}
+
+static void block_sigpipe(sigset_t * was) {
+
+  sigset_t pipe_set;
+
+  sigemptyset(&pipe_set);
+  sigaddset(&pipe_set, SIGPIPE);
+  (void)pthread_sigmask(SIG_BLOCK, &pipe_set, was);
+}
+
+static void restore_sigpipe(const sigset_t * was) {
+
+  static const struct timespec now = { 0, 0 };
+  sigset_t pipe_set, pending;
+
+  sigemptyset(&pipe_set);
+  sigaddset(&pipe_set, SIGPIPE);
+
+  /* a worker's child runs with SIGPIPE as it would from the prompt */
+  if (NULL == was) {
+    (void)sigprocmask(SIG_UNBLOCK, &pipe_set, NULL);
+    return;
+  }
+
+  if (sigismember(was, SIGPIPE)) {
+    return;
+  }
+
+  /* a failed write left SIGPIPE pending on this thread: unblocking it as
+   * it is would kill the shell after all */
+  sigemptyset(&pending);
+  while (0 == sigpending(&pending) && sigismember(&pending, SIGPIPE)) {
+    if (-1 == sigtimedwait(&pipe_set, NULL, &now) && EINTR != errno) break;
+  }
+
+  (void)pthread_sigmask(SIG_SETMASK, was, NULL);
+}
@@ -0,0 +1,48 @@
+/* Andre Byrne
+ * 100045589 */
+
+#ifndef MAP_H
+#define MAP_H
+
+#include "va_utils.h"
+#include "list.h"
+
+/* the most lines sent to a worker at once */
+#define MAP_BLOCK_LINES 64
+
+/* the most bytes read ahead of the workers: past this, the input is left
+ * until they catch up */
+#define MAP_BUFFER (1 << 20)
+
+/* forward declaration: map runs its workers in a context */
+struct Context;
+
+/* Map
+ * brief: map spreads a stream of lines over a fixed number of workers,
+ * each of them one process running the command for as long as the stream
+ * lasts, and puts what they write back together in the order the lines
+ * came in:
+ *
+ *   $$ map -j 4 sed -e 's/colour/color/g' < big.txt > fixed.txt
+ *   $$ find . -name '*.c' | map -j 8 awk '{ print length($0), $0 }'
+ *
+ * The lines are sent in blocks of up to MAP_BLOCK_LINES, each to whichever
+ * worker has the fewest lines still to answer. The command must write one
+ * line for every line it reads, as sed, tr, cut and most awk programs do:
+ * that is how the lines it writes are matched back up with the lines it
+ * was sent. It may hold them back as long as it likes.
+ *
+ * The lines are those of stdin, or of the < file, here-document or
+ * here-string. -j N runs N workers, one per processor by default, and -0
+ * splits on \0 rather than \n, in and out.
+ * */
+
+/* Runs the command given in argv over its input in parallel.
+ * @param context the context the workers run in
+ * @param argv (retained) the options, then the command and its arguments
+ * @crash YES failed to malloc; failed to fork
+ * @return 0 if every worker succeeded and answered every line, 1 otherwise
+ * */
+int run_map(struct Context * context, List * argv);
+
+#endif
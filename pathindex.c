@@ -0,0 +1,363 @@
+/* Andre Byrne
+ * 100045589 */
+
+#define _GNU_SOURCE /* st_mtim */
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "pathindex.h"
+
+/* the longest name the trie is walked for */
+#define PATH_NAME_MAX 1024
+
+/* struct PathNode
+ * the label of a node is labels[label .. label + length]. Its children are
+ * a list, linked through sibling. A node whose dirs is 0 ends no name. */
+struct PathNode {
+
+  size_t label;
+  unsigned int length;
+  unsigned int child; /* 0 for none: the root is no one's child */
+  unsigned int sibling;
+  unsigned long long dirs; /* bit n % 64 for the nth directory of the PATH */
+
+};
+
+/* struct PathDirectory
+ * a directory is read again once its modification time changes */
+struct PathDirectory {
+
+  char * path;
+  BOOL read;
+  struct timespec modified;
+
+};
+
+/* instance methods documented in pathindex.h */
+static int complete(PathIndex * self_, const char * prefix, List * matches);
+static void refresh(PathIndex * self_);
+
+/* Private instance methods */
+
+/* reads the nth directory again, replacing what it held before */
+static void read_directory(PathIndex * self, int directory);
+
+/* adds a name found in the given directories to the trie */
+static void insert(PathIndex * self, const char * name, unsigned long long dirs);
+
+/* makes a node with the given text as its label
+ * @return the new node */
+static unsigned int make_node(PathIndex * self, const char * text, size_t length);
+
+/* appends every name at or under the given node to names, the node's own
+ * name being the first depth characters of path */
+static void collect(const PathIndex * self, unsigned int node, char * path, size_t depth,
+    char *** names, int * count, int * capacity);
+
+/* Private class scope methods */
+
+/* orders names alphabetically, for qsort */
+static int compare_names(const void * left, const void * right);
+
+PathIndex * init_path_index(const List * PATH) {
+
+  PathIndex * self = (PathIndex *) failSafeMalloc(sizeof(PathIndex), "init_path_index");
+  const Node * node;
+  int index = 0;
+
+  self->directory_count = PATH->count(PATH);
+  self->directories = (struct PathDirectory *) failSafeMalloc(
+      sizeof(struct PathDirectory) * (self->directory_count + 1), "init_path_index");
+
+  for (node = PATH->head; NULL != node; node = node->next, index++) {
+    self->directories[index].path = string_with_size(strlen(node->string) + 1, "init_path_index");
+    strcpy(self->directories[index].path, node->string);
+    self->directories[index].read = false;
+  }
+
+  self->label_capacity = BUFSIZ;
+  self->label_length = 0;
+  self->labels = string_with_size(self->label_capacity, "init_path_index");
+
+  self->node_capacity = 1024;
+  self->node_count = 0;
+  self->nodes = (struct PathNode *) failSafeMalloc(sizeof(struct PathNode) * self->node_capacity, "init_path_index");
+  (void)make_node(self, "", 0);
+
+  self->complete = complete;
+  self->refresh = refresh;
+
+  return self;
+}
+
+void release_path_index(PathIndex * index) {
+
+  int directory;
+
+  if (NULL != index) {
+    for (directory = 0; directory < index->directory_count; directory++) {
+      free(index->directories[directory].path);
+    }
+
+    free(index->directories);
+    free(index->nodes);
+    free(index->labels);
+    free(index);
+  }
+}
+
+static int complete(PathIndex * self_, const char * prefix, List * matches) {
+  PathIndex * const self = self_;
+
+  size_t length = strlen(prefix), depth = 0;
+  unsigned int node = 0;
+  char path[PATH_NAME_MAX + 1];
+  char ** names = NULL;
+  int count = 0, capacity = 0, index;
+
+  refresh(self);
+
+  if (PATH_NAME_MAX < length) {
+    return 0;
+  }
+
+  /* down the trie as far as the prefix goes: the last node may have a
+   * label that runs past it */
+  while (depth < length) {
+    unsigned int child;
+    const struct PathNode * found = NULL;
+
+    for (child = self->nodes[node].child; 0 != child; child = self->nodes[child].sibling) {
+      if (self->labels[self->nodes[child].label] == prefix[depth]) {
+        found = &self->nodes[child];
+        break;
+      }
+    }
+
+    if (NULL == found || PATH_NAME_MAX < depth + found->length) {
+      return 0;
+    }
+
+    memcpy(&path[depth], &self->labels[found->label], found->length);
+    if (0 != strncmp(&path[depth], &prefix[depth],
+          (length - depth < found->length)? length - depth : found->length)) {
+      return 0;
+    }
+
+    depth += found->length;
+    node = child;
+  }
+
+  collect(self, node, path, depth, &names, &count, &capacity);
+  qsort(names, (size_t)count, sizeof(char *), compare_names);
+
+  for (index = 0; index < count; index++) {
+    (void)matches->append(matches, names[index]);
+    free(names[index]);
+  }
+  free(names);
+
+  return count;
+}
+
+static void refresh(PathIndex * self_) {
+  PathIndex * const self = self_;
+
+  int directory;
+
+  for (directory = 0; directory < self->directory_count; directory++) {
+    struct PathDirectory * entry = &self->directories[directory];
+    struct stat info;
+
+    if (-1 == stat(entry->path, &info)) {
+      continue;
+    }
+
+    if (!entry->read || info.st_mtim.tv_sec != entry->modified.tv_sec
+        || info.st_mtim.tv_nsec != entry->modified.tv_nsec) {
+      entry->read = true;
+      entry->modified = info.st_mtim;
+      read_directory(self, directory);
+    }
+  }
+}
+
+static void read_directory(PathIndex * self, int directory) {
+
+  unsigned long long bit = 1ULL << (directory % 64);
+  const char * path = self->directories[directory].path;
+  size_t length = strlen(path);
+  char * full = string_with_size(length + PATH_NAME_MAX + 2, "read_directory");
+  DIR * stream = opendir(path);
+  struct dirent * entry;
+  unsigned int node;
+  int other;
+
+  /* the names this directory no longer holds lose it */
+  for (node = 0; node < self->node_count; node++) {
+    self->nodes[node].dirs &= ~bit;
+  }
+
+  /* past 64 directories bits are shared, and the others sharing this one
+   * are read again to put back their names */
+  for (other = directory % 64; other < self->directory_count; other += 64) {
+    if (other != directory) self->directories[other].read = false;
+  }
+
+  if (NULL == stream) {
+    free(full);
+    return;
+  }
+
+  strcpy(full, path);
+  strcat(full, "/");
+
+  while (NULL != (entry = readdir(stream))) {
+    struct stat info;
+
+    if ('.' == entry->d_name[0] || PATH_NAME_MAX < strlen(entry->d_name)) {
+      continue;
+    }
+
+    strcpy(&full[length + 1], entry->d_name);
+
+    if (0 == stat(full, &info) && S_ISREG(info.st_mode) && 0 != (info.st_mode & (S_IXUSR | S_IXGRP | S_IXOTH))) {
+      insert(self, entry->d_name, bit);
+    }
+  }
+
+  (void)closedir(stream);
+  free(full);
+}
+
+static void insert(PathIndex * self, const char * name, unsigned long long dirs) {
+
+  unsigned int node = 0;
+  size_t length = strlen(name), depth = 0;
+
+  while (depth < length) {
+    unsigned int child, middle;
+    size_t common = 0;
+    struct PathNode * found = NULL;
+
+    for (child = self->nodes[node].child; 0 != child; child = self->nodes[child].sibling) {
+      if (self->labels[self->nodes[child].label] == name[depth]) {
+        found = &self->nodes[child];
+        break;
+      }
+    }
+
+    /* nothing starts with the rest of the name: it is a new leaf */
+    if (NULL == found) {
+      child = make_node(self, &name[depth], length - depth);
+      self->nodes[child].dirs = dirs;
+      self->nodes[child].sibling = self->nodes[node].child;
+      self->nodes[node].child = child;
+      return;
+    }
+
+    while (common < found->length && depth + common < length
+        && self->labels[found->label + common] == name[depth + common]) {
+      common++;
+    }
+
+    /* the label runs past where the name differs: split it in two */
+    if (common < found->length) {
+      middle = make_node(self, "", 0);
+      found = &self->nodes[child]; /* make_node may have moved the nodes */
+
+      self->nodes[middle].label = found->label;
+      self->nodes[middle].length = (unsigned int)common;
+      self->nodes[middle].child = child;
+      self->nodes[middle].sibling = found->sibling;
+
+      found->label += common;
+      found->length -= (unsigned int)common;
+      found->sibling = 0;
+
+      /* the middle takes the child's place among its siblings */
+      if (child == self->nodes[node].child) {
+        self->nodes[node].child = middle;
+      } else {
+        unsigned int before = self->nodes[node].child;
+        while (child != self->nodes[before].sibling) before = self->nodes[before].sibling;
+        self->nodes[before].sibling = middle;
+      }
+
+      child = middle;
+    }
+
+    depth += common;
+    node = child;
+  }
+
+  self->nodes[node].dirs |= dirs;
+}
+
+static unsigned int make_node(PathIndex * self, const char * text, size_t length) {
+
+  struct PathNode * node;
+
+  if (self->node_count == self->node_capacity) {
+    self->node_capacity *= 2;
+    self->nodes = (struct PathNode *) realloc(self->nodes, sizeof(struct PathNode) * self->node_capacity);
+    if (NULL == self->nodes) {
+      alertAndCrash("make_node", "failed to realloc");
+    }
+  }
+
+  while (self->label_length + length >= self->label_capacity) {
+    self->label_capacity *= 2;
+    self->labels = (char *) realloc(self->labels, self->label_capacity);
+    if (NULL == self->labels) {
+      alertAndCrash("make_node", "failed to realloc");
+    }
+  }
+
+  node = &self->nodes[self->node_count];
+  node->label = self->label_length;
+  node->length = (unsigned int)length;
+  node->child = 0;
+  node->sibling = 0;
+  node->dirs = 0;
+
+  memcpy(&self->labels[self->label_length], text, length);
+  self->label_length += length;
+
+  return self->node_count++;
+}
+
+static void collect(const PathIndex * self, unsigned int node, char * path, size_t depth,
+    char *** names, int * count, int * capacity) {
+
+  unsigned int child;
+
+  if (0 != self->nodes[node].dirs) {
+    if (*count == *capacity) {
+      *capacity = (0 == *capacity)? 64 : 2 * *capacity;
+      *names = (char **) realloc(*names, sizeof(char *) * *capacity);
+      if (NULL == *names) {
+        alertAndCrash("collect", "failed to realloc");
+      }
+    }
+
+    (*names)[*count] = string_with_size(depth + 1, "collect");
+    strncat((*names)[*count], path, depth);
+    (*count)++;
+  }
+
+  for (child = self->nodes[node].child; 0 != child; child = self->nodes[child].sibling) {
+    const struct PathNode * next = &self->nodes[child];
+
+    if (PATH_NAME_MAX >= depth + next->length) {
+      memcpy(&path[depth], &self->labels[next->label], next->length);
+      collect(self, child, path, depth + next->length, names, count, capacity);
+    }
+  }
+}
+
+static int compare_names(const void * left, const void * right) {
+
+  return strcmp(*(char * const *)left, *(char * const *)right);
+}
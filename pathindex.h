@@ -0,0 +1,73 @@
+/* Andre Byrne
+ * 100045589 */
+
+#ifndef PATHINDEX_H
+#define PATHINDEX_H
+
+#include "va_utils.h"
+#include "list.h"
+
+/* struct PathNode
+ * one edge of the trie, labelled with a run of characters. @see pathindex.c */
+struct PathNode;
+
+/* struct PathDirectory
+ * a directory of the PATH, and when it was last read. @see pathindex.c */
+struct PathDirectory;
+
+/* Class PathIndex
+ * brief: a PathIndex knows the name of every executable in the PATH, for
+ * completing commands as they are typed. The names are kept in a radix
+ * trie: each node is labelled with a run of characters held once in a
+ * shared buffer, so names with a common start share their nodes, and a
+ * node costs the same however long its label is.
+ *
+ * A directory is read the first time names are asked for, and again only
+ * when its modification time has changed since, so that asking costs one
+ * stat per directory and a walk of the trie. Each name records which
+ * directories it was found in, and reading a directory again takes it
+ * out of the names it no longer holds.
+ * */
+typedef struct PathIndex {
+
+  struct PathDirectory * directories;
+  int directory_count;
+
+  struct PathNode * nodes; /* nodes[0] is the root, with an empty label */
+  unsigned int node_count, node_capacity;
+
+  char * labels; /* every label, as offsets into this */
+  size_t label_length, label_capacity;
+
+  /* Appends every executable whose name starts with the given prefix to
+   * matches, sorted, reading again any directory that has changed.
+   * @param self_ the calling object
+   * @param prefix the start of the name
+   * @param matches the list to append the names to
+   * @crash YES failed to malloc
+   * @return the number of names appended
+   * */
+  int (*complete)(struct PathIndex * self_, const char * prefix, List * matches);
+
+  /* reads every directory that has changed since it was last read, or
+   * that has never been read, so that complete has nothing left to read
+   * @param self_ the calling object
+   * @crash YES failed to malloc
+   * */
+  void (*refresh)(struct PathIndex * self_);
+
+} PathIndex;
+
+/* Makes an index of the executables in the given directories. None of
+ * them is read until complete is called.
+ * @param PATH (retained) the directories, in order
+ * @alloc YES the caller becomes responsible for the return value
+ * @dtor YES PathIndex is a Class and instances must be freed with release_path_index
+ * @crash YES failed to malloc
+ * */
+PathIndex * init_path_index(const List * PATH);
+
+/* @dtor THIS is the destructor for Class PathIndex */
+void release_path_index(/*@null@*/ /*@only@*/ PathIndex * index);
+
+#endif
@@ -0,0 +1,619 @@
+/* Andre Byrne
+ * 100045589 */
+
+#define _GNU_SOURCE /* readahead, mincore, dl_iterate_phdr, nice */
+
+#include <elf.h>
+#include <link.h>
+#include <limits.h>
+#include <sys/mman.h>
+
+#include "prefetch.h"
+#include "cache.h"
+#include "recorder.h"
+
+/* struct Usage
+ * the runs of one executable: uses counts those of every session, and
+ * added those of this one that are not in the file yet */
+struct Usage {
+
+  char * path;
+  long uses, added;
+  long hits, misses; /* this session's */
+
+};
+
+/* instance methods documented in prefetch.h */
+static void used(Prefetch * self_, const char * executablePath);
+static void idle(Prefetch * self_, BOOL force);
+static void save(Prefetch * self_);
+static int run(Prefetch * self_, List * argv, int out);
+
+/* Private instance scope methods */
+
+/* finds the usage of the given executable, adding one if there is none
+ * @crash YES failed to malloc */
+static struct Usage * find(Prefetch * self, const char * path);
+
+/* reads the file of counts: each executable it has is counted as often as
+ * it says, plus the runs this session has added. Until the counts are
+ * first needed, only those runs are known */
+static void load(Prefetch * self);
+
+/* returns the usages, most used first, in an array the caller frees
+ * @alloc YES the caller becomes responsible for the return value */
+static struct Usage ** ranked(const Prefetch * self);
+
+/* Private class scope methods */
+
+/* whether the first PREFETCH_PROBE bytes of the given file are all in the
+ * page cache */
+static BOOL resident(const char * path);
+
+/* reads the given executable ahead, and every file it loads, in the
+ * grandchild @see idle
+ * @param directories where libraries are looked for */
+static void read_ahead(const char * path, const List * directories);
+
+/* reads one file ahead, and appends the interpreter and libraries it
+ * names, if it is an ELF file, to files */
+static void read_ahead_file(const char * path, List * files, const List * directories);
+
+/* appends the directory of every library loaded into the shell, for
+ * dl_iterate_phdr: the shell was loaded from where its commands are */
+static int add_directory(struct dl_phdr_info * info, size_t size, void * data);
+
+/* appends the given library, as it would be found, to files, if it is not
+ * already there
+ * @param origin the directory of the file that needs it, for $ORIGIN
+ * @param search the DT_RUNPATH or DT_RPATH of that file, or NULL */
+static void add_library(List * files, const char * name, const char * origin,
+    /*@null@*/ const char * search, const List * directories);
+
+/* whether the list has the given string */
+static BOOL has(const List * list, const char * string);
+
+/* orders usages from most to least used, for qsort */
+static int compare_usages(const void * left, const void * right);
+
+Prefetch * init_prefetch(const char * directory) {
+
+  Prefetch * self = (Prefetch *) failSafeMalloc(sizeof(Prefetch), "init_prefetch");
+
+  self->path = string_with_size(strlen(directory) + sizeof("/commands.usage"), "init_prefetch");
+  sprintf(self->path, "%s/commands.usage", directory);
+
+  self->usages = NULL;
+  self->count = 0;
+  self->capacity = 0;
+  self->hits = 0;
+  self->misses = 0;
+  self->prefetched = 0;
+  self->last_us = 0;
+  self->loaded = false;
+
+  self->used = used;
+  self->idle = idle;
+  self->save = save;
+  self->run = run;
+
+  return self;
+}
+
+void release_prefetch(Prefetch * prefetch) {
+
+  if (NULL != prefetch) {
+    int index;
+
+    prefetch->save(prefetch);
+
+    for (index = 0; index < prefetch->count; index++) {
+      free(prefetch->usages[index].path);
+    }
+
+    free(prefetch->usages);
+    free(prefetch->path);
+    free(prefetch);
+  }
+}
+
+static void used(Prefetch * self_, const char * executablePath) {
+  Prefetch * const self = self_;
+
+  struct Usage * usage = find(self, executablePath);
+
+  usage->uses++;
+  usage->added++;
+
+  if (resident(executablePath)) {
+    usage->hits++;
+    self->hits++;
+  } else {
+    usage->misses++;
+    self->misses++;
+  }
+}
+
+static void idle(Prefetch * self_, BOOL force) {
+  Prefetch * const self = self_;
+
+  struct Usage ** top;
+  long now = now_us();
+  pid_t pid;
+  int index;
+
+  if (!self->loaded) {
+    load(self);
+  }
+
+  if (0 == self->count
+      || (!force && 0 != self->last_us && now - self->last_us < PREFETCH_INTERVAL * 1000000L)) {
+    return;
+  }
+
+  self->last_us = now;
+  self->prefetched++;
+  top = ranked(self);
+
+  /* the grandchild is nobody's job: the shell reaps only its parent */
+  (void)fflush(NULL);
+  pid = fork();
+
+  if (0 == pid) {
+    if (0 == fork()) {
+      List * directories = init_list();
+      char * search = getenv("LD_LIBRARY_PATH");
+      char fallback[] = "/lib:/usr/lib:/lib64:/usr/lib64:/usr/local/lib";
+
+      /* the prompt, and whatever the user runs next, come first */
+      (void)nice(19);
+
+      if (NULL != search) {
+        char * copy = string_with_size(strlen(search) + 1, "idle");
+        strcpy(copy, search);
+        appendTokens(directories, copy, ":");
+        free(copy);
+      }
+      (void)dl_iterate_phdr(add_directory, directories);
+      appendTokens(directories, fallback, ":");
+
+      for (index = 0; index < self->count && index < PREFETCH_TOP; index++) {
+        read_ahead(top[index]->path, directories);
+      }
+
+      _exit(0);
+    }
+    _exit(0);
+  }
+
+  if (-1 == pid) {
+    perror(SHELL_NAME ": prefetch");
+  } else {
+    (void)waitpid(pid, NULL, 0);
+  }
+
+  free(top);
+}
+
+static void save(Prefetch * self_) {
+  Prefetch * const self = self_;
+
+  char * temporary;
+  FILE * stream;
+  int index;
+  BOOL changed = false;
+
+  for (index = 0; index < self->count; index++) {
+    changed = (BOOL)(changed || 0 < self->usages[index].added);
+  }
+
+  if (!changed) {
+    return;
+  }
+
+  /* what other sessions saved since this one started is kept */
+  load(self);
+
+  temporary = string_with_size(strlen(self->path) + 3 * sizeof(pid_t) + 2, "save");
+  sprintf(temporary, "%s.%d", self->path, (int)getpid());
+
+  /* the cache directory may not have been made yet */
+  *strrchr(self->path, '/') = '\0';
+  (void)make_directories(self->path);
+  self->path[strlen(self->path)] = '/';
+
+  if (NULL == (stream = fopen(temporary, "w"))) {
+    free(temporary);
+    return;
+  }
+
+  for (index = 0; index < self->count; index++) {
+    fprintf(stream, "%ld\t%s\n", self->usages[index].uses, self->usages[index].path);
+  }
+
+  if (0 == fclose(stream) && 0 == rename(temporary, self->path)) {
+    for (index = 0; index < self->count; index++) {
+      self->usages[index].added = 0;
+    }
+  } else {
+    (void)unlink(temporary);
+  }
+
+  free(temporary);
+}
+
+static int run(Prefetch * self_, List * argv, int out) {
+  Prefetch * const self = self_;
+
+  struct Usage ** top;
+  FILE * stream;
+  int index;
+
+  if (1 == argv->count(argv) && 0 == strcmp(argv->head->string, "now")) {
+    self->idle(self, true);
+    return 0;
+  }
+
+  if (!argv->isEmpty(argv)) {
+    fprintf(stderr, "%s: prefetch: usage: prefetch [now]\n", SHELL_NAME);
+    return 1;
+  }
+
+  /* buffered, on a descriptor of its own that fclose leaves out alone */
+  if (NULL == (stream = fdopen(dup(out), "w"))) {
+    perror(SHELL_NAME ": prefetch");
+    return 1;
+  }
+
+  if (!self->loaded) {
+    load(self);
+  }
+
+  top = ranked(self);
+
+  fprintf(stream, "%8s %6s %6s  %s\n", "runs", "hits", "misses", "executable");
+  for (index = 0; index < self->count; index++) {
+    fprintf(stream, "%8ld %6ld %6ld  %s%s\n", top[index]->uses, top[index]->hits, top[index]->misses,
+        top[index]->path, (index < PREFETCH_TOP)? " *" : "");
+  }
+  fprintf(stream, "%ld hits, %ld misses, %ld read aheads this session; * is read ahead at the prompt\n",
+      self->hits, self->misses, self->prefetched);
+
+  (void)fclose(stream);
+  free(top);
+
+  return 0;
+}
+
+static struct Usage * find(Prefetch * self, const char * path) {
+
+  struct Usage * usage;
+  int index;
+
+  for (index = 0; index < self->count; index++) {
+    if (0 == strcmp(self->usages[index].path, path)) {
+      return &self->usages[index];
+    }
+  }
+
+  if (self->count == self->capacity) {
+    self->capacity = (0 == self->capacity)? 32 : 2 * self->capacity;
+    self->usages = (struct Usage *) realloc(self->usages, sizeof(struct Usage) * self->capacity);
+    if (NULL == self->usages) {
+      alertAndCrash("find", "failed to realloc");
+    }
+  }
+
+  usage = &self->usages[self->count++];
+  usage->path = string_with_size(strlen(path) + 1, "find");
+  strcpy(usage->path, path);
+  usage->uses = usage->added = usage->hits = usage->misses = 0;
+
+  return usage;
+}
+
+static void load(Prefetch * self) {
+
+  FILE * stream = fopen(self->path, "r");
+  char line[PATH_MAX + 32];
+
+  self->loaded = true;
+
+  if (NULL == stream) {
+    return;
+  }
+
+  while (NULL != fgets(line, sizeof(line), stream)) {
+    char * path;
+    long uses = strtol(line, &path, 10);
+    struct Usage * usage;
+
+    if ('\t' != *path || '/' != path[1] || 0 >= uses) {
+      continue;
+    }
+
+    (void)chomp(++path, '\n');
+    usage = find(self, path);
+    usage->uses = uses + usage->added;
+  }
+
+  (void)fclose(stream);
+}
+
+static struct Usage ** ranked(const Prefetch * self) {
+
+  struct Usage ** top = (struct Usage **) failSafeMalloc(sizeof(struct Usage *) * (self->count + 1), "ranked");
+  int index;
+
+  for (index = 0; index < self->count; index++) {
+    top[index] = &self->usages[index];
+  }
+
+  qsort(top, (size_t)self->count, sizeof(struct Usage *), compare_usages);
+
+  return top;
+}
+
+static BOOL resident(const char * path) {
+
+  int file = open(path, O_RDONLY | O_CLOEXEC);
+  long page = sysconf(_SC_PAGESIZE);
+  struct stat status;
+  unsigned char * pages;
+  size_t length, index;
+  void * map;
+  BOOL all = true;
+
+  if (-1 == file) {
+    return false;
+  }
+
+  if (-1 == fstat(file, &status)) {
+    close(file);
+    return false;
+  }
+
+  /* an empty file has no pages to be out of memory */
+  if (0 == status.st_size) {
+    close(file);
+    return true;
+  }
+
+  length = (size_t)((status.st_size < PREFETCH_PROBE)? status.st_size : PREFETCH_PROBE);
+  map = mmap(NULL, length, PROT_READ, MAP_SHARED, file, 0);
+  close(file);
+
+  if (MAP_FAILED == map) {
+    return false;
+  }
+
+  /* mincore reads the page tables of the cache, and reads nothing in */
+  pages = (unsigned char *) failSafeMalloc((length + page - 1) / page, "resident");
+  if (0 == mincore(map, length, pages)) {
+    for (index = 0; index < (length + page - 1) / page && all; index++) {
+      all = (BOOL)(0 != (pages[index] & 1));
+    }
+  } else {
+    all = false;
+  }
+
+  free(pages);
+  (void)munmap(map, length);
+
+  return all;
+}
+
+static void read_ahead(const char * path, const List * directories) {
+
+  List * files = init_list();
+  const Node * node;
+
+  (void)files->append(files, path);
+
+  /* the list grows as it is walked: the libraries of each library too */
+  for (node = files->head; NULL != node; node = node->next) {
+    read_ahead_file(node->string, files, directories);
+  }
+
+  release_list(files);
+}
+
+static void read_ahead_file(const char * path, List * files, const List * directories) {
+
+  int file = open(path, O_RDONLY | O_CLOEXEC);
+  struct stat status;
+  Elf64_Ehdr header;
+  Elf64_Phdr * programs = NULL;
+  Elf64_Dyn * dynamic = NULL;
+  size_t entries = 0, index, needed_count = 0;
+  Elf64_Xword strtab = 0, search = 0, * needed = NULL;
+  char * origin, * slash, name[PATH_MAX];
+  int phdr;
+  BOOL found_search = false;
+
+  if (-1 == file) {
+    return;
+  }
+
+  if (-1 == fstat(file, &status)) {
+    close(file);
+    return;
+  }
+
+  /* the whole file, and only then the headers: they are in the first page */
+  (void)readahead(file, 0, (size_t)status.st_size);
+
+  if (sizeof(header) != pread(file, &header, sizeof(header), 0)
+      || 0 != memcmp(header.e_ident, ELFMAG, SELFMAG) || ELFCLASS64 != header.e_ident[EI_CLASS]
+      || sizeof(Elf64_Phdr) != header.e_phentsize || 0 == header.e_phnum) {
+    close(file);
+    return;
+  }
+
+  programs = (Elf64_Phdr *) failSafeMalloc(sizeof(Elf64_Phdr) * header.e_phnum, "read_ahead_file");
+  if ((ssize_t)(sizeof(Elf64_Phdr) * header.e_phnum)
+      != pread(file, programs, sizeof(Elf64_Phdr) * header.e_phnum, (off_t)header.e_phoff)) {
+    header.e_phnum = 0;
+  }
+
+  for (phdr = 0; phdr < header.e_phnum; phdr++) {
+    const Elf64_Phdr * program = &programs[phdr];
+
+    if (PT_INTERP == program->p_type && program->p_filesz < sizeof(name)) {
+      memset(name, 0, sizeof(name));
+      if ((ssize_t)program->p_filesz == pread(file, name, program->p_filesz, (off_t)program->p_offset)
+          && '/' == name[0] && !has(files, name) && files->count(files) < PREFETCH_FILES) {
+        (void)files->append(files, name);
+      }
+
+    } else if (PT_DYNAMIC == program->p_type && NULL == dynamic && 0 < program->p_filesz
+        && program->p_filesz < 64 * 1024) {
+      dynamic = (Elf64_Dyn *) failSafeMalloc(program->p_filesz, "read_ahead_file");
+      entries = ((ssize_t)program->p_filesz == pread(file, dynamic, program->p_filesz, (off_t)program->p_offset))?
+          program->p_filesz / sizeof(Elf64_Dyn) : 0;
+    }
+  }
+
+  needed = (Elf64_Xword *) failSafeMalloc(sizeof(Elf64_Xword) * (entries + 1), "read_ahead_file");
+  for (index = 0; index < entries && DT_NULL != dynamic[index].d_tag; index++) {
+    switch (dynamic[index].d_tag) {
+      case DT_NEEDED :
+        needed[needed_count++] = dynamic[index].d_un.d_val;
+        break;
+      case DT_STRTAB :
+        strtab = dynamic[index].d_un.d_ptr;
+        break;
+      case DT_RUNPATH :
+      case DT_RPATH :
+        search = dynamic[index].d_un.d_val;
+        found_search = true;
+        break;
+      default :
+        break;
+    }
+  }
+
+  /* the string table is given as an address: the segment it is loaded
+   * with says where that is in the file */
+  for (phdr = 0; phdr < header.e_phnum && 0 != strtab; phdr++) {
+    const Elf64_Phdr * program = &programs[phdr];
+
+    if (PT_LOAD == program->p_type && program->p_vaddr <= strtab
+        && strtab < program->p_vaddr + program->p_filesz) {
+      char search_path[PATH_MAX];
+      off_t table = (off_t)(strtab - program->p_vaddr + program->p_offset);
+
+      origin = string_with_size(strlen(path) + 1, "read_ahead_file");
+      strcpy(origin, path);
+      slash = strrchr(origin, '/');
+      if (NULL != slash) *slash = '\0';
+
+      memset(search_path, 0, sizeof(search_path));
+      if (found_search) {
+        (void)pread(file, search_path, sizeof(search_path) - 1, table + (off_t)search);
+      }
+
+      for (index = 0; index < needed_count; index++) {
+        memset(name, 0, sizeof(name));
+        if (0 < pread(file, name, sizeof(name) - 1, table + (off_t)needed[index])) {
+          add_library(files, name, origin, (found_search)? search_path : NULL, directories);
+        }
+      }
+
+      free(origin);
+      break;
+    }
+  }
+
+  free(needed);
+  free(dynamic);
+  free(programs);
+  close(file);
+}
+
+static void add_library(List * files, const char * name, const char * origin,
+    const char * search, const List * directories) {
+
+  char candidate[PATH_MAX];
+  const Node * node;
+
+  if (files->count(files) >= PREFETCH_FILES) {
+    return;
+  }
+
+  if (NULL != strchr(name, '/')) {
+    if (!has(files, name)) (void)files->append(files, name);
+    return;
+  }
+
+  /* the run path of the file that needs it, with $ORIGIN in it */
+  if (NULL != search) {
+    char * copy = string_with_size(strlen(search) + 1, "add_library"), * rest = copy, * entry;
+    strcpy(copy, search);
+
+    while (NULL != (entry = strsep(&rest, ":"))) {
+      if (0 == strncmp(entry, "$ORIGIN", 7)) {
+        snprintf(candidate, sizeof(candidate), "%s%s/%s", origin, entry + 7, name);
+      } else {
+        snprintf(candidate, sizeof(candidate), "%s/%s", entry, name);
+      }
+
+      if ('\0' != entry[0] && 0 == access(candidate, R_OK)) {
+        if (!has(files, candidate)) (void)files->append(files, candidate);
+        free(copy);
+        return;
+      }
+    }
+
+    free(copy);
+  }
+
+  for (node = directories->head; NULL != node; node = node->next) {
+    snprintf(candidate, sizeof(candidate), "%s/%s", node->string, name);
+
+    if (0 == access(candidate, R_OK)) {
+      if (!has(files, candidate)) (void)files->append(files, candidate);
+      return;
+    }
+  }
+}
+
+static int add_directory(struct dl_phdr_info * info, size_t size, void * data) {
+
+  List * directories = (List *)data;
+  const char * slash = (NULL == info->dlpi_name)? NULL : strrchr(info->dlpi_name, '/');
+  char directory[PATH_MAX];
+
+  (void)size;
+
+  if (NULL != slash && info->dlpi_name != slash && (size_t)(slash - info->dlpi_name) < sizeof(directory)) {
+    memcpy(directory, info->dlpi_name, (size_t)(slash - info->dlpi_name));
+    directory[slash - info->dlpi_name] = '\0';
+
+    if (!has(directories, directory)) {
+      (void)directories->append(directories, directory);
+    }
+  }
+
+  return 0;
+}
+
+static BOOL has(const List * list, const char * string) {
+
+  const Node * node;
+
+  for (node = list->head; NULL != node; node = node->next) {
+    if (0 == strcmp(node->string, string)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static int compare_usages(const void * left, const void * right) {
+
+  long a = (*(struct Usage * const *)left)->uses, b = (*(struct Usage * const *)right)->uses;
+
+  return (a > b)? -1 : (a < b)? 1 : 0;
+}
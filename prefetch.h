@@ -0,0 +1,103 @@
+/* Andre Byrne
+ * 100045589 */
+
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include "va_utils.h"
+#include "list.h"
+
+/* how many of the most used commands are read ahead at the prompt */
+#define PREFETCH_TOP 8
+
+/* the fewest seconds between two read aheads */
+#define PREFETCH_INTERVAL 30
+
+/* the most files read ahead for one command: the executable, its
+ * interpreter and the libraries it needs, and theirs */
+#define PREFETCH_FILES 64
+
+/* how much of an executable must be in the page cache, from its start,
+ * for it to count as a hit */
+#define PREFETCH_PROBE (4L * 1024L * 1024L)
+
+/* struct Usage
+ * how often one executable was run. @see prefetch.c */
+struct Usage;
+
+/* Class Prefetch
+ * brief: Prefetch counts how often each executable is run, and while the
+ * shell waits at the prompt it has the kernel read the most used of them
+ * back into the page cache, with the ELF interpreter and every library
+ * they need, so that the first run after the cache was dropped does not
+ * wait on the disk:
+ *
+ *   $$ prefetch
+ *   $$ prefetch now
+ *
+ * The counts are kept in commands.usage in the cache directory, a line
+ * for each executable: the number of runs, a tab, and its path. A session
+ * adds only what it counted itself to what is in the file when it saves,
+ * so sessions that end at once both keep their counts.
+ *
+ * The read ahead is done by a grandchild of the shell, so that the prompt
+ * never waits on it, and at most once every PREFETCH_INTERVAL seconds. A
+ * run is a hit if the first PREFETCH_PROBE bytes of the executable were
+ * all in memory when it was forked, and a miss otherwise.
+ * */
+typedef struct Prefetch {
+
+  char * path; /* the file the counts are kept in */
+
+  struct Usage * usages;
+  int count, capacity;
+
+  long hits, misses; /* of the runs of this session */
+  long prefetched; /* the read aheads started in this session */
+  long last_us; /* when the last one was started, or 0 */
+  BOOL loaded; /* whether the file has been read, which waits for a count to be needed */
+
+  /* counts a run of the given executable, and whether it was in memory
+   * @param self_ the calling object
+   * @param executablePath the absolute path of the executable
+   * @crash YES failed to malloc
+   * */
+  void (*used)(struct Prefetch * self_, const char * executablePath);
+
+  /* reads the most used executables ahead, unless that was done less than
+   * PREFETCH_INTERVAL seconds ago: called as the shell waits for a line
+   * @param self_ the calling object
+   * @param force read them ahead now, however recently that was done
+   * */
+  void (*idle)(struct Prefetch * self_, BOOL force);
+
+  /* adds the runs counted by this session to the file of counts
+   * @param self_ the calling object
+   * */
+  void (*save)(struct Prefetch * self_);
+
+  /* the prefetch builtin: prefetch shows the most used executables, their
+   * hits and misses, and prefetch now reads them ahead at once
+   * @param self_ the calling object
+   * @param argv (retained) the arguments to prefetch
+   * @param out the descriptor the counts are written to
+   * @return 0 on success, 1 on a bad argument
+   * */
+  int (*run)(struct Prefetch * self_, List * argv, int out);
+
+} Prefetch;
+
+/* Counts the runs of a session, adding them to those kept in the given
+ * directory, which are read the first time they are needed.
+ * @param directory the cache directory, @see Cache
+ * @alloc YES the caller becomes responsible for the return value
+ * @dtor YES Prefetch is a Class and instances must be freed with release_prefetch
+ * @crash YES failed to malloc
+ * */
+Prefetch * init_prefetch(const char * directory);
+
+/* saves the counts of this session and frees them
+ * @dtor THIS is the destructor for Class Prefetch */
+void release_prefetch(/*@null@*/ /*@only@*/ Prefetch * prefetch);
+
+#endif
@@ -0,0 +1,848 @@
+/* Andre Byrne
+ * 100045589 */
+
+#include "program.h"
+#include "vash.h"
+
+/* the words that open and close blocks */
+static const char * keywords[] = {
+  "for", "in", "do", "done", "while", "if", "then", "elif", "else", "fi", NULL
+};
+
+/* struct Parser
+ * the state of a compile: the tokens of the source, how far through them
+ * the parser is, and the program being built */
+typedef struct Parser {
+
+  char ** tokens;
+  int count;
+  int position;
+
+  Program * program;
+  struct Vash * vash;
+
+  /* the body the next << takes, of the here-documents read after the
+   * source, in order */
+  /*@null@*/ const Node * here_document;
+
+  BOOL failed;
+  BOOL incomplete; /* failed because the source ended too soon */
+
+} Parser;
+
+/* instance methods documented in program.h */
+static int run(Program * self_, Vash * vash);
+
+/* Private class scope methods */
+
+/* Splits source into words and separators. Separators are ; and newline,
+ * && and ||, each its own token. A lone & stays in its phrase, for the
+ * Command to see, and is followed by a ; since it ends the phrase too.
+ * Quotes are kept in the words, to be dealt with when the word is lexed
+ * again, as it runs. @see lex_words
+ * @alloc YES the caller becomes responsible for the return value
+ * */
+static List * lex_program(const char * source);
+
+/* returns true if the word must be lexed again each time it is used: it
+ * has a variable, a substitution, a quote or a pattern in it */
+static BOOL needs_lexing(const char * word);
+
+/* returns true if the token ends a phrase */
+static BOOL is_separator(const char * token);
+
+/* returns true if the token is one of the keywords above */
+static BOOL is_keyword(const char * token);
+
+/* Private instance scope methods */
+
+/* appends an instruction to the program
+ * @return the index of the instruction, to be patched with its target */
+static int emit(Program * self, OPCODE opcode, int operand);
+
+/* runs a single phrase of the program
+ * @return the exit status of the phrase */
+static int run_phrase(Program * self, Vash * vash, Template * phrase);
+
+/* the recursive descent parser: one method per rule of the grammar
+ *
+ *   list     := and_or ((; | newline) and_or)*
+ *   and_or   := command ((&& | ||) command)*
+ *   command  := for | while | if | phrase
+ *   for      := for NAME in WORD* (; | newline) do list done
+ *   while    := while list do list done
+ *   if       := if list then list (elif list then list)* (else list)? fi
+ * */
+static void parse_list(Parser * parser, const char * const * stops);
+static void parse_and_or(Parser * parser);
+static void parse_command(Parser * parser);
+static void parse_for(Parser * parser);
+static void parse_while(Parser * parser);
+static void parse_if(Parser * parser);
+static void parse_phrase(Parser * parser);
+
+/* the parser may look at the current token, and must consume it to move on */
+static /*@null@*/ const char * peek(const Parser * parser);
+static BOOL at(const Parser * parser, const char * token);
+static void skip_separators(Parser * parser);
+
+/* consumes the given keyword, or fails if it is not the current token */
+static BOOL expect(Parser * parser, const char * keyword);
+
+/* reports a syntax error at the current token, unless there is no current
+ * token, in which case the source is merely incomplete */
+static void fail(Parser * parser);
+
+BOOL is_program(const char * line) {
+
+  List * tokens = lex_program(line);
+  BOOL command_position = true, program = false;
+
+  while (!tokens->isEmpty(tokens)) {
+    char * token = tokens->pop(tokens);
+
+    if (0 == strcmp(token, "&&") || 0 == strcmp(token, "||")) {
+      program = true;
+    } else if (command_position && (0 == strcmp(token, "for")
+          || 0 == strcmp(token, "while") || 0 == strcmp(token, "if"))) {
+      program = true;
+    }
+
+    command_position = is_separator(token);
+    free(token);
+  }
+
+  release_list(tokens);
+
+  return program;
+}
+
+Program * init_program(Vash * vash, const char * source, BOOL * incomplete) {
+
+  Program * self = (Program *) failSafeMalloc(sizeof(Program), "init_program");
+  List * tokens = lex_program(source);
+  Parser parser;
+  int index;
+
+  self->code = NULL;
+  self->length = 0;
+  self->capacity = 0;
+  self->phrases = NULL;
+  self->phrase_count = 0;
+  self->loops = NULL;
+  self->loop_count = 0;
+
+  self->run = run;
+
+  parser.count = tokens->count(tokens);
+  parser.tokens = (char **) failSafeMalloc(sizeof(char *) * (parser.count + 1), "init_program");
+  for (index = 0; index < parser.count; index++) {
+    parser.tokens[index] = tokens->pop(tokens);
+  }
+  parser.position = 0;
+  parser.program = self;
+  parser.vash = vash;
+  parser.here_document = vash->here_documents->head;
+  parser.failed = false;
+  parser.incomplete = false;
+
+  parse_list(&parser, NULL);
+
+  /* the whole source is one list: anything left over is out of place */
+  if (!parser.failed && NULL != peek(&parser)) {
+    fail(&parser);
+  }
+
+  *incomplete = parser.incomplete;
+
+  for (index = 0; index < parser.count; index++) {
+    free(parser.tokens[index]);
+  }
+  free(parser.tokens);
+  release_list(tokens);
+
+  if (parser.failed) {
+    release_program(self);
+    self = NULL;
+  }
+
+  return self;
+}
+
+void release_program(Program * program) {
+
+  if (NULL != program) {
+    int index, word;
+
+    for (index = 0; index < program->phrase_count; index++) {
+      Template * phrase = &program->phrases[index];
+
+      for (word = 0; word < phrase->count; word++) {
+        free(phrase->words[word]);
+      }
+
+      free(phrase->words);
+      free(phrase->expands);
+      free(phrase->text);
+      free(phrase->context_name);
+      free(phrase->executablePath);
+      free(phrase->resolved_cwd);
+    }
+
+    for (index = 0; index < program->loop_count; index++) {
+      Loop * loop = &program->loops[index];
+
+      for (word = 0; word < loop->count; word++) {
+        free(loop->items[word]);
+      }
+
+      free(loop->items);
+      free(loop->expands);
+      free(loop->name);
+      release_list(loop->values);
+    }
+
+    free(program->phrases);
+    free(program->loops);
+    free(program->code);
+    free(program);
+  }
+}
+
+static int run(Program * self_, Vash * vash) {
+  Program * const self = self_;
+
+  int counter = 0, status = 0;
+  int mark = vash->substitution_count; /* for the <(...) in loop items */
+
+  while (counter < self->length && !vash->terminate_session) {
+    const Instruction * instruction = &self->code[counter++];
+    Loop * loop;
+
+    switch (instruction->opcode) {
+      case RUN :
+        status = run_phrase(self, vash, &self->phrases[instruction->operand]);
+        break;
+      case JUMP :
+        counter = instruction->target;
+        break;
+      case JUMP_IF_FAILED :
+        if (0 != status) counter = instruction->target;
+        break;
+      case JUMP_IF_SUCCEEDED :
+        if (0 == status) counter = instruction->target;
+        break;
+      case ENTER_LOOP : {
+        int index;
+
+        loop = &self->loops[instruction->operand];
+        while (!loop->values->isEmpty(loop->values)) {
+          free(loop->values->pop(loop->values));
+        }
+
+        /* an item with a variable in it may become several items, or none */
+        for (index = 0; index < loop->count; index++) {
+          if (loop->expands[index]) {
+            (void)lex_words(loop->values, loop->items[index], vash->getDefault(vash), vash);
+          } else {
+            (void)loop->values->append(loop->values, loop->items[index]);
+          }
+        }
+        break;
+      }
+      case NEXT :
+        loop = &self->loops[instruction->operand];
+        if (loop->values->isEmpty(loop->values)) {
+          counter = instruction->target;
+        } else {
+          /* loop variables are globals, like any other plain name=value */
+          char * value = loop->values->pop(loop->values);
+          vash->variables->set(vash->variables, loop->name, value);
+          free(value);
+        }
+        break;
+      case SUCCEED :
+        status = 0;
+        break;
+      default :
+        break;
+    }
+  }
+
+  vash->closeSubstitutions(vash, mark);
+
+  return status;
+}
+
+static int run_phrase(Program * self, Vash * vash, Template * phrase) {
+
+  Context * context = vash->getDefault(vash);
+  Table * scope = vash->variables; /* where name=value goes */
+  List * argv = init_list();
+  BOOL resolved = (BOOL)(!phrase->expands[0] && !phrase->assigns); /* is the command as compiled */
+  int index, exit_status = 0;
+  int mark = vash->substitution_count; /* the substitutions of this phrase come after */
+  long started = now_us();
+
+  if (NULL != phrase->context_name) {
+    Context * named = vash->getContext(vash, phrase->context_name);
+
+    if (NULL != named) {
+      context = named;
+      scope = context->variables;
+    }
+  }
+
+  vash->current_context = context;
+
+  /* only the words with variables, quotes or patterns in them are lexed
+   * again */
+  for (index = 0; index < phrase->count; index++) {
+    if (phrase->expands[index]) {
+      if (0 != lex_words(argv, phrase->words[index], context, vash)) {
+        exit_status = 1;
+      }
+    } else {
+      (void)argv->append(argv, phrase->words[index]);
+    }
+  }
+
+  /* a phrase whose patterns matched too much runs nothing, as
+   * interpret_phrase has it */
+  if (0 != exit_status) {
+    while (!argv->isEmpty(argv)) {
+      free(argv->pop(argv));
+    }
+    release_list(argv);
+    vash->current_context = vash->getDefault(vash);
+    vash->variables->set(vash->variables, "?", "1");
+    vash->closeSubstitutions(vash, mark);
+    return 1;
+  }
+
+  exit_status = vash->runWords(vash, context, scope, argv, (resolved)? phrase : NULL,
+      mark, phrase->text, started);
+
+  release_list(argv);
+
+  return exit_status;
+}
+
+int run_compiled(Template * phrase, Context * context, const char * message, List * argv) {
+
+  if (NULL == phrase->resolved_cwd || 0 != strcmp(phrase->resolved_cwd, context->cwd)) {
+    free(phrase->executablePath);
+    free(phrase->resolved_cwd);
+
+    phrase->executablePath = resolve_command(context, message);
+    phrase->resolved_cwd = string_with_size(strlen(context->cwd) + 1, "run_compiled");
+    strcpy(phrase->resolved_cwd, context->cwd);
+  }
+
+  /* callCommand says why it could not be found */
+  if (NULL == phrase->executablePath) {
+    return context->callCommand(context, message, argv);
+  }
+
+  return context->callResolved(context, message, phrase->executablePath, argv);
+}
+
+static List * lex_program(const char * source) {
+
+  List * tokens = init_list();
+  size_t length = strlen(source), size = 0, index;
+  char * word = string_with_size(length + 1, "lex_program");
+  char quote = '\0'; /* the quote we are inside of, if any */
+
+  for (index = 0; index <= length; index++) {
+    const char * separator = NULL;
+    char character = source[index];
+    size_t span;
+
+    /* so is everything in a substitution, separators and quotes and all */
+    if ('\'' != quote && 0 < (span = substitution_length(&source[index]))) {
+      strncpy(&word[size], &source[index], span);
+      size += span;
+      index += span - 1;
+      continue;
+    }
+
+    /* a quoted separator is part of its word */
+    if ('\0' != quote && '\0' != character) {
+      if (character == quote) quote = '\0';
+      word[size++] = character;
+      continue;
+    }
+
+    if ('\'' == character || '"' == character) {
+      quote = character;
+      word[size++] = character;
+      continue;
+    }
+
+    if ('\0' == character || ' ' == character || '\t' == character || '\r' == character) {
+      /* ends a word */
+    } else if (';' == character) {
+      separator = ";";
+    } else if ('\n' == character) {
+      separator = "\n";
+    } else if ('&' == character && '&' == source[index + 1]) {
+      separator = "&&";
+      index++;
+    } else if ('|' == character && '|' == source[index + 1]) {
+      separator = "||";
+      index++;
+    } else if ('&' == character) {
+      separator = "&";
+    } else {
+      word[size++] = character;
+      continue;
+    }
+
+    if (0 < size) {
+      word[size] = '\0';
+      (void)tokens->append(tokens, word);
+      size = 0;
+    }
+
+    if (NULL != separator) {
+      (void)tokens->append(tokens, separator);
+
+      /* & sends its phrase to the background and ends it */
+      if (0 == strcmp(separator, "&")) {
+        (void)tokens->append(tokens, ";");
+      }
+    }
+  }
+
+  free(word);
+
+  return tokens;
+}
+
+static BOOL is_separator(const char * token) {
+
+  return (BOOL)(0 == strcmp(token, ";") || 0 == strcmp(token, "\n")
+      || 0 == strcmp(token, "&&") || 0 == strcmp(token, "||"));
+}
+
+static BOOL is_keyword(const char * token) {
+
+  int index;
+
+  for (index = 0; NULL != keywords[index]; index++) {
+    if (0 == strcmp(token, keywords[index])) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static BOOL needs_lexing(const char * word) {
+
+  return (BOOL)(NULL != strpbrk(word, "$`('\"*?["));
+}
+
+static int emit(Program * self, OPCODE opcode, int operand) {
+
+  if (self->length == self->capacity) {
+    self->capacity = (0 == self->capacity)? 16 : 2 * self->capacity;
+    self->code = (Instruction *) realloc(self->code, sizeof(Instruction) * self->capacity);
+    if (NULL == self->code) {
+      alertAndCrash("emit", "failed to realloc");
+    }
+  }
+
+  self->code[self->length].opcode = opcode;
+  self->code[self->length].operand = operand;
+  self->code[self->length].target = -1;
+
+  return self->length++;
+}
+
+static const char * peek(const Parser * parser) {
+
+  return (parser->position < parser->count)? parser->tokens[parser->position] : NULL;
+}
+
+static BOOL at(const Parser * parser, const char * token) {
+
+  const char * current = peek(parser);
+
+  return (BOOL)(NULL != current && 0 == strcmp(current, token));
+}
+
+static void skip_separators(Parser * parser) {
+
+  while (at(parser, ";") || at(parser, "\n")) {
+    parser->position++;
+  }
+}
+
+static BOOL expect(Parser * parser, const char * keyword) {
+
+  if (!parser->failed && at(parser, keyword)) {
+    parser->position++;
+    return true;
+  }
+
+  fail(parser);
+
+  return false;
+}
+
+static void fail(Parser * parser) {
+
+  const char * current = peek(parser);
+
+  if (parser->failed) {
+    return;
+  }
+
+  parser->failed = true;
+
+  if (NULL == current) {
+    parser->incomplete = true;
+  } else {
+    fprintf(stderr, "%s: syntax error near %s\n", SHELL_NAME,
+        (0 == strcmp(current, "\n"))? "newline" : current);
+  }
+}
+
+static void parse_list(Parser * parser, const char * const * stops) {
+
+  skip_separators(parser);
+
+  while (!parser->failed && NULL != peek(parser)) {
+    int index;
+
+    /* the list ends at the first keyword its block is waiting for */
+    for (index = 0; NULL != stops && NULL != stops[index]; index++) {
+      if (at(parser, stops[index])) {
+        return;
+      }
+    }
+
+    parse_and_or(parser);
+
+    if (parser->failed || NULL == peek(parser)) {
+      break;
+    }
+
+    /* the next command must be separated from this one */
+    if (!at(parser, ";") && !at(parser, "\n")) {
+      fail(parser);
+      break;
+    }
+
+    skip_separators(parser);
+  }
+}
+
+static void parse_and_or(Parser * parser) {
+
+  parse_command(parser);
+
+  while (!parser->failed && (at(parser, "&&") || at(parser, "||"))) {
+    OPCODE opcode = (at(parser, "&&"))? JUMP_IF_FAILED : JUMP_IF_SUCCEEDED;
+    int jump;
+
+    parser->position++;
+
+    /* the command after && or || may be on the next line */
+    while (at(parser, "\n")) {
+      parser->position++;
+    }
+
+    jump = emit(parser->program, opcode, 0);
+    parse_command(parser);
+    parser->program->code[jump].target = parser->program->length;
+  }
+}
+
+static void parse_command(Parser * parser) {
+
+  const char * current = peek(parser);
+
+  if (NULL == current || is_separator(current)) {
+    fail(parser);
+  } else if (0 == strcmp(current, "for")) {
+    parse_for(parser);
+  } else if (0 == strcmp(current, "while")) {
+    parse_while(parser);
+  } else if (0 == strcmp(current, "if")) {
+    parse_if(parser);
+  } else if (is_keyword(current)) {
+    fail(parser); /* a keyword out of place: done with no do, and so on */
+  } else {
+    parse_phrase(parser);
+  }
+}
+
+static void parse_for(Parser * parser) {
+
+  static const char * const stops[] = { "done", NULL };
+
+  Program * program = parser->program;
+  Loop * loop;
+  const char * name;
+  int index, top, next, jump;
+
+  parser->position++; /* for */
+
+  name = peek(parser);
+  if (NULL == name || 0 == variable_name_length(name) || '\0' != name[variable_name_length(name)]) {
+    fail(parser);
+    return;
+  }
+
+  program->loops = (Loop *) realloc(program->loops, sizeof(Loop) * (program->loop_count + 1));
+  if (NULL == program->loops) {
+    alertAndCrash("parse_for", "failed to realloc");
+  }
+
+  index = program->loop_count++;
+  loop = &program->loops[index];
+  loop->name = string_with_size(strlen(name) + 1, "parse_for");
+  strcpy(loop->name, name);
+  loop->items = NULL;
+  loop->expands = NULL;
+  loop->count = 0;
+  loop->values = init_list();
+
+  parser->position++; /* NAME */
+
+  if (!expect(parser, "in")) {
+    return;
+  }
+
+  while (NULL != peek(parser) && !is_separator(peek(parser))) {
+    const char * item = peek(parser);
+
+    loop->items = (char **) realloc(loop->items, sizeof(char *) * (loop->count + 1));
+    loop->expands = (BOOL *) realloc(loop->expands, sizeof(BOOL) * (loop->count + 1));
+    if (NULL == loop->items || NULL == loop->expands) {
+      alertAndCrash("parse_for", "failed to realloc");
+    }
+
+    loop->items[loop->count] = string_with_size(strlen(item) + 1, "parse_for");
+    strcpy(loop->items[loop->count], item);
+    loop->expands[loop->count] = needs_lexing(item);
+    loop->count++;
+    parser->position++;
+  }
+
+  skip_separators(parser);
+  if (!expect(parser, "do")) {
+    return;
+  }
+
+  (void)emit(program, ENTER_LOOP, index);
+  top = program->length;
+  next = emit(program, NEXT, index);
+
+  parse_list(parser, stops);
+  if (!expect(parser, "done")) {
+    return;
+  }
+
+  jump = emit(program, JUMP, 0);
+  program->code[jump].target = top;
+  program->code[next].target = program->length;
+  (void)emit(program, SUCCEED, 0);
+}
+
+static void parse_while(Parser * parser) {
+
+  static const char * const conditions[] = { "do", NULL };
+  static const char * const stops[] = { "done", NULL };
+
+  Program * program = parser->program;
+  int top = program->length, out, jump;
+
+  parser->position++; /* while */
+
+  parse_list(parser, conditions);
+  if (!expect(parser, "do")) {
+    return;
+  }
+
+  out = emit(program, JUMP_IF_FAILED, 0);
+
+  parse_list(parser, stops);
+  if (!expect(parser, "done")) {
+    return;
+  }
+
+  jump = emit(program, JUMP, 0);
+  program->code[jump].target = top;
+  program->code[out].target = program->length;
+  (void)emit(program, SUCCEED, 0);
+}
+
+static void parse_if(Parser * parser) {
+
+  static const char * const conditions[] = { "then", NULL };
+  static const char * const branches[] = { "elif", "else", "fi", NULL };
+  static const char * const stops[] = { "fi", NULL };
+
+  Program * program = parser->program;
+
+  /* the jumps out of each branch form a chain through their targets, which
+   * is followed once the end of the whole if is known */
+  int chain = -1, jump, skip;
+
+  parser->position++; /* if */
+
+  for (;;) {
+    parse_list(parser, conditions);
+    if (!expect(parser, "then")) {
+      return;
+    }
+
+    skip = emit(program, JUMP_IF_FAILED, 0);
+    parse_list(parser, branches);
+    if (parser->failed) {
+      return;
+    }
+
+    jump = emit(program, JUMP, 0);
+    program->code[jump].target = chain;
+    chain = jump;
+
+    program->code[skip].target = program->length;
+
+    if (at(parser, "elif")) {
+      parser->position++;
+      continue;
+    }
+
+    if (at(parser, "else")) {
+      parser->position++;
+      parse_list(parser, stops);
+    } else {
+      /* an if with no branch taken succeeds */
+      (void)emit(program, SUCCEED, 0);
+    }
+
+    break;
+  }
+
+  if (!expect(parser, "fi")) {
+    return;
+  }
+
+  while (-1 != chain) {
+    jump = program->code[chain].target;
+    program->code[chain].target = program->length;
+    chain = jump;
+  }
+}
+
+static void parse_phrase(Parser * parser) {
+
+  Program * program = parser->program;
+  Template * phrase;
+  const char * first = peek(parser);
+  const char * separator = context_separator(first);
+  size_t capacity = 1;
+  int index;
+
+  program->phrases = (Template *) realloc(program->phrases, sizeof(Template) * (program->phrase_count + 1));
+  if (NULL == program->phrases) {
+    alertAndCrash("parse_phrase", "failed to realloc");
+  }
+
+  index = program->phrase_count++;
+  phrase = &program->phrases[index];
+  phrase->context_name = NULL;
+  phrase->words = NULL;
+  phrase->expands = NULL;
+  phrase->count = 0;
+  phrase->assigns = false;
+  phrase->executablePath = NULL;
+  phrase->resolved_cwd = NULL;
+  phrase->text = string_with_size(capacity, "parse_phrase");
+
+  /* name:command runs in the named context */
+  if (NULL != separator) {
+    size_t length = (size_t)(separator - first);
+
+    phrase->context_name = string_with_size(length + 1, "parse_phrase");
+    strncat(phrase->context_name, first, length);
+  }
+
+  while (NULL != peek(parser) && !is_separator(peek(parser))) {
+    const char * word = peek(parser);
+    const char * here_string = NULL;
+    BOOL body = false, literal = false; /* the body of a here-document is never lexed */
+
+    if (0 != phrase->count) {
+      phrase->text = string_append(phrase->text, &capacity, " ");
+    }
+    phrase->text = string_append(phrase->text, &capacity, word);
+
+    if (0 == phrase->count && NULL != separator) {
+      word = &separator[1];
+    }
+
+    /* the bodies were read after the source, before it was compiled: each
+     * << takes the next, and keeps it for every time the phrase runs */
+    if (0 == strncmp(word, "<<", 2) && 0 != strncmp(word, "<<<", 3)) {
+      here_string = (NULL == parser->here_document)? "" : parser->here_document->string;
+      body = true;
+      if (NULL != parser->here_document) {
+        parser->here_document = parser->here_document->next;
+      }
+
+      /* << EOF: the delimiter is the next word and is not an argument */
+      if ('\0' == word[2] && parser->position + 1 < parser->count
+          && !is_separator(parser->tokens[parser->position + 1])) {
+        parser->position++;
+      }
+      word = "<<";
+    }
+
+    /* <<<word is two words, as attachHereDocuments would have it */
+    if (0 == strncmp(word, "<<<", 3) && '\0' != word[3]) {
+      here_string = &word[3];
+      word = "<<<";
+    }
+
+    do {
+      phrase->words = (char **) realloc(phrase->words, sizeof(char *) * (phrase->count + 1));
+      phrase->expands = (BOOL *) realloc(phrase->expands, sizeof(BOOL) * (phrase->count + 1));
+      if (NULL == phrase->words || NULL == phrase->expands) {
+        alertAndCrash("parse_phrase", "failed to realloc");
+      }
+
+      phrase->expands[phrase->count] = (BOOL)(!literal && needs_lexing(word));
+      if (literal || phrase->expands[phrase->count]) {
+        phrase->words[phrase->count] = string_with_size(strlen(word) + 1, "parse_phrase");
+        strcpy(phrase->words[phrase->count], word);
+      } else {
+        /* a word that is not lexed again is marked as lex_words would */
+        phrase->words[phrase->count] = literal_word(word);
+      }
+      phrase->count++;
+
+      word = here_string;
+      here_string = NULL;
+      literal = body;
+    } while (NULL != word);
+
+    parser->position++;
+  }
+
+  phrase->assigns = is_assignment(phrase->words[0]);
+
+  /* name: with nothing after it names no command */
+  if ('\0' == phrase->words[0][0]) {
+    fprintf(stderr, "%s: %s: no command given\n", SHELL_NAME, first);
+    parser->failed = true;
+    return;
+  }
+
+  (void)emit(program, RUN, index);
+}
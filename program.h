@@ -0,0 +1,137 @@
+/* Andre Byrne
+ * 100045589 */
+
+#ifndef PROGRAM_H
+#define PROGRAM_H
+
+#include "va_utils.h"
+#include "list.h"
+
+/* forward declarations: a Program runs its phrases through Vash */
+struct Vash;
+struct Context;
+
+/* the instructions understood by Program->run */
+typedef enum OPCODE {
+  RUN, /* runs phrases[operand], which sets the status */
+  JUMP, /* continues at target */
+  JUMP_IF_FAILED, /* continues at target if the status is not 0 */
+  JUMP_IF_SUCCEEDED, /* continues at target if the status is 0 */
+  ENTER_LOOP, /* expands the items of loops[operand], ready for NEXT */
+  NEXT, /* binds the next item of loops[operand], or continues at target */
+  SUCCEED /* sets the status to 0 */
+} OPCODE;
+
+typedef struct Instruction {
+
+  OPCODE opcode;
+  int operand; /* the phrase or loop the instruction works on */
+  int target; /* where a jump goes */
+
+} Instruction;
+
+/* struct Template
+ * a phrase of the program, split into words once, when it is compiled.
+ * Only words with a $, quotes or a pattern in them are lexed again each time
+ * it runs.
+ * */
+typedef struct Template {
+
+  /*@null@*/ char * context_name; /* the context named by name:command */
+
+  char ** words; /* the command and its arguments, context part removed */
+  BOOL * expands; /* per word: must it be lexed again, for a $, quotes or a
+                   * pattern */
+  int count; /* the number of words */
+
+  BOOL assigns; /* does it start with name=value */
+
+  char * text; /* the words as written, for the tracer */
+
+  /* the executable the command resolved to, and the cwd of the context it
+   * was resolved in. It is resolved again only if that cwd changes */
+  /*@null@*/ char * executablePath;
+  /*@null@*/ char * resolved_cwd;
+
+} Template;
+
+/* struct Loop
+ * the variable and the items of a for loop */
+typedef struct Loop {
+
+  char * name; /* the variable, which is global */
+  char ** items; /* as written, before expansion */
+  BOOL * expands;
+  int count;
+
+  List * values; /* the expanded items not yet bound by NEXT */
+
+} Loop;
+
+/* Class Program
+ * brief: a Program is a line of vash with control flow in it, compiled once
+ * into a short list of instructions and then run as many times as its loops
+ * say, without tokenizing, decoding or resolving anything again:
+ *
+ *   $$ for f in a b c; do wc -c < $f > $f.size; done
+ *   $$ while test -e lock; do sleep 1; done
+ *   $$ if make; then ./lab02; else echo broken; fi
+ *   $$ make && ./lab02 || echo broken
+ *
+ * Loop variables are shell variables like any other. @see lexer.h
+ * */
+typedef struct Program {
+
+  Instruction * code;
+  int length; /* the number of instructions */
+  int capacity;
+
+  Template * phrases;
+  int phrase_count;
+
+  Loop * loops;
+  int loop_count;
+
+  /* Runs the program to its end, or until the shell is asked to exit.
+   * @param self_ the calling object
+   * @param vash the shell to run the phrases in
+   * @crash YES failed to malloc
+   * @return the status of the last phrase run, or 0 if a loop or if finished
+   *         last
+   * */
+  int (*run)(struct Program * self_, struct Vash * vash);
+
+} Program;
+
+/* returns true if the given line needs the compiler: it has a for, while or
+ * if in it where a command would be, or it has && or || in it */
+BOOL is_program(const char * line);
+
+/* Compiles the given source, which may span several lines.
+ * @see release_program
+ * @param vash the shell the program will be run in, to decode builtins
+ * @param source (retained) the text of the program
+ * @param incomplete set if the source ended before its last block did, in
+ *                   which case more lines should be read and compiling tried
+ *                   again. Nothing is printed in that case.
+ * @alloc YES the caller becomes responsible for the return value
+ * @dtor YES Program is a Class and instances must be freed with release_program
+ * @null YES if the source is not a valid program, after saying why on stderr
+ * @crash YES failed to malloc
+ * */
+/*@null@*/ Program * init_program(struct Vash * vash, const char * source, BOOL * incomplete);
+
+/* @dtor THIS is the destructor for Class Program */
+void release_program(/*@null@*/ /*@only@*/ Program * program);
+
+/* runs the command of a compiled phrase, resolving its executable only when
+ * it has not been resolved before in the cwd of the context
+ * @param phrase the phrase the command was compiled from
+ * @param context the context it runs in
+ * @param message the command, as compiled
+ * @param argv (retained) its arguments
+ * @return the exit status of the command
+ * */
+int run_compiled(Template * phrase, struct Context * context, const char * message, List * argv);
+
+#endif
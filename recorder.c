@@ -0,0 +1,276 @@
+/* Andre Byrne
+ * 100045589 */
+
+#define _GNU_SOURCE /* clock_gettime, getline */
+
+#include "recorder.h"
+
+/* the first line of every log, naming its fields */
+#define RECORD_HEADER "# offset_ms\tthink_ms\tresolve_us\trun_us\tstatus\tcontext\texecutable\tline\n"
+
+/* instance methods documented in recorder.h */
+static void begin(Recorder * self_, const char * line);
+static void extend(Recorder * self_, const char * line);
+static void finish(Recorder * self_, const char * context, const char * executable,
+    int status, long resolve_us, long run_us);
+
+/* Private class scope methods */
+
+/* writes the given text to the log with its tabs, newlines and
+ * backslashes escaped */
+static void write_escaped(FILE * log, const char * text);
+
+/* undoes write_escaped in place, and returns the text */
+static char * unescape_field(char * text);
+
+/* orders longs from least to greatest, for qsort */
+static int compare_longs(const void * left, const void * right);
+
+/* returns the given percentile of a sorted array */
+static long percentile(const long * sorted, int count, int percent);
+
+Recorder * init_recorder(const char * path) {
+
+  Recorder * self;
+  FILE * log = fopen(path, "w");
+
+  if (NULL == log) {
+    fprintf(stderr, "%s: --record: %s: ", SHELL_NAME, path);
+    perror("");
+    return NULL;
+  }
+
+  /* no child needs the log */
+  (void)fcntl(fileno(log), F_SETFD, FD_CLOEXEC);
+
+  self = (Recorder *) failSafeMalloc(sizeof(Recorder), "init_recorder");
+
+  self->log = log;
+  self->epoch = now_us();
+  self->read_at = self->epoch;
+  self->finished = self->epoch;
+  self->capacity = BUFSIZ;
+  self->text = string_with_size(self->capacity, "init_recorder");
+
+  self->begin = begin;
+  self->extend = extend;
+  self->finish = finish;
+
+  fputs(RECORD_HEADER, self->log);
+
+  return self;
+}
+
+void release_recorder(Recorder * recorder) {
+
+  if (NULL != recorder) {
+    (void)fclose(recorder->log);
+    free(recorder->text);
+    free(recorder);
+  }
+}
+
+static void begin(Recorder * self_, const char * line) {
+  Recorder * const self = self_;
+
+  self->read_at = now_us();
+  self->text[0] = '\0';
+  self->text = string_append(self->text, &self->capacity, line);
+}
+
+static void extend(Recorder * self_, const char * line) {
+  Recorder * const self = self_;
+
+  size_t length = strcspn(line, "\n");
+
+  self->text = string_append(self->text, &self->capacity, "\n");
+  if (length == strlen(line)) {
+    self->text = string_append(self->text, &self->capacity, line);
+  } else {
+    char * copy = string_with_size(length + 1, "extend");
+    strncat(copy, line, length);
+    self->text = string_append(self->text, &self->capacity, copy);
+    free(copy);
+  }
+}
+
+static void finish(Recorder * self_, const char * context, const char * executable,
+    int status, long resolve_us, long run_us) {
+  Recorder * const self = self_;
+
+  fprintf(self->log, "%ld\t%ld\t%ld\t%ld\t%d\t",
+      (self->read_at - self->epoch) / 1000,
+      (self->read_at - self->finished) / 1000,
+      resolve_us, run_us, status);
+
+  write_escaped(self->log, context);
+  fputc('\t', self->log);
+  write_escaped(self->log, executable);
+  fputc('\t', self->log);
+  write_escaped(self->log, self->text);
+  fputc('\n', self->log);
+
+  /* a session that crashes keeps every line it finished */
+  (void)fflush(self->log);
+
+  self->finished = now_us();
+}
+
+Record * read_record(FILE * log) {
+
+  char * buffer = NULL, * fields[8], * cursor;
+  size_t size = 0;
+  ssize_t length;
+  Record * record;
+  int index;
+
+  /* the header, and any other comment, is skipped */
+  do {
+    length = getline(&buffer, &size, log);
+  } while (0 < length && '#' == buffer[0]);
+
+  if (0 >= length) {
+    free(buffer);
+    return NULL;
+  }
+
+  (void)chomp(buffer, '\n');
+
+  cursor = buffer;
+  for (index = 0; index < 8; index++) {
+    fields[index] = cursor;
+    cursor = (7 == index)? NULL : strchr(cursor, '\t');
+
+    if (7 > index && NULL == cursor) {
+      fprintf(stderr, "%s: --replay: malformed record: %s\n", SHELL_NAME, buffer);
+      free(buffer);
+      return read_record(log);
+    }
+
+    if (NULL != cursor) {
+      *cursor++ = '\0';
+    }
+  }
+
+  record = (Record *) failSafeMalloc(sizeof(Record), "read_record");
+
+  record->offset_ms = strtol(fields[0], NULL, 10);
+  record->think_ms = strtol(fields[1], NULL, 10);
+  record->resolve_us = strtol(fields[2], NULL, 10);
+  record->run_us = strtol(fields[3], NULL, 10);
+  record->status = (int)strtol(fields[4], NULL, 10);
+
+  record->context = string_with_size(strlen(fields[5]) + 1, "read_record");
+  strcpy(record->context, unescape_field(fields[5]));
+  record->executable = string_with_size(strlen(fields[6]) + 1, "read_record");
+  strcpy(record->executable, unescape_field(fields[6]));
+  record->line = string_with_size(strlen(fields[7]) + 1, "read_record");
+  strcpy(record->line, unescape_field(fields[7]));
+
+  free(buffer);
+
+  return record;
+}
+
+void release_record(Record * record) {
+
+  if (NULL != record) {
+    free(record->context);
+    free(record->executable);
+    free(record->line);
+    free(record);
+  }
+}
+
+void compare_replay(long * recorded, long * replayed, int count, int differ) {
+
+  static const int percents[] = {50, 90, 99, 100};
+  int index;
+
+  fprintf(stderr, "%s: replay: %d lines, %d with a different exit status\n", SHELL_NAME, count, differ);
+
+  if (0 == count) {
+    return;
+  }
+
+  qsort(recorded, (size_t)count, sizeof(long), compare_longs);
+  qsort(replayed, (size_t)count, sizeof(long), compare_longs);
+
+  fprintf(stderr, "%s: replay: run time (ms)     p50       p90       p99       max\n", SHELL_NAME);
+
+  fprintf(stderr, "%s: replay: recorded  ", SHELL_NAME);
+  for (index = 0; index < 4; index++) {
+    fprintf(stderr, "%10.3f", percentile(recorded, count, percents[index]) / 1000.0);
+  }
+
+  fprintf(stderr, "\n%s: replay: replayed  ", SHELL_NAME);
+  for (index = 0; index < 4; index++) {
+    fprintf(stderr, "%10.3f", percentile(replayed, count, percents[index]) / 1000.0);
+  }
+
+  fputc('\n', stderr);
+}
+
+long now_us(void) {
+
+  struct timespec now;
+
+  (void)clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (long)now.tv_sec * 1000000L + now.tv_nsec / 1000L;
+}
+
+static void write_escaped(FILE * log, const char * text) {
+
+  for (; '\0' != *text; text++) {
+    switch (*text) {
+      case '\t' :
+        fputs("\\t", log);
+        break;
+      case '\n' :
+        fputs("\\n", log);
+        break;
+      case '\\' :
+        fputs("\\\\", log);
+        break;
+      default :
+        fputc(*text, log);
+        break;
+    }
+  }
+}
+
+static char * unescape_field(char * text) {
+
+  char * from = text, * to = text;
+
+  while ('\0' != *from) {
+    if ('\\' == from[0] && '\0' != from[1]) {
+      *to++ = ('t' == from[1])? '\t' : ('n' == from[1])? '\n' : from[1];
+      from += 2;
+    } else {
+      *to++ = *from++;
+    }
+  }
+
+  *to = '\0';
+
+  return text;
+}
+
+static int compare_longs(const void * left, const void * right) {
+
+  long a = *(const long *)left, b = *(const long *)right;
+
+  return (a > b) - (a < b);
+}
+
+static long percentile(const long * sorted, int count, int percent) {
+
+  int index = (count * percent + 99) / 100 - 1;
+
+  if (0 > index) index = 0;
+  if (count <= index) index = count - 1;
+
+  return sorted[index];
+}
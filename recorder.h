@@ -0,0 +1,119 @@
+/* Andre Byrne
+ * 100045589 */
+
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include "va_utils.h"
+
+/* struct Record
+ * one line of a session, as the recorder writes it and replay reads it */
+typedef struct Record {
+
+  long offset_ms; /* when the line was read, from the start of the session */
+  long think_ms; /* how long the shell sat at the prompt before it */
+  long resolve_us; /* how long finding its executable took */
+  long run_us; /* how long running it took */
+  int status; /* its exit status */
+
+  char * context; /* the name of the context it ran in */
+  char * executable; /* what it ran: a path, a builtin, dag or program */
+
+  /* the line as typed, followed by every line read to finish it: the rest
+   * of its blocks and here-documents, each after a \n */
+  char * line;
+
+} Record;
+
+/* Class Recorder
+ * brief: a Recorder writes down a session as it happens, one line of the
+ * log per line of input, so that it can be replayed later:
+ *
+ *   $ ./lab02 --record session.log
+ *   $ ./lab02 --replay session.log --speed max
+ *   $ ./lab02 --replay session.log --record again.log
+ *
+ * The log is text, with a tab between fields, so that two of them can be
+ * compared with diff or cut. Tabs, newlines and backslashes in a line are
+ * written as \t, \n and \\.
+ * */
+typedef struct Recorder {
+
+  FILE * log;
+
+  /* in microseconds, @see now_us */
+  long epoch; /* when the session started */
+  long read_at; /* when the current line was read */
+  long finished; /* when the last line was done */
+
+  char * text; /* the current line, and the lines read to finish it */
+  size_t capacity;
+
+  /* starts recording a line that has just been read
+   * @param self_ the calling object
+   * @param line the line, without its newline
+   * @crash YES failed to malloc
+   * */
+  void (*begin)(struct Recorder * self_, const char * line);
+
+  /* adds a line read to finish the current one, for a block or a
+   * here-document
+   * @param self_ the calling object
+   * @param line the line, with or without its newline
+   * @crash YES failed to malloc
+   * */
+  void (*extend)(struct Recorder * self_, const char * line);
+
+  /* writes the current line to the log, with how it went
+   * @param self_ the calling object
+   * @param context the name of the context the line ran in
+   * @param executable what the line ran
+   * @param status the exit status of the line
+   * @param resolve_us how long finding the executable took
+   * @param run_us how long running the line took
+   * */
+  void (*finish)(struct Recorder * self_, const char * context, const char * executable,
+      int status, long resolve_us, long run_us);
+
+} Recorder;
+
+/* Opens a log for writing, replacing any log already at the path.
+ * @param path where the log is written
+ * @alloc YES the caller becomes responsible for the return value
+ * @dtor YES Recorder is a Class and instances must be freed with release_recorder
+ * @null YES if the log could not be opened, after saying why on stderr
+ * @crash YES failed to malloc
+ * */
+/*@null@*/ Recorder * init_recorder(const char * path);
+
+/* @dtor THIS is the destructor for Class Recorder */
+void release_recorder(/*@null@*/ /*@only@*/ Recorder * recorder);
+
+/* Reads the next record of a log.
+ * @param log a log written by a Recorder
+ * @alloc YES the caller becomes responsible for the return value
+ * @dtor YES records must be freed with release_record
+ * @null YES at the end of the log
+ * @crash YES failed to malloc
+ * */
+/*@null@*/ Record * read_record(FILE * log);
+
+/* @dtor THIS is the destructor for struct Record */
+void release_record(/*@null@*/ /*@only@*/ Record * record);
+
+/* Prints to stderr how the run times of a replay compare with those of
+ * the recording: the median, 90th and 99th percentiles and the maximum
+ * of each, and how many lines exited differently.
+ * @param recorded the run times in the log, in microseconds
+ * @param replayed the run times of the replay, in the same order
+ * @param count the number of lines replayed
+ * @param differ the number of lines whose exit status changed
+ * @bang YES both arrays are sorted in place
+ * */
+void compare_replay(long * recorded, long * replayed, int count, int differ);
+
+/* returns the time in microseconds on a clock that only goes forward, for
+ * measuring how long things take */
+long now_us(void);
+
+#endif
@@ -0,0 +1,321 @@
+/* Andre Byrne
+ * 100045589 */
+
+#define _GNU_SOURCE /* splice, tee, copy_file_range, F_SETPIPE_SZ */
+
+#include <poll.h>
+#include <sys/sendfile.h>
+
+#include "relay.h"
+#include "recorder.h"
+
+/* the ways relay_copy may move bytes, from cheapest to dearest */
+typedef enum COPY_METHOD {COPY_FILE_RANGE, SPLICE, SENDFILE, BUFFER} COPY_METHOD;
+
+/* Private class scope methods */
+
+/* moves exactly length bytes from the pipe in_fd to out_fd with splice(2).
+ * Some descriptors (terminals, for instance) cannot be spliced to: then,
+ * and only then, the bytes are copied through a small buffer instead.
+ * @return 0 on success, 1 if the bytes could not be moved
+ * */
+static int drain(int in_fd, int out_fd, size_t length);
+
+/* writes length bytes, or everything up to end of file, from in_fd to
+ * out_fd by way of read(2) and write(2). This is the slow path of drain.
+ * If out_fd is -1 the bytes are read and thrown away.
+ * @return 0 on success, 1 otherwise
+ * */
+static int copy_through_buffer(int in_fd, int out_fd, size_t length);
+
+int relay_fan_out(int in_fd, const int * outs, int count) {
+
+  int (*scratch)[2];
+  int * targets;
+  int index, pipe_size, live = count;
+  int exit_status = 0;
+  ssize_t length, moved;
+
+  if (1 > count) {
+    return 0;
+  }
+
+  /* a scratch pipe as large as the input pipe is guaranteed to accept
+   * everything that tee finds in the input pipe */
+  pipe_size = fcntl(in_fd, F_GETPIPE_SZ);
+  scratch = failSafeMalloc(sizeof(*scratch) * count, "relay_fan_out");
+  targets = (int *) failSafeMalloc(sizeof(int) * count, "relay_fan_out");
+
+  for (index = 0; index < count; index++) {
+    targets[index] = outs[index];
+
+    if (-1 == pipe(scratch[index])) {
+      perror(SHELL_NAME ": relay");
+      while (0 < index--) {
+        close(scratch[index][0]);
+        close(scratch[index][1]);
+      }
+      free(scratch);
+      free(targets);
+      return 1;
+    }
+
+    if (0 < pipe_size) {
+      (void)fcntl(scratch[index][1], F_SETPIPE_SZ, pipe_size);
+    }
+  }
+
+  while (0 == exit_status && 0 < live) {
+
+    /* duplicate whatever is in the input pipe, without consuming it,
+     * into the scratch pipe of every output but the last */
+    length = -1;
+    for (index = 0; index < live - 1 && 0 == exit_status; index++) {
+
+      do {
+        moved = tee(in_fd, scratch[index][1], (0 > length)? RELAY_CHUNK : (size_t)length, 0);
+      } while (-1 == moved && EINTR == errno);
+
+      if (-1 == moved) {
+        perror(SHELL_NAME ": relay: tee");
+        exit_status = 1;
+      } else if (0 > length) {
+        length = moved;
+      } else if (moved != length) {
+        fprintf(stderr, "%s: relay: short copy\n", SHELL_NAME);
+        exit_status = 1;
+      }
+
+      if (0 == exit_status && 0 < moved && 0 != drain(scratch[index][0], targets[index], (size_t)moved)) {
+        if (EPIPE != errno) {
+          exit_status = 1;
+        } else {
+          /* the reader went away: forget it, and park its scratch pipe,
+           * which may still hold data, beyond the live outputs */
+          int temp[2];
+
+          live--;
+          targets[index] = targets[live];
+          memcpy(temp, scratch[index], sizeof temp);
+          memcpy(scratch[index], scratch[live], sizeof temp);
+          memcpy(scratch[live], temp, sizeof temp);
+          index--;
+        }
+      }
+    }
+
+    if (0 != exit_status || 0 == length || 0 == live) {
+      break; /* end of file: every output has seen every byte */
+    }
+
+    /* the last output consumes the input, by as much as the others saw */
+    if (0 > length) {
+      do {
+        moved = splice(in_fd, NULL, targets[live - 1], NULL, RELAY_CHUNK, SPLICE_F_MOVE);
+      } while (-1 == moved && EINTR == errno);
+
+      if (-1 == moved && EINVAL == errno) {
+        /* the output cannot be spliced to: copy the rest of the stream */
+        exit_status = copy_through_buffer(in_fd, targets[live - 1], (size_t)-1);
+        break;
+      }
+
+      if (-1 == moved && EPIPE != errno) {
+        perror(SHELL_NAME ": relay: splice");
+        exit_status = 1;
+      }
+
+      if (0 == moved || (-1 == moved && EPIPE == errno)) {
+        break;
+      }
+    } else if (0 != drain(in_fd, targets[live - 1], (size_t)length)) {
+      if (EPIPE != errno) {
+        exit_status = 1;
+      } else {
+        /* the others have seen bytes the last never took: throw them away */
+        live--;
+        exit_status = copy_through_buffer(in_fd, -1, (size_t)length);
+      }
+    }
+  }
+
+  for (index = 0; index < count; index++) {
+    close(scratch[index][0]);
+    close(scratch[index][1]);
+  }
+
+  free(scratch);
+  free(targets);
+
+  return exit_status;
+}
+
+static int drain(int in_fd, int out_fd, size_t length) {
+
+  ssize_t moved;
+
+  while (0 < length) {
+    moved = splice(in_fd, NULL, out_fd, NULL, length, SPLICE_F_MOVE);
+
+    if (-1 == moved && EINTR == errno) {
+      continue;
+    } else if (-1 == moved && EINVAL == errno) {
+      return copy_through_buffer(in_fd, out_fd, length);
+    } else if (0 >= moved) {
+      if (EPIPE != errno) {
+        perror(SHELL_NAME ": relay: splice");
+      }
+      return 1;
+    }
+
+    length -= (size_t)moved;
+  }
+
+  return 0;
+}
+
+static int copy_through_buffer(int in_fd, int out_fd, size_t length) {
+
+  char buffer[BUFSIZ];
+  ssize_t got, put, offset;
+
+  while (0 < length) {
+    got = read(in_fd, buffer, (length < sizeof buffer)? length : sizeof buffer);
+
+    if (-1 == got && EINTR == errno) continue;
+    if (0 >= got) return (0 == got)? 0 : 1;
+
+    for (offset = (-1 == out_fd)? got : 0; offset < got; offset += put) {
+      put = write(out_fd, &buffer[offset], (size_t)(got - offset));
+      if (-1 == put && EINTR == errno) {
+        put = 0;
+      } else if (-1 == put) {
+        if (EPIPE != errno) {
+          perror(SHELL_NAME ": relay: write");
+        }
+        return 1;
+      }
+    }
+
+    length -= (size_t)got;
+  }
+
+  return 0;
+}
+
+int relay_metered(int in_fd, int out_fd, RelayMeter * meter) {
+
+  int exit_status = 0;
+
+  meter->bytes = 0;
+  meter->waited_in_us = 0;
+  meter->waited_out_us = 0;
+  meter->started_us = now_us();
+
+  for (;;) {
+    struct pollfd side;
+    long waited;
+    ssize_t moved = splice(in_fd, NULL, out_fd, NULL, RELAY_CHUNK, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+    if (0 < moved) {
+      meter->bytes += moved;
+      continue;
+    }
+
+    /* end of file: the writer closed its end and the pipe is empty */
+    if (0 == moved) {
+      break;
+    }
+
+    if (EINTR == errno) {
+      continue;
+    }
+
+    /* the reader went away, or something worse */
+    if (EAGAIN != errno) {
+      if (EPIPE != errno) {
+        perror(SHELL_NAME ": relay: splice");
+      }
+      exit_status = 1;
+      break;
+    }
+
+    /* nothing to read is the writer's doing, and nowhere to put it the
+     * reader's */
+    side.fd = in_fd;
+    side.events = POLLIN;
+    waited = now_us();
+
+    if (0 == poll(&side, 1, 0)) {
+      while (-1 == poll(&side, 1, -1) && EINTR == errno);
+      meter->waited_in_us += now_us() - waited;
+    } else {
+      side.fd = out_fd;
+      side.events = POLLOUT;
+      while (-1 == poll(&side, 1, -1) && EINTR == errno);
+      meter->waited_out_us += now_us() - waited;
+    }
+  }
+
+  meter->finished_us = now_us();
+  meter->metered = true;
+
+  return exit_status;
+}
+
+int relay_copy(int in_fd, int out_fd) {
+
+  struct stat in_stat, out_stat;
+  COPY_METHOD method = BUFFER;
+  ssize_t moved;
+
+  if (-1 == fstat(in_fd, &in_stat) || -1 == fstat(out_fd, &out_stat)) {
+    perror(SHELL_NAME ": copy");
+    return 1;
+  }
+
+  if (S_ISFIFO(in_stat.st_mode) || S_ISFIFO(out_stat.st_mode)) {
+    method = SPLICE;
+  } else if (S_ISREG(in_stat.st_mode) && S_ISREG(out_stat.st_mode)) {
+    method = COPY_FILE_RANGE;
+  } else if (S_ISREG(in_stat.st_mode)) {
+    method = SENDFILE;
+  }
+
+  for (;;) {
+    switch (method) {
+      case COPY_FILE_RANGE :
+        moved = copy_file_range(in_fd, NULL, out_fd, NULL, RELAY_CHUNK, 0);
+        break;
+      case SPLICE :
+        moved = splice(in_fd, NULL, out_fd, NULL, RELAY_CHUNK, SPLICE_F_MOVE);
+        break;
+      case SENDFILE :
+        moved = sendfile(out_fd, in_fd, NULL, RELAY_CHUNK);
+        break;
+      default :
+        return copy_through_buffer(in_fd, out_fd, (size_t)-1);
+    }
+
+    if (0 == moved) {
+      return 0;
+
+    } else if (-1 == moved && EINTR == errno) {
+      continue;
+
+    } else if (-1 == moved && (EXDEV == errno || EINVAL == errno
+          || ENOSYS == errno || EOPNOTSUPP == errno
+          || (EBADF == errno && COPY_FILE_RANGE == method))) {
+      /* (copy_file_range also refuses an output opened with O_APPEND) */
+      /* the file systems or the kernel won't have it: step down. Nothing
+       * has been moved by the failed call, so the offsets are still good */
+      method = (COPY_FILE_RANGE == method)? SENDFILE : BUFFER;
+
+    } else if (-1 == moved) {
+      if (EPIPE != errno) {
+        perror(SHELL_NAME ": copy");
+      }
+      return 1;
+    }
+  }
+}
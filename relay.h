@@ -0,0 +1,79 @@
+/* Andre Byrne
+ * 100045589 */
+
+#ifndef RELAY_H
+#define RELAY_H
+
+#include "va_utils.h"
+
+/* the most a relay will ask the kernel to move in a single call */
+#define RELAY_CHUNK (1 << 20)
+
+/* Relay
+ * brief: a relay moves bytes from one descriptor to others entirely inside
+ * the kernel. Data read from a pipe is duplicated with tee(2) and moved with
+ * splice(2), so it never passes through a user space buffer. The shell uses
+ * relays wherever a stage has more than one place to send its output:
+ *
+ *   make > build.log > archive.log
+ *   make |> grep error |> gzip > build.log.gz
+ * */
+
+/* Copies everything that can be read from the pipe in_fd to every one of
+ * the given output descriptors, until in_fd reaches end of file. Outputs
+ * may be pipes or regular files. Every output but the last receives its
+ * copy through a private scratch pipe which is filled with tee(2) and
+ * drained with splice(2); the last output consumes the data from in_fd.
+ * An output whose reader goes away is dropped and the rest carry on.
+ * @pre in_fd is the read end of a pipe
+ * @pre SIGPIPE is ignored
+ * @param in_fd the pipe to be drained
+ * @param outs the descriptors which will each receive a copy of the data
+ * @param count the number of descriptors in outs
+ * @return 0 if every byte reached every output, 1 otherwise
+ * */
+int relay_fan_out(int in_fd, const int * outs, int count);
+
+/* RelayMeter
+ * what a metered relay saw of the pipe it sat in, @see relay_metered. A
+ * meter is written by the relay and read by the shell once the relay has
+ * finished, so it lives in memory the two share.
+ * */
+typedef struct RelayMeter {
+
+  BOOL metered; /* false for a pipe no relay sat in */
+  long long bytes; /* every byte moved */
+
+  /* in microseconds: how long the relay waited for its writer to write,
+   * and for its reader to read */
+  long waited_in_us, waited_out_us;
+
+  long started_us, finished_us; /* @see now_us */
+
+} RelayMeter;
+
+/* Moves everything from the pipe in_fd to the pipe out_fd with splice(2),
+ * as a pipe between them would, and counts the bytes and the time spent
+ * waiting on either side. Each splice is made without blocking: when it
+ * cannot move anything, the relay polls the side that held it up.
+ * @pre in_fd and out_fd are pipes
+ * @pre SIGPIPE is ignored
+ * @param in_fd the pipe to be drained
+ * @param out_fd the pipe to be filled
+ * @param meter the counts, which are zeroed first
+ * @return 0 if every byte was moved, 1 otherwise
+ * */
+int relay_metered(int in_fd, int out_fd, RelayMeter * meter);
+
+/* Copies everything from in_fd to out_fd, from their current offsets, with
+ * the cheapest mechanism the pair allows: copy_file_range(2) between
+ * regular files, which may share blocks or copy on the device itself;
+ * splice(2) when either side is a pipe; sendfile(2) from a regular file to
+ * anything else. Only when none of those apply is a buffer used.
+ * @param in_fd the descriptor to be read until end of file
+ * @param out_fd the descriptor to be written
+ * @return 0 if everything was copied, 1 otherwise
+ * */
+int relay_copy(int in_fd, int out_fd);
+
+#endif
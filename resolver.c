@@ -0,0 +1,367 @@
+/* Andre Byrne
+ * 100045589 */
+
+#define _GNU_SOURCE /* MAP_ANONYMOUS, st_mtim */
+
+#include <sys/mman.h>
+
+#include "resolver.h"
+
+/* how many slots past the one a name hashes to it may be found in */
+#define RESOLVER_PROBES 8
+
+/* the offset of a slot whose entry was forgotten: it is free for a new
+ * entry, but a name that hashed before it may still be found after it */
+#define RESOLVER_TOMBSTONE 0xffffffffu
+
+/* struct ResolverTable
+ * an entry is its name and its path, one after the other in the arena,
+ * and is found through a slot: the epoch it was added in, above its offset
+ * in the arena plus 1. A slot of any other epoch is empty, so moving the
+ * table to the next epoch empties every slot at once. A forgotten entry
+ * leaves a RESOLVER_TOMBSTONE, so that a probe does not stop short at it. */
+struct ResolverTable {
+
+  /* even while the entries of this epoch can be read, odd while the table
+   * is being cleared */
+  uint32_t epoch;
+
+  pid_t writer; /* the process adding to the table, or 0 */
+  uint32_t used; /* the bytes of the arena taken up this epoch */
+
+  /* the modification time of each PATH directory when it was last looked
+   * at, or 0 for one that was not there */
+  struct timespec modified[RESOLVER_DIRECTORIES];
+
+  uint64_t slots[RESOLVER_SLOTS];
+  char arena[RESOLVER_ARENA];
+
+};
+
+/* instance methods documented in resolver.h */
+static char * resolve(Resolver * self_, const char * name);
+static void expire(Resolver * self_);
+static void forget(Resolver * self_, const char * name);
+
+/* Private instance scope methods */
+
+/* looks at every watched PATH directory, and clears the table if any has
+ * changed since it was last looked at. Leaves checked false if the table
+ * needed clearing but another process was adding to it. */
+static void check(Resolver * self);
+
+/* adds an entry to the table, unless another process is adding one */
+static void insert(Resolver * self, const char * name, const char * path);
+
+/* Private class scope methods */
+
+/* finds a name in the table without a lock, @see Resolver
+ * @alloc YES the caller becomes responsible for the return value
+ * @null YES if it is not there, or the table changed while it was read
+ * */
+static /*@null@*/ char * lookup(const struct ResolverTable * table, const char * name);
+
+/* takes the table for adding to it. A writer that died holding it gives
+ * it up.
+ * @return false if another process is adding to it */
+static BOOL lock(struct ResolverTable * table);
+
+static void unlock(struct ResolverTable * table);
+
+/* moves the table to the next epoch, emptying it. The caller holds it */
+static void clear(struct ResolverTable * table);
+
+/* whether the entry at the given offset in the arena is for the given
+ * name, without reading past the arena */
+static BOOL holds(const struct ResolverTable * table, uint32_t offset, const char * name, size_t length);
+
+/* FNV-1a of the given name */
+static uint32_t hash(const char * name);
+
+Resolver * init_resolver(const List * PATH) {
+
+  Resolver * self = (Resolver *) failSafeMalloc(sizeof(Resolver), "init_resolver");
+  void * table = mmap(NULL, sizeof(struct ResolverTable), PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+  /* the memory is zeroed: every slot is empty, and of epoch 0 */
+  self->table = (MAP_FAILED == table)? NULL : (struct ResolverTable *)table;
+  if (NULL != self->table) {
+    self->table->epoch = 2;
+  }
+
+  self->PATH = PATH;
+  self->checked = false;
+
+  self->resolve = resolve;
+  self->expire = expire;
+  self->forget = forget;
+
+  return self;
+}
+
+void release_resolver(Resolver * resolver) {
+
+  if (NULL != resolver) {
+    if (NULL != resolver->table) {
+      (void)munmap(resolver->table, sizeof(struct ResolverTable));
+    }
+
+    free(resolver);
+  }
+}
+
+static char * resolve(Resolver * self_, const char * name) {
+  Resolver * const self = self_;
+
+  const Node * node;
+  char * executablePath = NULL;
+  int directory = 0;
+
+  if (!self->checked) {
+    check(self);
+  }
+
+  if (self->checked && NULL != self->table
+      && NULL != (executablePath = lookup(self->table, name))) {
+    return executablePath;
+  }
+
+  for (node = self->PATH->head; NULL != node && NULL == executablePath; node = node->next) {
+    executablePath = resolve_path(node->string, name);
+    directory++;
+  }
+
+  /* a name from past the watched directories could go stale unnoticed */
+  if (NULL != executablePath && self->checked && directory <= RESOLVER_DIRECTORIES) {
+    insert(self, name, executablePath);
+  }
+
+  return executablePath;
+}
+
+static void expire(Resolver * self_) {
+  Resolver * const self = self_;
+
+  self->checked = false;
+}
+
+static void forget(Resolver * self_, const char * name) {
+  Resolver * const self = self_;
+
+  struct ResolverTable * table = self->table;
+  uint32_t start = hash(name), epoch;
+  size_t length = strlen(name);
+  int probe;
+
+  if (NULL == table || !lock(table)) {
+    return;
+  }
+
+  epoch = table->epoch;
+
+  for (probe = 0; probe < RESOLVER_PROBES; probe++) {
+    uint64_t * slot = &table->slots[(start + probe) & (RESOLVER_SLOTS - 1)];
+    uint32_t offset = (uint32_t)(*slot & 0xffffffff);
+
+    if ((uint32_t)(*slot >> 32) != epoch || 0 == offset) {
+      break;
+    }
+
+    if (RESOLVER_TOMBSTONE != offset && holds(table, offset - 1, name, length)) {
+      __atomic_store_n(slot, ((uint64_t)epoch << 32) | RESOLVER_TOMBSTONE, __ATOMIC_RELEASE);
+      break;
+    }
+  }
+
+  unlock(table);
+}
+
+static void check(Resolver * self) {
+
+  struct ResolverTable * table = self->table;
+  struct timespec modified[RESOLVER_DIRECTORIES];
+  const Node * node;
+  int count = 0, index;
+  BOOL changed = false;
+
+  if (NULL == table) {
+    self->checked = true;
+    return;
+  }
+
+  for (node = self->PATH->head; NULL != node && count < RESOLVER_DIRECTORIES; node = node->next) {
+    struct stat status;
+
+    memset(&modified[count], 0, sizeof(struct timespec));
+    if (0 == stat(node->string, &status)) {
+      modified[count] = status.st_mtim;
+    }
+    count++;
+  }
+
+  for (index = 0; index < count && !changed; index++) {
+    changed = (BOOL)(modified[index].tv_sec != table->modified[index].tv_sec
+        || modified[index].tv_nsec != table->modified[index].tv_nsec);
+  }
+
+  if (!changed) {
+    self->checked = true;
+  } else if (lock(table)) {
+    clear(table);
+    memcpy(table->modified, modified, sizeof(struct timespec) * count);
+    unlock(table);
+    self->checked = true;
+  }
+}
+
+static void insert(Resolver * self, const char * name, const char * path) {
+
+  struct ResolverTable * table = self->table;
+  size_t length = strlen(name), needed = length + strlen(path) + 2;
+  uint32_t start = hash(name), epoch;
+  int probe, free_slot = -1;
+
+  if (RESOLVER_ARENA / 16 < needed || !lock(table)) {
+    return;
+  }
+
+  epoch = table->epoch;
+
+  /* the first tombstone is reused, but only once an empty slot shows the
+   * name is not further on */
+  for (probe = 0; probe < RESOLVER_PROBES; probe++) {
+    int index = (int)((start + probe) & (RESOLVER_SLOTS - 1));
+    uint64_t slot = table->slots[index];
+    uint32_t offset = (uint32_t)(slot & 0xffffffff);
+
+    if ((uint32_t)(slot >> 32) != epoch || 0 == offset) {
+      if (-1 == free_slot) free_slot = index;
+      break;
+    } else if (RESOLVER_TOMBSTONE == offset) {
+      if (-1 == free_slot) free_slot = index;
+    } else if (holds(table, offset - 1, name, length)) {
+      /* another process got there first */
+      unlock(table);
+      return;
+    }
+  }
+
+  /* a full table starts again rather than sorting out what to drop */
+  if (-1 == free_slot || RESOLVER_ARENA < table->used + needed) {
+    clear(table);
+    epoch = table->epoch;
+    free_slot = (int)(start & (RESOLVER_SLOTS - 1));
+  }
+
+  memcpy(table->arena + table->used, name, length + 1);
+  strcpy(table->arena + table->used + length + 1, path);
+
+  /* the entry is all there before the slot says where it is */
+  __atomic_store_n(&table->slots[free_slot],
+      ((uint64_t)epoch << 32) | (uint64_t)(table->used + 1), __ATOMIC_RELEASE);
+  table->used += (uint32_t)needed;
+
+  unlock(table);
+}
+
+static char * lookup(const struct ResolverTable * table, const char * name) {
+
+  uint32_t epoch = __atomic_load_n(&table->epoch, __ATOMIC_ACQUIRE), start = hash(name);
+  size_t length = strlen(name);
+  char * found = NULL;
+  int probe;
+
+  if (0 != (epoch & 1)) {
+    return NULL;
+  }
+
+  for (probe = 0; probe < RESOLVER_PROBES && NULL == found; probe++) {
+    uint64_t slot = __atomic_load_n(&table->slots[(start + probe) & (RESOLVER_SLOTS - 1)], __ATOMIC_ACQUIRE);
+    uint32_t offset = (uint32_t)(slot & 0xffffffff);
+    const char * path, * end;
+
+    if ((uint32_t)(slot >> 32) != epoch || 0 == offset) {
+      break;
+    }
+
+    if (RESOLVER_TOMBSTONE == offset) {
+      continue;
+    }
+
+    /* the bytes may be of the next epoch already: nothing is trusted to be
+     * in bounds, or terminated, until the epoch is read again below */
+    offset--;
+    if (!holds(table, offset, name, length)) {
+      continue;
+    }
+
+    path = table->arena + offset + length + 1;
+    end = (const char *)memchr(path, '\0', (size_t)(table->arena + RESOLVER_ARENA - path));
+    if (NULL == end) {
+      break;
+    }
+
+    found = string_with_size((size_t)(end - path) + 1, "lookup");
+    memcpy(found, path, (size_t)(end - path));
+    found[end - path] = '\0';
+  }
+
+  /* an entry read while the table was cleared may be half another entry */
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  if (epoch != __atomic_load_n(&table->epoch, __ATOMIC_RELAXED)) {
+    free(found);
+    found = NULL;
+  }
+
+  return found;
+}
+
+static BOOL lock(struct ResolverTable * table) {
+
+  pid_t holder = 0, self = getpid();
+
+  if (__atomic_compare_exchange_n(&table->writer, &holder, self, false,
+        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+    return true;
+  }
+
+  if (-1 == kill(holder, 0) && ESRCH == errno) {
+    return (BOOL)__atomic_compare_exchange_n(&table->writer, &holder, self, false,
+        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+  }
+
+  return false;
+}
+
+static void unlock(struct ResolverTable * table) {
+
+  __atomic_store_n(&table->writer, 0, __ATOMIC_RELEASE);
+}
+
+static void clear(struct ResolverTable * table) {
+
+  uint32_t epoch = table->epoch;
+
+  /* a reader that sees anything written after this sees the epoch move */
+  __atomic_store_n(&table->epoch, epoch + 1, __ATOMIC_SEQ_CST);
+  table->used = 0;
+  __atomic_store_n(&table->epoch, epoch + 2, __ATOMIC_SEQ_CST);
+}
+
+static BOOL holds(const struct ResolverTable * table, uint32_t offset, const char * name, size_t length) {
+
+  return (BOOL)(offset + length + 1 < RESOLVER_ARENA
+      && 0 == memcmp(table->arena + offset, name, length + 1));
+}
+
+static uint32_t hash(const char * name) {
+
+  uint32_t value = 2166136261u;
+
+  for (; '\0' != *name; name++) {
+    value = (value ^ (unsigned char)*name) * 16777619u;
+  }
+
+  return value;
+}
@@ -0,0 +1,84 @@
+/* Andre Byrne
+ * 100045589 */
+
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include "va_utils.h"
+#include "list.h"
+
+/* the number of names the table can hold at once: a power of 2 */
+#define RESOLVER_SLOTS 1024
+
+/* the bytes the names and paths in the table can take up together */
+#define RESOLVER_ARENA (96 * 1024)
+
+/* the PATH directories the table watches for changes. The names of any
+ * after these are not remembered */
+#define RESOLVER_DIRECTORIES 64
+
+/* struct ResolverTable
+ * the table itself, in memory shared by every process forked from the
+ * shell that made it. @see resolver.c */
+struct ResolverTable;
+
+/* Class Resolver
+ * brief: a Resolver remembers which directory of the PATH each command was
+ * found in, so that running a command again looks in memory and not in
+ * every directory before it.
+ *
+ * The table is mapped shared, before anything is forked, so that the
+ * workers of dag and each and the sessions of lab02 --serve all read and
+ * fill one table. Reading takes no lock and writes nothing: an entry is
+ * never changed once it is in the table, and a reader that was reading it
+ * while the table was cleared sees that the epoch of the table changed
+ * under it, and looks in the PATH instead. Entries are only added by one
+ * process at a time, and one that finds another adding just leaves its
+ * entry out.
+ *
+ * Changes to the PATH are looked for once a line, with a stat of each
+ * directory, and not once a command. A change to any of them clears the
+ * whole table at once, by moving it to the next epoch. A command that
+ * vanishes while a line runs is forgotten when it fails to exec.
+ * */
+typedef struct Resolver {
+
+  /*@null@*/ struct ResolverTable * table; /* NULL if it could not be mapped */
+  const List * PATH;
+  BOOL checked; /* whether the directories have been looked at this line */
+
+  /* finds the executable of the given name in the PATH
+   * @param self_ the calling object
+   * @param name the name of a command, with no / in it
+   * @alloc YES the caller becomes responsible for the return value
+   * @null YES if there is no such executable
+   * @crash YES failed to malloc
+   * */
+  /*@null@*/ char * (*resolve)(struct Resolver * self_, const char * name);
+
+  /* the next name resolved looks at the PATH directories first, to see
+   * if any have changed: called as each line starts
+   * @param self_ the calling object */
+  void (*expire)(struct Resolver * self_);
+
+  /* takes the given name out of the table, after its executable failed to
+   * run, so that it is looked for again
+   * @param self_ the calling object
+   * @param name the name of the command
+   * */
+  void (*forget)(struct Resolver * self_, const char * name);
+
+} Resolver;
+
+/* Makes an empty table for the given PATH.
+ * @param PATH (retained) the directories, in order
+ * @alloc YES the caller becomes responsible for the return value
+ * @dtor YES Resolver is a Class and instances must be freed with release_resolver
+ * @crash YES failed to malloc
+ * */
+Resolver * init_resolver(const List * PATH);
+
+/* unmaps the table, for this process. @dtor THIS is the destructor for Class Resolver */
+void release_resolver(/*@null@*/ /*@only@*/ Resolver * resolver);
+
+#endif
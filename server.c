@@ -0,0 +1,327 @@
+/* Andre Byrne
+ * 100045589 */
+
+#define _GNU_SOURCE /* epoll, signalfd, accept4, SCM_RIGHTS */
+
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <limits.h>
+
+#include "server.h"
+#include "vash.h"
+
+/* instance methods documented in server.h */
+static int run(Server * self_);
+
+/* private class scope methods */
+
+/* fills in the address of the socket at the given path
+ * @return false if the path is too long for a unix socket, after saying why
+ * */
+static BOOL addressOf(const char * path, struct sockaddr_un * address);
+
+/* Private instance scope methods */
+
+/* forks a session for a client that has just connected. The server keeps
+ * no descriptor of the client: the session has it.
+ * @param client the connection to the client
+ * */
+static void startSession(Server * self, int client);
+
+/* runs a session, in the child forked for it, and never returns. @see Server
+ * @param client the connection to the client
+ * */
+static void runSession(Server * self, int client);
+
+Server * init_server(Vash * vash, const char * path) {
+
+  Server * self;
+  struct sockaddr_un address;
+  struct epoll_event event;
+  sigset_t handled;
+  int listener;
+
+  if (!addressOf(path, &address)) {
+    return NULL;
+  }
+
+  listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+  if (-1 == listener || -1 == bind(listener, (struct sockaddr *)&address, sizeof(address))
+      || -1 == listen(listener, SOMAXCONN)) {
+    fprintf(stderr, "%s: --serve: %s: ", SHELL_NAME, path);
+    perror("");
+    if (-1 != listener) (void)close(listener);
+    return NULL;
+  }
+
+  self = (Server *) failSafeMalloc(sizeof(Server), "init_server");
+
+  self->listener = listener;
+  self->path = string_with_size(strlen(path) + 1, "init_server");
+  strcpy(self->path, path);
+  self->vash = vash;
+  self->sessions = init_jobs();
+  self->run = run;
+
+  /* the signals are read from the signalfd, so they must not be delivered */
+  (void)sigemptyset(&handled);
+  (void)sigaddset(&handled, SIGCHLD);
+  (void)sigaddset(&handled, SIGINT);
+  (void)sigaddset(&handled, SIGTERM);
+  (void)sigprocmask(SIG_BLOCK, &handled, &self->unblocked);
+
+  self->signals = signalfd(-1, &handled, SFD_CLOEXEC | SFD_NONBLOCK);
+  self->events = epoll_create1(EPOLL_CLOEXEC);
+
+  event.events = EPOLLIN;
+  event.data.fd = self->listener;
+  if (-1 == self->signals || -1 == self->events
+      || -1 == epoll_ctl(self->events, EPOLL_CTL_ADD, self->listener, &event)) {
+    perror(SHELL_NAME);
+  }
+
+  event.data.fd = self->signals;
+  if (-1 != self->signals && -1 != self->events
+      && -1 == epoll_ctl(self->events, EPOLL_CTL_ADD, self->signals, &event)) {
+    perror(SHELL_NAME);
+  }
+
+  return self;
+}
+
+void release_server(Server * server) {
+
+  if (NULL != server) {
+    (void)close(server->listener);
+    if (-1 != server->signals) (void)close(server->signals);
+    if (-1 != server->events) (void)close(server->events);
+    (void)unlink(server->path);
+    (void)sigprocmask(SIG_SETMASK, &server->unblocked, NULL);
+
+    release_jobs(server->sessions);
+    free(server->path);
+    free(server);
+  }
+}
+
+static int run(Server * self_) {
+  Server * const self = self_;
+
+  struct epoll_event ready[8];
+  BOOL serving = (BOOL)(-1 != self->signals && -1 != self->events);
+  int result = serving? 0 : 1;
+
+  while (serving) {
+    int count = epoll_wait(self->events, ready, 8, -1), index;
+
+    if (-1 == count) {
+      if (EINTR == errno) continue;
+      perror(SHELL_NAME);
+      result = 1;
+      break;
+    }
+
+    for (index = 0; index < count; index++) {
+      if (ready[index].data.fd == self->listener) {
+        int client;
+
+        while (-1 != (client = accept4(self->listener, NULL, NULL, SOCK_CLOEXEC))) {
+          startSession(self, client);
+        }
+
+        if (EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno) {
+          perror(SHELL_NAME);
+        }
+      } else {
+        struct signalfd_siginfo info;
+
+        while (sizeof(info) == read(self->signals, &info, sizeof(info))) {
+          if (SIGCHLD == info.ssi_signo) {
+            self->sessions->reap(self->sessions, NULL);
+          } else {
+            serving = false;
+          }
+        }
+      }
+    }
+  }
+
+  return result;
+}
+
+static void startSession(Server * self, int client) {
+
+  pid_t pid;
+
+  /* a command installed since the last session is found by the next, and
+   * every session gets the index read, in memory it shares with the
+   * others until one of them changes it */
+  (void)self->vash->getPath(self->vash);
+  self->vash->commands->refresh(self->vash->commands);
+
+  (void)fflush(NULL);
+  pid = fork();
+
+  if (0 == pid) {
+    runSession(self, client);
+  } else if (-1 == pid) {
+    perror(SHELL_NAME);
+  } else {
+    self->sessions->add(self->sessions, pid);
+  }
+
+  (void)close(client);
+}
+
+static void runSession(Server * self, int client) {
+
+  Vash * const vash = self->vash;
+
+  char cwd[PATH_MAX], status[16], control[CMSG_SPACE(3 * sizeof(int))];
+  struct msghdr message;
+  struct iovec payload;
+  struct cmsghdr * header;
+  Context * context;
+  ssize_t received;
+  int fds[3], index, exit_status;
+
+  (void)close(self->listener);
+  (void)close(self->events);
+  (void)close(self->signals);
+  (void)sigprocmask(SIG_SETMASK, &self->unblocked, NULL);
+
+  /* the client sends its cwd, with its stdin, stdout and stderr */
+  memset(&message, 0, sizeof(message));
+  memset(cwd, 0, sizeof(cwd));
+  payload.iov_base = cwd;
+  payload.iov_len = sizeof(cwd) - 1;
+  message.msg_iov = &payload;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+
+  received = recvmsg(client, &message, MSG_CMSG_CLOEXEC);
+  header = CMSG_FIRSTHDR(&message);
+
+  if (0 >= received || NULL == header || SCM_RIGHTS != header->cmsg_type
+      || CMSG_LEN(sizeof(fds)) != header->cmsg_len || '/' != cwd[0]) {
+    fprintf(stderr, "%s: --serve: a client sent no session\n", SHELL_NAME);
+    exit(1);
+  }
+
+  memcpy(fds, CMSG_DATA(header), sizeof(fds));
+  for (index = 0; index < 3; index++) {
+    if (-1 == dup2(fds[index], index)) {
+      exit(1);
+    }
+    (void)close(fds[index]);
+  }
+
+  /* twice, so that cd - stays there too */
+  context = vash->getDefault(vash);
+  context->setCWD(context, cwd);
+  context->setCWD(context, cwd);
+
+  sprintf(status, "%d", (int)getpid());
+  vash->variables->set(vash->variables, "$", status);
+
+  exit_status = vash->start(vash);
+  if (NULL != vash->prefetch) {
+    vash->prefetch->save(vash->prefetch);
+  }
+
+  sprintf(status, "%d\n", exit_status);
+  (void)send(client, status, strlen(status), MSG_NOSIGNAL);
+
+  exit(exit_status);
+}
+
+int run_client(const char * path) {
+
+  struct sockaddr_un address;
+  char cwd[PATH_MAX], status[16], control[CMSG_SPACE(3 * sizeof(int))];
+  struct msghdr message;
+  struct iovec payload;
+  struct cmsghdr * header;
+  int fds[3] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+  int server, result = 1;
+  size_t length = 0;
+  ssize_t got;
+
+  if (!addressOf(path, &address)) {
+    return 1;
+  }
+
+  if (NULL == getcwd(cwd, sizeof(cwd))) {
+    perror(SHELL_NAME);
+    return 1;
+  }
+
+  server = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (-1 == server || -1 == connect(server, (struct sockaddr *)&address, sizeof(address))) {
+    fprintf(stderr, "%s: --connect: %s: ", SHELL_NAME, path);
+    perror("");
+    if (-1 != server) (void)close(server);
+    return 1;
+  }
+
+  memset(&message, 0, sizeof(message));
+  memset(control, 0, sizeof(control));
+  payload.iov_base = cwd;
+  payload.iov_len = strlen(cwd) + 1;
+  message.msg_iov = &payload;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+
+  header = CMSG_FIRSTHDR(&message);
+  header->cmsg_level = SOL_SOCKET;
+  header->cmsg_type = SCM_RIGHTS;
+  header->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(header), fds, sizeof(fds));
+
+  /* [Ctrl-c] is for the commands of the session, which have the terminal */
+  (void)signal(SIGINT, SIG_IGN);
+
+  if (-1 == sendmsg(server, &message, MSG_NOSIGNAL)) {
+    perror(SHELL_NAME);
+    (void)close(server);
+    return 1;
+  }
+
+  /* the session says its exit status as it ends, and then hangs up */
+  while (length < sizeof(status) - 1
+      && 0 != (got = read(server, status + length, sizeof(status) - 1 - length))) {
+    if (-1 == got) {
+      if (EINTR == errno) continue;
+      break;
+    }
+    length += (size_t)got;
+  }
+  status[length] = '\0';
+
+  if (NULL != chomp(status, '\n')) {
+    result = atoi(status);
+  }
+
+  (void)close(server);
+
+  return result;
+}
+
+static BOOL addressOf(const char * path, struct sockaddr_un * address) {
+
+  memset(address, 0, sizeof(*address));
+  address->sun_family = AF_UNIX;
+
+  if (strlen(path) >= sizeof(address->sun_path)) {
+    fprintf(stderr, "%s: %s: the path of a socket is too long\n", SHELL_NAME, path);
+    return false;
+  }
+
+  strcpy(address->sun_path, path);
+
+  return true;
+}
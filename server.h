@@ -0,0 +1,80 @@
+/* Andre Byrne
+ * 100045589 */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "va_utils.h"
+
+/* forward declaration: the server starts every session from a Vash */
+struct Vash;
+
+/* Class Server
+ * brief: a Server runs shells for clients that connect to a unix socket,
+ * so that a session costs a fork and not a whole new process:
+ *
+ *   $ ./lab02 --serve /tmp/vash.sock &
+ *   $ ./lab02 --connect /tmp/vash.sock
+ *   $ printf 'make\n' | ./lab02 --connect /tmp/vash.sock
+ *
+ * A client hands the server its stdin, stdout and stderr and its cwd, over
+ * the socket. The server forks a session for it from a Vash it keeps
+ * ready, with the PATH parsed and the PATH index read, and the session
+ * runs as lab02 would, on the client's descriptors and from the client's
+ * cwd: with the line editor, if they are a terminal. Every session has
+ * contexts and jobs of its own. When it ends, its exit status goes back to
+ * the client, which exits with it.
+ *
+ * The server waits on one epoll for clients to connect, for sessions to
+ * end and for SIGINT or SIGTERM, which stop it taking clients. Sessions
+ * run in processes of their own, so that one running a long line holds
+ * up no other and one that crashes takes no other down.
+ * */
+typedef struct Server {
+
+  int listener; /* the socket clients connect to */
+  int events; /* the epoll the server waits on */
+  int signals; /* a signalfd for SIGCHLD, SIGINT and SIGTERM */
+  sigset_t unblocked; /* the signal mask from before, for the sessions */
+  char * path;
+
+  /* every session starts as a copy of this shell, which never runs a
+   * line itself */
+  struct Vash * vash;
+
+  /* the sessions still running */
+  struct Jobs * sessions;
+
+  /* serves clients until SIGINT or SIGTERM. Running sessions are left to
+   * end on their own
+   * @param self_ the calling object
+   * @crash YES failed to malloc
+   * @return 0, or 1 if the server could not wait for clients
+   * */
+  int (*run)(struct Server * self_);
+
+} Server;
+
+/* Makes a server listening on a unix socket at the given path, which must
+ * not exist yet.
+ * @param vash (retained) the shell every session starts as a copy of
+ * @param path the path of the socket
+ * @alloc YES the caller becomes responsible for the return value
+ * @dtor YES Server is a Class and instances must be freed with release_server
+ * @null YES if the socket could not be made, after saying why
+ * @crash YES failed to malloc
+ * */
+/*@null@*/ Server * init_server(struct Vash * vash, const char * path);
+
+/* removes the socket. @dtor THIS is the destructor for Class Server */
+void release_server(/*@null@*/ /*@only@*/ Server * server);
+
+/* The client of a Server: hands it this process's stdin, stdout, stderr
+ * and cwd, and waits for the session to end. [Ctrl-c] is not passed on to
+ * the session, and is ignored while it runs.
+ * @param path the path of the server's socket
+ * @return the exit status of the session, or 1 if there was none
+ * */
+int run_client(const char * path);
+
+#endif
@@ -0,0 +1,366 @@
+/* Andre Byrne
+ * 100045589 */
+
+#include <ctype.h>
+#include <sys/mman.h>
+
+#include "snapshot.h"
+#include "vash.h"
+
+/* Private class scope methods */
+
+/* appends count bytes to a buffer, growing it as needed
+ * @crash YES failed to realloc */
+static void append_bytes(char ** buffer, size_t * length, size_t * capacity, const void * bytes, size_t count);
+
+/* appends a string and its \0 to a buffer */
+static void append_string(char ** buffer, size_t * length, size_t * capacity, const char * string);
+
+/* appends the record of the given context to a buffer */
+static void append_record(char ** buffer, size_t * length, size_t * capacity,
+    const char * name, const struct Context * context);
+
+/* reads a string of a record, and moves past it
+ * @null YES if it runs past the end of the record */
+static /*@null@*/ const char * next_string(const char ** cursor, const char * end);
+
+/* reads a count of a record, and moves past it
+ * @return false if it runs past the end of the record */
+static BOOL next_count(const char ** cursor, const char * end, uint32_t * count);
+
+/* returns the file the builtin was given, relative to the current context
+ * @null YES if it was not given exactly one
+ * @alloc YES the caller becomes responsible for the return value */
+static /*@null@*/ char * file_of(const struct Vash * vash, const List * argv, const char * builtin);
+
+int run_save(Vash * vash, List * argv) {
+
+  char * path = file_of(vash, argv, "save");
+  int exit_status;
+
+  if (NULL == path) {
+    return 1;
+  }
+
+  exit_status = save_snapshot(vash, path);
+  free(path);
+
+  return exit_status;
+}
+
+int run_load(Vash * vash, List * argv) {
+
+  char * path = file_of(vash, argv, "load");
+  int exit_status;
+
+  if (NULL == path) {
+    return 1;
+  }
+
+  exit_status = load_snapshot(vash, path, false);
+  free(path);
+
+  return exit_status;
+}
+
+int save_snapshot(Vash * vash, const char * path) {
+
+  char * buffer = NULL, * temporary;
+  size_t length = 0, capacity = 0, written = 0;
+  uint32_t count = 0;
+  int index, file;
+
+  append_bytes(&buffer, &length, &capacity, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_LENGTH);
+  append_bytes(&buffer, &length, &capacity, &count, sizeof(count));
+
+  for (index = 0; index < vash->number_of_contexts; index++) {
+    const char * record = vash->context_records[index];
+
+    if (NULL != vash->default_context && vash->default_context == vash->contexts[index]) {
+      continue;
+    }
+
+    /* a context never used is still as it was loaded */
+    if (NULL != record) {
+      uint32_t size;
+
+      memcpy(&size, record, sizeof(size));
+      append_bytes(&buffer, &length, &capacity, record, size);
+      count++;
+    } else if (NULL != vash->contexts[index]) {
+      append_record(&buffer, &length, &capacity, vash->context_names[index], vash->contexts[index]);
+      count++;
+    }
+  }
+
+  memcpy(&buffer[SNAPSHOT_MAGIC_LENGTH], &count, sizeof(count));
+
+  /* the old file may be mapped, by this shell or another: it is replaced,
+   * never written over */
+  temporary = string_with_size(strlen(path) + 3 * sizeof(pid_t) + 2, "save_snapshot");
+  sprintf(temporary, "%s.%d", path, (int)getpid());
+
+  file = open(temporary, O_WRONLY | O_CREAT | O_TRUNC, S_IWUSR | S_IRUSR);
+
+  while (-1 != file && written < length) {
+    ssize_t put = write(file, buffer + written, length - written);
+
+    if (-1 == put && EINTR == errno) continue;
+    if (-1 == put) break;
+    written += (size_t)put;
+  }
+
+  if (-1 == file || written < length || 0 != close(file) || -1 == rename(temporary, path)) {
+    fprintf(stderr, "%s: save: %s: ", SHELL_NAME, path);
+    perror("");
+    (void)unlink(temporary);
+    free(temporary);
+    free(buffer);
+    return 1;
+  }
+
+  free(temporary);
+  free(buffer);
+
+  return 0;
+}
+
+int load_snapshot(Vash * vash, const char * path, BOOL missing_ok) {
+
+  int file = open(path, O_RDONLY);
+  struct stat status;
+  Snapshot * snapshot;
+  const char * cursor, * end;
+  uint32_t count, index;
+  int existing, before = vash->number_of_contexts;
+  void * map;
+
+  if (-1 == file) {
+    if (missing_ok && ENOENT == errno) {
+      return 0;
+    }
+
+    fprintf(stderr, "%s: load: %s: ", SHELL_NAME, path);
+    perror("");
+    return 1;
+  }
+
+  if (-1 == fstat(file, &status) || (off_t)(SNAPSHOT_MAGIC_LENGTH + sizeof(count)) > status.st_size
+      || MAP_FAILED == (map = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, file, 0))) {
+    fprintf(stderr, "%s: load: %s: not a snapshot\n", SHELL_NAME, path);
+    (void)close(file);
+    return 1;
+  }
+
+  (void)close(file);
+
+  if (0 != memcmp(map, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_LENGTH)) {
+    fprintf(stderr, "%s: load: %s: not a snapshot\n", SHELL_NAME, path);
+    (void)munmap(map, (size_t)status.st_size);
+    return 1;
+  }
+
+  snapshot = (Snapshot *) failSafeMalloc(sizeof(Snapshot), "load_snapshot");
+  snapshot->map = (const char *)map;
+  snapshot->size = (size_t)status.st_size;
+  snapshot->next = vash->snapshots;
+  vash->snapshots = snapshot;
+
+  memcpy(&count, snapshot->map + SNAPSHOT_MAGIC_LENGTH, sizeof(count));
+  cursor = snapshot->map + SNAPSHOT_MAGIC_LENGTH + sizeof(count);
+  end = snapshot->map + snapshot->size;
+
+  /* only the names are read now, and the rest of each record skipped */
+  for (index = 0; index < count; index++) {
+    const char * name = cursor + sizeof(uint32_t);
+    uint32_t length;
+
+    if ((size_t)(end - cursor) < sizeof(length) + 1) break;
+    memcpy(&length, cursor, sizeof(length));
+    if (length <= sizeof(length) || (size_t)(end - cursor) < length
+        || NULL == memchr(name, '\0', length - sizeof(length))) {
+      break;
+    }
+
+    /* the names of a snapshot differ: only those already here are looked at */
+    for (existing = 0; existing < before && 0 != strcmp(name, vash->context_names[existing]); existing++);
+    if (existing == before) {
+      vash->addContext(vash, name, NULL, cursor);
+    }
+
+    cursor += length;
+  }
+
+  if (index < count) {
+    fprintf(stderr, "%s: load: %s: damaged after %u contexts\n", SHELL_NAME, path, (unsigned int)index);
+    return 1;
+  }
+
+  return 0;
+}
+
+Context * restore_context(Vash * vash, const char * record) {
+
+  const char * cursor = record + sizeof(uint32_t), * end;
+  const char * name, * cwd, * old_cwd;
+  Context * context;
+  List * PATH;
+  uint32_t length, count, index;
+
+  memcpy(&length, record, sizeof(length));
+  end = record + length;
+
+  name = next_string(&cursor, end);
+  cwd = next_string(&cursor, end);
+  old_cwd = next_string(&cursor, end);
+
+  if (NULL == name || NULL == cwd || NULL == old_cwd || !next_count(&cursor, end, &count)) {
+    return NULL;
+  }
+
+  /* a context whose directory is gone is gone too, as mk would refuse it */
+  if (NULL == (context = init_context(vash, cwd))) {
+    fprintf(stderr, "%s: %s: %s: no such directory\n", SHELL_NAME, name, cwd);
+    return NULL;
+  }
+
+  free(context->old_cwd);
+  context->old_cwd = string_with_size(strlen(old_cwd) + 1, "restore_context");
+  strcpy(context->old_cwd, old_cwd);
+
+  PATH = init_list();
+  for (index = 0; index < count && NULL != cursor; index++) {
+    const char * directory = next_string(&cursor, end);
+    if (NULL != directory) (void)PATH->append(PATH, directory);
+  }
+
+  release_list(context->PATH);
+  context->PATH = PATH;
+
+  if (NULL != cursor && next_count(&cursor, end, &count)) {
+    for (index = 0; index < count; index++) {
+      const char * variable = next_string(&cursor, end);
+      const char * value = next_string(&cursor, end);
+
+      if (NULL == variable || NULL == value) break;
+      context->variables->set(context->variables, variable, value);
+    }
+  }
+
+  return context;
+}
+
+void release_snapshots(Snapshot * snapshot) {
+
+  while (NULL != snapshot) {
+    Snapshot * next = snapshot->next;
+
+    (void)munmap((void *)snapshot->map, snapshot->size);
+    free(snapshot);
+    snapshot = next;
+  }
+}
+
+static void append_record(char ** buffer, size_t * length, size_t * capacity,
+    const char * name, const Context * context) {
+
+  size_t start = *length, slot;
+  uint32_t size = 0, count = 0;
+  const Table * variables = context->variables;
+  const List * PATH;
+  const Node * node;
+
+  append_bytes(buffer, length, capacity, &size, sizeof(size));
+  append_string(buffer, length, capacity, name);
+  append_string(buffer, length, capacity, context->cwd);
+  append_string(buffer, length, capacity, context->old_cwd);
+
+  PATH = context->getPath(context);
+  count = (uint32_t)PATH->count(PATH);
+  append_bytes(buffer, length, capacity, &count, sizeof(count));
+  for (node = PATH->head; NULL != node; node = node->next) {
+    append_string(buffer, length, capacity, node->string);
+  }
+
+  /* only the variables of the context's own scope, and not $! or the like,
+   * which are of this session */
+  count = 0;
+  for (slot = 0; slot < variables->capacity; slot++) {
+    const Slot * entry = &variables->entries[slot];
+    if (NULL != entry->name && NULL != entry->value && (isalpha((unsigned char)entry->name[0]) || '_' == entry->name[0])) {
+      count++;
+    }
+  }
+
+  append_bytes(buffer, length, capacity, &count, sizeof(count));
+  for (slot = 0; slot < variables->capacity; slot++) {
+    const Slot * entry = &variables->entries[slot];
+    if (NULL != entry->name && NULL != entry->value && (isalpha((unsigned char)entry->name[0]) || '_' == entry->name[0])) {
+      append_string(buffer, length, capacity, entry->name);
+      append_string(buffer, length, capacity, entry->value);
+    }
+  }
+
+  size = (uint32_t)(*length - start);
+  memcpy(*buffer + start, &size, sizeof(size));
+}
+
+static const char * next_string(const char ** cursor, const char * end) {
+
+  const char * string = *cursor;
+  const char * terminator;
+
+  if (NULL == string || string >= end
+      || NULL == (terminator = (const char *)memchr(string, '\0', (size_t)(end - string)))) {
+    *cursor = NULL;
+    return NULL;
+  }
+
+  *cursor = terminator + 1;
+
+  return string;
+}
+
+static BOOL next_count(const char ** cursor, const char * end, uint32_t * count) {
+
+  if (NULL == *cursor || (size_t)(end - *cursor) < sizeof(*count)) {
+    return false;
+  }
+
+  memcpy(count, *cursor, sizeof(*count));
+  *cursor += sizeof(*count);
+
+  return true;
+}
+
+static char * file_of(const Vash * vash, const List * argv, const char * builtin) {
+
+  if (1 != argv->count(argv)) {
+    fprintf(stderr, "%s: %s: usage: %s FILE\n", SHELL_NAME, builtin, builtin);
+    return NULL;
+  }
+
+  return absolute_path(vash->current_context->cwd, argv->head->string);
+}
+
+static void append_string(char ** buffer, size_t * length, size_t * capacity, const char * string) {
+
+  append_bytes(buffer, length, capacity, string, strlen(string) + 1);
+}
+
+static void append_bytes(char ** buffer, size_t * length, size_t * capacity, const void * bytes, size_t count) {
+
+  if (*length + count > *capacity) {
+    while (*length + count > *capacity) {
+      *capacity = (0 == *capacity)? BUFSIZ : 2 * *capacity;
+    }
+
+    *buffer = (char *) realloc(*buffer, *capacity);
+    if (NULL == *buffer) {
+      alertAndCrash("append_bytes", "failed to realloc");
+    }
+  }
+
+  memcpy(*buffer + *length, bytes, count);
+  *length += count;
+}
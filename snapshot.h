@@ -0,0 +1,89 @@
+/* Andre Byrne
+ * 100045589 */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "va_utils.h"
+#include "list.h"
+
+/* the first bytes of every snapshot, with the version in the last */
+#define SNAPSHOT_MAGIC "VASHCTX1"
+#define SNAPSHOT_MAGIC_LENGTH 8
+
+/* forward declarations: a snapshot is of the contexts of a Vash */
+struct Vash;
+struct Context;
+
+/* struct Snapshot
+ * brief: a snapshot is the contexts made with mk, in a file, so that a new
+ * session can have them back without making them again:
+ *
+ *   $$ save ~/.vash_contexts
+ *   $$ load ~/.vash_contexts
+ *
+ * and with VASH_CONTEXTS=FILE in the environment, the shell loads FILE as
+ * it starts and saves its contexts to it as it exits.
+ *
+ * The file is the magic, the number of contexts as a uint32_t and then a
+ * record for each, in the native byte order:
+ *
+ *   uint32_t length      the bytes of the record, this field included
+ *   name\0 cwd\0 old_cwd\0
+ *   uint32_t count       then that many directories of its PATH, each \0
+ *   uint32_t count       then that many name\0value\0 of its variables
+ *
+ * A snapshot is mapped, not read. Loading it only steps from one record
+ * to the next to copy out the names: a context is made from its record
+ * the first time it is used, and one that is never used is never made.
+ * The mapping lasts as long as the Vash, so a file saved over it while it
+ * is in use is a new file, and the mapping is of the old one.
+ * */
+typedef struct Snapshot {
+
+  const char * map;
+  size_t size;
+
+  /*@null@*/ struct Snapshot * next; /* the snapshot loaded before this one */
+
+} Snapshot;
+
+/* the save builtin: writes every context but the default to a snapshot,
+ * through a file of its own that is renamed over the given one
+ * @param vash the Vash whose contexts are saved
+ * @param argv (retained) the file, relative to the current context
+ * @return 0 on success, 1 if the file could not be written
+ * */
+int run_save(struct Vash * vash, List * argv);
+
+/* the load builtin: adds the contexts of a snapshot to those of the Vash.
+ * A context of the same name as one the Vash has already is left out.
+ * @param vash the Vash the contexts are added to
+ * @param argv (retained) the file, relative to the current context
+ * @return 0 on success, 1 if the file is not a snapshot
+ * */
+int run_load(struct Vash * vash, List * argv);
+
+/* writes a snapshot of the contexts of the given Vash, @see run_save
+ * @return 0 on success, 1 otherwise */
+int save_snapshot(struct Vash * vash, const char * path);
+
+/* loads a snapshot into the given Vash, @see run_load
+ * @param missing_ok a file that does not exist is no error
+ * @return 0 on success, 1 otherwise */
+int load_snapshot(struct Vash * vash, const char * path, BOOL missing_ok);
+
+/* makes the context of the given record of a loaded snapshot
+ * @param vash the Vash the context is made for
+ * @param record where the record starts in the mapping
+ * @alloc YES the caller becomes responsible for the return value
+ * @null YES if its cwd is gone, or the record is damaged
+ * @crash YES failed to malloc
+ * */
+/*@null@*/ struct Context * restore_context(struct Vash * vash, const char * record);
+
+/* unmaps the given snapshot and every one loaded before it
+ * @dtor THIS is the destructor for struct Snapshot */
+void release_snapshots(/*@null@*/ /*@only@*/ Snapshot * snapshot);
+
+#endif
@@ -0,0 +1,257 @@
+/* Andre Byrne
+ * 100045589 */
+
+#include "table.h"
+
+/* struct Pool
+ * an open addressing set of names, laid out like a Table without values */
+struct Pool {
+
+  char ** names;
+  uint32_t * hashes;
+  size_t capacity; /* always a power of 2 */
+  size_t count;
+
+};
+
+/* instance methods documented in table.h */
+static const char * get(const Table * self_, const char * name);
+static void set(Table * self_, const char * name, const char * value);
+
+/* Private class scope methods */
+
+/* the FNV-1a hash of the given name */
+static uint32_t hash_name(const char * name);
+
+/* returns the pooled copy of the given name
+ * @null YES if the name was never pooled, and so is in no table */
+static /*@null@*/ const char * find(const struct Pool * pool, const char * name, uint32_t hash);
+
+/* returns the pooled copy of the given name, pooling it if need be
+ * @crash YES failed to malloc */
+static const char * intern(struct Pool * pool, const char * name, uint32_t hash);
+
+/* doubles the capacity of the given table, placing every entry again */
+static void grow(Table * table);
+
+/* doubles the capacity of the given pool, placing every name again */
+static void grow_pool(struct Pool * pool);
+
+Table * init_table(const Table * parent) {
+
+  Table * self = (Table *) failSafeMalloc(sizeof(Table), "init_table");
+
+  self->capacity = TABLE_CAPACITY;
+  self->count = 0;
+  self->entries = (Slot *) calloc(self->capacity, sizeof(Slot));
+  if (NULL == self->entries) {
+    alertAndCrash("init_table", "failed to calloc");
+  }
+
+  self->parent = parent;
+
+  if (NULL != parent) {
+    self->pool = parent->pool;
+  } else {
+    self->pool = (struct Pool *) failSafeMalloc(sizeof(struct Pool), "init_table");
+    self->pool->capacity = TABLE_CAPACITY;
+    self->pool->count = 0;
+    self->pool->names = (char **) calloc(self->pool->capacity, sizeof(char *));
+    self->pool->hashes = (uint32_t *) calloc(self->pool->capacity, sizeof(uint32_t));
+    if (NULL == self->pool->names || NULL == self->pool->hashes) {
+      alertAndCrash("init_table", "failed to calloc");
+    }
+  }
+
+  self->get = get;
+  self->set = set;
+
+  return self;
+}
+
+void release_table(Table * table) {
+
+  if (NULL != table) {
+    size_t index;
+
+    for (index = 0; index < table->capacity; index++) {
+      free(table->entries[index].value);
+    }
+
+    free(table->entries);
+
+    /* the global scope owns the pool that its scopes share */
+    if (NULL == table->parent) {
+      for (index = 0; index < table->pool->capacity; index++) {
+        free(table->pool->names[index]);
+      }
+
+      free(table->pool->names);
+      free(table->pool->hashes);
+      free(table->pool);
+    }
+
+    free(table);
+  }
+}
+
+static const char * get(const Table * self_, const char * name) {
+
+  const Table * scope;
+  uint32_t hash = hash_name(name);
+  const char * interned = find(self_->pool, name, hash);
+
+  /* a name that was never pooled was never set anywhere */
+  if (NULL == interned) {
+    return NULL;
+  }
+
+  for (scope = self_; NULL != scope; scope = scope->parent) {
+    size_t mask = scope->capacity - 1, index = hash & mask;
+
+    while (NULL != scope->entries[index].name) {
+      if (interned == scope->entries[index].name) {
+        return scope->entries[index].value;
+      }
+      index = (index + 1) & mask;
+    }
+  }
+
+  return NULL;
+}
+
+static void set(Table * self_, const char * name, const char * value) {
+  Table * const self = self_;
+
+  uint32_t hash = hash_name(name);
+  const char * interned = intern(self->pool, name, hash);
+  size_t mask = self->capacity - 1, index = hash & mask;
+  char * copy = string_with_size(strlen(value) + 1, "set");
+
+  strcpy(copy, value);
+
+  while (NULL != self->entries[index].name) {
+    if (interned == self->entries[index].name) {
+      free(self->entries[index].value);
+      self->entries[index].value = copy;
+      return;
+    }
+    index = (index + 1) & mask;
+  }
+
+  self->entries[index].name = interned;
+  self->entries[index].hash = hash;
+  self->entries[index].value = copy;
+
+  /* never more than half full, so that probes stay short */
+  if (2 * ++self->count > self->capacity) {
+    grow(self);
+  }
+}
+
+static uint32_t hash_name(const char * name) {
+
+  uint32_t hash = 2166136261U; /* FNV-1a */
+
+  while ('\0' != *name) {
+    hash ^= (uint32_t)(unsigned char)*name++;
+    hash *= 16777619U;
+  }
+
+  return hash;
+}
+
+static const char * find(const struct Pool * pool, const char * name, uint32_t hash) {
+
+  size_t mask = pool->capacity - 1, index = hash & mask;
+
+  while (NULL != pool->names[index]) {
+    if (hash == pool->hashes[index] && 0 == strcmp(name, pool->names[index])) {
+      return pool->names[index];
+    }
+    index = (index + 1) & mask;
+  }
+
+  return NULL;
+}
+
+static const char * intern(struct Pool * pool, const char * name, uint32_t hash) {
+
+  size_t mask = pool->capacity - 1, index = hash & mask;
+  const char * interned;
+
+  while (NULL != pool->names[index]) {
+    if (hash == pool->hashes[index] && 0 == strcmp(name, pool->names[index])) {
+      return pool->names[index];
+    }
+    index = (index + 1) & mask;
+  }
+
+  pool->names[index] = string_with_size(strlen(name) + 1, "intern");
+  strcpy(pool->names[index], name);
+  pool->hashes[index] = hash;
+  interned = pool->names[index];
+
+  if (2 * ++pool->count > pool->capacity) {
+    grow_pool(pool);
+  }
+
+  return interned;
+}
+
+static void grow(Table * table) {
+
+  Slot * old = table->entries;
+  size_t old_capacity = table->capacity, index;
+
+  table->capacity *= 2;
+  table->entries = (Slot *) calloc(table->capacity, sizeof(Slot));
+  if (NULL == table->entries) {
+    alertAndCrash("grow", "failed to calloc");
+  }
+
+  for (index = 0; index < old_capacity; index++) {
+    if (NULL != old[index].name) {
+      size_t mask = table->capacity - 1, slot = old[index].hash & mask;
+
+      while (NULL != table->entries[slot].name) {
+        slot = (slot + 1) & mask;
+      }
+
+      table->entries[slot] = old[index];
+    }
+  }
+
+  free(old);
+}
+
+static void grow_pool(struct Pool * pool) {
+
+  char ** old_names = pool->names;
+  uint32_t * old_hashes = pool->hashes;
+  size_t old_capacity = pool->capacity, index;
+
+  /* the names themselves stay where they are: tables point at them */
+  pool->capacity *= 2;
+  pool->names = (char **) calloc(pool->capacity, sizeof(char *));
+  pool->hashes = (uint32_t *) calloc(pool->capacity, sizeof(uint32_t));
+  if (NULL == pool->names || NULL == pool->hashes) {
+    alertAndCrash("grow_pool", "failed to calloc");
+  }
+
+  for (index = 0; index < old_capacity; index++) {
+    if (NULL != old_names[index]) {
+      size_t mask = pool->capacity - 1, slot = old_hashes[index] & mask;
+
+      while (NULL != pool->names[slot]) {
+        slot = (slot + 1) & mask;
+      }
+
+      pool->names[slot] = old_names[index];
+      pool->hashes[slot] = old_hashes[index];
+    }
+  }
+
+  free(old_names);
+  free(old_hashes);
+}
@@ -0,0 +1,84 @@
+/* Andre Byrne
+ * 100045589 */
+
+#ifndef TABLE_H
+#define TABLE_H
+
+#include "va_utils.h"
+
+/* a new table has room for this many entries before it first grows */
+#define TABLE_CAPACITY 16
+
+/* struct Pool
+ * every name ever set in a table, stored once. Tables that share a pool
+ * compare names by address. @see table.c */
+struct Pool;
+
+/* struct Slot
+ * a slot of the table: empty while name is NULL */
+typedef struct Slot {
+
+  const char * name; /* interned in the pool of the table */
+  uint32_t hash; /* the hash of name, kept so growing never hashes again */
+  char * value;
+
+} Slot;
+
+/* Class Table
+ * brief: a Table maps the names of shell variables to their values. It is
+ * an open addressing hash table: entries live in one array, and a name
+ * that collides simply takes the next free slot. The table never fills
+ * past half, so a lookup usually touches one slot and rarely more than
+ * two, however many variables there are.
+ *
+ * Tables nest: a table made with a parent is a scope on top of it, and a
+ * name that is not set in the scope is looked up in its parent. Each
+ * context of the shell has its own scope on top of the global one.
+ *
+ * The names are interned: a scope and all its ancestors keep a single
+ * copy of each name, in a pool they share, so the same name is only ever
+ * hashed once per lookup, no matter how many scopes the lookup climbs.
+ * */
+typedef struct Table {
+
+  Slot * entries;
+  size_t capacity; /* always a power of 2 */
+  size_t count; /* the number of slots in use */
+
+  /* lookups that find nothing here continue in the parent */
+  /*@null@*/ const struct Table * parent;
+
+  struct Pool * pool; /* shared with the parent */
+
+  /* returns the value of the given name in this scope or the nearest
+   * enclosing scope that has it
+   * @param self_ the calling object
+   * @param name the name of the variable
+   * @null YES if the name is not set in any scope
+   * @return a reference to the value, which the table still owns
+   * */
+  const char * (*get)(const struct Table * self_, const char * name);
+
+  /* sets the given name to the given value in this scope
+   * @param self_ the calling object
+   * @param name (retained) the name of the variable
+   * @param value (retained) its new value
+   * @crash YES failed to malloc
+   * */
+  void (*set)(struct Table * self_, const char * name, const char * value);
+
+} Table;
+
+/* Allocates an empty table.
+ * @param parent the enclosing scope, or NULL for a global scope
+ * @alloc YES the caller becomes responsible for the return value
+ * @dtor YES Table is a Class and instances must be freed with release_table,
+ *           and always before their parent
+ * @crash YES failed to malloc
+ * */
+Table * init_table(/*@null@*/ const Table * parent);
+
+/* @dtor THIS is the destructor for Class Table */
+void release_table(/*@null@*/ /*@only@*/ Table * table);
+
+#endif
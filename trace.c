@@ -0,0 +1,310 @@
+/* Andre Byrne
+ * 100045589 */
+
+#define _GNU_SOURCE /* O_CLOEXEC */
+
+#include <fcntl.h>
+
+#include "trace.h"
+#include "recorder.h"
+
+/* instance methods documented in trace.h */
+static int run(Tracer * self_, const char * cwd, List * argv);
+static BOOL tracing(const Tracer * self_);
+static void enter(Tracer * self_, const char * context);
+static void span(Tracer * self_, const char * category, const char * name, long started);
+static void started(Tracer * self_, pid_t pid, const char * category, const char * name, long started);
+static void reaped(Tracer * self_, pid_t pid, int status);
+
+/* Private instance methods */
+
+/* turns tracing on, writing to a new trace at the given path
+ * @return 0 on success, 1 if the file could not be opened */
+static int turn_on(Tracer * self, const char * path);
+
+/* turns tracing off, forgetting the tracks and children it knew */
+static void turn_off(Tracer * self);
+
+/* writes an event that names the given track, or the given thread of it */
+static void name_track(Tracer * self, int track, pid_t pid, const char * name);
+
+/* writes one event: the given text, and the , that follows every event */
+static void write_event(const Tracer * self, const char * event);
+
+/* Private class scope methods */
+
+/* returns the given text as a JSON string, without the quotes
+ * @alloc YES the caller becomes responsible for the return value
+ * @crash YES failed to malloc */
+static char * json_escape(const char * text);
+
+Tracer * init_tracer(void) {
+
+  Tracer * self = (Tracer *) failSafeMalloc(sizeof(Tracer), "init_tracer");
+
+  self->fd = -1;
+  self->epoch = 0;
+  self->track = 0;
+  self->tracks = init_table(NULL);
+  self->track_count = 0;
+  self->children = NULL;
+  self->child_count = 0;
+  self->child_capacity = 0;
+
+  self->run = run;
+  self->tracing = tracing;
+  self->enter = enter;
+  self->span = span;
+  self->started = started;
+  self->reaped = reaped;
+
+  return self;
+}
+
+void release_tracer(Tracer * tracer) {
+
+  if (NULL != tracer) {
+    turn_off(tracer);
+    release_table(tracer->tracks);
+    free(tracer->children);
+    free(tracer);
+  }
+}
+
+static int run(Tracer * self_, const char * cwd, List * argv) {
+  Tracer * const self = self_;
+
+  int count = argv->count(argv);
+  const char * action = (0 < count)? argv->head->string : "";
+
+  if (2 == count && 0 == strcmp(action, "on")) {
+    char * path = absolute_path(cwd, argv->head->next->string);
+    int exit_status;
+
+    turn_off(self);
+    exit_status = turn_on(self, path);
+    free(path);
+
+    return exit_status;
+  }
+
+  if (1 == count && 0 == strcmp(action, "off")) {
+    turn_off(self);
+    return 0;
+  }
+
+  fprintf(stderr, "%s: trace: usage: trace on FILE | trace off\n", SHELL_NAME);
+
+  return 1;
+}
+
+static BOOL tracing(const Tracer * self_) {
+  const Tracer * const self = self_;
+
+  return (BOOL)(-1 != self->fd);
+}
+
+static void enter(Tracer * self_, const char * context) {
+  Tracer * const self = self_;
+
+  const char * track;
+  char number[3 * sizeof(int) + 2];
+
+  if (!self->tracing(self)) {
+    return;
+  }
+
+  track = self->tracks->get(self->tracks, context);
+
+  if (NULL == track) {
+    sprintf(number, "%d", ++self->track_count);
+    self->tracks->set(self->tracks, context, number);
+    track = number;
+
+    name_track(self, self->track_count, 0, context);
+    name_track(self, self->track_count, getpid(), SHELL_NAME);
+  }
+
+  self->track = (int)strtol(track, NULL, 10);
+}
+
+static void span(Tracer * self_, const char * category, const char * name, long started) {
+  Tracer * const self = self_;
+
+  char * escaped, * event;
+
+  /* the line that turned tracing on began before the trace did */
+  if (!self->tracing(self) || started < self->epoch) {
+    return;
+  }
+
+  escaped = json_escape(name);
+  event = string_with_size(strlen(escaped) + strlen(category) + 160, "span");
+
+  sprintf(event, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%ld,\"dur\":%ld,\"pid\":%d,\"tid\":%d}",
+      escaped, category, started - self->epoch, now_us() - started, self->track, (int)getpid());
+  write_event(self, event);
+
+  free(event);
+  free(escaped);
+}
+
+static void started(Tracer * self_, pid_t pid, const char * category, const char * name, long started) {
+  Tracer * const self = self_;
+
+  Child * child;
+
+  if (!self->tracing(self)) {
+    return;
+  }
+
+  if (self->child_count == self->child_capacity) {
+    self->child_capacity = (0 == self->child_capacity)? 8 : 2 * self->child_capacity;
+    self->children = (Child *) realloc(self->children, sizeof(Child) * self->child_capacity);
+    if (NULL == self->children) {
+      alertAndCrash("started", "failed to realloc");
+    }
+  }
+
+  child = &self->children[self->child_count++];
+  child->pid = pid;
+  child->track = self->track;
+  child->started = started;
+  child->category = string_with_size(strlen(category) + 1, "started");
+  strcpy(child->category, category);
+  child->name = string_with_size(strlen(name) + 1, "started");
+  strcpy(child->name, name);
+
+  name_track(self, self->track, pid, name);
+}
+
+static void reaped(Tracer * self_, pid_t pid, int status) {
+  Tracer * const self = self_;
+
+  Child * child = NULL;
+  char * escaped, * event;
+  int index;
+
+  for (index = 0; index < self->child_count && NULL == child; index++) {
+    if (pid == self->children[index].pid) child = &self->children[index];
+  }
+
+  if (NULL == child) {
+    return;
+  }
+
+  escaped = json_escape(child->name);
+  event = string_with_size(strlen(escaped) + strlen(child->category) + 200, "reaped");
+
+  sprintf(event, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%ld,\"dur\":%ld,\"pid\":%d,\"tid\":%d,"
+      "\"args\":{\"status\":%d}}",
+      escaped, child->category, child->started - self->epoch, now_us() - child->started,
+      child->track, (int)pid, (WIFEXITED(status))? WEXITSTATUS(status) : -1);
+  write_event(self, event);
+
+  free(event);
+  free(escaped);
+  free(child->category);
+  free(child->name);
+  *child = self->children[--self->child_count];
+}
+
+static int turn_on(Tracer * self, const char * path) {
+
+  /* children write to the trace, but anything they exec does not */
+  self->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+
+  if (-1 == self->fd) {
+    fprintf(stderr, "%s: trace: %s: ", SHELL_NAME, path);
+    perror("");
+    return 1;
+  }
+
+  if (2 != write(self->fd, "[\n", 2)) {
+    perror(SHELL_NAME ": trace");
+  }
+
+  self->epoch = now_us();
+
+  return 0;
+}
+
+static void turn_off(Tracer * self) {
+
+  int index;
+
+  if (self->tracing(self)) {
+    (void)close(self->fd);
+    self->fd = -1;
+  }
+
+  /* a child still running when tracing stops is not traced */
+  for (index = 0; index < self->child_count; index++) {
+    free(self->children[index].category);
+    free(self->children[index].name);
+  }
+  self->child_count = 0;
+
+  release_table(self->tracks);
+  self->tracks = init_table(NULL);
+  self->track_count = 0;
+  self->track = 0;
+}
+
+static void name_track(Tracer * self, int track, pid_t pid, const char * name) {
+
+  char * escaped = json_escape(name);
+  char * event = string_with_size(strlen(escaped) + 120, "name_track");
+
+  if (0 == pid) {
+    sprintf(event, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"%s\"}}",
+        track, escaped);
+  } else {
+    sprintf(event, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+        track, (int)pid, escaped);
+  }
+  write_event(self, event);
+
+  free(event);
+  free(escaped);
+}
+
+static void write_event(const Tracer * self, const char * event) {
+
+  size_t length = strlen(event);
+  char * line = string_with_size(length + 3, "write_event");
+
+  /* one write per event, so that no other process's event lands inside it */
+  strcpy(line, event);
+  strcat(line, ",\n");
+
+  if ((ssize_t)(length + 2) != write(self->fd, line, length + 2)) {
+    perror(SHELL_NAME ": trace");
+  }
+
+  free(line);
+}
+
+static char * json_escape(const char * text) {
+
+  char * escaped = string_with_size(6 * strlen(text) + 1, "json_escape");
+  char * to = escaped;
+
+  for (; '\0' != *text; text++) {
+    unsigned char character = (unsigned char)*text;
+
+    if ('"' == character || '\\' == character) {
+      *to++ = '\\';
+      *to++ = (char)character;
+    } else if (0x20 > character) {
+      sprintf(to, "\\u%04x", character);
+      to += 6;
+    } else {
+      *to++ = (char)character;
+    }
+  }
+
+  *to = '\0';
+
+  return escaped;
+}
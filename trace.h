@@ -0,0 +1,114 @@
+/* Andre Byrne
+ * 100045589 */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "va_utils.h"
+#include "list.h"
+#include "table.h"
+
+/* struct Child
+ * a process the tracer saw start and has not yet seen finish */
+typedef struct Child {
+
+  pid_t pid;
+  int track; /* the context it was started in */
+  long started; /* when it was forked, @see now_us */
+  char * category;
+  char * name;
+
+} Child;
+
+/* Class Tracer
+ * brief: a Tracer writes a timeline of what the shell does, in the trace
+ * event format that chrome://tracing and ui.perfetto.dev read:
+ *
+ *   $$ trace on build.json
+ *   $$ make | grep error
+ *   $$ trace off
+ *
+ * Every line, phrase, fork, exec and wait is a span. Each context is a
+ * process in the viewer, named after the context, and each pid is a
+ * thread of it: the shell's own work is on the shell's pid, and every
+ * child, pipeline stage, relay and background job is on its own, from
+ * when it was forked to when it was reaped. A slow line shows whether the
+ * time went to the shell, to waiting, or to the children themselves.
+ *
+ * The trace is written with write, a whole event at a time, to a file
+ * opened to append, so that a child writes its part of the timeline to
+ * the same file between fork and exec. The closing ] is never written:
+ * a trace may end anywhere, and the viewers expect as much.
+ * */
+typedef struct Tracer {
+
+  int fd; /* -1 when tracing is off */
+  long epoch; /* when tracing was turned on, @see now_us */
+
+  int track; /* the context being traced, as the pid of its events */
+  Table * tracks; /* context name -> track */
+  int track_count;
+
+  Child * children;
+  int child_count, child_capacity;
+
+  /* the trace builtin: trace on FILE, trace off
+   * @param self_ the calling object
+   * @param cwd the directory FILE is relative to
+   * @param argv (retained) the arguments to trace
+   * @return 0 on success, 1 on a bad argument or a file that won't open
+   * */
+  int (*run)(struct Tracer * self_, const char * cwd, List * argv);
+
+  /* @return true if the tracer is on */
+  BOOL (*tracing)(const struct Tracer * self_);
+
+  /* files the events that follow under the given context, naming its
+   * track the first time it is seen
+   * @param self_ the calling object
+   * @param context the name of the context
+   * @crash YES failed to malloc
+   * */
+  void (*enter)(struct Tracer * self_, const char * context);
+
+  /* writes a span of this process from the given time until now
+   * @param self_ the calling object
+   * @param category line, phrase, fork, exec, wait...
+   * @param name what the span is of
+   * @param started when the span began, @see now_us
+   * @crash YES failed to malloc
+   * */
+  void (*span)(struct Tracer * self_, const char * category, const char * name, long started);
+
+  /* notes a child that has just been forked, to be given a track of its
+   * own once it is reaped
+   * @param self_ the calling object
+   * @param pid the child
+   * @param category stage, relay, job...
+   * @param name the name of its track
+   * @param started when it was forked
+   * @crash YES failed to malloc
+   * */
+  void (*started)(struct Tracer * self_, pid_t pid, const char * category, const char * name, long started);
+
+  /* writes the span of a child noted by started from its fork until now.
+   * A pid that was not noted is ignored.
+   * @param self_ the calling object
+   * @param pid the child
+   * @param status its status, as waitpid gives it
+   * */
+  void (*reaped)(struct Tracer * self_, pid_t pid, int status);
+
+} Tracer;
+
+/* Makes a tracer that is off.
+ * @alloc YES the caller becomes responsible for the return value
+ * @dtor YES Tracer is a Class and instances must be freed with release_tracer
+ * @crash YES failed to malloc
+ * */
+Tracer * init_tracer(void);
+
+/* @dtor THIS is the destructor for Class Tracer */
+void release_tracer(/*@null@*/ /*@only@*/ Tracer * tracer);
+
+#endif
@@ -81,6 +81,38 @@ char * resolve_path(const char * base_path, const char * dir_name) {
   return absolute_path;
 }
 
+char * absolute_path(const char * cwd, const char * file_name) {
+
+  char * path;
+
+  if ('/' == file_name[0]) {
+    path = string_with_size(strlen(file_name) + 1, "absolute_path");
+    strcpy(path, file_name);
+  } else {
+    path = string_with_size(strlen(cwd) + strlen(file_name) + 2, "absolute_path");
+    strcpy(path, cwd);
+    strcat(path, "/");
+    strcat(path, file_name);
+  }
+
+  return path;
+}
+
+BOOL names_own_fd(const char * cwd, const char * file_name) {
+
+  static const char * const prefixes[] = { "/dev/stdin", "/dev/stdout", "/dev/stderr",
+      "/dev/fd/", "/proc/self/fd/", "/proc/thread-self/fd/", NULL };
+
+  char * path = absolute_path(cwd, file_name);
+  int index;
+
+  for (index = 0; NULL != prefixes[index]
+      && 0 != strncmp(path, prefixes[index], strlen(prefixes[index])); index++);
+  free(path);
+
+  return (BOOL)(NULL != prefixes[index]);
+}
+
 static size_t va_strspn(const char * str1, const char * str2) {
 
   size_t span_length = 0;
@@ -199,3 +231,20 @@ char * va_strtok(char * string, const char * delimiter) {
 
   return result;
 }
+
+char * string_append(char * string, size_t * capacity, const char * suffix) {
+
+  size_t length = strlen(string), needed = length + strlen(suffix) + 1;
+
+  if (needed > *capacity) {
+    *capacity = (needed > 2 * *capacity)? needed : 2 * *capacity;
+    string = (char *) realloc(string, *capacity);
+    if (NULL == string) {
+      alertAndCrash("string_append", "failed to realloc");
+    }
+  }
+
+  strcpy(&string[length], suffix);
+
+  return string;
+}
@@ -53,8 +53,36 @@ void alertAndCrash(const char * calling_method, const char * failure);
 
 /*@null@*/ char * resolve_path(const char * base_path, const char * file_name);
 
+/* returns the given file name as a path that does not depend on the cwd
+ * of the process: as it is if it starts with /, and otherwise under the
+ * given cwd. Nothing is checked against the file system.
+ * @param cwd the directory a relative file name is relative to
+ * @param file_name the file name
+ * @alloc YES the caller becomes responsible for the return value
+ * @crash YES failed to malloc
+ * */
+char * absolute_path(const char * cwd, const char * file_name);
+
+/* returns true if the given file, relative to the given cwd, names one of
+ * the fds of whatever process opens it: /dev/stdin, /dev/fd/N and the
+ * like, as <(...) gives. Opened in the shell it is the shell's own fd, and
+ * read in the cache it is a pipe whose contents no key can describe
+ * @crash YES failed to malloc
+ * */
+BOOL names_own_fd(const char * cwd, const char * file_name);
+
 /*@out@*/ void * failSafeMalloc(size_t size, const char * calling_method);
 
 char * va_strtok(char * string, const char * delimiter);
 
+/* appends suffix to a string that was allocated with the given capacity,
+ * growing it as needed. The string may move, so always keep the return.
+ * @param string (retained) a string allocated with string_with_size
+ * @param capacity the size of the allocation, updated if the string grows
+ * @param suffix the string to be appended
+ * @crash YES failed to realloc
+ * @return the string with suffix appended
+ * */
+char * string_append(/*@only@*/ char * string, size_t * capacity, const char * suffix);
+
 #endif
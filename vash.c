@@ -1,6 +1,12 @@
 /* Andre Byrne
  * 100045589 */
 
+#define _GNU_SOURCE /* memfd_create */
+
+#include <sys/mman.h>
+#include <time.h>
+#include <dirent.h>
+
 #include "vash.h"
 
 /* a table of vash builtins for looking them up by name
@@ -10,7 +16,16 @@ static const char * builtin_lookup_table[NUM_BUILTINS] = {
   "not_a_builtin",
   "cd",
   "mk",
-  "exit"
+  "exit",
+  "cache",
+  "each",
+  "trace",
+  "history",
+  "pipestat",
+  "map",
+  "prefetch",
+  "save",
+  "load"
 };
 
 /* enums for switching based on builtin type */
@@ -18,20 +33,42 @@ typedef enum VASH_BUILTIN {
   NOT_A_BUILTIN,
   CD,
   MK,
-  EXIT
+  EXIT,
+  CACHE,
+  EACH,
+  TRACE,
+  HISTORY,
+  PIPESTAT,
+  MAP,
+  PREFETCH,
+  SAVE,
+  LOAD
 } VASH_BUILTIN;
 
 /* documented in vash.h */
 static char * getInput(Vash * self_);
 static TYPE decode(char * message);
 static int start(Vash * self_);
+static int replay(Vash * self_, const char * path, BOOL realtime);
 static int callBuiltin(Vash * self_, const char * message, List * argv);
 static char * setContext(Vash * self_, /*@only@*/ const char * symbol);
 static /*@null@*/ Context * getContext(Vash * self_, const char * symbol);
-static const List * getPath(const Vash * self_);
+static Context * contextOf(Vash * self_, const char * phrase);
+static char * capture(Vash * self_, const char * line);
+static char * substitute(Vash * self_, const char * line, BOOL writable);
+static void closeSubstitutions(Vash * self_, int mark);
+static int runWords(Vash * self_, Context * context, Table * scope, List * words,
+    /*@null@*/ Template * compiled, int mark, const char * text, long started);
+static const List * getPath(Vash * self_);
+static Context * getDefault(Vash * self_);
+static Cache * getCache(Vash * self_);
+static History * getHistory(Vash * self_);
+static Prefetch * getPrefetch(Vash * self_);
 static int changeDirectory(Vash * self_, const List * list);
 static int makeBranch(Vash * self_, const List * list);
+static void addContext(Vash * self_, const char * name, /*@only@*/ /*@null@*/ Context * context, /*@null@*/ const char * record);
 static void displayPrompt(const Vash * self_);
+static void completeWord(Vash * self_, const char * line, size_t start, List * matches);
 static void displayContexts(const Vash * self_);
 
 /* private class scope methods */
@@ -55,9 +92,121 @@ static char * waitForInput();
 
 /* Private instance scope methods */
 
+/* reads the body of a here-document from stdin, up to but not including
+ * the line that consists of the delimiter alone, or up to EOF.
+ * @alloc YES the caller becomes responsible for the return value
+ * @crash YES failed to malloc
+ * @return the body, every line of it terminated by \n
+ * */
+static char * readHereDocument(Vash * self, const char * delimiter);
+
+/* finds every << in the given line and reads the body of each, in order,
+ * into the here_documents of the given Vash. <<< here-strings have their
+ * body on the line already and are left alone, as is a quoted "<<".
+ * */
+static void collectHereDocuments(Vash * self, const char * input);
+
+/* returns the next << of the given line that is not in quotes, or NULL */
+static /*@null@*/ const char * nextHereDocument(const char * cursor);
+
+/* rewrites the tokens of a phrase so that every << is followed by the body
+ * of its here-document instead of by the delimiter, and every <<< by its
+ * word: cat <<EOF becomes { cat, <<, body } and cat <<<hi { cat, <<<, hi }
+ * @alloc YES the caller becomes responsible for the return value
+ * @return a new list of tokens
+ * */
+static List * attachHereDocuments(Vash * self, List * tokens);
+
+/* returns true if the given line opens a dag block: dag { ... } */
+static BOOL isDagBlock(const char * input);
+
+/* returns true unless the given line is a single phrase that runs a
+ * command named as it is, or a builtin that only reads the shell: an
+ * assignment, cd, mk, load, trace, exit, a program or a second phrase may
+ * change the variables, cwd, contexts or tracer of the shell */
+static BOOL changesShell(const char * line);
+
+/* reads the rest of a dag block, if it spans several lines, and runs its
+ * phrases in dependency order on a pool of workers. @see Dag
+ * @return the exit status of the last phrase in the block
+ * */
+static int runDagBlock(Vash * self, const char * input);
+
+/* compiles a line with for, while, if, && or || in it, reading more lines
+ * while its blocks are still open, and runs it. @see Program
+ * @return the exit status of the program
+ * */
+static int runProgram(Vash * self, const char * input);
+
+/* reads a line that finishes the current one, for a block or a
+ * here-document, from the input of the shell, prompting with > when that
+ * is a terminal. The line is recorded along with the one it finishes, and
+ * goes in the history with it if that was typed.
+ * @param line a buffer of MAX_INPUT_LENGTH, filled as fgets would
+ * @return false at the end of the input
+ * */
+static BOOL readContinuation(Vash * self, char * line);
+
+/* returns the name the given context was made with, or default */
+static const char * contextName(const Vash * self, const Context * context);
+
+/* replaces a line that starts with !prefix with the newest line in the
+ * history that starts with prefix, followed by the rest of the line, and
+ * !! with the newest line of all. The line run is echoed, as typed.
+ * @alloc YES the caller becomes responsible for the return value
+ * @null YES if there was no such line, after saying so
+ * @crash YES failed to malloc
+ * */
+static /*@null@*/ char * expandHistory(Vash * self, const char * input);
+
+/* returns the text of the prompt
+ * @alloc YES the caller becomes responsible for the return value
+ * @crash YES failed to malloc */
+static char * promptText(const Vash * self);
+
+/* appends every builtin, context: and executable that starts with the
+ * given word to matches, each after the given context: prefix */
+static void completeCommand(Vash * self, const char * prefix, const char * word, List * matches);
+
+/* appends every entry of the directory that starts with the given prefix
+ * to matches, after the given directory part, with a / after those that
+ * are directories themselves */
+static void completePath(const char * cwd, const char * word, List * matches);
+
+/* reads back everything written to a memfd
+ * @param length set to the bytes read, not counting the \0 after them
+ * @alloc YES the caller becomes responsible for the return value
+ * @crash YES failed to malloc */
+static char * readMemory(int memory, size_t * length);
+
+/* makes the default context current again */
+static void resetContext(Vash * self);
+
+/* runs a line of input, recording it if the session is being recorded
+ * @param run_us set to how long running the line took
+ * @return the exit status of the line */
+static int runLine(Vash * self, char * input, long * run_us);
+
+/* names what the given line runs, for the recorder: the executable its
+ * first command resolves to, a builtin, dag or program, or - if its
+ * command could not be found
+ * @param context set to the name of the context the line runs in
+ * @alloc YES the caller becomes responsible for the return value
+ * */
+static char * describeLine(Vash * self, const char * input, const char ** context);
+
 /* calls the context constructor with the cwd */
 static Context * setupDefaultContext(Vash * self);
 
+/* splits a line into phrases on ; and &, each phrase keeping the run of
+ * delimiters that ends it as a word of its own. A ; or & inside quotes or
+ * a substitution does not split anything. */
+static void splitPhrases(List * phrases, const char * input);
+
+/* removes the ; and & that ended a phrase from its words, for a builtin,
+ * which has no use for them as arguments */
+static void dropDelimiters(List * words);
+
 /* analyzes input and tries to execute every command
  * that can be identified from the input
  * */
@@ -73,35 +222,83 @@ Vash * init_vash() {
 
   if (NULL != self) {
 
-    /* initialize the PATH */
-    char * data = getenv("PATH");
-    char * raw_path = string_with_size(strlen(data) + 1, "init_vash");
-    strcpy(raw_path, data);
+    char pid[3 * sizeof(pid_t) + 2];
 
     /* setup function pointers first */
     self->start = start;
+    self->replay = replay;
     self->decode = decode;
     self->callBuiltin = callBuiltin;
     self->setContext = setContext;
     self->getContext = getContext;
+    self->contextOf = contextOf;
     self->getPath = getPath;
+    self->getDefault = getDefault;
+    self->getCache = getCache;
+    self->getHistory = getHistory;
+    self->getPrefetch = getPrefetch;
     self->changeDirectory = changeDirectory;
     self->makeBranch = makeBranch;
+    self->addContext = addContext;
     self->displayPrompt = displayPrompt;
+    self->completeWord = completeWord;
     self->displayContexts = displayContexts;
     self->getInput = getInput;
-
-    /* parse the raw path into the list */
-    self->PATH = init_list();
-    appendTokens(self->PATH, raw_path, ":");
+    self->interpretPhrase = interpret_phrase;
+    self->runWords = runWords;
+    self->capture = capture;
+    self->substitute = substitute;
+    self->closeSubstitutions = closeSubstitutions;
+
+    /* nothing is read from the environment or the file system until it
+     * is used: a line run with -c never completes a word, and one that
+     * names its executable never looks in the PATH. The history, the
+     * editor and the prefetch are for the prompt */
+    self->PATH = NULL;
+    self->commands = NULL;
+    self->resolver = NULL;
+    self->cache = NULL;
+    self->prefetch = NULL;
+    self->history = NULL;
+    self->editor = NULL;
 
     self->terminate_session = false;
-
+    self->typed = false;
+    self->source_capacity = MAX_INPUT_LENGTH;
+    self->source = string_with_size(self->source_capacity, "init_vash");
+    self->here_documents = init_list();
+    self->recorder = NULL;
+    self->tracer = init_tracer();
+    self->jobs = init_jobs();
+    self->stdio[STDIN_FILENO] = STDIN_FILENO;
+    self->stdio[STDOUT_FILENO] = STDOUT_FILENO;
+    self->stdio[STDERR_FILENO] = STDERR_FILENO;
+    self->input = stdin;
+    self->substitutions = NULL;
+    self->substitution_count = 0;
+    self->substitution_capacity = 0;
+    self->glob = init_glob();
+
+    /* the globals exist before any context is made on top of them */
+    self->variables = init_table(NULL);
+    sprintf(pid, "%d", (int)getpid());
+    self->variables->set(self->variables, "$", pid);
+    self->variables->set(self->variables, "?", "0");
+
+    self->contexts = NULL;
+    self->context_names = NULL;
+    self->context_records = NULL;
     self->number_of_contexts = 0;
-    self->default_context = setupDefaultContext(self);
-    self->current_context = self->default_context;
+    self->context_capacity = 0;
+    self->snapshots = NULL;
+    self->current_context = NULL;
+    self->default_context = NULL;
+
+    /* the contexts of the last session, if it was asked to keep them */
+    if (NULL != getenv("VASH_CONTEXTS")) {
+      (void)load_snapshot(self, getenv("VASH_CONTEXTS"), true);
+    }
 
-    free(raw_path);
   } else {
     free(self);
     self = NULL;
@@ -116,18 +313,103 @@ void release_vash(Vash * vash) {
 
   if (self != NULL) {
 
+    if (NULL != getenv("VASH_CONTEXTS")) {
+      (void)save_snapshot(self, getenv("VASH_CONTEXTS"));
+    }
+
     release_list(self->PATH);
+    release_list(self->here_documents);
+    free(self->source);
+    release_cache(self->cache);
+    release_glob(self->glob);
+    release_recorder(self->recorder);
+    release_tracer(self->tracer);
+    release_jobs(self->jobs);
+    release_history(self->history);
+    release_editor(self->editor);
+    release_path_index(self->commands);
+    release_resolver(self->resolver);
+    release_prefetch(self->prefetch);
+    self->closeSubstitutions(self, 0);
+    free(self->substitutions);
 
     for (index = 0; index < (self->number_of_contexts); index++) {
       release_context(vash->contexts[index]);
       free(vash->context_names[index]);
     }
+    free(self->contexts);
+    free(self->context_names);
+    free(self->context_records);
+    release_snapshots(self->snapshots);
+
+    /* every scope goes before the globals under it */
+    release_table(self->variables);
 
     free(self);
   }
 
 }
 
+int vash_eval(Vash * vash, const char * text, VashResult * result) {
+  Vash * const self = vash;
+
+  size_t length = strcspn(text, "\n");
+  const char * rest = ('\n' == text[length])? &text[length + 1] : "";
+  char * input = string_with_size(length + 1, "vash_eval");
+  /*@null@*/ FILE * input_was = self->input;
+  int out = self->stdio[STDOUT_FILENO], memory = -1;
+  int exit_status = 0;
+  long run_us;
+
+  strncat(input, text, length);
+
+  self->jobs->reap(self->jobs, self->tracer);
+  resetContext(self);
+
+  /* the rest of the text is read as the rest of the input would be */
+  self->input = ('\0' == rest[0])? NULL : fmemopen((void *)rest, strlen(rest), "r");
+
+  if (NULL != result && -1 == (memory = memfd_create("vash-eval", MFD_CLOEXEC))) {
+    perror(SHELL_NAME ": vash_eval");
+  }
+
+  if (-1 != memory) {
+    self->stdio[STDOUT_FILENO] = memory;
+  }
+
+  if ('\0' != input[0]) {
+    exit_status = runLine(self, input, &run_us);
+  }
+
+  self->stdio[STDOUT_FILENO] = out;
+  if (NULL != self->input) {
+    (void)fclose(self->input);
+  }
+  self->input = input_was;
+
+  if (NULL != result) {
+    result->status = exit_status;
+    result->exited = self->terminate_session;
+
+    if (-1 == memory) {
+      result->output = string_with_size(1, "vash_eval");
+      result->length = 0;
+    } else {
+      result->output = readMemory(memory, &result->length);
+    }
+  }
+
+  if (-1 != memory) {
+    close(memory);
+  }
+
+  /* exit ends the line: whether it ends the shell is up to the program */
+  self->terminate_session = false;
+  free(input);
+
+  return exit_status;
+}
+
 void the_worst_signal_handler_EVAR(int status, pid_t pid) {
 
   int exit_status;
@@ -178,7 +460,7 @@ void the_worst_signal_handler_EVAR(int status, pid_t pid) {
 
 int start(Vash * self_) {
   Vash * const self = (Vash *)self_;
-  int exit_status;
+  int exit_status = 0;
 
   if (SIG_ERR == signal(SIGINT, SIG_IGN)) {
     perror("vash");
@@ -188,20 +470,52 @@ int start(Vash * self_) {
 
   while (false == self->terminate_session) {
     char * input;
-    int status;
-    pid_t pid;
 
-    /* TODO this is not how we handle SIGCHLD */
-    if (0 < (pid = waitpid(-1, &status, WNOHANG | WUNTRACED))) {
-      /* uh oh something happened: better call the worst signal handler
-       * we can imagine! */
-      the_worst_signal_handler_EVAR(status, pid);
-    }
+    /* uh oh something happened: better call the worst signal handler we
+     * can imagine, for every job of ours that finished */
+    self->jobs->reap(self->jobs, self->tracer);
 
     input = self->getInput(self);
 
+    if (NULL != input && '!' == input[0] && '\0' != input[1] && NULL == strchr(" =", input[1])) {
+      char * expanded = expandHistory(self, input);
+      free(input);
+      input = expanded;
+      if (NULL == input) exit_status = 1;
+    }
+
     if (NULL != input && 0 < strlen(input)) {
-      exit_status = handleInput(self, input);
+      /* a program from the history is several lines: the first is run,
+       * and the rest are read as the lines typed after it would be */
+      char * rest = strchr(input, '\n');
+      FILE * input_was = self->input;
+      long run_us;
+      size_t length;
+
+      if (NULL != rest) {
+        *rest++ = '\0';
+        self->input = fmemopen(rest, strlen(rest), "r");
+      }
+
+      self->source[0] = '\0';
+      self->source = string_append(self->source, &self->source_capacity, input);
+      self->source = string_append(self->source, &self->source_capacity, "\n");
+
+      exit_status = runLine(self, input, &run_us);
+
+      if (NULL != rest) {
+        if (NULL != self->input) (void)fclose(self->input);
+        self->input = input_was;
+      }
+
+      if (self->typed) {
+        History * history = self->getHistory(self);
+
+        for (length = strlen(self->source); 0 < length && '\n' == self->source[length - 1]; length--);
+        self->source[length] = '\0';
+        history->add(history,
+            contextName(self, self->contextOf(self, input)), exit_status, self->source);
+      }
     }
 
     free(input);
@@ -210,13 +524,114 @@ int start(Vash * self_) {
   return exit_status;
 }
 
+int replay(Vash * self_, const char * path, BOOL realtime) {
+  Vash * const self = (Vash *)self_;
+
+  FILE * log = fopen(path, "r");
+  Record * record;
+  long started = now_us(), * recorded = NULL, * replayed = NULL;
+  int count = 0, capacity = 0, differ = 0;
+
+  if (NULL == log) {
+    fprintf(stderr, "%s: --replay: %s: ", SHELL_NAME, path);
+    perror("");
+    return 1;
+  }
+
+  /* the lines replayed run commands, and none of them needs the log */
+  (void)fcntl(fileno(log), F_SETFD, FD_CLOEXEC);
+
+  while (false == self->terminate_session && NULL != (record = read_record(log))) {
+    char input[MAX_INPUT_LENGTH];
+    FILE * stream;
+    int exit_status;
+
+    /* at 1x each line waits until it was typed in the recording */
+    if (realtime) {
+      long wait_us = record->offset_ms * 1000 - (now_us() - started);
+
+      if (0 < wait_us) {
+        struct timespec delay;
+        delay.tv_sec = wait_us / 1000000;
+        delay.tv_nsec = (wait_us % 1000000) * 1000;
+        (void)nanosleep(&delay, NULL);
+      }
+    }
+
+    resetContext(self);
+
+    /* the rest of the record is read as the rest of the input would be */
+    stream = fmemopen(record->line, strlen(record->line), "r");
+    if (NULL == stream || NULL == fgets(input, MAX_INPUT_LENGTH, stream)) {
+      if (NULL != stream) (void)fclose(stream);
+      release_record(record);
+      continue;
+    }
+    (void)chomp(input, '\n');
+
+    if (count == capacity) {
+      capacity = (0 == capacity)? 64 : capacity * 2;
+      recorded = (long *) realloc(recorded, sizeof(long) * capacity);
+      replayed = (long *) realloc(replayed, sizeof(long) * capacity);
+      if (NULL == recorded || NULL == replayed) {
+        alertAndCrash("replay", "failed to realloc");
+      }
+    }
+
+    self->input = stream;
+    exit_status = runLine(self, input, &replayed[count]);
+    self->input = stdin;
+    (void)fclose(stream);
+
+    recorded[count++] = record->run_us;
+
+    if (exit_status != record->status) {
+      fprintf(stderr, "%s: replay: line %d: exit %d, recorded %d: %s\n",
+          SHELL_NAME, count, exit_status, record->status, input);
+      differ++;
+    }
+
+    release_record(record);
+  }
+
+  (void)fclose(log);
+
+  compare_replay(recorded, replayed, count, differ);
+  free(recorded);
+  free(replayed);
+
+  return (0 == differ)? 0 : 1;
+}
+
 int handleInput(Vash * vash, char * input) {
 
   int index, length;
   int exit_status = 1;
-  List * tokens = init_list();
+  List * tokens;
+
+  /* a directory read for one line may have changed by the next */
+  vash->glob->forget(vash->glob);
+  if (NULL != vash->resolver) {
+    vash->resolver->expire(vash->resolver);
+  }
+
+  /* dag blocks are not run left to right at all */
+  if (isDagBlock(input)) {
+    return runDagBlock(vash, input);
+  }
+
+  /* control flow is compiled once and run as often as it says */
+  if (is_program(input)) {
+    return runProgram(vash, input);
+  }
+
+  tokens = init_list();
+
+  /* here-document bodies follow the line, so they are read before any of
+   * the line is run */
+  collectHereDocuments(vash, input);
 
-  appendTokensAndDelimiters(tokens, input, ";&");
+  splitPhrases(tokens, input);
   length = tokens->count(tokens);
 
   /* We are dealing with three things:
@@ -235,48 +650,199 @@ int handleInput(Vash * vash, char * input) {
     free(phrase);
   }
 
+  /* bodies left over belong to phrases that never got that far */
+  while (!vash->here_documents->isEmpty(vash->here_documents)) {
+    free(vash->here_documents->pop(vash->here_documents));
+  }
+
   release_list(tokens);
 
   return exit_status;
 }
 
+void splitPhrases(List * phrases, const char * input) {
+
+  size_t start = strspn(input, ";&"), index = start, length;
+  char quote = '\0'; /* the quote we are inside of, if any */
+  char * phrase;
+
+  while ('\0' != input[index]) {
+    char character = input[index];
+
+    if ('\'' != quote && 0 < (length = substitution_length(&input[index]))) {
+      index += length;
+    } else if ('\0' != quote) {
+      if (character == quote) quote = '\0';
+      index++;
+    } else if ('\'' == character || '"' == character) {
+      quote = character;
+      index++;
+    } else if (';' == character || '&' == character) {
+      length = strspn(&input[index], ";&");
+
+      /* the delimiters become a word of their own: a;b is a ; b */
+      phrase = string_with_size(index - start + length + 2, "splitPhrases");
+      strncat(phrase, &input[start], index - start);
+      strcat(phrase, " ");
+      strncat(phrase, &input[index], length);
+      (void)phrases->append(phrases, phrase);
+      index += length;
+      free(phrase);
+      start = index;
+    } else {
+      index++;
+    }
+  }
+
+  if (start < index) {
+    (void)phrases->append(phrases, &input[start]);
+  }
+}
+
+void dropDelimiters(List * words) {
+
+  List * kept = init_list();
+
+  while (!words->isEmpty(words)) {
+    char * word = words->pop(words);
+
+    if (!is_operator(word, ";") && !is_operator(word, "&")) {
+      (void)kept->append(kept, word);
+    }
+    free(word);
+  }
+
+  while (!kept->isEmpty(kept)) {
+    char * word = kept->pop(kept);
+    (void)words->append(words, word);
+    free(word);
+  }
+
+  release_list(kept);
+}
+
 int interpret_phrase(Vash * vash, char * phrase) {
 
-  int exit_status = 1;
+  int exit_status;
   char * first, * message;
   List * tokens = init_list();
-  Context * context;
+  Context * context = vash->contextOf(vash, phrase);
+  Table * scope;
+  int mark = vash->substitution_count; /* the substitutions of this phrase come after */
+  long started = now_us();
+
+  /* split into words, expanding the variables and patterns of the context
+   * as we go */
+  if (0 != lex_words(tokens, phrase, context, vash)) {
+    while (!tokens->isEmpty(tokens)) {
+      free(tokens->pop(tokens));
+    }
+    release_list(tokens);
+    vash->variables->set(vash->variables, "?", "1");
+    vash->closeSubstitutions(vash, mark);
+    return 1;
+  }
+  tokens = attachHereDocuments(vash, tokens);
 
-  /* tokenize on spaces */
-  appendTokens(tokens, phrase, " ");
-  first = tokens->pop(tokens);
+  /* a phrase may expand to nothing at all */
+  if (tokens->isEmpty(tokens)) {
+    release_list(tokens);
+    vash->closeSubstitutions(vash, mark);
+    return 0;
+  }
 
-  /* strtok may return null */
-  if (NULL == first) return 1;
+  first = tokens->pop(tokens);
 
   /* set the context if the first token contains ":" */
   message = vash->setContext(vash, first);
   context = vash->current_context;
 
-  switch (vash->decode(message)) {
-    case BUILTIN :
-      exit_status = vash->callBuiltin(vash, message, tokens);
-      break;
-    case COMMAND :
-      exit_status = context->callCommand(context, message, tokens);
-      break;
-    default :
-      exit_status = 1;
-      break;
+  /* context: with nothing after it names no command */
+  if (NULL == message) {
+    fprintf(stderr, "%s: %s no command given\n", SHELL_NAME, first);
+    free(vash->setContext(vash, "default:"));
+    release_list(tokens);
+    free(first);
+    vash->closeSubstitutions(vash, mark);
+    return 1;
   }
 
-  /* setContext just returns null here */
-  free(vash->setContext(vash, "default:"));
+  /* name=value phrases set variables: globals, unless a context was named */
+  scope = (context == vash->default_context && NULL == context_separator(first))?
+      vash->variables : context->variables;
 
-  release_list(tokens);
+  (void)tokens->add(tokens, message);
   free(message);
   free(first);
 
+  exit_status = vash->runWords(vash, context, scope, tokens, NULL, mark, phrase, started);
+
+  release_list(tokens);
+
+  return exit_status;
+}
+
+static int runWords(Vash * self_, Context * context, Table * scope, List * words,
+    Template * compiled, int mark, const char * text, long started) {
+  Vash * const self = self_;
+
+  char status[3 * sizeof(int) + 2];
+  char * message = (words->isEmpty(words))? NULL : words->pop(words);
+  int exit_status = 0;
+
+  self->current_context = context;
+  self->tracer->enter(self->tracer, contextName(self, context));
+
+  while (NULL != message && assign_variable(scope, message)) {
+    free(message);
+    message = (words->isEmpty(words))? NULL : words->pop(words);
+
+    /* what follows the assignments is not the command that was compiled */
+    compiled = NULL;
+
+    /* the ; that ended the phrase is not a command */
+    if (NULL != message && is_operator(message, ";")) {
+      free(message);
+      message = NULL;
+    }
+  }
+
+  /* a phrase of assignments alone, or that expands to nothing, runs
+   * nothing */
+  if (NULL != message) {
+    switch (self->decode(message)) {
+      case BUILTIN :
+        dropDelimiters(words);
+        exit_status = self->callBuiltin(self, message, words);
+        break;
+      case COMMAND :
+        exit_status = (NULL != compiled)?
+            run_compiled(compiled, context, message, words)
+            : context->callCommand(context, message, words);
+        break;
+      case REDIRECTION :
+        /* the empty message asks for a command that only redirects */
+        (void)words->add(words, message);
+        exit_status = context->callCommand(context, "", words);
+        break;
+      default :
+        exit_status = 1;
+        break;
+    }
+  }
+
+  self->current_context = self->getDefault(self);
+
+  sprintf(status, "%d", exit_status);
+  self->variables->set(self->variables, "?", status);
+
+  free(message);
+
+  /* the phrase is done with its <(...) and >(...) */
+  self->closeSubstitutions(self, mark);
+
+  self->tracer->span(self->tracer, "phrase", text, started);
+
   return exit_status;
 }
 
@@ -294,7 +860,151 @@ void displayContexts(const Vash * self_) {
 void displayPrompt(const Vash * self_) {
   const Vash * const self = self_;
 
-  printf("(Vash) %s %s ", self->current_context->cwd, "$$");
+  char * prompt = promptText(self);
+
+  printf("%s", prompt);
+  free(prompt);
+}
+
+char * promptText(const Vash * self) {
+
+  char * prompt = string_with_size(strlen(self->current_context->cwd) + 16, "promptText");
+
+  sprintf(prompt, "(Vash) %s %s ", self->current_context->cwd, "$$");
+
+  return prompt;
+}
+
+void completeWord(Vash * self_, const char * line, size_t start, List * matches) {
+  Vash * const self = self_;
+
+  const char * word = &line[start];
+  const char * colon = strchr(word, ':');
+  size_t before = start, phrase = start;
+  Context * context;
+  char * prefix;
+  BOOL command;
+
+  /* a command is the first word of a phrase */
+  while (0 < before && NULL != strchr(" \t", line[before - 1])) before--;
+  command = (BOOL)(0 == before || NULL != strchr(";&|(", line[before - 1]));
+
+  if (command && NULL == strchr(word, '/')) {
+    if (NULL == colon) {
+      completeCommand(self, "", word, matches);
+    } else {
+      /* ctx:com completes com, and keeps the ctx: */
+      prefix = string_with_size((size_t)(colon - word) + 2, "completeWord");
+      strncat(prefix, word, (size_t)(colon - word) + 1);
+      completeCommand(self, prefix, &colon[1], matches);
+      free(prefix);
+    }
+    return;
+  }
+
+  /* paths are relative to the context of the phrase the word is in */
+  while (0 < phrase && NULL == strchr(";&|", line[phrase - 1])) phrase--;
+  context = self->contextOf(self, &line[phrase]);
+  if (NULL == context) {
+    context = self->current_context;
+  }
+
+  completePath(context->cwd, word, matches);
+}
+
+void completeCommand(Vash * self, const char * prefix, const char * word, List * matches) {
+
+  size_t length = strlen(word);
+  List * commands = init_list();
+  char * match;
+  int index;
+
+  for (index = 1; index < NUM_BUILTINS; index++) {
+    if (0 == strncmp(builtin_lookup_table[index], word, length)) {
+      (void)commands->append(commands, builtin_lookup_table[index]);
+    }
+  }
+
+  /* a context: only goes at the start */
+  for (index = 0; '\0' == prefix[0] && index < self->number_of_contexts; index++) {
+    if (0 == strncmp(self->context_names[index], word, length)) {
+      match = string_with_size(strlen(self->context_names[index]) + 2, "completeCommand");
+      strcpy(match, self->context_names[index]);
+      strcat(match, ":");
+      (void)commands->append(commands, match);
+      free(match);
+    }
+  }
+
+  (void)self->getPath(self);
+  (void)self->commands->complete(self->commands, word, commands);
+
+  while (!commands->isEmpty(commands)) {
+    char * command = commands->pop(commands);
+
+    match = string_with_size(strlen(prefix) + strlen(command) + 1, "completeCommand");
+    strcpy(match, prefix);
+    strcat(match, command);
+    (void)matches->append(matches, match);
+
+    free(match);
+    free(command);
+  }
+
+  release_list(commands);
+}
+
+void completePath(const char * cwd, const char * word, List * matches) {
+
+  const char * slash = strrchr(word, '/');
+  size_t directory_length = (NULL == slash)? 0 : (size_t)(slash - word) + 1;
+  const char * name = &word[directory_length];
+  size_t name_length = strlen(name);
+  char * directory, * full, * match;
+  struct dirent * entry;
+  DIR * stream;
+
+  /* the directory to read, and the text that goes before each entry */
+  directory = string_with_size(strlen(cwd) + directory_length + 2, "completePath");
+  if ('/' != word[0]) {
+    strcpy(directory, cwd);
+    strcat(directory, "/");
+  }
+  strncat(directory, word, directory_length);
+
+  if (NULL == (stream = opendir(directory))) {
+    free(directory);
+    return;
+  }
+
+  while (NULL != (entry = readdir(stream))) {
+    struct stat info;
+
+    /* hidden entries only when they are asked for */
+    if (0 != strncmp(entry->d_name, name, name_length)
+        || ('.' == entry->d_name[0] && '.' != name[0])
+        || 0 == strcmp(entry->d_name, ".") || 0 == strcmp(entry->d_name, "..")) {
+      continue;
+    }
+
+    full = string_with_size(strlen(directory) + strlen(entry->d_name) + 1, "completePath");
+    strcpy(full, directory);
+    strcat(full, entry->d_name);
+
+    match = string_with_size(directory_length + strlen(entry->d_name) + 2, "completePath");
+    strncat(match, word, directory_length);
+    strcat(match, entry->d_name);
+    if (0 == stat(full, &info) && S_ISDIR(info.st_mode)) {
+      strcat(match, "/");
+    }
+    (void)matches->append(matches, match);
+
+    free(match);
+    free(full);
+  }
+
+  (void)closedir(stream);
+  free(directory);
 }
 
 char * waitForInput() {
@@ -322,16 +1032,34 @@ char * getInput(Vash * self_) {
 
   char * input;
 
+  resetContext(self);
   self->displayContexts(self);
 
-  self->current_context = self->default_context;
-  if (-1 == chdir(self->current_context->cwd)) {
-    perror("vash: getInput");
-  }
+  /* a terminal gets a line that can be edited, anything else is read */
+  if (isatty(STDIN_FILENO)) {
+    char * prompt = promptText(self);
+
+    /* the time spent typing is time the disk is free */
+    self->getPrefetch(self)->idle(self->prefetch, false);
+
+    if (NULL == self->editor) {
+      self->editor = init_editor(self, MAX_INPUT_LENGTH);
+    }
 
-  /* set the current context to getcwd */
-  self->current_context->setCWD(self->current_context, "");
+    fflush(stdout);
+    input = self->editor->read(self->editor, prompt);
+    free(prompt);
+
+    self->typed = (BOOL)(NULL != input);
+    if (NULL == input) {
+      input = string_with_size(sizeof("exit"), "getInput");
+      strcpy(input, "exit");
+    }
+
+    return input;
+  }
 
+  self->typed = false;
   self->displayPrompt(self);
   input = waitForInput();
 
@@ -352,6 +1080,10 @@ TYPE decode(char * message) {
   if (NOT_A_BUILTIN != builtin) {
     type = BUILTIN;
 
+  /* < in > out moves bytes without naming a command */
+  } else if (is_operator(message, "<") || is_operator(message, ">")) {
+    type = REDIRECTION;
+
   /* the message may be a command */
   } else {
     type = COMMAND;
@@ -377,6 +1109,34 @@ int callBuiltin(Vash * self_, const char * message, List * list) {
     case MK :
       exit_status = self->makeBranch(self, list);
       break;
+    case CACHE :
+      exit_status = self->getCache(self)->run(self->cache, self->current_context, list);
+      break;
+    case EACH :
+      exit_status = run_each(self->current_context, self->glob, list,
+          (BOOL)(stdin == self->input && !isatty(STDIN_FILENO)));
+      break;
+    case TRACE :
+      exit_status = self->tracer->run(self->tracer, self->current_context->cwd, list);
+      break;
+    case HISTORY :
+      exit_status = self->getHistory(self)->run(self->history, list, self->stdio[STDOUT_FILENO]);
+      break;
+    case PIPESTAT :
+      exit_status = run_pipestat(self->current_context, list);
+      break;
+    case MAP :
+      exit_status = run_map(self->current_context, list);
+      break;
+    case PREFETCH :
+      exit_status = self->getPrefetch(self)->run(self->prefetch, list, self->stdio[STDOUT_FILENO]);
+      break;
+    case SAVE :
+      exit_status = run_save(self, list);
+      break;
+    case LOAD :
+      exit_status = run_load(self, list);
+      break;
     default :
       exit_status = 1;
       break;
@@ -392,9 +1152,10 @@ char * setContext(Vash * self_, const char * symbol) {
   char * index_of_separator;
   char * index_after_separator;
   char * instruction_part, * branch_name;
+  const char * separator = context_separator(symbol);
 
   strcpy(mutable_copy, symbol);
-  index_of_separator = strpbrk(mutable_copy, ":");
+  index_of_separator = (NULL == separator)? NULL : &mutable_copy[separator - symbol];
 
   /* if there is a separator, proceed with separation */
   if (NULL != index_of_separator) {
@@ -414,9 +1175,6 @@ char * setContext(Vash * self_, const char * symbol) {
     context = self->getContext(self, branch_name);
     if (NULL != context) {
       self->current_context = context;
-      if (-1 == chdir(self->current_context->cwd)) {
-        perror("vash: setContext:");
-      };
     }
 
   /* if there is no separator, then just copy the symbol */
@@ -430,17 +1188,73 @@ char * setContext(Vash * self_, const char * symbol) {
   return instruction_part;
 }
 
-static const List * getPath(const Vash * self_) {
+static const List * getPath(Vash * self_) {
+  Vash * const self = self_;
+
+  if (NULL == self->PATH) {
+    char * data = getenv("PATH");
+    char * raw_path = string_with_size(((NULL == data)? 0 : strlen(data)) + 1, "getPath");
+    if (NULL != data) strcpy(raw_path, data);
+
+    /* parse the raw path into the list, and make what is read from it */
+    self->PATH = init_list();
+    appendTokens(self->PATH, raw_path, ":");
+    self->commands = init_path_index(self->PATH);
+    self->resolver = init_resolver(self->PATH);
+
+    free(raw_path);
+  }
 
-  return self_->PATH;
+  return self->PATH;
 }
 
-static int changeDirectory(Vash * self_, const List * list) {
+static Context * getDefault(Vash * self_) {
   Vash * const self = self_;
 
-  /* much like cd, we will just try to cd into the first arg and ignore the rest */
+  if (NULL == self->default_context) {
+    self->default_context = setupDefaultContext(self);
+  }
 
-  /* if no argument or ~ are given, go HOME */
+  return self->default_context;
+}
+
+static Cache * getCache(Vash * self_) {
+  Vash * const self = self_;
+
+  if (NULL == self->cache) {
+    self->cache = init_cache(NULL, 0);
+  }
+
+  return self->cache;
+}
+
+static History * getHistory(Vash * self_) {
+  Vash * const self = self_;
+
+  if (NULL == self->history) {
+    self->history = init_history();
+  }
+
+  return self->history;
+}
+
+static Prefetch * getPrefetch(Vash * self_) {
+  Vash * const self = self_;
+
+  /* the counts are kept in the cache directory */
+  if (NULL == self->prefetch) {
+    self->prefetch = init_prefetch(self->getCache(self)->directory);
+  }
+
+  return self->prefetch;
+}
+
+static int changeDirectory(Vash * self_, const List * list) {
+  Vash * const self = self_;
+
+  /* much like cd, we will just try to cd into the first arg and ignore the rest */
+
+  /* if no argument or ~ are given, go HOME */
   if (NULL == list->head || 0 == strcmp(list->head->string, "~")) {
     char * environment_home = getenv("HOME");
     char * home;
@@ -463,10 +1277,13 @@ static int changeDirectory(Vash * self_, const List * list) {
   /* try resolving the path to see if it is a real path */
   } else {
 
-    char * absolute_path = resolve_path(self->current_context->cwd, list->head->string);
+    char * resolved = resolve_path(self->current_context->cwd, list->head->string);
+
+    /* the shell never chdirs, so nothing else takes the .. out of the path */
+    char * absolute = (NULL == resolved)? NULL : realpath(resolved, NULL);
 
-    if (NULL != absolute_path) {
-      self->current_context->setCWD(self->current_context, absolute_path);
+    if (NULL != absolute) {
+      self->current_context->setCWD(self->current_context, absolute);
     } else {
       fprintf(stderr, "%s: %s: %s: %s\n",
               SHELL_NAME,
@@ -475,7 +1292,8 @@ static int changeDirectory(Vash * self_, const List * list) {
               " No such file or directory");
     }
 
-    free(absolute_path);
+    free(resolved);
+    free(absolute);
   }
 
   return 0;
@@ -490,27 +1308,28 @@ static int makeBranch(Vash * self_, const List * list) {
       fprintf(stderr, "vash: mk: usage: cd branch_name dir \n");
       exit_status = 1;
 
-  } else if (MAX_CONTEXTS > self->number_of_contexts) {
+  } else {
     char * name = list->head->string;
     char * dir_name = list->head->next->string;
 
+    /* a context's cwd is absolute: the directory is relative to the
+     * current context, or to nothing while the default is being made */
+    char * resolved = resolve_path((NULL == self->current_context)? "" : self->current_context->cwd, dir_name);
+    char * absolute = (NULL == resolved)? NULL : realpath(resolved, NULL);
+
     /* like cd, we are just going to try the first arg given and bail if NO */
 
-    self->contexts[self->number_of_contexts] = init_context(self, dir_name);
+    Context * context = (NULL == absolute)? NULL : init_context(self, absolute);
+    free(resolved);
+    free(absolute);
 
-    if (NULL != self->contexts[self->number_of_contexts]) {
-      self->context_names[self->number_of_contexts] = string_with_size(strlen(name) + 1, "makeBranch");
-      strcpy(self->context_names[self->number_of_contexts], name);
-      self->number_of_contexts++;
+    if (NULL != context) {
+      self->addContext(self, name, context, NULL);
 
     } else {
       fprintf(stderr, "vash: mk: failed to create context: directory bad access\n");
       exit_status = 1;
     }
-
-  } else {
-    fprintf(stderr, "vash: mk: failed to create context: too many contexts\n");
-    exit_status = 1;
   }
 
   return exit_status;
@@ -547,6 +1366,24 @@ Context * getContext(Vash * self_, const char * symbol) {
   while (NULL == context && index < self->number_of_contexts) {
     differ = strcmp(symbol, self->context_names[index]);
 
+    /* a context loaded from a snapshot is made the first time it is used */
+    if (0 == differ && NULL != self->context_records[index]) {
+      self->contexts[index] = restore_context(self, self->context_records[index]);
+      self->context_records[index] = NULL;
+
+      /* and one that cannot be made is dropped, as if never loaded */
+      if (NULL == self->contexts[index]) {
+        int moved = self->number_of_contexts - index - 1;
+
+        free(self->context_names[index]);
+        memmove(&self->contexts[index], &self->contexts[index + 1], sizeof(Context *) * moved);
+        memmove(&self->context_names[index], &self->context_names[index + 1], sizeof(char *) * moved);
+        memmove(&self->context_records[index], &self->context_records[index + 1], sizeof(char *) * moved);
+        self->number_of_contexts--;
+        break;
+      }
+    }
+
     if (0 == differ) {
       context = self->contexts[index];
     }
@@ -557,6 +1394,665 @@ Context * getContext(Vash * self_, const char * symbol) {
   return context;
 }
 
+void addContext(Vash * self_, const char * name, Context * context, const char * record) {
+  Vash * const self = self_;
+
+  if (self->number_of_contexts == self->context_capacity) {
+    self->context_capacity = (0 == self->context_capacity)? 16 : 2 * self->context_capacity;
+    self->contexts = (Context **) realloc(self->contexts, sizeof(Context *) * self->context_capacity);
+    self->context_names = (char **) realloc(self->context_names, sizeof(char *) * self->context_capacity);
+    self->context_records = (const char **) realloc(self->context_records,
+        sizeof(const char *) * self->context_capacity);
+
+    if (NULL == self->contexts || NULL == self->context_names || NULL == self->context_records) {
+      alertAndCrash("addContext", "failed to realloc");
+    }
+  }
+
+  self->contexts[self->number_of_contexts] = context;
+  self->context_names[self->number_of_contexts] = string_with_size(strlen(name) + 1, "addContext");
+  strcpy(self->context_names[self->number_of_contexts], name);
+  self->context_records[self->number_of_contexts] = record;
+  self->number_of_contexts++;
+}
+
+Context * contextOf(Vash * self_, const char * phrase) {
+  Vash * const self = self_;
+
+  Context * context = NULL;
+  size_t length;
+  char * name;
+
+  phrase = &phrase[strspn(phrase, " \t")];
+  length = strcspn(phrase, ":= \t");
+
+  /* the context is named by whatever comes before a : in the first word,
+   * and a : after an = is part of a value */
+  if (':' == phrase[length]) {
+    name = string_with_size(length + 1, "contextOf");
+    strncat(name, phrase, length);
+    context = self->getContext(self, name);
+    free(name);
+  }
+
+  return (NULL == context)? self->getDefault(self) : context;
+}
+
+char * capture(Vash * self_, const char * line) {
+  Vash * const self = self_;
+
+  Context * context = self->current_context;
+  List * here_documents = self->here_documents;
+  char * copy = string_with_size(strlen(line) + 1, "capture");
+  char * output;
+  size_t length;
+  int memory, saved = self->stdio[STDOUT_FILENO], index, status;
+  pid_t pid;
+  long forked;
+
+  strcpy(copy, line);
+
+  if (-1 == (memory = memfd_create("vash-capture", MFD_CLOEXEC))) {
+    perror(SHELL_NAME ": capture");
+    free(copy);
+    return string_with_size(1, "capture");
+  }
+
+  /* the line has here-documents of its own, and must not discard the ones
+   * still waiting for the phrase it was found in. Its commands write to
+   * the memfd, and the process's stdout is left alone */
+  self->here_documents = init_list();
+
+  if (changesShell(line)) {
+    /* x=$(y=1; cd /; mk c) leaves y, the cwd and the contexts alone */
+    fflush(stdout);
+    fflush(stderr);
+
+    forked = now_us();
+    switch ((pid = fork())) {
+      case -1 :
+        perror("fork");
+        exit(1);
+      case 0 :
+        for (index = 0; index < self->substitution_count; index++) {
+          close(self->substitutions[index].fd);
+        }
+        self->substitution_count = 0;
+
+        dup2(memory, STDOUT_FILENO);
+        self->stdio[STDOUT_FILENO] = STDOUT_FILENO;
+        exit(handleInput(self, copy));
+      default :
+        self->tracer->span(self->tracer, "fork", line, forked);
+        self->tracer->started(self->tracer, pid, "substitution", line, forked);
+        if (pid == waitpid(pid, &status, 0)) {
+          self->tracer->reaped(self->tracer, pid, status);
+        }
+    }
+
+  } else {
+    /* the command forks anyway: a second fork around it would buy nothing */
+    self->stdio[STDOUT_FILENO] = memory;
+    (void)handleInput(self, copy);
+    self->stdio[STDOUT_FILENO] = saved;
+    self->current_context = context;
+  }
+
+  release_list(self->here_documents);
+  self->here_documents = here_documents;
+
+  output = readMemory(memory, &length);
+
+  close(memory);
+  free(copy);
+
+  while (0 < length && '\n' == output[length - 1]) {
+    output[--length] = '\0';
+  }
+
+  return output;
+}
+
+char * readMemory(int memory, size_t * length) {
+
+  off_t size = lseek(memory, 0, SEEK_END), offset = 0;
+  ssize_t got;
+  char * text = string_with_size((size_t)((0 < size)? size : 0) + 1, "readMemory");
+
+  /* everything written is in the memfd, and is read back in one go */
+  while (offset < size && 0 < (got = pread(memory, &text[offset], (size_t)(size - offset), offset))) {
+    offset += got;
+  }
+
+  text[offset] = '\0';
+  *length = (size_t)offset;
+
+  return text;
+}
+
+char * substitute(Vash * self_, const char * line, BOOL writable) {
+  Vash * const self = self_;
+
+  Substitution * substitution;
+  char * copy, * path;
+  int ends[2], index;
+  int near = (writable)? 1 : 0; /* the end the shell keeps for the phrase */
+  pid_t pid;
+  long forked;
+
+  if (-1 == pipe(ends)) {
+    perror(SHELL_NAME ": substitute");
+    return NULL;
+  }
+
+  if (self->substitution_count == self->substitution_capacity) {
+    self->substitution_capacity = (0 == self->substitution_capacity)? 4 : 2 * self->substitution_capacity;
+    self->substitutions = (Substitution *) realloc(self->substitutions,
+        sizeof(Substitution) * self->substitution_capacity);
+    if (NULL == self->substitutions) {
+      alertAndCrash("substitute", "failed to realloc");
+    }
+  }
+
+  /* a child must not repeat whatever the shell has buffered */
+  fflush(stdout);
+  fflush(stderr);
+
+  forked = now_us();
+  switch ((pid = fork())) {
+    case -1 :
+      perror("fork");
+      exit(1);
+    case 0 :
+      /* the child holds no end of any pipe but its own, so that every
+       * other substitution sees end of file when the shell closes it */
+      for (index = 0; index < self->substitution_count; index++) {
+        close(self->substitutions[index].fd);
+      }
+      self->substitution_count = 0;
+
+      dup2(ends[1 - near], (writable)? STDIN_FILENO : STDOUT_FILENO);
+      self->stdio[(writable)? STDIN_FILENO : STDOUT_FILENO] = (writable)? STDIN_FILENO : STDOUT_FILENO;
+      close(ends[0]);
+      close(ends[1]);
+
+      copy = string_with_size(strlen(line) + 1, "substitute");
+      strcpy(copy, line);
+      exit(handleInput(self, copy));
+    default :
+      self->tracer->span(self->tracer, "fork", line, forked);
+      self->tracer->started(self->tracer, pid, "substitution", line, forked);
+      break;
+  }
+
+  close(ends[1 - near]);
+
+  substitution = &self->substitutions[self->substitution_count++];
+  substitution->fd = ends[near];
+  substitution->pid = pid;
+
+  path = string_with_size(sizeof("/dev/fd/") + 3 * sizeof(int), "substitute");
+  sprintf(path, "/dev/fd/%d", ends[near]);
+
+  return path;
+}
+
+void closeSubstitutions(Vash * self_, int mark) {
+  Vash * const self = self_;
+
+  int index;
+
+  /* every end is closed before any child is waited on: a >(command) only
+   * finishes once its input does */
+  for (index = mark; index < self->substitution_count; index++) {
+    close(self->substitutions[index].fd);
+  }
+
+  for (index = mark; index < self->substitution_count; index++) {
+    long waited = now_us();
+    int status;
+
+    if (self->substitutions[index].pid == waitpid(self->substitutions[index].pid, &status, 0)) {
+      self->tracer->span(self->tracer, "wait", "substitution", waited);
+      self->tracer->reaped(self->tracer, self->substitutions[index].pid, status);
+    }
+  }
+
+  if (mark < self->substitution_count) {
+    self->substitution_count = mark;
+  }
+}
+
+BOOL readContinuation(Vash * self, char * line) {
+
+  if (stdin == self->input && isatty(STDIN_FILENO)) {
+    printf("> ");
+    fflush(stdout);
+  }
+
+  if (NULL == self->input || NULL == fgets(line, MAX_INPUT_LENGTH, self->input)) {
+    return false;
+  }
+
+  if (NULL != self->recorder) {
+    self->recorder->extend(self->recorder, line);
+  }
+
+  if (self->typed) {
+    self->source = string_append(self->source, &self->source_capacity, line);
+    if ('\n' != line[strlen(line) - 1]) {
+      self->source = string_append(self->source, &self->source_capacity, "\n");
+    }
+  }
+
+  return true;
+}
+
+void resetContext(Vash * self) {
+
+  self->current_context = self->getDefault(self);
+}
+
+char * expandHistory(Vash * self, const char * input) {
+
+  size_t length = strcspn(&input[1], " \t");
+  char * prefix = string_with_size(length + 1, "expandHistory");
+  char * line, * expanded;
+  long entry;
+
+  /* !! is the newest line, whatever it starts with */
+  if (0 != strncmp(input, "!!", 2) || 1 != length) {
+    strncat(prefix, &input[1], length);
+  }
+
+  entry = self->getHistory(self)->complete(self->history, prefix);
+  free(prefix);
+
+  if (-1 == entry) {
+    fprintf(stderr, "%s: %.*s: event not found\n", SHELL_NAME, (int)length + 1, input);
+    return NULL;
+  }
+
+  line = self->history->line(self->history, entry);
+  expanded = string_with_size(strlen(line) + strlen(&input[length + 1]) + 1, "expandHistory");
+  strcpy(expanded, line);
+  strcat(expanded, &input[length + 1]);
+  free(line);
+
+  printf("%s\n", expanded);
+  fflush(stdout);
+
+  return expanded;
+}
+
+const char * contextName(const Vash * self, const Context * context) {
+
+  const char * name = "default";
+  int index;
+
+  for (index = 0; index < self->number_of_contexts; index++) {
+    if (context == self->contexts[index]) name = self->context_names[index];
+  }
+
+  return name;
+}
+
+int runLine(Vash * self, char * input, long * run_us) {
+
+  const char * context = "default";
+  char * executable = NULL;
+  long started, resolved;
+  int exit_status;
+
+  started = now_us();
+  self->tracer->enter(self->tracer, contextName(self, self->contextOf(self, input)));
+
+  if (NULL != self->recorder) {
+    self->recorder->begin(self->recorder, input);
+    executable = describeLine(self, input, &context);
+  }
+
+  resolved = now_us();
+  exit_status = handleInput(self, input);
+  *run_us = now_us() - resolved;
+
+  if (NULL != self->recorder) {
+    self->recorder->finish(self->recorder, context, executable, exit_status,
+        resolved - started, *run_us);
+  }
+
+  self->tracer->span(self->tracer, "line", input, started);
+
+  free(executable);
+
+  return exit_status;
+}
+
+char * describeLine(Vash * self, const char * input, const char ** context) {
+
+  Context * found = self->contextOf(self, input);
+  const char * word = &input[strspn(input, " \t")];
+  const char * separator;
+  char * name, * executable;
+  size_t length;
+
+  *context = contextName(self, found);
+
+  length = strcspn(word, " \t;&|<>");
+  separator = memchr(word, ':', strcspn(word, " \t;&|<>="));
+  if (NULL != separator) {
+    length -= (size_t)(&separator[1] - word);
+    word = &separator[1];
+  }
+
+  if (isDagBlock(input)) {
+    word = "dag";
+    length = strlen(word);
+  } else if (is_program(input)) {
+    word = "program";
+    length = strlen(word);
+  }
+
+  name = string_with_size(length + 1, "describeLine");
+  strncat(name, word, length);
+
+  if (0 == length || is_assignment(name)) {
+    executable = string_with_size(2, "describeLine");
+    strcpy(executable, "-");
+  } else if (NOT_A_BUILTIN != getBuiltin(name) || isDagBlock(input) || is_program(input)) {
+    executable = name;
+    name = NULL;
+  } else if (NULL == (executable = resolve_command(found, name))) {
+    executable = string_with_size(2, "describeLine");
+    strcpy(executable, "-");
+  }
+
+  free(name);
+
+  return executable;
+}
+
+char * readHereDocument(Vash * self, const char * delimiter) {
+
+  size_t capacity = MAX_INPUT_LENGTH, length = 0;
+  char * body = string_with_size(capacity, "readHereDocument");
+  char line[MAX_INPUT_LENGTH];
+
+  for (;;) {
+    size_t line_length;
+
+    if (!readContinuation(self, line)) {
+      break; /* EOF ends the document too */
+    }
+
+    line_length = strlen(line);
+
+    /* the delimiter must stand alone on its line */
+    if (0 == strncmp(line, delimiter, strlen(delimiter))
+        && ('\n' == line[strlen(delimiter)] || '\0' == line[strlen(delimiter)])) {
+      break;
+    }
+
+    if (length + line_length + 2 > capacity) {
+      capacity = 2 * (length + line_length + 2);
+      body = (char *) realloc(body, capacity);
+      if (NULL == body) {
+        alertAndCrash("readHereDocument", "failed to realloc");
+      }
+    }
+
+    strcpy(&body[length], line);
+    length += line_length;
+
+    /* a last line without a newline still gets one */
+    if ('\n' != body[length - 1]) {
+      body[length++] = '\n';
+      body[length] = '\0';
+    }
+  }
+
+  return body;
+}
+
+static const char * nextHereDocument(const char * cursor) {
+
+  char quote = '\0';
+
+  for (; '\0' != cursor[0]; cursor++) {
+    if ('\0' != quote) {
+      if (quote == cursor[0]) quote = '\0';
+    } else if ('\'' == cursor[0] || '"' == cursor[0]) {
+      quote = cursor[0];
+    } else if ('<' == cursor[0] && '<' == cursor[1]) {
+      return cursor;
+    }
+  }
+
+  return NULL;
+}
+
+void collectHereDocuments(Vash * self, const char * input) {
+
+  const char * cursor = input;
+
+  while (NULL != (cursor = nextHereDocument(cursor))) {
+    size_t length;
+    char * delimiter, * body;
+
+    cursor += 2;
+
+    /* <<< is a here-string: skip all of its angle brackets */
+    if ('<' == cursor[0]) {
+      while ('<' == cursor[0]) cursor++;
+      continue;
+    }
+
+    while (' ' == cursor[0] || '\t' == cursor[0]) cursor++;
+
+    length = strcspn(cursor, " \t;&|<>");
+    if (0 == length) {
+      continue; /* no delimiter, no document */
+    }
+
+    delimiter = string_with_size(length + 1, "collectHereDocuments");
+    strncat(delimiter, cursor, length);
+
+    body = readHereDocument(self, delimiter);
+    (void)self->here_documents->append(self->here_documents, body);
+
+    free(body);
+    free(delimiter);
+    cursor += length;
+  }
+}
+
+List * attachHereDocuments(Vash * self, List * tokens) {
+
+  List * attached = init_list();
+
+  while (!tokens->isEmpty(tokens)) {
+    char * token = tokens->pop(tokens);
+
+    if (OPERATOR_MARK == token[0] && 0 == strncmp(&token[1], "<<<", 3)) {
+      (void)attached->append(attached, OPERATOR_MARK_STRING "<<<");
+      /* <<<word carries its word, <<< word leaves it for the next token */
+      if ('\0' != token[4]) {
+        (void)attached->append(attached, &token[4]);
+      }
+
+    } else if (OPERATOR_MARK == token[0] && 0 == strncmp(&token[1], "<<", 2)) {
+      char * body = (self->here_documents->isEmpty(self->here_documents))?
+          NULL : self->here_documents->pop(self->here_documents);
+
+      (void)attached->append(attached, OPERATOR_MARK_STRING "<<");
+      (void)attached->append(attached, (NULL == body)? "" : body);
+
+      /* << EOF: the delimiter is the next token and is not an argument */
+      if ('\0' == token[3] && !tokens->isEmpty(tokens)) {
+        free(tokens->pop(tokens));
+      }
+
+      free(body);
+
+    } else {
+      (void)attached->append(attached, token);
+    }
+
+    free(token);
+  }
+
+  release_list(tokens);
+
+  return attached;
+}
+
+BOOL changesShell(const char * line) {
+
+  static const char * const named = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789_-+./";
+  const char * word = line, * cursor;
+  char quote = '\0', * name;
+  size_t length;
+  VASH_BUILTIN builtin;
+  BOOL changes;
+
+  if (isDagBlock(line) || is_program(line)) {
+    return true;
+  }
+
+  for (cursor = line; '\0' != cursor[0]; cursor++) {
+    if ('\0' != quote) {
+      if (quote == cursor[0]) quote = '\0';
+    } else if ('\'' == cursor[0] || '"' == cursor[0]) {
+      quote = cursor[0];
+    } else if (';' == cursor[0] || '&' == cursor[0] || '\n' == cursor[0]) {
+      return true;
+    }
+  }
+
+  /* context:command runs the command in that context */
+  word += strspn(word, " \t");
+  length = strcspn(word, " \t:=");
+  if (':' == word[length]) {
+    word += length + 1;
+  }
+
+  /* a quote, a $ or an = may make the word anything, or an assignment */
+  length = strcspn(word, " \t");
+  if (0 == length || length != strspn(word, named)) {
+    return true;
+  }
+
+  /* cd, mk, exit, load and trace change the shell itself. The others only
+   * read it, or run commands as any other command would */
+  name = string_with_size(length + 1, "changesShell");
+  strncat(name, word, length);
+  builtin = getBuiltin(name);
+  changes = (BOOL)(CD == builtin || MK == builtin || EXIT == builtin
+      || LOAD == builtin || TRACE == builtin);
+  free(name);
+
+  return changes;
+}
+
+BOOL isDagBlock(const char * input) {
+
+  input = &input[strspn(input, " \t")];
+
+  return (BOOL)(0 == strncmp(input, "dag", 3) && '{' == input[3 + strspn(&input[3], " \t")]);
+}
+
+int runDagBlock(Vash * self, const char * input) {
+
+  size_t capacity = strlen(input) + 1;
+  char * block = string_with_size(capacity, "runDagBlock");
+  char line[MAX_INPUT_LENGTH];
+  char * body, * end;
+  List * phrases = init_list();
+  Dag * dag = init_dag(0);
+  int exit_status;
+
+  strcpy(block, input);
+
+  /* a block may go on for as many lines as it likes, up to its } */
+  while (NULL == strchr(block, '}')) {
+    if (!readContinuation(self, line)) {
+      break;
+    }
+
+    (void)chomp(line, '\n');
+    block = string_append(block, &capacity, ";");
+    block = string_append(block, &capacity, line);
+  }
+
+  body = &strchr(block, '{')[1];
+  if (NULL != (end = strrchr(body, '}'))) {
+    *end = '\0';
+  }
+
+  appendTokens(phrases, body, ";\n");
+
+  while (!phrases->isEmpty(phrases)) {
+    char * phrase = phrases->pop(phrases);
+
+    /* blank phrases between separators are not phrases at all */
+    if ('\0' != phrase[strspn(phrase, " \t")]) {
+      dag->addPhrase(dag, self, phrase);
+    }
+
+    free(phrase);
+  }
+
+  exit_status = dag->run(dag, self);
+
+  release_dag(dag);
+  release_list(phrases);
+  free(block);
+
+  return exit_status;
+}
+
+int runProgram(Vash * self, const char * input) {
+
+  size_t capacity = strlen(input) + 1;
+  char * source = string_with_size(capacity, "runProgram");
+  char line[MAX_INPUT_LENGTH];
+  Program * program;
+  BOOL incomplete;
+  int exit_status = 1;
+
+  strcpy(source, input);
+
+  /* the bodies of the here-documents of each line follow that line, and
+   * are taken by the phrases as they are compiled */
+  collectHereDocuments(self, input);
+
+  /* a block may go on for as many lines as it likes, up to its done or fi */
+  while (NULL == (program = init_program(self, source, &incomplete)) && incomplete) {
+    if (!readContinuation(self, line)) {
+      fprintf(stderr, "%s: syntax error: unexpected end of file\n", SHELL_NAME);
+      break;
+    }
+
+    (void)chomp(line, '\n');
+    collectHereDocuments(self, line);
+    source = string_append(source, &capacity, "\n");
+    source = string_append(source, &capacity, line);
+  }
+
+  while (!self->here_documents->isEmpty(self->here_documents)) {
+    free(self->here_documents->pop(self->here_documents));
+  }
+
+  if (NULL != program) {
+    exit_status = program->run(program, self);
+  }
+
+  release_program(program);
+  free(source);
+
+  return exit_status;
+}
+
 Context * setupDefaultContext(Vash * self_) {
   Vash * const self = self_;
 
@@ -568,10 +2064,25 @@ Context * setupDefaultContext(Vash * self_) {
     alertAndCrash("setupDefaultContext", "failed to get cwd");
   }
 
-  /* make the default branch and return it */
+  /* make the default branch and return it. It is listed first, even
+   * after the contexts loaded before it was made */
   (void)args->append(args, "default");
   (void)args->append(args, cwd);
   self->makeBranch(self, args);
+
+  if (1 < self->number_of_contexts) {
+    int last = self->number_of_contexts - 1;
+    char * name = self->context_names[last];
+    const char * record = self->context_records[last];
+    Context * made = self->contexts[last];
+
+    memmove(&self->contexts[1], &self->contexts[0], sizeof(Context *) * last);
+    memmove(&self->context_names[1], &self->context_names[0], sizeof(char *) * last);
+    memmove(&self->context_records[1], &self->context_records[0], sizeof(char *) * last);
+    self->contexts[0] = made;
+    self->context_names[0] = name;
+    self->context_records[0] = record;
+  }
   context = self->contexts[0];
 
   free(cwd);
@@ -11,43 +11,169 @@
 #include "va_utils.h"
 #include "context.h"
 #include "list.h"
+#include "cache.h"
+#include "dag.h"
+#include "program.h"
+#include "lexer.h"
+#include "glob.h"
+#include "each.h"
+#include "map.h"
+#include "recorder.h"
+#include "trace.h"
+#include "jobs.h"
+#include "history.h"
+#include "pathindex.h"
+#include "editor.h"
+#include "resolver.h"
+#include "prefetch.h"
+#include "snapshot.h"
 
-#define MAX_CONTEXTS 16
 #define MAX_INPUT_LENGTH 256
-#define NUM_BUILTINS 4
+#define NUM_BUILTINS 13
 #define MAX_ARGC 256
 #ifndef PATH_MAX
   #define PATH_MAX 4096
 #endif
 
-/* a message may represent a Vash builtin or a system command (or it may be invalid) */
-typedef enum TYPE {BUILTIN, COMMAND, INVALID} TYPE;
+/* a message may represent a Vash builtin or a system command (or it may be invalid).
+ * A message that begins with < or > is a bare redirection, with no command at all */
+typedef enum TYPE {BUILTIN, COMMAND, REDIRECTION, INVALID} TYPE;
+
+/* struct Substitution
+ * a <(command) or >(command) that is running alongside a phrase: the end
+ * of its pipe that the phrase is given as /dev/fd/N, and the child running
+ * the command */
+typedef struct Substitution {
+
+  int fd;
+  pid_t pid;
+
+} Substitution;
+
+/* struct VashResult
+ * what a line run by vash_eval did */
+typedef struct VashResult {
+
+  int status; /* the exit status of the line */
+  char * output; /* what it wrote to stdout, \0 terminated */
+  size_t length; /* the bytes of output, which may hold a \0 of its own */
+  BOOL exited; /* the line ran exit */
+
+} VashResult;
 
 /* Class Vash
  * brief: Vash is the Double Dollar Shell. Vash is a command line interpreter
  * with double the number of dollar signs commonly found in a shell.
+ *
+ * A Vash keeps all of its state to itself, so that a program can link
+ * libvash.a and run as many as it likes side by side, @see vash_eval. It
+ * never changes the cwd of the process: each context knows its own, and
+ * every path is taken relative to it. Children are only ever waited for
+ * by pid, @see Jobs, and commands get the stdio of the Vash rather than of
+ * the process. Only start, the interactive session, changes how the whole
+ * process handles SIGINT.
  * */
 typedef struct Vash {
 
-  List * PATH; /* the environment PATH */
+  /*@null@*/ List * PATH; /* the environment PATH, NULL until getPath */
 
   BOOL terminate_session; /* if set, Vash will terminate gracefully */
 
+  /* was the last line getInput returned typed at a terminal, rather than
+   * read from a script or made up at end of file: only those go in the
+   * history */
+  BOOL typed;
+
+  /* the line being run and every line read to finish it, as a block or a
+   * here-document does, which is what goes in the history @see start */
+  char * source;
+  size_t source_capacity;
+
   /* The context system is unique to Vash 
-   * by default, all commands are executed in the default context */
-  struct Context * default_context;
-  struct Context * current_context;
+   * by default, all commands are executed in the default context.
+   * Both are NULL until the first line is run, @see getDefault */
+  /*@null@*/ struct Context * default_context;
+  /*@null@*/ struct Context * current_context;
 
   /* In addition to the default context, a Vash
-   * user can execute commands in up to 16 other
-   * contexts.
+   * user can execute commands in as many other
+   * contexts as they make, or load. A context that
+   * was loaded is only made when it is first used:
+   * until then it is NULL in contexts, and its
+   * record in context_records. @see Snapshot
    * */
-  struct Context * contexts[MAX_CONTEXTS];
-  char * context_names[MAX_CONTEXTS];
+  struct Context ** contexts;
+  char ** context_names;
+  const char ** context_records; /* per context, NULL once it is made */
   int number_of_contexts;
+  int context_capacity;
+
+  /* the snapshots loaded, which the records are in */
+  /*@null@*/ Snapshot * snapshots;
+
+  /* the bodies of the << here-documents in the line being handled, in the
+   * order they appear. They are read before the line is run, and each is
+   * attached to its phrase as that phrase is interpreted */
+  List * here_documents;
+
+  /* the global variables, under the variables of every context. A plain
+   * name=value sets a global, and context:name=value sets one in context */
+  Table * variables;
+
+  /* expands the patterns in words, remembering the directories it read
+   * for as long as a line runs */
+  Glob * glob;
+
+  /* remembers the output of commands run through the cache builtin.
+   * NULL until it is first used, @see getCache */
+  /*@null@*/ Cache * cache;
+
+  /* every line run at the prompt, in this session and every other. NULL
+   * until it is first used, @see getHistory */
+  /*@null@*/ History * history;
+
+  /* reads lines from a terminal, with completion from commands. NULL
+   * until the first line is read from a terminal */
+  /*@null@*/ Editor * editor;
+  /*@null@*/ PathIndex * commands; /* the executables of the PATH */
+
+  /* where each command was found in the PATH, shared with every process
+   * forked from this one. Made with the PATH, @see getPath */
+  /*@null@*/ Resolver * resolver;
+
+  /* how often each executable is run, to read the most used ahead. NULL
+   * until the prompt or the prefetch builtin first uses it, so that a
+   * line run with -c neither reads nor writes the counts, @see getPrefetch */
+  /*@null@*/ Prefetch * prefetch;
+
+  /* writes a timeline of what the shell does, once trace on is run */
+  Tracer * tracer;
+
+  /* the children started in the background and not yet reaped */
+  Jobs * jobs;
+
+  /* the stdin, stdout and stderr that commands get: 0, 1 and 2 unless the
+   * program running the shell says otherwise. The shell's own messages
+   * still go to stderr */
+  int stdio[3];
+
+  /* writes down every line run, if the session is being recorded */
+  /*@null@*/ Recorder * recorder;
+
+  /* where lines that finish a block or a here-document are read from:
+   * stdin, the record being replayed, the rest of the text given to
+   * vash_eval, or NULL for nowhere */
+  /*@null@*/ FILE * input;
+
+  /* the process substitutions open for the phrases being run, innermost
+   * last */
+  Substitution * substitutions;
+  int substitution_count;
+  int substitution_capacity;
 
   /* Begin the VASH instance, which will run until VASH received 
-   * exit, quit, logout, or [Ctrl-d] 
+   * exit, quit, logout, or [Ctrl-d]. The process ignores SIGINT from
+   * then on, so that [Ctrl-c] reaches the command rather than the shell
    * @param self_ the calling object
    * @alloc NO any memory allocated by Vash will be freed by Vash
    * @crash YES failed to malloc; failed to get cwd; failed to fork
@@ -55,6 +181,19 @@ typedef struct Vash {
    * */
   int (*start)(struct Vash * self_);
 
+  /* Runs the lines of a recorded session again, without a prompt, then
+   * says on stderr how their exit statuses and run times compare with the
+   * recording. @see Recorder
+   * @param self_ the calling object
+   * @param path the log to replay
+   * @param realtime wait as long between lines as the recording did,
+   *                 rather than running them one after another
+   * @crash YES failed to malloc; failed to fork
+   * @return the exit status of the last line, or 1 if the log could not
+   *         be read
+   * */
+  int (*replay)(struct Vash * self_, const char * path, BOOL realtime);
+
   /* wait while the user enters input to the keyboard 
    * @post the context list is displayed to standard out
    *       the current context is reset to default
@@ -110,11 +249,43 @@ typedef struct Vash {
    * */
   int (*callBuiltin)(struct Vash * self_, const char * message, List * list);
 
-  /* returns the PATH list 
+  /* returns the PATH list, parsed from the environment the first time it
+   * is asked for, when the commands and resolver are made from it too
    * @param self_ the calling object 
+   * @crash YES failed to malloc
    * @return a const reference to the PATH 
    * */
-  const List * (*getPath)(const struct Vash * self_);
+  const List * (*getPath)(struct Vash * self_);
+
+  /* returns the default context, made in the cwd of the process the first
+   * time it is asked for, and listed before every other context
+   * @param self_ the calling object
+   * @crash YES failed to malloc, or to get the cwd
+   * @return a reference to the default context
+   * */
+  struct Context * (*getDefault)(struct Vash * self_);
+
+  /* return the cache, the history and the prefetch of the shell, each
+   * made the first time it is asked for
+   * @param self_ the calling object
+   * @crash YES failed to malloc
+   * @return a reference the Vash still owns
+   * */
+  Cache * (*getCache)(struct Vash * self_);
+  History * (*getHistory)(struct Vash * self_);
+  Prefetch * (*getPrefetch)(struct Vash * self_);
+
+  /* Appends every word that the word at the end of the given line could
+   * complete to: a builtin, context: or executable in the PATH where a
+   * command goes, and otherwise a path relative to the cwd of the context
+   * the line runs in. A directory ends in /.
+   * @param self_ the calling object
+   * @param line the line, up to the end of the word being completed
+   * @param start where the word starts in the line
+   * @param matches the list to append the words to, in no order
+   * @crash YES failed to malloc
+   * */
+  void (*completeWord)(struct Vash * self_, const char * line, size_t start, List * matches);
 
   /* Displays the Vash Double Dollar prompt ellegantly 
    * @post you are amazed 
@@ -163,8 +334,89 @@ typedef struct Vash {
    * */
   int (*makeBranch)(struct Vash * self_, const struct List * list);
 
+  /* adds a context to the ones the Vash has, by name
+   * @param self_ the calling object
+   * @param name the name of the context
+   * @param context (only) the context, or NULL for one not made yet
+   * @param record where it is in a loaded snapshot, or NULL
+   * @crash YES failed to malloc
+   * */
+  void (*addContext)(struct Vash * self_, const char * name,
+      /*@null@*/ struct Context * context, /*@null@*/ const char * record);
+
   struct Context * (*getContext)(struct Vash * self_, const char * symbol);
 
+  /* returns the context a phrase will run in, judging by its first word
+   * alone, so that its variables are known before it is split into words
+   * @param self_ the calling object
+   * @param phrase the phrase, as typed
+   * @return the context named by the phrase, or the default context
+   * */
+  struct Context * (*contextOf)(struct Vash * self_, const char * phrase);
+
+  /* decodes and executes a single phrase: a command, a pipeline or a 
+   * builtin, optionally prefixed by a context name. 
+   * @param self_ the calling object 
+   * @param phrase the phrase to be interpreted 
+   * @bang YES the given phrase is tokenized in place 
+   * @return the exit status of the phrase 
+   * */
+  int (*interpretPhrase)(struct Vash * self_, char * phrase);
+
+  /* runs the words of a phrase that has been lexed, the end that every
+   * phrase comes to, typed or compiled: the name=value words at its start
+   * set variables in scope, and the rest runs in context as a builtin or a
+   * command. Then $? is set, the default context is current again and the
+   * substitutions the phrase made are closed.
+   * @param self_ the calling object
+   * @param context the context the phrase runs in
+   * @param scope where its name=value words are set
+   * @param words (retained) the words, which are popped as they are used
+   * @param compiled the phrase of a Program the words came from, whose
+   *                 command is resolved once, or NULL @see run_compiled
+   * @param mark the substitution_count before the phrase was lexed
+   * @param text the phrase as written, for the tracer
+   * @param started when the phrase began, @see now_us
+   * @return the exit status of the phrase
+   * */
+  int (*runWords)(struct Vash * self_, struct Context * context, Table * scope, List * words,
+      /*@null@*/ struct Template * compiled, int mark, const char * text, long started);
+
+  /* runs the given line as a subshell would, with its stdout captured in
+   * memory rather than printed: nothing the line does to variables,
+   * contexts or the cwd reaches the shell. A line that only runs a command,
+   * or a builtin that only reads the shell such as history, runs in the
+   * shell without a fork of its own; an assignment, cd, mk, load, trace or
+   * any line of several phrases runs in a child. @see lexer.h
+   * @param self_ the calling object
+   * @param line the line to be run
+   * @alloc YES the caller becomes responsible for the return value
+   * @crash YES failed to malloc
+   * @return what the line printed, less its trailing newlines
+   * */
+  char * (*capture)(struct Vash * self_, const char * line);
+
+  /* starts the given line running alongside the shell, with its stdout on
+   * a pipe, or its stdin on a pipe if writable is set, and returns a path
+   * to the other end of that pipe for a command to open. The pipe stays
+   * open in the shell until closeSubstitutions. @see lexer.h
+   * @param self_ the calling object
+   * @param line the line to be run
+   * @param writable is the path to be written to, >(line), or read, <(line)
+   * @alloc YES the caller becomes responsible for the return value
+   * @crash YES failed to malloc; failed to fork
+   * @null YES if no pipe could be made, after saying why on stderr
+   * @return a path of the form /dev/fd/N
+   * */
+  /*@null@*/ char * (*substitute)(struct Vash * self_, const char * line, BOOL writable);
+
+  /* closes the end of every process substitution opened after the first
+   * mark of them, and waits for the commands behind them to finish
+   * @param self_ the calling object
+   * @param mark the substitution_count before the phrase that opened them
+   * */
+  void (*closeSubstitutions)(struct Vash * self_, int mark);
+
 } Vash;
 
 /* initializes and returns a pointer to a new instance of vash 
@@ -183,5 +435,29 @@ typedef struct Vash {
  * */
 void release_vash(/*@null@*/ /*@only@*/ Vash * vash);
 
+/* runs the given text in the given shell, as if it had been typed at the
+ * prompt, without a prompt or the history. Its first line is the line run
+ * and the lines after it are read as the lines typed after it would be,
+ * by here-documents and blocks that go on past the first line. Jobs the
+ * shell started in the background that have finished are reaped first.
+ * Nothing is shared between two shells, so two threads may each run
+ * their own.
+ * @param vash the shell to run the text in
+ * @param text the text to run
+ * @param result set to what the line did, with its stdout captured in
+ *               memory; or NULL, to leave stdout where stdio[1] says
+ * @alloc YES the caller becomes responsible for result->output
+ * @crash YES failed to malloc; failed to fork
+ * @return the exit status of the line
+ * */
+int vash_eval(Vash * vash, const char * text, /*@null@*/ VashResult * result);
+
+/* reports, on stderr, how the background child with the given pid 
+ * finished, given the status collected by waitpid 
+ * @param status the status returned by waitpid 
+ * @param pid the child that was waited on 
+ * */
+void the_worst_signal_handler_EVAR(int status, pid_t pid);
+
 #endif
 